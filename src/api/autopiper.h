@@ -0,0 +1,115 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_API_AUTOPIPER_H_
+#define _AUTOPIPER_API_AUTOPIPER_H_
+
+/*
+ * C interface to the in-process compiler (libautopiper), for language
+ * bindings. It wraps autopiper::Compile() (see api/compile.h): every call is
+ * reentrant, and compilations may run concurrently on any number of threads.
+ * An options object is read-only during autopiper_compile() and may be
+ * shared by concurrent compilations; a result belongs to its caller.
+ *
+ *   autopiper_options* opts = autopiper_options_new();
+ *   autopiper_options_set(opts, "timing-model", "standard");
+ *   autopiper_result* res = autopiper_compile(opts, text, strlen(text));
+ *   if (autopiper_result_ok(res))
+ *       use(autopiper_result_output(res, "verilog"));
+ *   for (int i = 0; i < autopiper_result_diagnostic_count(res); i++)
+ *       puts(autopiper_result_diagnostic(res, i));
+ *   autopiper_result_free(res);
+ *   autopiper_options_free(opts);
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct autopiper_options autopiper_options;
+typedef struct autopiper_result autopiper_result;
+
+/* Library version, e.g. "0.1". */
+const char* autopiper_version(void);
+
+autopiper_options* autopiper_options_new(void);
+void autopiper_options_free(autopiper_options* options);
+
+/*
+ * Sets an option, named as the command-line flag without its dashes:
+ *
+ *   "language"        "source" (default) or "ir"
+ *   "filename"        name of the input in diagnostics
+ *   "timing-model"    as --timing-model
+ *   "qor"             "1" (default) or "0": produce the "qor" output
+ *   "stage-map", "stage-map-html", "sdc"
+ *                     "1" or "0" (default): produce the output of that name
+ *   "sdc-period"      as --sdc-period
+ *   "trace"           as --trace; produces the "trace-map" output
+ *   "trace-value"     as --trace-value; appends to the list
+ *   "print-ir", "print-lowered"
+ *                     "1" or "0" (default): add to the "print" output
+ *
+ * Returns 0 on success, or -1 for an unknown name or malformed value.
+ */
+int autopiper_options_set(autopiper_options* options,
+                          const char* name, const char* value);
+
+/*
+ * Compiles |length| bytes of |source|. Never returns NULL except when out of
+ * memory.
+ */
+autopiper_result* autopiper_compile(const autopiper_options* options,
+                                    const char* source, size_t length);
+
+void autopiper_result_free(autopiper_result* result);
+
+/* Nonzero if compilation succeeded. */
+int autopiper_result_ok(const autopiper_result* result);
+
+/*
+ * The output of the given name -- "verilog", "qor", "stage-map",
+ * "stage-map-html", "sdc", "trace-map" or "print" -- as a NUL-terminated
+ * string owned by |result|, or NULL for an unknown name. Outputs that were
+ * not produced are empty.
+ */
+const char* autopiper_result_output(const autopiper_result* result,
+                                    const char* name);
+
+/*
+ * Diagnostics, in the order reported. autopiper_result_diagnostic() gives
+ * the i-th formatted as the command-line tools print it; the _detail variant
+ * gives its parts (level: 0 error, 1 warning, 2 info), any of whose
+ * pointers may be NULL. Strings are owned by |result|.
+ */
+int autopiper_result_diagnostic_count(const autopiper_result* result);
+const char* autopiper_result_diagnostic(const autopiper_result* result,
+                                        int i);
+void autopiper_result_diagnostic_detail(const autopiper_result* result,
+                                        int i,
+                                        int* level,
+                                        const char** filename,
+                                        int* line,
+                                        int* column,
+                                        const char** message);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* _AUTOPIPER_API_AUTOPIPER_H_ */
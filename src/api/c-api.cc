@@ -0,0 +1,202 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "api/autopiper.h"
+#include "api/compile.h"
+#include "build-config.h"
+
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace autopiper;
+
+struct autopiper_options {
+    CompileRequest request;
+};
+
+struct autopiper_result {
+    CompileResult result;
+    vector<string> formatted;  // diagnostics, as ToString()
+};
+
+namespace {
+
+bool ParseBool(const char* value, bool* out) {
+    string v(value);
+    if (v == "1") {
+        *out = true;
+    } else if (v == "0") {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseInt(const char* value, int* out) {
+    char* end = nullptr;
+    long v = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0') return false;
+    *out = static_cast<int>(v);
+    return true;
+}
+
+bool ParseDouble(const char* value, double* out) {
+    char* end = nullptr;
+    double v = strtod(value, &end);
+    if (*value == '\0' || *end != '\0') return false;
+    *out = v;
+    return true;
+}
+
+}  // anonymous namespace
+
+extern "C" {
+
+const char* autopiper_version(void) {
+    return CONFIG_VERSION;
+}
+
+autopiper_options* autopiper_options_new(void) {
+    return new (nothrow) autopiper_options();
+}
+
+void autopiper_options_free(autopiper_options* options) {
+    delete options;
+}
+
+int autopiper_options_set(autopiper_options* options,
+                          const char* name, const char* value) {
+    if (!options || !name || !value) return -1;
+    CompileRequest& r = options->request;
+    string n(name);
+    bool ok = true;
+    if (n == "language") {
+        string v(value);
+        if (v == "source") {
+            r.language = CompileRequest::SOURCE;
+        } else if (v == "ir") {
+            r.language = CompileRequest::IR;
+        } else {
+            ok = false;
+        }
+    } else if (n == "filename") {
+        r.filename = value;
+    } else if (n == "timing-model") {
+        r.timing_model = value;
+    } else if (n == "qor") {
+        ok = ParseBool(value, &r.qor);
+    } else if (n == "stage-map") {
+        ok = ParseBool(value, &r.stage_map);
+    } else if (n == "stage-map-html") {
+        ok = ParseBool(value, &r.stage_map_html);
+    } else if (n == "sdc") {
+        ok = ParseBool(value, &r.sdc);
+    } else if (n == "sdc-period") {
+        ok = ParseDouble(value, &r.sdc_clock_period);
+    } else if (n == "trace") {
+        ok = ParseInt(value, &r.trace_depth);
+    } else if (n == "trace-value") {
+        r.trace_values.push_back(value);
+    } else if (n == "print-ir") {
+        ok = ParseBool(value, &r.print_ir);
+    } else if (n == "print-lowered") {
+        ok = ParseBool(value, &r.print_lowered);
+    } else {
+        ok = false;
+    }
+    return ok ? 0 : -1;
+}
+
+autopiper_result* autopiper_compile(const autopiper_options* options,
+                                    const char* source, size_t length) {
+    try {
+        CompileRequest request;
+        if (options) {
+            request = options->request;
+        }
+        if (source) {
+            request.source.assign(source, length);
+        }
+        autopiper_result* res = new autopiper_result();
+        res->result = Compile(request);
+        for (auto& d : res->result.diagnostics) {
+            res->formatted.push_back(d.ToString());
+        }
+        return res;
+    } catch (std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void autopiper_result_free(autopiper_result* result) {
+    delete result;
+}
+
+int autopiper_result_ok(const autopiper_result* result) {
+    return result && result->result.ok;
+}
+
+const char* autopiper_result_output(const autopiper_result* result,
+                                    const char* name) {
+    if (!result || !name) return nullptr;
+    const CompileResult& r = result->result;
+    string n(name);
+    if (n == "verilog") return r.verilog.c_str();
+    if (n == "qor") return r.qor.c_str();
+    if (n == "stage-map") return r.stage_map.c_str();
+    if (n == "stage-map-html") return r.stage_map_html.c_str();
+    if (n == "sdc") return r.sdc.c_str();
+    if (n == "trace-map") return r.trace_map.c_str();
+    if (n == "print") return r.print.c_str();
+    return nullptr;
+}
+
+int autopiper_result_diagnostic_count(const autopiper_result* result) {
+    return result ? static_cast<int>(result->formatted.size()) : 0;
+}
+
+const char* autopiper_result_diagnostic(const autopiper_result* result,
+                                        int i) {
+    if (!result || i < 0 || i >= static_cast<int>(result->formatted.size())) {
+        return nullptr;
+    }
+    return result->formatted[i].c_str();
+}
+
+void autopiper_result_diagnostic_detail(const autopiper_result* result,
+                                        int i,
+                                        int* level,
+                                        const char** filename,
+                                        int* line,
+                                        int* column,
+                                        const char** message) {
+    if (!result || i < 0 ||
+        i >= static_cast<int>(result->result.diagnostics.size())) {
+        return;
+    }
+    const Diagnostic& d = result->result.diagnostics[i];
+    if (level) *level = d.level;
+    if (filename) *filename = d.filename.c_str();
+    if (line) *line = d.line;
+    if (column) *column = d.column;
+    if (message) *message = d.message.c_str();
+}
+
+}  // extern "C"
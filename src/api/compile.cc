@@ -0,0 +1,191 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "api/compile.h"
+#include "backend/compiler.h"
+#include "backend/ir.h"
+#include "frontend/compiler.h"
+#include "common/exception.h"
+
+#include <exception>
+#include <memory>
+#include <sstream>
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+// Collects diagnostics into a CompileResult.
+class ResultErrorCollector : public ErrorCollector {
+    public:
+        ResultErrorCollector(vector<Diagnostic>* out)
+            : out_(out), has_errors_(false) {}
+
+        virtual void ReportError(Location loc,
+                                 Level level,
+                                 const string& message) {
+            Diagnostic d;
+            d.level = level;
+            d.filename = loc.filename();
+            d.line = loc.line;
+            d.column = loc.column;
+            d.message = message;
+            out_->push_back(d);
+            if (level == ERROR) {
+                has_errors_ = true;
+            }
+        }
+
+        virtual bool HasErrors() const { return has_errors_; }
+
+    private:
+        vector<Diagnostic>* out_;
+        bool has_errors_;
+};
+
+// The streams that collect a compilation's outputs.
+struct ResultStreams {
+    ostringstream verilog;
+    ostringstream qor;
+    ostringstream stage_map;
+    ostringstream stage_map_html;
+    ostringstream sdc;
+    ostringstream trace_map;
+    ostringstream print;
+
+    // Points |options|'s output streams at ours, for the requested reports.
+    template<typename Options>
+    void Attach(const CompileRequest& request, Options* options) {
+        options->output_stream = &verilog;
+        options->print_stream = &print;
+        options->qor_stream = request.qor ? &qor : nullptr;
+        options->stage_map_stream = request.stage_map ? &stage_map : nullptr;
+        options->stage_map_html_stream =
+            request.stage_map_html ? &stage_map_html : nullptr;
+        options->sdc_stream = request.sdc ? &sdc : nullptr;
+        options->trace_map_stream =
+            request.trace_depth > 0 ? &trace_map : nullptr;
+        options->sdc_clock_period = request.sdc_clock_period;
+        options->trace_depth = request.trace_depth;
+        options->trace_values = request.trace_values;
+        options->timing_model = request.timing_model;
+        options->print_lowered = request.print_lowered;
+    }
+
+    void Collect(CompileResult* result) {
+        result->verilog = verilog.str();
+        result->qor = qor.str();
+        result->stage_map = stage_map.str();
+        result->stage_map_html = stage_map_html.str();
+        result->sdc = sdc.str();
+        result->trace_map = trace_map.str();
+        result->print = print.str();
+    }
+};
+
+bool CompileSource(const CompileRequest& request,
+                   ResultStreams* streams,
+                   ErrorCollector* collector) {
+    istringstream in(request.source);
+    frontend::Compiler compiler;
+    frontend::Compiler::Options options;
+    options.filename = request.filename;
+    options.input_stream = &in;
+    // The frontend's IR printout is the one the backend would print first.
+    options.print_ir = request.print_ir;
+    streams->Attach(request, &options);
+    return compiler.CompileFile(options, collector);
+}
+
+bool CompileIR(const CompileRequest& request,
+               ResultStreams* streams,
+               ErrorCollector* collector) {
+    istringstream in(request.source);
+    unique_ptr<IRProgram> prog =
+        IRProgram::Parse(request.filename, &in, collector);
+    if (!prog) {
+        return false;
+    }
+    BackendCompiler compiler;
+    BackendCompiler::Options options;
+    options.input_ir = prog.get();
+    options.filename = request.filename;
+    options.print_ir = request.print_ir;
+    streams->Attach(request, &options);
+    return compiler.CompileFile(options, collector);
+}
+
+}  // anonymous namespace
+
+string Diagnostic::ToString() const {
+    ostringstream os;
+    switch (level) {
+        case ErrorCollector::ERROR: os << "Error: "; break;
+        case ErrorCollector::WARNING: os << "Warning: "; break;
+        case ErrorCollector::INFO: os << "Info: "; break;
+    }
+    if (!filename.empty()) {
+        os << filename << ":" << line << ":" << column << ": ";
+    }
+    os << message;
+    return os.str();
+}
+
+CompileResult Compile(const CompileRequest& request) {
+    // Filenames are interned per compilation, so that a long-running host
+    // does not accumulate every name it has ever compiled.
+    SourceMap source_map;
+    SourceMapScope source_map_scope(&source_map);
+
+    CompileResult result;
+    ResultErrorCollector collector(&result.diagnostics);
+    ResultStreams streams;
+
+    // Passes report failure by throwing after reporting their errors; the
+    // exception carries no location, and only says where compilation
+    // stopped.
+    string failure;
+    try {
+        bool ok = (request.language == CompileRequest::IR)
+            ? CompileIR(request, &streams, &collector)
+            : CompileSource(request, &streams, &collector);
+        result.ok = ok && !collector.HasErrors();
+        if (!result.ok) {
+            failure = "Compilation failed.";
+        }
+    } catch (autopiper::Exception& e) {
+        failure = e.what();
+    } catch (std::exception& e) {
+        failure = string("Internal compiler error: ") + e.what();
+    }
+
+    if (!result.ok) {
+        Diagnostic d;
+        d.level = ErrorCollector::ERROR;
+        d.line = d.column = 0;
+        d.message = failure;
+        result.diagnostics.push_back(d);
+        // Keep any debug printouts: they show how far compilation got.
+        result.print = streams.print.str();
+        return result;
+    }
+    streams.Collect(&result);
+    return result;
+}
+
+}  // namespace autopiper
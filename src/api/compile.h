@@ -0,0 +1,111 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_API_COMPILE_H_
+#define _AUTOPIPER_API_COMPILE_H_
+
+#include "common/parser-utils.h"
+
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// In-process compiler entry point, for tools that run many compilations:
+// source text in, Verilog, reports and diagnostics out, with no files and no
+// output to stdout or stderr. Compile() keeps all of its state in the
+// compilation itself, including the SourceMap of interned filenames, so any
+// number may run at once on different threads and none leaves state behind.
+// See api/autopiper.h for the C interface.
+
+struct CompileRequest {
+    enum Language {
+        SOURCE,  // autopiper source, as accepted by `autopiper`
+        IR,      // backend IR, as accepted by `autopiper-backend`
+    };
+
+    Language language;
+    std::string source;
+
+    // Names the input in diagnostics. Paths the source refers to (array
+    // initializer files) are relative to its directory.
+    std::string filename;
+
+    // If set, overrides the program's 'timing_model' pragma.
+    std::string timing_model;
+
+    // Reports to produce, as for the command-line flags of the same names.
+    bool qor;
+    bool stage_map;
+    bool stage_map_html;
+    bool sdc;
+    double sdc_clock_period;
+    int trace_depth;                        // 0: no trace buffer
+    std::vector<std::string> trace_values;  // with trace_depth
+
+    // Debug printouts, collected into CompileResult::print.
+    bool print_ir;
+    bool print_lowered;
+
+    CompileRequest()
+        : language(SOURCE)
+        , filename("(input)")
+        , qor(true)
+        , stage_map(false)
+        , stage_map_html(false)
+        , sdc(false)
+        , sdc_clock_period(10.0)
+        , trace_depth(0)
+        , print_ir(false)
+        , print_lowered(false)
+    {}
+};
+
+struct Diagnostic {
+    ErrorCollector::Level level;
+    std::string filename;
+    int line;
+    int column;
+    std::string message;
+
+    // "Error: file:line:col: message", as the command-line tools print it.
+    std::string ToString() const;
+};
+
+struct CompileResult {
+    CompileResult() : ok(false) {}
+
+    bool ok;
+    std::vector<Diagnostic> diagnostics;
+
+    std::string verilog;
+    // Reports, each empty unless requested. |qor| holds the compilation's
+    // quality-of-results statistics (see qor.h), as JSON.
+    std::string qor;
+    std::string stage_map;
+    std::string stage_map_html;
+    std::string sdc;
+    std::string trace_map;
+    std::string print;
+};
+
+// Compiles |request|. Never throws: failures are returned as !ok, with at
+// least one ERROR diagnostic.
+CompileResult Compile(const CompileRequest& request);
+
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_API_COMPILE_H_
@@ -0,0 +1,712 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backend/checkpoint.h"
+#include "common/util.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+// Bump whenever the layout below or the set of serialized fields changes.
+static const char kMagic[] = "autopiper-checkpoint";
+static const int kVersion = 2;
+
+// Pointer-to-index tables for every object a snapshot may refer to. Index -1
+// is null.
+template<typename T>
+class IndexTable {
+    public:
+        void Add(const T* t) {
+            int index = objs_.size();
+            indices_[t] = index;
+            objs_.push_back(const_cast<T*>(t));
+        }
+        int Index(const T* t) const {
+            if (!t) return -1;
+            auto it = indices_.find(t);
+            // Everything reachable from the program must be owned by it.
+            assert(it != indices_.end());
+            return it->second;
+        }
+        T* Get(int64_t index, bool* ok) const {
+            if (index == -1) return nullptr;
+            if (index < 0 || index >= static_cast<int64_t>(objs_.size())) {
+                *ok = false;
+                return nullptr;
+            }
+            return objs_[index];
+        }
+
+    private:
+        map<const T*, int> indices_;
+        vector<T*> objs_;
+};
+
+struct Tables {
+    IndexTable<IRBB> bbs;
+    IndexTable<IRStmt> stmts;
+    IndexTable<IRPort> ports;
+    IndexTable<IRStorage> storage;
+    IndexTable<IRTimeVar> timevars;
+    IndexTable<IRBypass> bypasses;
+    IndexTable<Pipe> pipes;
+};
+
+class Writer {
+    public:
+        Writer(string* out, const Tables* tables)
+            : out_(out), t_(tables) {}
+
+        // Signed integers are zigzag-encoded varints.
+        void Int(int64_t v) {
+            uint64_t u = (static_cast<uint64_t>(v) << 1) ^
+                         static_cast<uint64_t>(v >> 63);
+            while (u >= 0x80) {
+                out_->push_back(static_cast<char>((u & 0x7f) | 0x80));
+                u >>= 7;
+            }
+            out_->push_back(static_cast<char>(u));
+        }
+        void Bool(bool b) { Int(b ? 1 : 0); }
+        void Str(const string& s) {
+            Int(s.size());
+            out_->append(s);
+        }
+        void Big(const bignum& b) { Str(b.str()); }
+        void Loc(const Location& loc) {
+            Str(loc.filename());
+            Int(loc.line);
+            Int(loc.column);
+        }
+
+        void BB(const IRBB* bb) { Int(t_->bbs.Index(bb)); }
+        void Stmt(const IRStmt* stmt) { Int(t_->stmts.Index(stmt)); }
+        void Port(const IRPort* port) { Int(t_->ports.Index(port)); }
+        void Storage(const IRStorage* s) { Int(t_->storage.Index(s)); }
+        void TimeVar(const IRTimeVar* v) { Int(t_->timevars.Index(v)); }
+        void Bypass(const IRBypass* b) { Int(t_->bypasses.Index(b)); }
+        void PipeRef(const Pipe* p) { Int(t_->pipes.Index(p)); }
+
+        template<typename V>
+        void Stmts(const V& stmts) {
+            Int(stmts.size());
+            for (auto* stmt : stmts) Stmt(stmt);
+        }
+        template<typename V>
+        void BBs(const V& bbs) {
+            Int(bbs.size());
+            for (auto* bb : bbs) BB(bb);
+        }
+
+        void Pred(const Predicate<IRStmt*>& pred) {
+            auto terms = pred.Terms();
+            Int(terms.size());
+            for (auto& term : terms) {
+                auto factors = term.Factors();
+                Int(factors.size());
+                for (auto& f : factors) {
+                    Stmt(f.first);
+                    Bool(f.second);
+                }
+            }
+            Bool(pred.IsBackedge());
+        }
+
+    private:
+        string* out_;
+        const Tables* t_;
+};
+
+class Reader {
+    public:
+        Reader(const string& data, const Tables* tables)
+            : data_(data), pos_(0), ok_(true), t_(tables) {}
+
+        bool ok() const { return ok_; }
+        bool AtEnd() const { return pos_ == data_.size(); }
+        void Fail() { ok_ = false; }
+
+        int64_t Int() {
+            uint64_t u = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos_ >= data_.size()) {
+                    ok_ = false;
+                    return 0;
+                }
+                uint8_t byte = static_cast<uint8_t>(data_[pos_++]);
+                u |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return static_cast<int64_t>(u >> 1) ^
+                           -static_cast<int64_t>(u & 1);
+                }
+            }
+            ok_ = false;
+            return 0;
+        }
+        // A count of following items, each at least one byte long.
+        size_t Count() {
+            int64_t n = Int();
+            if (n < 0 || static_cast<uint64_t>(n) > data_.size() - pos_) {
+                ok_ = false;
+                return 0;
+            }
+            return n;
+        }
+        bool Bool() { return Int() != 0; }
+        string Str() {
+            int64_t n = Int();
+            if (n < 0 || static_cast<uint64_t>(n) > data_.size() - pos_) {
+                ok_ = false;
+                return "";
+            }
+            string s = data_.substr(pos_, n);
+            pos_ += n;
+            return s;
+        }
+        bignum Big() {
+            string s = Str();
+            bignum b;
+            try {
+                b = bignum(s.c_str());
+            } catch (...) {
+                ok_ = false;
+            }
+            return b;
+        }
+        Location Loc() {
+            Location loc;
+            loc.set_filename(Str());
+            loc.line = Int();
+            loc.column = Int();
+            return loc;
+        }
+
+        IRBB* BB() { return t_->bbs.Get(Int(), &ok_); }
+        IRStmt* Stmt() { return t_->stmts.Get(Int(), &ok_); }
+        IRPort* Port() { return t_->ports.Get(Int(), &ok_); }
+        IRStorage* Storage() { return t_->storage.Get(Int(), &ok_); }
+        IRTimeVar* TimeVar() { return t_->timevars.Get(Int(), &ok_); }
+        IRBypass* Bypass() { return t_->bypasses.Get(Int(), &ok_); }
+        Pipe* PipeRef() { return t_->pipes.Get(Int(), &ok_); }
+
+        template<typename T>
+        void Stmts(vector<T*>* stmts) {
+            size_t n = Count();
+            for (size_t i = 0; i < n && ok_; i++) stmts->push_back(Stmt());
+        }
+        template<typename T>
+        void BBs(vector<T*>* bbs) {
+            size_t n = Count();
+            for (size_t i = 0; i < n && ok_; i++) bbs->push_back(BB());
+        }
+
+        Predicate<IRStmt*> Pred() {
+            vector<vector<pair<IRStmt*, bool>>> terms(Count());
+            for (auto& term : terms) {
+                size_t n = Count();
+                for (size_t i = 0; i < n && ok_; i++) {
+                    IRStmt* factor = Stmt();
+                    bool polarity = Bool();
+                    if (!factor) ok_ = false;
+                    term.push_back(make_pair(factor, polarity));
+                }
+            }
+            if (!ok_) return Predicate<IRStmt*>();
+            auto pred = Predicate<IRStmt*>::FromTerms(terms);
+            if (Bool()) pred.SetBackedge();
+            return pred;
+        }
+
+    private:
+        const string& data_;
+        size_t pos_;
+        bool ok_;
+        const Tables* t_;
+};
+
+void SaveStmt(Writer* w, const IRStmt* stmt) {
+    // Stage assignment is the first thing LowerTimed() does; a snapshot is
+    // only meaningful before it.
+    assert(stmt->stage == nullptr);
+
+    w->Int(stmt->valnum);
+    w->Int(stmt->type);
+    w->Int(stmt->op);
+    w->BB(stmt->bb);
+    w->Stmts(stmt->args);
+    w->Big(stmt->constant);
+    w->Bool(stmt->has_constant);
+    w->BBs(stmt->targets);
+    w->Port(stmt->port);
+    w->Storage(stmt->storage);
+    w->TimeVar(stmt->timevar);
+    w->Bypass(stmt->bypass);
+    w->Int(stmt->time_offset);
+    w->Int(stmt->width);
+    w->Int(stmt->arg_nums.size());
+    for (int n : stmt->arg_nums) w->Int(n);
+    w->Int(stmt->target_names.size());
+    for (auto& name : stmt->target_names) w->Str(name);
+    w->Str(stmt->port_name);
+    w->Big(stmt->port_default);
+    w->Bool(stmt->port_has_default);
+    w->Int(stmt->array_init.size());
+    for (auto& value : stmt->array_init) w->Big(value);
+    w->Bool(stmt->array_registered);
+    w->Stmt(stmt->dom_killyounger);
+    w->Stmt(stmt->restart_arg);
+    w->BB(stmt->restart_target);
+    w->PipeRef(stmt->pipe);
+    w->Bool(stmt->is_valid_start);
+    w->Pred(stmt->valid_in_pred);
+    w->Pred(stmt->valid_out_pred);
+    w->Stmt(stmt->valid_in);
+    w->Stmt(stmt->valid_out);
+    w->Bool(stmt->valid_spine);
+    w->Stmts(stmt->pipedag_deps);
+    w->Bool(stmt->deleted);
+    w->Loc(stmt->location);
+}
+
+void RestoreStmt(Reader* r, IRStmt* stmt) {
+    stmt->valnum = r->Int();
+    stmt->type = static_cast<IRStmtType>(r->Int());
+    stmt->op = static_cast<IRStmtOp>(r->Int());
+    stmt->bb = r->BB();
+    r->Stmts(&stmt->args);
+    stmt->constant = r->Big();
+    stmt->has_constant = r->Bool();
+    r->BBs(&stmt->targets);
+    stmt->port = r->Port();
+    stmt->storage = r->Storage();
+    stmt->timevar = r->TimeVar();
+    stmt->bypass = r->Bypass();
+    stmt->time_offset = r->Int();
+    stmt->width = r->Int();
+    size_t n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        stmt->arg_nums.push_back(r->Int());
+    }
+    n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        stmt->target_names.push_back(r->Str());
+    }
+    stmt->port_name = r->Str();
+    stmt->port_default = r->Big();
+    stmt->port_has_default = r->Bool();
+    n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        stmt->array_init.push_back(r->Big());
+    }
+    stmt->array_registered = r->Bool();
+    stmt->dom_killyounger = r->Stmt();
+    stmt->restart_arg = r->Stmt();
+    stmt->restart_target = r->BB();
+    stmt->pipe = r->PipeRef();
+    stmt->is_valid_start = r->Bool();
+    stmt->valid_in_pred = r->Pred();
+    stmt->valid_out_pred = r->Pred();
+    stmt->valid_in = r->Stmt();
+    stmt->valid_out = r->Stmt();
+    stmt->valid_spine = r->Bool();
+    r->Stmts(&stmt->pipedag_deps);
+    stmt->deleted = r->Bool();
+    stmt->location = r->Loc();
+}
+
+void SaveBB(Writer* w, const IRBB* bb) {
+    w->Bool(bb->is_entry);
+    w->PipeRef(bb->pipe);
+    w->Loc(bb->location);
+    w->BBs(bb->succs);
+    w->Int(bb->backedge.size());
+    for (bool b : bb->backedge) w->Bool(b);
+    w->Pred(bb->in_pred);
+    w->Stmt(bb->in_valid);
+    w->Int(bb->out_preds.size());
+    for (auto& pred : bb->out_preds) w->Pred(pred);
+    w->Stmts(bb->out_valids);
+    w->Bool(bb->is_restart);
+    w->Stmt(bb->restart_cond);
+    w->Stmt(bb->restart_pred_src);
+    for (auto& stmt : bb->stmts) {
+        SaveStmt(w, stmt.get());
+    }
+}
+
+void RestoreBB(Reader* r, IRBB* bb) {
+    bb->is_entry = r->Bool();
+    bb->pipe = r->PipeRef();
+    bb->location = r->Loc();
+    r->BBs(&bb->succs);
+    size_t n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        bb->backedge.push_back(r->Bool());
+    }
+    bb->in_pred = r->Pred();
+    bb->in_valid = r->Stmt();
+    n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        bb->out_preds.push_back(r->Pred());
+    }
+    r->Stmts(&bb->out_valids);
+    bb->is_restart = r->Bool();
+    bb->restart_cond = r->Stmt();
+    bb->restart_pred_src = r->Stmt();
+    for (auto& stmt : bb->stmts) {
+        if (!r->ok()) break;
+        RestoreStmt(r, stmt.get());
+    }
+}
+
+void SavePipe(Writer* w, const Pipe* pipe) {
+    assert(pipe->stages.empty());
+    w->BB(pipe->entry);
+    w->BBs(pipe->roots);
+    w->BBs(pipe->bbs);
+    w->Stmts(pipe->stmts);
+    w->Int(pipe->backedges.size());
+    for (auto& p : pipe->backedges) {
+        w->Stmt(p.first);
+        w->Stmt(p.second);
+    }
+    w->PipeRef(pipe->parent);
+    w->Int(pipe->children.size());
+    for (auto* child : pipe->children) w->PipeRef(child);
+    w->Stmt(pipe->spawn);
+}
+
+void RestorePipe(Reader* r, Pipe* pipe) {
+    pipe->entry = r->BB();
+    r->BBs(&pipe->roots);
+    r->BBs(&pipe->bbs);
+    r->Stmts(&pipe->stmts);
+    size_t n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        IRStmt* first = r->Stmt();
+        IRStmt* second = r->Stmt();
+        pipe->backedges.push_back(make_pair(first, second));
+    }
+    pipe->parent = r->PipeRef();
+    n = r->Count();
+    for (size_t i = 0; i < n && r->ok(); i++) {
+        pipe->children.push_back(r->PipeRef());
+    }
+    pipe->spawn = r->Stmt();
+}
+
+}  // anonymous namespace
+
+void LoweringCheckpoint::Save(
+        const IRProgram* program,
+        const vector<unique_ptr<PipeSys>>& systems,
+        const string& extra_verilog) {
+    Tables tables;
+    for (auto& bb : program->bbs) {
+        tables.bbs.Add(bb.get());
+        for (auto& stmt : bb->stmts) {
+            tables.stmts.Add(stmt.get());
+        }
+    }
+    for (auto& port : program->ports) tables.ports.Add(port.get());
+    for (auto& s : program->storage) tables.storage.Add(s.get());
+    for (auto& v : program->timevars) tables.timevars.Add(v.get());
+    for (auto& b : program->bypasses) tables.bypasses.Add(b.get());
+    for (auto& sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            tables.pipes.Add(pipe.get());
+        }
+    }
+
+    data_.clear();
+    Writer w(&data_, &tables);
+    w.Str(kMagic);
+    w.Int(kVersion);
+
+    w.Str(program->timing_model);
+    w.Str(extra_verilog);
+    w.Bool(program->crosslinked_args_bbs);
+    w.Int(program->next_valnum);
+    w.Int(program->next_anon_timevar);
+
+    // Object counts first, so that the reader can create every object before
+    // resolving references to them.
+    w.Int(program->bbs.size());
+    for (auto& bb : program->bbs) {
+        w.Str(bb->label);
+        w.Int(bb->stmts.size());
+    }
+    w.Int(program->ports.size());
+    w.Int(program->storage.size());
+    w.Int(program->timevars.size());
+    w.Int(program->bypasses.size());
+    w.Int(systems.size());
+    for (auto& sys : systems) {
+        assert(sys->program == program);
+        w.Int(sys->pipes.size());
+    }
+
+    for (auto& bb : program->bbs) {
+        SaveBB(&w, bb.get());
+    }
+    for (auto& port : program->ports) {
+        w.Str(port->name);
+        w.Int(port->width);
+        w.Int(port->type);
+        w.Bool(port->exported);
+        w.Stmts(port->defs);
+        w.Stmts(port->uses);
+        w.Stmts(port->exports);
+    }
+    for (auto& s : program->storage) {
+        w.Str(s->name);
+        w.Int(s->data_width);
+        w.Int(s->index_width);
+        w.Int(s->elements);
+        w.Int(s->init.size());
+        for (auto& value : s->init) w.Big(value);
+        w.Bool(s->registered);
+        w.Stmts(s->writers);
+        w.Stmts(s->readers);
+    }
+    for (auto& v : program->timevars) {
+        w.Str(v->name);
+        w.Int(v->basis);
+        w.Stmts(v->uses);
+    }
+    w.Int(program->timevar_map.size());
+    for (auto& p : program->timevar_map) {
+        w.Str(p.first);
+        w.TimeVar(p.second);
+    }
+    for (auto& b : program->bypasses) {
+        w.Str(b->name);
+        w.Stmt(b->start);
+        w.Stmt(b->end);
+        w.Stmts(b->reads);
+        w.Stmts(b->writes);
+        w.Int(b->writes_by_stage.size());
+        for (auto& p : b->writes_by_stage) {
+            w.Int(p.first);
+            w.Stmt(p.second);
+        }
+        w.Int(b->width);
+    }
+    w.BBs(program->entries);
+    for (auto& sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            SavePipe(&w, pipe.get());
+        }
+    }
+}
+
+bool LoweringCheckpoint::Restore(
+        unique_ptr<IRProgram>* program_out,
+        vector<unique_ptr<PipeSys>>* systems_out,
+        string* extra_verilog_out,
+        ErrorCollector* coll) const {
+    Location loc;
+    loc.set_filename(filename_.empty() ? string("(checkpoint)") : filename_);
+
+    Tables tables;
+    Reader r(data_, &tables);
+    if (r.Str() != kMagic || !r.ok()) {
+        coll->ReportError(loc, ErrorCollector::ERROR,
+                          "Not a lowering checkpoint.");
+        return false;
+    }
+    int version = r.Int();
+    if (version != kVersion) {
+        coll->ReportError(loc, ErrorCollector::ERROR,
+                strprintf("Checkpoint version %d does not match this "
+                          "compiler (version %d); re-create it.",
+                          version, kVersion));
+        return false;
+    }
+
+    unique_ptr<IRProgram> program(new IRProgram());
+    program->timing_model = r.Str();
+    string extra_verilog = r.Str();
+    program->crosslinked_args_bbs = r.Bool();
+    program->next_valnum = r.Int();
+    program->next_anon_timevar = r.Int();
+
+    size_t n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        unique_ptr<IRBB> bb(new IRBB());
+        bb->label = r.Str();
+        size_t stmts = r.Count();
+        for (size_t j = 0; j < stmts && r.ok(); j++) {
+            unique_ptr<IRStmt> stmt(new IRStmt());
+            tables.stmts.Add(stmt.get());
+            bb->stmts.push_back(move(stmt));
+        }
+        tables.bbs.Add(bb.get());
+        program->bbs.push_back(move(bb));
+    }
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        program->ports.emplace_back(new IRPort());
+        tables.ports.Add(program->ports.back().get());
+    }
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        program->storage.emplace_back(new IRStorage());
+        tables.storage.Add(program->storage.back().get());
+    }
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        program->timevars.emplace_back(new IRTimeVar());
+        tables.timevars.Add(program->timevars.back().get());
+    }
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        program->bypasses.emplace_back(new IRBypass());
+        tables.bypasses.Add(program->bypasses.back().get());
+    }
+    vector<unique_ptr<PipeSys>> systems;
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        unique_ptr<PipeSys> sys(new PipeSys());
+        sys->program = program.get();
+        size_t pipes = r.Count();
+        for (size_t j = 0; j < pipes && r.ok(); j++) {
+            unique_ptr<Pipe> pipe(new Pipe());
+            pipe->sys = sys.get();
+            tables.pipes.Add(pipe.get());
+            sys->pipes.push_back(move(pipe));
+        }
+        systems.push_back(move(sys));
+    }
+
+    for (auto& bb : program->bbs) {
+        if (!r.ok()) break;
+        RestoreBB(&r, bb.get());
+    }
+    for (auto& port : program->ports) {
+        if (!r.ok()) break;
+        port->name = r.Str();
+        port->width = r.Int();
+        port->type = static_cast<IRPort::Type>(r.Int());
+        port->exported = r.Bool();
+        r.Stmts(&port->defs);
+        r.Stmts(&port->uses);
+        r.Stmts(&port->exports);
+    }
+    for (auto& s : program->storage) {
+        if (!r.ok()) break;
+        s->name = r.Str();
+        s->data_width = r.Int();
+        s->index_width = r.Int();
+        s->elements = r.Int();
+        size_t n = r.Count();
+        for (size_t i = 0; i < n && r.ok(); i++) {
+            s->init.push_back(r.Big());
+        }
+        s->registered = r.Bool();
+        r.Stmts(&s->writers);
+        r.Stmts(&s->readers);
+    }
+    for (auto& v : program->timevars) {
+        if (!r.ok()) break;
+        v->name = r.Str();
+        v->basis = r.Int();
+        r.Stmts(&v->uses);
+    }
+    n = r.Count();
+    for (size_t i = 0; i < n && r.ok(); i++) {
+        string name = r.Str();
+        program->timevar_map[name] = r.TimeVar();
+    }
+    for (auto& b : program->bypasses) {
+        if (!r.ok()) break;
+        b->name = r.Str();
+        b->start = r.Stmt();
+        b->end = r.Stmt();
+        r.Stmts(&b->reads);
+        r.Stmts(&b->writes);
+        size_t writes = r.Count();
+        for (size_t i = 0; i < writes && r.ok(); i++) {
+            int stage = r.Int();
+            b->writes_by_stage[stage] = r.Stmt();
+        }
+        b->width = r.Int();
+    }
+    r.BBs(&program->entries);
+    for (auto& sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            if (!r.ok()) break;
+            RestorePipe(&r, pipe.get());
+        }
+    }
+
+    if (!r.ok() || !r.AtEnd()) {
+        coll->ReportError(loc, ErrorCollector::ERROR,
+                          "Lowering checkpoint is truncated or corrupt.");
+        return false;
+    }
+
+    *program_out = move(program);
+    *systems_out = move(systems);
+    *extra_verilog_out = extra_verilog;
+    return true;
+}
+
+bool LoweringCheckpoint::WriteFile(const string& filename,
+                                   ErrorCollector* coll) const {
+    ofstream out(filename, ios::binary);
+    if (out.good()) {
+        out.write(data_.data(), data_.size());
+    }
+    if (!out.good()) {
+        Location loc;
+        loc.set_filename(filename);
+        coll->ReportError(loc, ErrorCollector::ERROR,
+                          string("Could not write file '") + filename +
+                          string("'"));
+        return false;
+    }
+    return true;
+}
+
+bool LoweringCheckpoint::ReadFile(const string& filename,
+                                  ErrorCollector* coll) {
+    ifstream in(filename, ios::binary);
+    if (!in.good()) {
+        Location loc;
+        loc.set_filename(filename);
+        coll->ReportError(loc, ErrorCollector::ERROR,
+                          string("Could not open file '") + filename +
+                          string("'"));
+        return false;
+    }
+    ostringstream buf;
+    buf << in.rdbuf();
+    data_ = buf.str();
+    filename_ = filename;
+    return true;
+}
+
+}  // namespace autopiper
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_CHECKPOINT_H_
+#define _AUTOPIPER_CHECKPOINT_H_
+
+#include "backend/ir.h"
+#include "backend/pipe.h"
+#include "common/parser-utils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// A snapshot of a program lowered up to pipe timing, i.e., the output of
+// IRProgram::LowerUntimed(): the whole IRProgram (including the BBs and stmts
+// created by lowering) plus each PipeSys's flattened stmt lists, pipedag deps
+// and valid predicates. Restoring it yields a fresh, independent program and
+// pipe systems ready for IRProgram::LowerTimed(), so one snapshot can be
+// re-timed under any number of timing models without re-running parsing,
+// inlining, codegen or the pre-timing passes.
+//
+// The snapshot is a self-contained binary blob; it can be kept in memory and
+// restored repeatedly, or written to and read from a file. Pointers are stored
+// as indices, so a restored program does not depend on the address layout of
+// the one that was saved.
+class LoweringCheckpoint {
+    public:
+        LoweringCheckpoint() {}
+
+        // Snapshot |program| and its |systems| as returned by LowerUntimed().
+        // |extra_verilog| is emitted alongside the program's own modules (the
+        // frontend's instance submodules) and is carried through verbatim: it
+        // was generated under the same timing model as the instance latencies
+        // baked into |program|, so it stays consistent with them under any
+        // re-timing.
+        void Save(const IRProgram* program,
+                  const std::vector<std::unique_ptr<PipeSys>>& systems,
+                  const std::string& extra_verilog);
+
+        // Rebuild a new program and pipe systems, and the extra Verilog, from
+        // the snapshot. Returns false, reporting to |coll|, if the snapshot
+        // is malformed or was written by an incompatible version.
+        bool Restore(std::unique_ptr<IRProgram>* program,
+                     std::vector<std::unique_ptr<PipeSys>>* systems,
+                     std::string* extra_verilog,
+                     ErrorCollector* coll) const;
+
+        bool WriteFile(const std::string& filename,
+                       ErrorCollector* coll) const;
+        bool ReadFile(const std::string& filename, ErrorCollector* coll);
+
+        const std::string& data() const { return data_; }
+
+    private:
+        std::string data_;
+        std::string filename_;  // for diagnostics, if read from a file
+};
+
+}  // namespace autopiper
+
+#endif
@@ -21,6 +21,7 @@
 #include "common/exception.h"
 #include "build-config.h"
 
+#include <stdlib.h>
 #include <string>
 #include <iostream>
 
@@ -35,6 +36,30 @@ static const char* kUsage =
     "        --print-ir:      print IR as parsed, before transforms or lowering.\n"
     "        --print-lowered: print program as lowered to pipeline form,\n"
     "                         before code generation occurs.\n"
+    "        --qor <filename>: write quality-of-results metrics (JSON).\n"
+    "        --stage-map <filename>: write per-stage occupancy and register\n"
+    "                         pressure (JSON).\n"
+    "        --stage-map-html <filename>: as --stage-map, as an HTML table.\n"
+    "        --sdc <filename>: write timing constraints (SDC) grouped by\n"
+    "                         pipeline stage.\n"
+    "        --sdc-period <ns>: clock period for --sdc (default 10).\n"
+    "        --trace <depth>: add an on-chip trace buffer of <depth> entries\n"
+    "                         sampling every stage's valid, stall, hold and\n"
+    "                         kill bits.\n"
+    "        --trace-value <port>: also sample this port's value with --trace\n"
+    "                         (may be repeated).\n"
+    "        --trace-map <filename>: write the --trace sample layout (JSON).\n"
+    "        --timing-model <name>: override the program's timing_model pragma\n"
+    "                         (null, standard, standard:<gates>, table:<file>).\n"
+    "        --parse-chunk-size <bytes>: split IR inputs of at least twice\n"
+    "                         this size into chunks of about this size, and\n"
+    "                         parse them in parallel (default 1048576).\n"
+    "        --parse-threads <n>: threads for the parallel IR parse (default:\n"
+    "                         the hardware concurrency; 1 parses serially).\n"
+    "        --checkpoint-out <filename>: save the program as lowered up to\n"
+    "                         pipe timing.\n"
+    "        --checkpoint-in <filename>: start from a saved checkpoint instead\n"
+    "                         of <input>, redoing only timing and later passes.\n"
     "        -h, --help:      print this help message.\n"
     "        -v, --version:   print version and license information.\n";
 
@@ -77,6 +102,46 @@ class BackendFlags : public CmdlineParser {
             } else if (flag == "--print-lowered") {
                 driver_->options_.print_lowered = true;
                 return FLAG_CONSUMED_KEY;
+            } else if (flag == "--qor") {
+                driver_->options_.qor_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--stage-map") {
+                driver_->options_.stage_map_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--stage-map-html") {
+                driver_->options_.stage_map_html_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--sdc") {
+                driver_->options_.sdc_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--sdc-period") {
+                driver_->options_.sdc_clock_period = atof(value.c_str());
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace") {
+                driver_->options_.trace_depth = atoi(value.c_str());
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace-value") {
+                driver_->options_.trace_values.push_back(value);
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace-map") {
+                driver_->options_.trace_map_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--timing-model") {
+                driver_->options_.timing_model = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--parse-chunk-size") {
+                driver_->options_.parse_options.chunk_size =
+                    strtoul(value.c_str(), nullptr, 10);
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--parse-threads") {
+                driver_->options_.parse_options.threads = atoi(value.c_str());
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--checkpoint-out") {
+                driver_->options_.checkpoint_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--checkpoint-in") {
+                driver_->options_.checkpoint_input = value;
+                return FLAG_CONSUMED_KEY_VALUE;
             } else if (flag == "-o") {
                 driver_->options_.output = value;
                 return FLAG_CONSUMED_KEY_VALUE;
@@ -110,6 +175,9 @@ class BackendFlags : public CmdlineParser {
 void BackendCmdlineDriver::ParseArgs(int argc, const char* const* argv) {
     BackendFlags parser(this, argc, argv);
     parser.Parse();
+    if (options_.output.empty() && !options_.checkpoint_input.empty()) {
+        options_.output = options_.checkpoint_input + ".v";
+    }
 }
 
 void BackendCmdlineDriver::Execute() {
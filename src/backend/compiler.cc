@@ -15,30 +15,155 @@
  */
 
 #include "backend/compiler.h"
+#include "backend/checkpoint.h"
 #include "backend/ir.h"
 #include "backend/pipe.h"
 #include "backend/gen-verilog.h"
+#include "backend/qor.h"
+#include "backend/sdc.h"
+#include "backend/stage-map.h"
+#include "backend/trace.h"
+#include "common/util.h"
 
 #include <fstream>
+#include <iostream>
 #include <memory>
 
 using namespace std;
 
 namespace autopiper {
 
+namespace {
+
+// Returns the stream to write a report to: |stream| if set, and otherwise
+// the file |filename|, opened into |file|. Returns nullptr, reporting an
+// error, if the file cannot be opened.
+ostream* OpenReport(const string& filename, ostream* stream, ofstream* file,
+                    ErrorCollector* collector) {
+    if (stream) {
+        return stream;
+    }
+    file->open(filename);
+    if (!file->good()) {
+        Location loc;
+        loc.set_filename(filename);
+        collector->ReportError(loc, ErrorCollector::ERROR,
+                               string("Could not open file '") +
+                               filename +
+                               string("'"));
+        return nullptr;
+    }
+    return file;
+}
+
+// Checks that a program compiled as a submodule is a fixed-latency pipeline --
+// a single pipe with no state, restarts, kills or holds, so that a result
+// leaves exactly as many cycles after its inputs as there are stages between
+// them -- and computes that latency.
+bool ComputeInstanceLatency(const vector<PipeSys*>& systems,
+                            int* latency,
+                            ErrorCollector* collector) {
+    Location loc;
+    if (systems.size() != 1 || systems[0]->pipes.size() != 1) {
+        collector->ReportError(loc, ErrorCollector::ERROR,
+                "Instance module must consist of exactly one pipe.");
+        return false;
+    }
+    if (!systems[0]->pipes[0]->backedges.empty()) {
+        collector->ReportError(loc, ErrorCollector::ERROR,
+                "Instance module must not contain loops.");
+        return false;
+    }
+    int read_stage = -1, write_stage = -1;
+    for (auto* stmt : systems[0]->pipes[0]->stmts) {
+        if (stmt->deleted) continue;
+        switch (stmt->type) {
+            case IRStmtSpawn:
+            case IRStmtKill:
+            case IRStmtKillYounger:
+            case IRStmtKillIf:
+            case IRStmtWait:
+            case IRStmtBackedge:
+            case IRStmtRegRead:
+            case IRStmtRegWrite:
+            case IRStmtArrayRead:
+            case IRStmtArrayWrite:
+            case IRStmtBypassStart:
+            case IRStmtBypassEnd:
+            case IRStmtBypassWrite:
+            case IRStmtBypassPresent:
+            case IRStmtBypassReady:
+            case IRStmtBypassRead:
+                collector->ReportError(stmt->location, ErrorCollector::ERROR,
+                        strprintf("Statement %%%d is not allowed in a "
+                                  "fixed-latency instance module.",
+                                  stmt->valnum));
+                return false;
+            case IRStmtPortRead:
+                if (stmt->port->name.compare(0, 3, "arg") != 0) {
+                    collector->ReportError(stmt->location,
+                            ErrorCollector::ERROR,
+                            "Instance module may read only its arguments.");
+                    return false;
+                }
+                if (read_stage != -1 && read_stage != stmt->stage->stage) {
+                    collector->ReportError(stmt->location,
+                            ErrorCollector::ERROR,
+                            "Instance module inputs must all be read in the "
+                            "same stage.");
+                    return false;
+                }
+                read_stage = stmt->stage->stage;
+                break;
+            case IRStmtPortWrite:
+                if (stmt->port->name != "result") {
+                    collector->ReportError(stmt->location,
+                            ErrorCollector::ERROR,
+                            "Instance module may write only its result.");
+                    return false;
+                }
+                write_stage = stmt->stage->stage;
+                break;
+            default:
+                break;
+        }
+    }
+    if (read_stage == -1 || write_stage == -1 || write_stage < read_stage) {
+        collector->ReportError(loc, ErrorCollector::ERROR,
+                "Instance module must read its inputs before writing its "
+                "result.");
+        return false;
+    }
+    *latency = write_stage - read_stage;
+    return true;
+}
+
+}  // anonymous namespace
+
 bool BackendCompiler::CompileFile(
         const Options& options,
         ErrorCollector* collector) {
     unique_ptr<IRProgram> parsed_prog;
     IRProgram* prog = nullptr;
+    vector<unique_ptr<PipeSys>> pipesystems;
+    string extra_verilog = options.extra_verilog;
+    ostream& print = options.print_stream ? *options.print_stream : cout;
 
-    if (options.input_ir) {
+    if (!options.checkpoint_input.empty()) {
+        LoweringCheckpoint checkpoint;
+        if (!checkpoint.ReadFile(options.checkpoint_input, collector) ||
+            !checkpoint.Restore(&parsed_prog, &pipesystems, &extra_verilog,
+                                collector)) {
+            return false;
+        }
+        prog = parsed_prog.get();
+    } else if (options.input_ir) {
         prog = options.input_ir;
     } else {
         ifstream in(options.filename);
         if (!in.good()) {
             Location loc;
-            loc.filename = options.filename;
+            loc.set_filename(options.filename);
             loc.line = loc.column = 0;
             collector->ReportError(loc, ErrorCollector::ERROR,
                                    string("Could not open file '") +
@@ -47,48 +172,165 @@ bool BackendCompiler::CompileFile(
             return false;
         }
 
-        parsed_prog = IRProgram::Parse(options.filename, &in, collector);
+        parsed_prog = IRProgram::Parse(options.filename, &in, collector,
+                                       options.parse_options);
         prog = parsed_prog.get();
         in.close();
         if (!prog) return false;
     }
 
-    if (!prog->Crosslink(collector)) return false;
-    if (!prog->Typecheck(collector)) return false;
+    if (!options.timing_model.empty()) {
+        prog->timing_model = options.timing_model;
+    }
+
+    if (options.checkpoint_input.empty()) {
+        if (!prog->Crosslink(collector)) return false;
+        if (!prog->Typecheck(collector)) return false;
 
-    if (options.print_ir) {
-        printf("IR:\n%s\n", prog->ToString().c_str());
+        if (options.print_ir) {
+            print << "IR:" << endl << prog->ToString() << endl;
+        }
+
+        pipesystems = prog->LowerUntimed(collector);
+        if (pipesystems.empty()) return false;
+
+        if (!options.checkpoint_output.empty()) {
+            LoweringCheckpoint checkpoint;
+            checkpoint.Save(prog, pipesystems, extra_verilog);
+            if (!checkpoint.WriteFile(options.checkpoint_output, collector)) {
+                return false;
+            }
+        }
     }
 
-    vector<unique_ptr<PipeSys>> pipesystems = prog->Lower(collector);
-    if (pipesystems.empty()) return false;
+    if (!prog->LowerTimed(&pipesystems, collector)) return false;
     vector<PipeSys*> systems;
     for (auto& sys : pipesystems) {
         systems.push_back(sys.get());
     }
 
     if (options.print_lowered) {
-        printf("Lowered pipeline form:\n");
+        print << "Lowered pipeline form:" << endl;
         for (auto& pipesys : pipesystems) {
-            printf("%s\n", pipesys->ToString().c_str());
+            print << pipesys->ToString() << endl;
         }
     }
 
-    ofstream out(options.output);
-    if (!out.good()) {
-        Location loc;
-        loc.filename = options.output;
-        loc.line = loc.column = 0;
-        collector->ReportError(loc, ErrorCollector::ERROR,
-                               string("Could not open file '") +
-                               options.output +
-                               string("'"));
+    if (options.instance_module) {
+        int latency = 0;
+        if (!ComputeInstanceLatency(systems, &latency, collector)) {
+            return false;
+        }
+        if (options.instance_latency) {
+            *options.instance_latency = latency;
+        }
     }
-    Printer out_printer(&out);
 
-    VerilogGenerator gen(&out_printer, systems, "main");
+    ofstream out;
+    if (!options.output_stream) {
+        out.open(options.output);
+        if (!out.good()) {
+            Location loc;
+            loc.set_filename(options.output);
+            loc.line = loc.column = 0;
+            collector->ReportError(loc, ErrorCollector::ERROR,
+                                   string("Could not open file '") +
+                                   options.output +
+                                   string("'"));
+        }
+    }
+    Printer out_printer(options.output_stream ? options.output_stream : &out);
+
+    TraceBuffer trace;
+    if (options.trace_depth > 0) {
+        if (!trace.Compute(systems, options.trace_depth,
+                           options.trace_values, collector)) {
+            return false;
+        }
+    }
+
+    VerilogGenerator gen(&out_printer, systems, options.module_name);
+    gen.SetEmitPipeRegModule(!options.instance_module);
+    if (options.trace_depth > 0) {
+        gen.SetTrace(&trace);
+    }
     gen.Generate();
-    out.close();
+    (options.output_stream ? *options.output_stream : out) << extra_verilog;
+    if (!options.output_stream) {
+        out.close();
+    }
+
+    if (!options.qor_output.empty() || options.qor_stream) {
+        ofstream qor_file;
+        ostream* qor_out = OpenReport(options.qor_output, options.qor_stream,
+                                      &qor_file, collector);
+        if (!qor_out) {
+            return false;
+        }
+        QoRMetrics qor;
+        qor.Compute(systems, gen);
+        qor.WriteJSON(qor_out);
+    }
+
+    bool stage_map_json =
+        !options.stage_map_output.empty() || options.stage_map_stream;
+    bool stage_map_html =
+        !options.stage_map_html_output.empty() ||
+        options.stage_map_html_stream;
+    if (stage_map_json || stage_map_html) {
+        // LowerTimed() has already checked that the model exists.
+        unique_ptr<TimingModel> model = TimingModel::New(prog->timing_model);
+        StageMap stage_map;
+        stage_map.Compute(systems, gen, *model);
+        if (stage_map_json) {
+            ofstream map_file;
+            ostream* map_out = OpenReport(options.stage_map_output,
+                                          options.stage_map_stream,
+                                          &map_file, collector);
+            if (!map_out) {
+                return false;
+            }
+            stage_map.WriteJSON(map_out);
+        }
+        if (stage_map_html) {
+            ofstream map_file;
+            ostream* map_out = OpenReport(options.stage_map_html_output,
+                                          options.stage_map_html_stream,
+                                          &map_file, collector);
+            if (!map_out) {
+                return false;
+            }
+            stage_map.WriteHTML(map_out);
+        }
+    }
+
+    if (!options.sdc_output.empty() || options.sdc_stream) {
+        ofstream sdc_file;
+        ostream* sdc_out = OpenReport(options.sdc_output, options.sdc_stream,
+                                      &sdc_file, collector);
+        if (!sdc_out) {
+            return false;
+        }
+        // LowerTimed() has already checked that the model exists.
+        unique_ptr<TimingModel> model = TimingModel::New(prog->timing_model);
+        SDCConstraints sdc;
+        sdc.module_name = options.module_name;
+        sdc.clock_period = options.sdc_clock_period;
+        sdc.Compute(systems, gen, *model);
+        sdc.Write(sdc_out);
+    }
+
+    if (options.trace_depth > 0 &&
+        (!options.trace_map_output.empty() || options.trace_map_stream)) {
+        ofstream map_file;
+        ostream* map_out = OpenReport(options.trace_map_output,
+                                      options.trace_map_stream,
+                                      &map_file, collector);
+        if (!map_out) {
+            return false;
+        }
+        trace.WriteJSON(map_out, options.module_name);
+    }
 
     return true;
 }
@@ -21,8 +21,10 @@
 #include "common/parser-utils.h"
 
 #include <boost/noncopyable.hpp>
+#include <iostream>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace autopiper {
 
@@ -32,12 +34,45 @@ class BackendCompiler : public boost::noncopyable {
         ~BackendCompiler() { }
 
         struct Options {
-            // Specify exactly one of input_ir or filename (a text IR file).
+            // Specify exactly one of input_ir, filename (a text IR file), or
+            // checkpoint_input.
             IRProgram* input_ir;
             std::string filename;
 
-            // Verilog output.
+            // Start from a lowering checkpoint (see checkpoint.h) instead of
+            // IR, redoing only timing and the passes after it.
+            std::string checkpoint_input;
+
+            // If set, write a lowering checkpoint of the program, taken just
+            // before pipe timing, to this file.
+            std::string checkpoint_output;
+
+            // Verilog appended after the generated modules (the frontend's
+            // instance submodules). Saved in a checkpoint, and emitted again
+            // when compiling from one.
+            std::string extra_verilog;
+
+            // Chunk size and thread count for parsing a text IR |filename|.
+            IRProgram::ParseOptions parse_options;
+
+            // If set, overrides the program's 'timing_model' pragma.
+            std::string timing_model;
+
+            // Verilog output: the named file, or |output_stream| if set.
             std::string output;
+            std::ostream* output_stream;
+
+            // Name of the generated top-level Verilog module.
+            std::string module_name;
+
+            // Compile the program as a fixed-latency submodule to be
+            // instantiated by another module: it must be a single
+            // straight-line pipe that reads its inputs in one stage and writes
+            // its result port in a later one. The shared pipereg module is not
+            // emitted, and the latency (in stages) is stored to
+            // |instance_latency|.
+            bool instance_module;
+            int* instance_latency;
 
             // Print IR before transforming in the backend.
             bool print_ir;
@@ -45,10 +80,55 @@ class BackendCompiler : public boost::noncopyable {
             // Print lowered pipeline form before generating Verilog.
             bool print_lowered;
 
+            // If set, write quality-of-results metrics (JSON) to this file.
+            std::string qor_output;
+
+            // If set, write the per-stage occupancy and register-pressure
+            // map as JSON and/or as an HTML table to these files.
+            std::string stage_map_output;
+            std::string stage_map_html_output;
+
+            // If set, write timing constraints (SDC) aligned with the
+            // pipeline stages to this file, for a clock of |sdc_clock_period|
+            // ns.
+            std::string sdc_output;
+            double sdc_clock_period;
+
+            // If nonzero, add an on-chip trace buffer of this many entries
+            // (see trace.h), sampling every stage's control bits and the
+            // ports named in |trace_values|, and write its sample layout
+            // (JSON) to |trace_map_output| if set.
+            int trace_depth;
+            std::vector<std::string> trace_values;
+            std::string trace_map_output;
+
+            // Streams to write the reports above to instead of files. A
+            // report is produced if either its file or its stream is set.
+            std::ostream* qor_stream;
+            std::ostream* stage_map_stream;
+            std::ostream* stage_map_html_stream;
+            std::ostream* sdc_stream;
+            std::ostream* trace_map_stream;
+
+            // Where |print_ir| and |print_lowered| print (stdout if unset).
+            std::ostream* print_stream;
+
             Options()
                 : input_ir(nullptr)
+                , output_stream(nullptr)
+                , module_name("main")
+                , instance_module(false)
+                , instance_latency(nullptr)
                 , print_ir(false)
                 , print_lowered(false)
+                , sdc_clock_period(10.0)
+                , trace_depth(0)
+                , qor_stream(nullptr)
+                , stage_map_stream(nullptr)
+                , stage_map_html_stream(nullptr)
+                , sdc_stream(nullptr)
+                , trace_map_stream(nullptr)
+                , print_stream(nullptr)
             {}
         };
 
@@ -19,6 +19,8 @@
 #include "backend/pipe.h"
 #include "common/util.h"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -38,6 +40,41 @@ string HexStrAllOnes(int width) {
     }
     return os.str();
 }
+
+// Placeholders for names that differ between structurally identical
+// systems, in a shared module's text: the module name, and the ports and
+// storage bound to each slot.
+const char kPlaceholder = '\x01';
+
+string Placeholder(char kind, int slot) {
+    return strprintf("%c%c%d%c", kPlaceholder, kind, slot, kPlaceholder);
+}
+
+// Fills in a shared module's placeholders.
+string FillPlaceholders(const string& text, const string& module_name,
+                        const vector<string>& ports,
+                        const vector<string>& storage) {
+    string out;
+    size_t pos = 0;
+    while (true) {
+        size_t start = text.find(kPlaceholder, pos);
+        if (start == string::npos) break;
+        size_t end = text.find(kPlaceholder, start + 1);
+        out += text.substr(pos, start - pos);
+        char kind = text[start + 1];
+        int slot = atoi(text.c_str() + start + 2);
+        if (kind == 'M') {
+            out += module_name;
+        } else if (kind == 'P') {
+            out += ports[slot];
+        } else {
+            out += storage[slot];
+        }
+        pos = end + 1;
+    }
+    out += text.substr(pos);
+    return out;
+}
 }  // anonymous namespace
 
 // Strategy:
@@ -51,35 +88,65 @@ string HexStrAllOnes(int width) {
 // have helpers that carry signals from generation point to required pipestage
 // and create piperegs along the way.
 //
-// By the time we reach this point, each pipestage should have 'stall' and
-// 'kill' signals.
+// By the time we reach this point, each pipestage should have 'stall', 'hold'
+// and 'kill' signals.
 
 void VerilogGenerator::Generate() {
     PrinterScope global_scope(out_);
     out_->SetVar("module_name", name_);
 
+    PlanStaging();
+    FindSharedSystems();
+
     GenerateModuleStart();
-    // Generate storage elements: registers and arrays.
+    // Generate storage elements: registers and arrays. Those private to a
+    // shared system are in its module.
     for (auto& s : program_->storage) {
+        if (shared_storage_.count(s.get())) continue;
         GenerateStorage(s.get());
     }
     // Generate node implementations. In the process, we learn which signals
     // need to be staged to which pipestages.
     for (auto* sys : systems_) {
+        auto it = shared_instances_.find(sys);
+        if (it != shared_instances_.end()) {
+            out_->Print(it->second);
+            continue;
+        }
         for (auto& pipe : sys->pipes) {
             for (auto& stmt : pipe->stmts) {
                 GenerateNode(stmt);
             }
         }
     }
+    if (trace_) {
+        GenerateTrace();
+    }
     // Generate flops between each pipestage for each signal.
     for (auto& p : signal_stages_) {
         const auto* signal = p.first;
         GenerateStaging(signal);
     }
+    // Report the shared instances' piperegs along with this module's.
+    signal_stages_.insert(shared_signal_stages_.begin(),
+                          shared_signal_stages_.end());
     GenerateModuleEnd();
 
-    GeneratePipeRegModule();
+    if (!shared_modules_.empty()) {
+        PrinterScope scope(out_);
+        out_->SetVar("modules", shared_modules_);
+        out_->Print("$modules$");
+    }
+
+    for (auto& s : program_->storage) {
+        if (s->IsRom()) {
+            GenerateRomModule(s.get());
+        }
+    }
+
+    if (emit_pipereg_module_) {
+        GeneratePipeRegModule();
+    }
 }
 
 void VerilogGenerator::GenerateModuleStart() {
@@ -92,6 +159,17 @@ void VerilogGenerator::GenerateModuleStart() {
                 GenerateModulePortDef(port.get());
             }
         }
+        if (trace_) {
+            PrinterScope scope(out_);
+            out_->SetVars({
+                { "addr_msb", strprintf("%d", trace_->addr_bits - 1) },
+                { "data_msb", strprintf("%d", trace_->width - 1) },
+            });
+            out_->Print(",\ninput trace_trigger"
+                        ",\ninput [$addr_msb$:0] trace_read_addr"
+                        ",\noutput [$data_msb$:0] trace_read_data"
+                        ",\noutput trace_done");
+        }
         out_->Print("\n");
     }
     out_->Print(");\n");
@@ -114,6 +192,64 @@ void VerilogGenerator::GenerateModuleEnd() {
     out_->Print("endmodule\n");
 }
 
+// The trace buffer (see trace.h) writes one sample per cycle at 'trace_head',
+// which is thus also the oldest entry, until the trigger has been followed by
+// its post-trigger samples. Each stage's control bits are sampled as that
+// stage sees them, so they are staged there like any other use.
+void VerilogGenerator::GenerateTrace() {
+    vector<string> fields;
+    for (auto& s : trace_->signals) {
+        if (s.kind == TraceSignal::VALUE) {
+            fields.push_back(PortName(s.port));
+            continue;
+        }
+        string bit;
+        for (auto* stmt : s.stmts) {
+            if (!bit.empty()) bit += " | ";
+            bit += GetSignalInStage(stmt, max(s.stage, stmt->stage->stage));
+        }
+        fields.push_back(s.stmts.size() > 1 ? "(" + bit + ")" : bit);
+    }
+    // The first signal is the sample's lsb.
+    string sample;
+    for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        if (!sample.empty()) sample += ", ";
+        sample += *it;
+    }
+
+    PrinterScope scope(out_);
+    out_->SetVars({
+        { "width", strprintf("%d", trace_->width) },
+        { "depth", strprintf("%d", trace_->depth) },
+        { "addr_bits", strprintf("%d", trace_->addr_bits) },
+        { "post", strprintf("%d", trace_->post_trigger) },
+        { "sample", sample },
+    });
+    out_->Print(
+        "wire [$width$-1:0] trace_sample;\n"
+        "assign trace_sample = {$sample$};\n"
+        "reg [$width$-1:0] trace_buf[$depth$-1:0];\n"
+        "reg [$addr_bits$-1:0] trace_head;\n"
+        "reg [$addr_bits$:0] trace_remaining;\n"
+        "reg trace_triggered;\n"
+        "assign trace_done = trace_remaining == 0;\n"
+        "always @(posedge clock) begin\n"
+        "    if (reset) begin\n"
+        "        trace_head <= 0;\n"
+        "        trace_remaining <= $post$;\n"
+        "        trace_triggered <= 0;\n"
+        "    end else if (!trace_done) begin\n"
+        "        trace_buf[trace_head] <= trace_sample;\n"
+        "        trace_head <= trace_head + 1;\n"
+        "        if (trace_triggered || trace_trigger) begin\n"
+        "            trace_triggered <= 1;\n"
+        "            trace_remaining <= trace_remaining - 1;\n"
+        "        end\n"
+        "    end\n"
+        "end\n"
+        "assign trace_read_data = trace_buf[trace_head + trace_read_addr];\n");
+}
+
 void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
     PrinterScope scope(out_);
     // Special case: eliminate zero-width data ops, as they're the result of
@@ -125,10 +261,15 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
     if (stmt->deleted) {
         return;
     }
-    // Materialize all inputs.
+    // Materialize all inputs. A submodule instance consumes its inputs
+    // |latency| stages before its result stage.
+    int arg_stage = stmt->stage->stage;
+    if (stmt->type == IRStmtInstance) {
+        arg_stage -= static_cast<int>(stmt->constant);
+    }
     vector<string> arg_signals;
     for (auto* arg : stmt->args) {
-        arg_signals.push_back(GetSignalInStage(arg, stmt->stage->stage));
+        arg_signals.push_back(GetSignalInStage(arg, arg_stage));
     }
     // Materialize the valid signal, if any.
     string valid_signal;
@@ -170,14 +311,14 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
             break;
 
         case IRStmtPortRead:
-            out_->SetVar("portname", stmt->port->name);
+            out_->SetVar("portname", PortName(stmt->port));
             out_->Print("assign $signal$ = $portname$;\n");
             break;
 
         case IRStmtPortWrite:
-            out_->SetVar("portname", stmt->port->name);
+            out_->SetVar("portname", PortName(stmt->port));
             out_->SetVar("arg", arg_signals[0]);
-            if (!stmt->port->exported) {
+            if (!stmt->port->exported && !bound_ports_.count(stmt->port)) {
                 out_->SetVar("width", strprintf("%d", stmt->args[0]->width));
                 out_->Print("wire [$width$-1:0] $portname$;\n");
             }
@@ -194,12 +335,12 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
             break;
 
         case IRStmtRegRead:
-            out_->SetVar("regname", stmt->storage->name);
+            out_->SetVar("regname", StorageName(stmt->storage));
             out_->Print("assign $signal$ = reg_$regname$;\n");
             break;
 
         case IRStmtRegWrite:
-            out_->SetVar("regname", stmt->storage->name);
+            out_->SetVar("regname", StorageName(stmt->storage));
             out_->SetVar("arg", arg_signals[0]);
             out_->Print(
                 "always @(negedge clock) begin\n"
@@ -211,14 +352,32 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
             break;
 
         case IRStmtArrayRead:
-            out_->SetVar("arrayname", stmt->storage->name);
+            out_->SetVar("arrayname", StorageName(stmt->storage));
             out_->SetVar("index", arg_signals[0]);
+            if (stmt->storage->IsRom()) {
+                // One instance of the ROM's module per read port. The module
+                // is named after the top-level module, so a system that reads
+                // a ROM is not emitted as a shared module.
+                if (shared_module_) {
+                    foreign_signal_ = true;
+                }
+                out_->SetVars({
+                    { "module", RomModuleName(stmt->storage) },
+                    { "instname", strprintf("rom_%s_val%d",
+                                            stmt->storage->name.c_str(),
+                                            SignalNumber(stmt)) },
+                });
+                out_->Print("$module$ $instname$(\n"
+                            "    .addr($index$),\n"
+                            "    .data($signal$));\n");
+                break;
+            }
             out_->Print(
                 "assign $signal$ = array_$arrayname$[$index$];\n");
             break;
 
         case IRStmtArrayWrite:
-            out_->SetVar("arrayname", stmt->storage->name);
+            out_->SetVar("arrayname", StorageName(stmt->storage));
             out_->SetVar("index", arg_signals[0]);
             out_->SetVar("data", arg_signals[1]);
             out_->Print(
@@ -239,6 +398,14 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
                             stmt->restart_arg,
                             stmt->restart_arg->stage->stage + 1));
                 out_->Print("assign $signal$ = $arg$;\n");
+            } else if (stmt->is_valid_start && stmt->pipe->spawn) {
+                // Entry of a spawned pipe: its txns start where the spawn
+                // fires.
+                out_->SetVar("arg",
+                        GetSignalInStage(
+                            stmt->pipe->spawn->valid_in,
+                            stmt->stage->stage));
+                out_->Print("assign $signal$ = $arg$;\n");
             } else {
                 // No arg -- set to all ones.
                 out_->SetVar("allones", HexStrAllOnes(stmt->width));
@@ -263,6 +430,39 @@ void VerilogGenerator::GenerateNode(const IRStmt* stmt) {
             // Nothing required -- recognized in AssignKills().
             break;
 
+        case IRStmtWait:
+            // The hold signal: a valid txn whose condition is not yet met.
+            // AssignKills() fans this back to upstream stages and their
+            // latches.
+            out_->SetVar("arg", arg_signals[0]);
+            if (stmt->valid_in) {
+                out_->Print("assign $signal$ = $predicate$ & ~$arg$;\n");
+            } else {
+                out_->Print("assign $signal$ = ~$arg$;\n");
+            }
+            break;
+
+        case IRStmtInstance:
+            // The submodule is emitted separately; it has the same clock and
+            // reset, inputs arg0..argN-1, and output 'result'.
+            out_->SetVars({
+                { "module", stmt->port_name },
+                { "instname", strprintf("%s_val%d", stmt->port_name.c_str(),
+                                        SignalNumber(stmt)) },
+            });
+            out_->Print("$module$ $instname$(\n"
+                        "    .clock(clock),\n"
+                        "    .reset(reset),\n");
+            for (unsigned i = 0; i < arg_signals.size(); i++) {
+                out_->SetVars({
+                    { "i", strprintf("%d", i) },
+                    { "arg", arg_signals[i] },
+                });
+                out_->Print("    .arg$i$($arg$),\n");
+            }
+            out_->Print("    .result($signal$));\n");
+            break;
+
         case IRStmtTimingBarrier:
             // Nothing
             break;
@@ -500,7 +700,187 @@ void VerilogGenerator::GenerateNodeExpr(const IRStmt* stmt,
     }
 }
 
+namespace {
+
+// Whether |pred|, as read in |stage|, is true only if |valid| is: it is
+// |valid| itself, or an AND computed in |stage| with such an input. (A value
+// carried in from an earlier stage is only as fresh as its own valid.)
+bool Implies(const IRStmt* pred, const IRStmt* valid, int stage) {
+    if (pred == valid) {
+        return true;
+    }
+    if (!pred || pred->type != IRStmtExpr || pred->op != IRStmtOpAnd ||
+        pred->width != 1 || pred->stage->stage != stage) {
+        return false;
+    }
+    for (auto* arg : pred->args) {
+        if (Implies(arg, valid, stage)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Statements whose every effect is gated by their valid.
+bool IsGatedSink(const IRStmt* stmt) {
+    switch (stmt->type) {
+        case IRStmtRegWrite:
+        case IRStmtArrayWrite:
+            return true;
+        case IRStmtPortWrite:
+            return stmt->port_has_default;
+        default:
+            return false;
+    }
+}
+
+}  // anonymous namespace
+
+void VerilogGenerator::PlanStaging() {
+    // Values that GenerateNode() reads other than as the args of a statement
+    // in the statement's own stage: valids, stage controls, channel and
+    // restart sources, bypass buses, instance inputs and traced signals.
+    // These are staged as they always were.
+    set<const IRStmt*> pinned;
+    map<const IRStmt*, vector<const IRStmt*>> users;
+    set<const IRStorage*> written;
+    for (auto* sys : systems_) {
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                if (stmt->deleted) continue;
+                for (auto* arg : stmt->args) {
+                    users[arg].push_back(stmt);
+                    if (stmt->type == IRStmtInstance) pinned.insert(arg);
+                }
+                pinned.insert(stmt->valid_in);
+                if (stmt->type == IRStmtChanRead &&
+                    !stmt->port->defs.empty()) {
+                    pinned.insert(stmt->port->defs[0]->args[0]);
+                }
+                if (stmt->type == IRStmtRestartValue) {
+                    pinned.insert(stmt->restart_arg);
+                    // A restart valid is latched every cycle: gated by
+                    // itself, its pipereg would only ever latch a 1, and
+                    // the backedge would keep restarting once taken.
+                    if (stmt->is_valid_start && stmt->restart_arg) {
+                        free_running_.insert(stmt->restart_arg);
+                    }
+                    if (stmt->pipe->spawn) {
+                        pinned.insert(stmt->pipe->spawn->valid_in);
+                    }
+                }
+                if (stmt->bypass) {
+                    pinned.insert(stmt);
+                    pinned.insert(stmt->bypass->start->valid_in);
+                    pinned.insert(stmt->bypass->start->args[0]);
+                }
+                if (stmt->storage && stmt->type != IRStmtRegRead &&
+                    stmt->type != IRStmtArrayRead) {
+                    written.insert(stmt->storage);
+                }
+            }
+            for (auto& stage : pipe->stages) {
+                pinned.insert(stage->stall);
+                pinned.insert(stage->hold);
+                pinned.insert(stage->kill);
+                pinned.insert(stage->valids.begin(), stage->valids.end());
+                for (auto& link : stage->links) {
+                    if (link.first == PipeStage::LINK_HOLD) {
+                        hold_links_.insert(
+                            make_pair(link.second, stage->stage));
+                    }
+                }
+            }
+        }
+    }
+    if (trace_) {
+        for (auto& s : trace_->signals) {
+            pinned.insert(s.stmts.begin(), s.stmts.end());
+        }
+    }
+
+    // Invariant values. A pinned value is not one, nor is anything computed
+    // from it: a valid or a restart source must not be seen in a later stage
+    // before a transaction has carried it there. An arg not yet seen (logic
+    // that a lowering pass appended to the pipe) counts as variant.
+    for (auto* sys : systems_) {
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                if (stmt->deleted || stmt->width == 0) continue;
+                bool invariant = false;
+                if (stmt->type == IRStmtExpr) {
+                    invariant = true;
+                    for (auto* arg : stmt->args) {
+                        if (!invariant_.count(arg)) invariant = false;
+                    }
+                } else if (stmt->type == IRStmtRegRead) {
+                    invariant = !written.count(stmt->storage);
+                }
+                if (invariant && !pinned.count(stmt)) {
+                    invariant_.insert(stmt);
+                }
+            }
+        }
+    }
+
+    // A use of a value in a later stage may be fed by piperegs that ignore
+    // the value's valid |valid| if the use has no effect unless it holds:
+    // it is a gated sink whose predicate implies |valid|, or logic read only
+    // in its own stage by such uses.
+    function<bool(const IRStmt*, const IRStmt*)> gated =
+        [&](const IRStmt* use, const IRStmt* valid) {
+        if (use->pipe != valid->pipe) {
+            return false;
+        }
+        if (IsGatedSink(use)) {
+            return Implies(use->valid_in, valid, use->stage->stage);
+        }
+        if (use->type != IRStmtExpr || use->width == 0 ||
+            pinned.count(use)) {
+            return false;
+        }
+        for (auto* next : users[use]) {
+            if (next->stage != use->stage || !gated(next, valid)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    for (auto* sys : systems_) {
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                const IRStmt* valid = stmt->valid_in;
+                if (stmt->deleted || stmt->width == 0 || !valid ||
+                    valid->valid_in || valid->pipe != stmt->pipe ||
+                    pinned.count(stmt) || invariant_.count(stmt)) {
+                    continue;
+                }
+                bool free = true;
+                for (auto* use : users[stmt]) {
+                    if (use->stage->stage > stmt->stage->stage &&
+                        !gated(use, valid)) {
+                        free = false;
+                        break;
+                    }
+                }
+                if (free) free_running_.insert(stmt);
+            }
+        }
+    }
+}
+
 std::string VerilogGenerator::GetSignalInStage(const IRStmt* stmt, int stage) {
+    // A use in an earlier stage must be a hold link, a wait's hold signal
+    // fanning back upstream in the same cycle: it is never staged. Anything
+    // else would read a later transaction's value.
+    if (stage < stmt->stage->stage) {
+        assert(hold_links_.count(make_pair(stmt, stage)));
+        return SignalName(stmt, stmt->stage->stage);
+    }
+    // An invariant value is read where it is computed.
+    if (invariant_.count(stmt)) {
+        return SignalName(stmt, stmt->stage->stage);
+    }
     auto it = signal_stages_.find(stmt);
     if (it == signal_stages_.end()) {
         it = signal_stages_.insert(
@@ -510,12 +890,66 @@ std::string VerilogGenerator::GetSignalInStage(const IRStmt* stmt, int stage) {
     }
     auto& min_max = it->second;
     if (stage < min_max.first) min_max.first = stage;
-    if (stage > min_max.second) min_max.second = stage;
+    if (stage > min_max.second) {
+        min_max.second = stage;
+        // Each pipereg that carries this value is gated by the value's valid
+        // signal in the source stage, so that signal must reach it too. (It
+        // may not otherwise: e.g., a hold-gated valid is used only locally.)
+        // A free-running value's piperegs need no valid.
+        if (stmt->valid_in && !free_running_.count(stmt)) {
+            GetSignalInStage(stmt->valid_in, stage - 1);
+        }
+    }
     return SignalName(stmt, stage);
 }
 
 std::string VerilogGenerator::SignalName(const IRStmt* stmt, int stage) const {
-    return strprintf("val%d_%d", stmt->valnum, stage);
+    return strprintf("val%d_%d", SignalNumber(stmt), stage);
+}
+
+int VerilogGenerator::SignalNumber(const IRStmt* stmt) const {
+    if (shared_module_) {
+        auto it = local_index_.find(stmt);
+        if (it != local_index_.end()) return it->second;
+        foreign_signal_ = true;
+    }
+    return stmt->valnum;
+}
+
+std::string VerilogGenerator::PortName(const IRPort* port) const {
+    if (shared_module_) {
+        auto it = port_slot_.find(port);
+        if (it != port_slot_.end()) return Placeholder('P', it->second);
+        foreign_signal_ = true;
+    }
+    return port->name;
+}
+
+std::string VerilogGenerator::StorageName(const IRStorage* storage) const {
+    if (shared_module_) {
+        auto it = storage_slot_.find(storage);
+        if (it != storage_slot_.end()) return Placeholder('S', it->second);
+        foreign_signal_ = true;
+    }
+    return storage->name;
+}
+
+std::string VerilogGenerator::PipeRegName(const IRStmt* stmt,
+                                          int stage) const {
+    auto it = shared_signals_.find(stmt);
+    if (it != shared_signals_.end()) {
+        return strprintf("%s/val%d_%d_pipereg", it->second.first.c_str(),
+                         it->second.second, stage);
+    }
+    return SignalName(stmt, stage) + "_pipereg";
+}
+
+std::string VerilogGenerator::StorageCellName(
+        const IRStorage* storage) const {
+    auto it = shared_storage_.find(storage);
+    if (it != shared_storage_.end()) return it->second;
+    return (storage->index_width == 0 ? "reg_" : "array_") +
+           StorageName(storage);
 }
 
 void VerilogGenerator::GenerateStaging(const IRStmt* stmt) {
@@ -524,54 +958,352 @@ void VerilogGenerator::GenerateStaging(const IRStmt* stmt) {
     auto min_max = it->second;
     for (int i = min_max.first; i < min_max.second; i++) {
         // We need to stage the value from pipestage i to pipestage i+1.
+        // Valid signal is staged because it logically travels with the txn.
+        string valid;
+        if (stmt->valid_in && !free_running_.count(stmt)) {
+            valid = SignalName(stmt->valid_in, i);
+        }
+        // Hold signal is not staged -- comes directly from combinational
+        // logic that generates it.
+        string hold;
+        if (const IRStmt* h = stmt->pipe->stages[i]->hold) {
+            hold = SignalName(h, h->stage->stage);
+        }
+        string enable = PipeRegEnable(valid, hold);
+
         PrinterScope scope(out_);
         out_->SetVars({
             { "src", SignalName(stmt, i) },
             { "dst", SignalName(stmt, i+1) },
-            // Valid signal is staged because it logically travels with the txn.
-            { "valid", stmt->valid_in ? SignalName(stmt->valid_in, i) : "1'b1" },
-            // Stall signal is not staged -- comes directly from combinational
-            // logic that generates it.
-            { "hold",  stmt->pipe->stages[i]->stall ?
-                       SignalName(stmt->pipe->stages[i]->stall,
-                                  stmt->pipe->stages[i]->stall->stage->stage) : "1'b0" },
+            { "enable", enable },
             { "width", strprintf("%d", stmt->width) },
-            { "instance_name", SignalName(stmt, i+1) + "_pipereg" },
+            { "instance_name", PipeRegName(stmt, i+1) },
         });
 
         out_->Print("pipereg #($width$) $instance_name$(\n"
                     "  .src($src$),\n"
                     "  .dst($dst$),\n"
-                    "  .valid($valid$),\n"
-                    "  .hold($hold$),\n"
+                    "  .enable($enable$),\n"
                     "  .clock(clock),\n"
                     "  .reset(reset));\n");
         out_->Print("wire [$width$-1:0] $dst$;\n");
     }
 }
 
+std::string VerilogGenerator::PipeRegEnable(const string& valid,
+                                            const string& hold) {
+    if (hold.empty()) {
+        return valid.empty() ? "1'b1" : valid;
+    }
+    auto key = make_pair(valid, hold);
+    auto it = enables_.find(key);
+    if (it != enables_.end()) {
+        return it->second;
+    }
+    string name = strprintf("pipereg_en%d",
+                            static_cast<int>(enables_.size()));
+    enables_[key] = name;
+
+    PrinterScope scope(out_);
+    out_->SetVars({
+        { "name", name },
+        { "valid", valid },
+        { "hold", hold },
+    });
+    out_->Print("wire $name$;\n");
+    if (valid.empty()) {
+        out_->Print("assign $name$ = ~$hold$;\n");
+    } else {
+        out_->Print("assign $name$ = $valid$ & ~$hold$;\n");
+    }
+    return name;
+}
+
 void VerilogGenerator::GenerateStorage(const IRStorage* storage) {
     PrinterScope scope(out_);
-    out_->SetVar("name", storage->name);
+    out_->SetVar("name", StorageName(storage));
     out_->SetVar("width", strprintf("%d", storage->data_width));
     assert(storage->index_width < 64);  // checked during typecheck
     out_->SetVar("entries", strprintf("%d", storage->elements));
 
     if (storage->index_width == 0) {  // individual register
         out_->Print("reg [$width$-1:0] reg_$name$;\n");
-    } else {  // array
+    } else if (!storage->IsRom()) {  // array; a ROM is a module of its own
         out_->Print("reg [$width$-1:0] array_$name$[$entries$-1:0];\n");
+        GenerateArrayInit(storage, "array_" + StorageName(storage));
     }
 }
 
+void VerilogGenerator::GenerateArrayInit(const IRStorage* storage,
+                                         const string& cell) {
+    if (storage->init.empty()) {
+        return;
+    }
+    PrinterScope scope(out_);
+    out_->SetVars({
+        { "cell", cell },
+        { "width", strprintf("%d", storage->data_width) },
+        { "entries", strprintf("%d", storage->elements) },
+    });
+    out_->Print("initial begin : $cell$_init\n");
+    out_->Indent();
+    if (storage->init.size() < static_cast<size_t>(storage->elements)) {
+        out_->Print("integer i;\n"
+                    "for (i = 0; i < $entries$; i = i + 1)\n"
+                    "    $cell$[i] = 0;\n");
+    }
+    for (size_t i = 0; i < storage->init.size(); i++) {
+        out_->SetVars({
+            { "i", strprintf("%d", static_cast<int>(i)) },
+            { "value", storage->init[i].str() },
+        });
+        out_->Print("$cell$[$i$] = $width$'d$value$;\n");
+    }
+    out_->Outdent();
+    out_->Print("end\n");
+}
+
+std::string VerilogGenerator::RomModuleName(const IRStorage* storage) const {
+    return name_ + "_rom_" + storage->name;
+}
+
+// A ROM is emitted as a module with one read port, of which each read is an
+// instance, holding its contents in an initial block. A registered ROM's
+// index comes from a pipeline register (see RegisterRomReads() in
+// lower.cc), so that synthesis can map it to a synchronous-read memory.
+void VerilogGenerator::GenerateRomModule(const IRStorage* storage) {
+    PrinterScope scope(out_);
+    out_->SetVars({
+        { "module", RomModuleName(storage) },
+        { "index_width", strprintf("%d", storage->index_width) },
+        { "width", strprintf("%d", storage->data_width) },
+        { "entries", strprintf("%d", storage->elements) },
+    });
+    out_->Print("\nmodule $module$(\n"
+                "    input [$index_width$-1:0] addr,\n"
+                "    output [$width$-1:0] data);\n"
+                "\n");
+    out_->Indent();
+    out_->Print("reg [$width$-1:0] rom[$entries$-1:0];\n");
+    GenerateArrayInit(storage, "rom");
+    out_->Print("assign data = rom[addr];\n");
+    out_->Outdent();
+    out_->Print("\nendmodule\n");
+}
+
+void VerilogGenerator::FindSharedSystems() {
+    if (shared_module_ || trace_ || systems_.size() < 2) return;
+
+    // Which systems use each port and each storage element. A system can
+    // only be moved into a module of its own if no other system uses its
+    // storage; a port it shares with another system, or that is exported,
+    // becomes a module port.
+    map<const IRPort*, set<const PipeSys*>> port_users;
+    map<const IRStorage*, set<const PipeSys*>> storage_users;
+    for (auto* sys : systems_) {
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                if (stmt->port && stmt->port->type == IRPort::PORT) {
+                    port_users[stmt->port].insert(sys);
+                }
+                if (stmt->storage) {
+                    storage_users[stmt->storage].insert(sys);
+                }
+            }
+        }
+    }
+
+    // Generate each system's module text and group systems by it, keeping
+    // the classes in the order of their first system.
+    vector<unique_ptr<VerilogGenerator>> nested(systems_.size());
+    map<string, vector<int>> classes;
+    vector<map<string, vector<int>>::iterator> class_order;
+    for (unsigned i = 0; i < systems_.size(); i++) {
+        PipeSys* sys = systems_[i];
+        bool standalone = true;
+        set<const IRPort*> bound;
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                if (stmt->storage && storage_users[stmt->storage].size() > 1) {
+                    standalone = false;
+                }
+                if (stmt->port && stmt->port->type == IRPort::PORT &&
+                    (stmt->port->exported ||
+                     port_users[stmt->port].size() > 1)) {
+                    bound.insert(stmt->port);
+                }
+            }
+        }
+        if (!standalone) continue;
+
+        nested[i].reset(new VerilogGenerator(nullptr, { sys },
+                                             Placeholder('M', 0)));
+        nested[i]->shared_module_ = true;
+        nested[i]->invariant_ = invariant_;
+        nested[i]->free_running_ = free_running_;
+        nested[i]->hold_links_ = hold_links_;
+        string text = nested[i]->GenerateSharedModule(bound);
+        if (text.empty()) continue;
+        auto it = classes.find(text);
+        if (it == classes.end()) {
+            it = classes.insert(make_pair(text, vector<int>())).first;
+            class_order.push_back(it);
+        }
+        it->second.push_back(i);
+    }
+
+    int module_count = 0;
+    for (auto cls : class_order) {
+        const vector<int>& members = cls->second;
+        if (members.size() < 2) continue;
+        const VerilogGenerator* rep = nested[members[0]].get();
+        string module = strprintf("%s_shared%d", name_.c_str(),
+                                  module_count++);
+
+        // The module takes its port and storage names from its first
+        // system.
+        vector<string> port_names, storage_names;
+        for (auto* port : rep->port_slots_) {
+            port_names.push_back(port->name);
+        }
+        for (auto* storage : rep->storage_slots_) {
+            storage_names.push_back(storage->name);
+        }
+        shared_modules_ += FillPlaceholders(cls->first, module, port_names,
+                                            storage_names);
+
+        for (int i : members) {
+            const VerilogGenerator* gen = nested[i].get();
+            const PipeSys* sys = systems_[i];
+            string instance;
+            if (!sys->pipes.empty() && sys->pipes[0]->entry) {
+                instance = sys->pipes[0]->entry->label + "_inst";
+            } else {
+                instance = strprintf("sys%d_inst", i);
+            }
+
+            // Ports that the instance drives and that no one else declares.
+            string text;
+            for (auto* port : gen->port_slots_) {
+                if (gen->bound_ports_.count(port) && !port->exported &&
+                    gen->written_ports_.count(port)) {
+                    text += strprintf("wire [%d-1:0] %s;\n", port->width,
+                                      port->name.c_str());
+                }
+            }
+            text += module + " " + instance + "(\n"
+                    "    .clock(clock),\n"
+                    "    .reset(reset)";
+            for (unsigned slot = 0; slot < gen->port_slots_.size(); slot++) {
+                const IRPort* port = gen->port_slots_[slot];
+                if (!gen->bound_ports_.count(port)) continue;
+                text += ",\n    ." + port_names[slot] + "(" + port->name + ")";
+            }
+            text += ");\n";
+            shared_instances_[sys] = text;
+
+            for (auto& p : gen->local_index_) {
+                shared_signals_[p.first] = make_pair(instance, p.second);
+            }
+            for (unsigned slot = 0; slot < gen->storage_slots_.size();
+                 slot++) {
+                const IRStorage* storage = gen->storage_slots_[slot];
+                shared_storage_[storage] =
+                    instance + "/" +
+                    (storage->index_width == 0 ? "reg_" : "array_") +
+                    storage_names[slot];
+            }
+            shared_signal_stages_.insert(gen->signal_stages_.begin(),
+                                         gen->signal_stages_.end());
+        }
+    }
+}
+
+string VerilogGenerator::GenerateSharedModule(
+        const set<const IRPort*>& bound) {
+    PipeSys* sys = systems_[0];
+    bound_ports_ = bound;
+
+    // Number signals by position in the system, and ports and storage by
+    // first use, so that identical systems produce identical text.
+    for (auto& pipe : sys->pipes) {
+        for (auto* stmt : pipe->stmts) {
+            int index = local_index_.size();
+            local_index_[stmt] = index;
+            const IRPort* port = stmt->port;
+            if (port && port->type == IRPort::PORT &&
+                !port_slot_.count(port)) {
+                port_slot_[port] = port_slots_.size();
+                port_slots_.push_back(port);
+            }
+            if (stmt->type == IRStmtPortWrite) {
+                written_ports_.insert(port);
+            }
+            if (stmt->storage && !storage_slot_.count(stmt->storage)) {
+                storage_slot_[stmt->storage] = storage_slots_.size();
+                storage_slots_.push_back(stmt->storage);
+            }
+        }
+    }
+
+    ostringstream os;
+    Printer printer(&os);
+    out_ = &printer;
+    {
+        PrinterScope global_scope(out_);
+        out_->SetVar("module_name", name_);
+        out_->Print("\nmodule $module_name$(\n");
+        out_->Indent();
+        out_->Print("input clock,\ninput reset");
+        for (auto* port : port_slots_) {
+            if (!bound_ports_.count(port)) continue;
+            PrinterScope scope(out_);
+            out_->SetVars({
+                { "name", PortName(port) },
+                { "msb", strprintf("%d", port->width - 1) },
+                { "dir", written_ports_.count(port) ? "output" : "input" },
+            });
+            out_->Print(",\n$dir$ [$msb$:0] $name$");
+        }
+        out_->Print("\n");
+        out_->Outdent();
+        out_->Print(");\n");
+        out_->Indent();
+
+        for (auto* storage : storage_slots_) {
+            GenerateStorage(storage);
+        }
+        for (auto& pipe : sys->pipes) {
+            for (auto* stmt : pipe->stmts) {
+                GenerateNode(stmt);
+            }
+        }
+        // Stage signals in position order rather than valnum order.
+        vector<const IRStmt*> staged;
+        for (auto& p : signal_stages_) {
+            staged.push_back(p.first);
+        }
+        sort(staged.begin(), staged.end(),
+             [this](const IRStmt* a, const IRStmt* b) {
+                 return SignalNumber(a) < SignalNumber(b);
+             });
+        for (auto* stmt : staged) {
+            GenerateStaging(stmt);
+        }
+        GenerateModuleEnd();
+    }
+    out_ = nullptr;
+
+    return foreign_signal_ ? string() : os.str();
+}
+
 void VerilogGenerator::GeneratePipeRegModule() {
     out_->Print(
         "\n"
         "module pipereg(\n"
         "    input [width-1:0] src,\n"
         "    output [width-1:0] dst,\n"
-        "    input valid,\n"
-        "    input hold,\n"
+        "    input enable,\n"
         "    input clock,\n"
         "    input reset);\n"
         "\n"
@@ -584,7 +1316,7 @@ void VerilogGenerator::GeneratePipeRegModule() {
         "        if (reset)\n"
         "            dst <= 0;\n"
         "        else begin\n"
-        "            if (valid)\n"
+        "            if (enable)\n"
         "                dst <= src;\n"
         "        end\n"
         "    end\n"
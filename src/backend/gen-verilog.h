@@ -27,6 +27,7 @@
 #include "backend/ir.h"
 #include "backend/pipe.h"
 #include "backend/gen-printer.h"
+#include "backend/trace.h"
 
 namespace autopiper {
 
@@ -35,7 +36,9 @@ class VerilogGenerator {
   VerilogGenerator(Printer* out,
                    const std::vector<PipeSys*>& systems,
                    const std::string& name)
-      : out_(out), program_(nullptr), systems_(systems), name_(name) {
+      : out_(out), program_(nullptr), systems_(systems), name_(name),
+        emit_pipereg_module_(true), trace_(nullptr), shared_module_(false),
+        foreign_signal_(false) {
       if (systems.size() > 0) {
           program_ = systems[0]->program;
       }
@@ -43,14 +46,107 @@ class VerilogGenerator {
 
   void Generate();
 
+  // Whether Generate() also emits the shared pipereg module. A submodule
+  // compiled for instantiation in another module leaves it to that module.
+  void SetEmitPipeRegModule(bool emit) { emit_pipereg_module_ = emit; }
+
+  // Adds |trace|'s buffer and its ports to the module. Tracing samples
+  // signals throughout the design, so no system is emitted as a shared
+  // module.
+  void SetTrace(const TraceBuffer* trace) { trace_ = trace; }
+
+  // Map from generating node to the (min_stage, max_stage) range over which
+  // its value is carried. Valid after Generate(); a value ranging over stages
+  // [a, b] is staged through b - a piperegs.
+  typedef std::map<const IRStmt*, std::pair<int, int>, IRStmtLess>
+      SignalStageMap;
+  const SignalStageMap& StagedSignals() const {
+      return signal_stages_;
+  }
+
+  // Instance name of the pipereg that latches |stmt|'s value into |stage|,
+  // as a hierarchical path if |stmt| is in a shared-module instance.
+  std::string PipeRegName(const IRStmt* stmt, int stage) const;
+
+  // Name of the cell that holds |storage| (reg_<name> or array_<name>),
+  // likewise hierarchical if it lives in a shared-module instance.
+  std::string StorageCellName(const IRStorage* storage) const;
+
  private:
   Printer* out_;
   IRProgram* program_;
   std::vector<PipeSys*> systems_;
   std::string name_;
+  bool emit_pipereg_module_;
+  const TraceBuffer* trace_;
 
   // Map from generating node to (min_stage, max_stage) pairs
-  std::map<const IRStmt*, std::pair<int, int>> signal_stages_;
+  SignalStageMap signal_stages_;
+
+  // Staging plan, made over all systems before any node is generated (and
+  // handed to nested generators). An invariant value -- a constant, or logic
+  // over constants and registers that are never written -- is the same in
+  // every stage, so later stages read it where it is computed and it is not
+  // staged at all. A free-running value's piperegs ignore its valid: every
+  // later-stage use of it is gated by a predicate that implies that valid,
+  // so a value latched for an invalid transaction is never observed. (A
+  // backedge's restart valid is also free-running; it must clear when no
+  // iteration restarts.)
+  std::set<const IRStmt*> invariant_;
+  std::set<const IRStmt*> free_running_;
+
+  // Hold links (see PipeStage::links), by (wait, reading stage): the only
+  // same-cycle uses of a value in an earlier stage than its own.
+  std::set<std::pair<const IRStmt*, int>> hold_links_;
+
+  // Pipereg enables that combine a valid and a hold signal, by (valid,
+  // hold) pair, each computed once for all the piperegs that share it.
+  std::map<std::pair<std::string, std::string>, std::string> enables_;
+
+  // Systems that are structurally identical (the same statements, widths
+  // and stages, up to which ports and storage they use) are emitted once as
+  // a shared module and instantiated per system. A shared module's text is
+  // generated by a nested generator per system in |shared_module_| mode,
+  // where signals are numbered by position in the system and ports, storage
+  // and the module name are placeholders; systems whose text matches share
+  // one module.
+  //
+  // Instantiation text per shared system, and hierarchical names of the
+  // signals (instance, signal number) and storage cells inside them.
+  std::map<const PipeSys*, std::string> shared_instances_;
+  std::map<const IRStmt*, std::pair<std::string, int>> shared_signals_;
+  std::map<const IRStorage*, std::string> shared_storage_;
+  SignalStageMap shared_signal_stages_;
+  std::string shared_modules_;  // module definitions, ready to print
+
+  // Nested-generator state in |shared_module_| mode.
+  bool shared_module_;
+  std::map<const IRStmt*, int> local_index_;
+  std::vector<const IRPort*> port_slots_;
+  std::map<const IRPort*, int> port_slot_;
+  std::set<const IRPort*> bound_ports_;    // module ports, not local wires
+  std::set<const IRPort*> written_ports_;
+  std::vector<const IRStorage*> storage_slots_;
+  std::map<const IRStorage*, int> storage_slot_;
+  // Set if the system names a signal outside itself.
+  mutable bool foreign_signal_;
+
+  // Finds systems to emit as shared modules and generates their modules
+  // and instantiations.
+  void FindSharedSystems();
+  // In a nested generator: returns the module text for its one system, or
+  // an empty string if the system cannot stand alone.
+  std::string GenerateSharedModule(const std::set<const IRPort*>& bound);
+
+  // Names of ports and storage as emitted (placeholders in a nested
+  // generator).
+  std::string PortName(const IRPort* port) const;
+  std::string StorageName(const IRStorage* storage) const;
+  // Number used in a statement's signal names.
+  int SignalNumber(const IRStmt* stmt) const;
+
+  // Computes |invariant_|, |free_running_| and |hold_links_|.
+  void PlanStaging();
 
   // Returns a signal name for an IRStmt's value in a given stage. Creates
   // entries in the staged-values map but does not emit the pipereg instances.
@@ -61,14 +157,23 @@ class VerilogGenerator {
 
   // Generate pipereg instances for a signal.
   void GenerateStaging(const IRStmt* stmt);
+  // Returns the enable for piperegs gated by |valid| and |hold| (either may
+  // be empty), emitting its wire on first use.
+  std::string PipeRegEnable(const std::string& valid, const std::string& hold);
 
   // Helpers: Generate()
   void GenerateModuleStart();
   void GenerateModuleEnd();
   void GenerateModulePortDef(const IRPort* port);
+  void GenerateTrace();
 
   // Generate a storage element.
   void GenerateStorage(const IRStorage* storage);
+  // Generate the initial contents, if any, of an array held in |cell|.
+  void GenerateArrayInit(const IRStorage* storage, const std::string& cell);
+  // Generate a ROM's module, and its name.
+  void GenerateRomModule(const IRStorage* storage);
+  std::string RomModuleName(const IRStorage* storage) const;
 
   // Helper: GenerateNode()
   void GenerateNodeExpr(const IRStmt* stmt,
@@ -227,6 +227,8 @@ bool CreateStorage(IRProgram* program,
             }
             if (stmt->type == IRStmtArraySize) {
                 storage->elements = static_cast<int>(stmt->constant);
+                storage->init = stmt->array_init;
+                storage->registered = stmt->array_registered;
             }
         }
         program->storage.push_back(move(storage));
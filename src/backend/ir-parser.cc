@@ -19,8 +19,13 @@
 
 #include "common/parser-utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
 #include <assert.h>
 #include <ctype.h>
 
@@ -43,6 +48,7 @@ class Parser : public ParserBase {
 
         bool ParseIRStmt(IRProgram* program, IRBB* bb);
         bool ParseIRStmtTimingAnchor(IRProgram* program, IRStmt* stmt);
+        bool ParseArraySizeAttrs(IRStmt* stmt);
 
     //private:
     public:
@@ -129,7 +135,7 @@ bool IdentToStatementType(string ident,
     SE("rsh", IRStmtOpRsh,  StmtArgValnum, StmtArgValnum);
     SE("bsl", IRStmtOpBitslice,  StmtArgValnum, StmtArgValnum, StmtArgValnum);
     SE("cat", IRStmtOpConcat,  StmtArgValnums);
-    SE("sel", IRStmtOpConcat,  StmtArgValnum, StmtArgValnum, StmtArgValnum);
+    SE("sel", IRStmtOpSelect,  StmtArgValnum, StmtArgValnum, StmtArgValnum);
     SE("cmplt", IRStmtOpCmpLT,  StmtArgValnum, StmtArgValnum);
     SE("cmple", IRStmtOpCmpLE,  StmtArgValnum, StmtArgValnum);
     SE("cmpeq", IRStmtOpCmpEQ,  StmtArgValnum, StmtArgValnum);
@@ -151,6 +157,7 @@ bool IdentToStatementType(string ident,
     S("regwrite", IRStmtRegWrite, StmtArgPortname, StmtArgValnum);
     S("arrayread", IRStmtArrayRead,  StmtArgPortname, StmtArgValnum);
     S("arraywrite", IRStmtArrayWrite,  StmtArgPortname, StmtArgValnum, StmtArgValnum);
+    S("arraysize", IRStmtArraySize,  StmtArgPortname, StmtArgConst);
 
     S("bypassstart", IRStmtBypassStart, StmtArgPortname, StmtArgValnum);
     S("bypassend", IRStmtBypassEnd, StmtArgPortname);
@@ -164,6 +171,8 @@ bool IdentToStatementType(string ident,
     S("killyounger", IRStmtKillYounger, StmtArgNone);
     S("done", IRStmtDone, StmtArgNone);
     S("killif", IRStmtKillIf, StmtArgValnum);
+    S("wait", IRStmtWait, StmtArgValnum);
+    S("instance", IRStmtInstance, StmtArgPortname, StmtArgConst, StmtArgValnums);
 
     S("timing_barrier", IRStmtTimingBarrier, StmtArgNone);
 
@@ -287,6 +296,10 @@ bool Parser::ParseIRStmt(IRProgram* program, IRBB* bb) {
         }
     }
 
+    if (stmt_type == IRStmtArraySize) {
+        if (!ParseArraySizeAttrs(stmt.get())) return false;
+    }
+
     if (TryExpect(Token::AT)) {
         if (!ParseIRStmtTimingAnchor(program, stmt.get())) return false;
     }
@@ -298,6 +311,32 @@ bool Parser::ParseIRStmt(IRProgram* program, IRBB* bb) {
     return true;
 }
 
+// An array's optional initial contents and registered-read flag, as printed
+// by IRStmt::ToString(): '[init = 1, 2, 3] [registered]'.
+bool Parser::ParseArraySizeAttrs(IRStmt* stmt) {
+    while (TryConsume(Token::LBRACKET)) {
+        if (!Expect(Token::IDENT)) return false;
+        string attr = CurToken().s;
+        if (attr == "init") {
+            Consume();
+            if (!Consume(Token::EQUALS)) return false;
+            do {
+                if (!Expect(Token::INT_LITERAL)) return false;
+                stmt->array_init.push_back(CurToken().int_literal);
+                Consume();
+            } while (TryConsume(Token::COMMA));
+        } else if (attr == "registered") {
+            Consume();
+            stmt->array_registered = true;
+        } else {
+            Error(string("Unknown array attribute '") + attr + string("'"));
+            return false;
+        }
+        if (!Consume(Token::RBRACKET)) return false;
+    }
+    return true;
+}
+
 bool Parser::ParseIRStmtTimingAnchor(IRProgram* program, IRStmt* stmt) {
     if (!Consume(Token::AT)) return false;
     if (!Consume(Token::LBRACKET)) return false;
@@ -329,12 +368,178 @@ bool Parser::ParseIRStmtTimingAnchor(IRProgram* program, IRStmt* stmt) {
     return true;
 }
 
+// Large inputs are parsed in parallel. The text is split into chunks at
+// BB-label lines, each chunk is parsed on its own into a separate IRProgram
+// fragment, and the fragments are spliced together in source order. This is
+// possible because the parser leaves all cross-BB references (arg valnums and
+// target BB names) to be resolved by Crosslink(); the only shared state is the
+// timevar table, which is merged by name when splicing.
+//
+// Chunk parses are speculative: they collect no error messages. If any chunk
+// fails, we discard the fragments and re-parse the whole input serially, so
+// errors are reported exactly as the serial parser would report them.
+//
+// IRProgram::ParseOptions sets the chunk size and the thread count, so that
+// the parallel path can also be exercised on small inputs and machines.
+
+// Tracks only whether an error occurred.
+class ChunkErrorCollector : public ErrorCollector {
+    public:
+        ChunkErrorCollector() : has_errors_(false) {}
+
+        virtual void ReportError(Location loc, Level level,
+                                 const string& message) {
+            if (level == ERROR) {
+                has_errors_ = true;
+            }
+        }
+        virtual bool HasErrors() const { return has_errors_; }
+
+    private:
+        bool has_errors_;
+};
+
+struct IRChunk {
+    size_t begin, end;  // byte range in the source text
+    int first_line;
+    unique_ptr<IRProgram> prog;
+    bool ok;
+};
+
+// Is the line [begin, end) a BB label: not blank, not a comment, not a
+// statement, and ending (ignoring any trailing comment) in a colon?
+bool IsBBLabelLine(const string& text, size_t begin, size_t end) {
+    while (begin < end && isspace(text[begin])) begin++;
+    if (begin == end || text[begin] == '%' || text[begin] == '#') {
+        return false;
+    }
+    end = find(text.begin() + begin, text.begin() + end, '#') - text.begin();
+    while (end > begin && isspace(text[end - 1])) end--;
+    return end > begin && text[end - 1] == ':';
+}
+
+vector<IRChunk> SplitAtBBLabels(const string& text, size_t chunk_size) {
+    vector<IRChunk> chunks;
+    size_t chunk_begin = 0;
+    int chunk_line = 1;
+    int line = 1;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == string::npos) {
+            eol = text.size();
+        }
+        if (pos - chunk_begin >= chunk_size &&
+            IsBBLabelLine(text, pos, eol)) {
+            chunks.push_back({ chunk_begin, pos, chunk_line, nullptr, false });
+            chunk_begin = pos;
+            chunk_line = line;
+        }
+        pos = eol + 1;
+        line++;
+    }
+    chunks.push_back({ chunk_begin, text.size(), chunk_line, nullptr, false });
+    return chunks;
+}
+
+void ParseChunk(const string& filename, const string& text, IRChunk* chunk) {
+    istringstream in(text.substr(chunk->begin, chunk->end - chunk->begin));
+    LexerImpl lex(&in, chunk->first_line);
+    ChunkErrorCollector collector;
+    Parser parse(filename, &lex, &collector);
+    chunk->prog.reset(new IRProgram);
+    parse.ParseProgram(chunk->prog.get());
+    // The serial parser silently stops at anything it can't parse as a BB;
+    // if this chunk stopped early, the serial parse would have stopped there
+    // too, so treat it as a failure and let the serial parse decide.
+    chunk->ok = !collector.HasErrors() && !lex.Have();
+}
+
+void SpliceChunk(IRProgram* program, IRProgram* chunk) {
+    for (auto& bb : chunk->bbs) {
+        program->bbs.push_back(move(bb));
+    }
+    for (auto* entry : chunk->entries) {
+        program->entries.push_back(entry);
+    }
+    if (chunk->next_valnum > program->next_valnum) {
+        program->next_valnum = chunk->next_valnum;
+    }
+    // Timevars are created on first use, so taking them in chunk order
+    // preserves the serial parser's ordering.
+    for (auto& timevar : chunk->timevars) {
+        auto it = program->timevar_map.find(timevar->name);
+        if (it == program->timevar_map.end()) {
+            program->timevar_map[timevar->name] = timevar.get();
+            program->timevars.push_back(move(timevar));
+        } else {
+            for (auto* use : timevar->uses) {
+                use->timevar = it->second;
+                it->second->uses.push_back(use);
+            }
+        }
+    }
+}
+
+bool ParseParallel(const string& filename, const string& text,
+                   const IRProgram::ParseOptions& options,
+                   IRProgram* program) {
+    vector<IRChunk> chunks = SplitAtBBLabels(text, options.chunk_size);
+    unsigned nthreads = options.threads ? options.threads
+                                        : thread::hardware_concurrency();
+    if (nthreads > chunks.size()) {
+        nthreads = chunks.size();
+    }
+    if (nthreads < 2) {
+        return false;
+    }
+
+    atomic<size_t> next_chunk(0);
+    vector<thread> workers;
+    // Workers intern locations into this thread's SourceMap.
+    SourceMap* source_map = SourceMap::Current();
+    for (unsigned i = 0; i < nthreads; i++) {
+        workers.push_back(thread([&]() {
+            SourceMapScope source_map_scope(source_map);
+            size_t idx;
+            while ((idx = next_chunk++) < chunks.size()) {
+                ParseChunk(filename, text, &chunks[idx]);
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (auto& chunk : chunks) {
+        if (!chunk.ok) {
+            return false;
+        }
+    }
+    for (auto& chunk : chunks) {
+        SpliceChunk(program, chunk.prog.get());
+    }
+    return true;
+}
+
 }  // anonymous namespace
 
 unique_ptr<IRProgram> IRProgram::Parse(const std::string& filename,
                                        std::istream* in,
-                                       ErrorCollector* collector) {
-    LexerImpl lex(in);
+                                       ErrorCollector* collector,
+                                       const ParseOptions& options) {
+    string text((istreambuf_iterator<char>(*in)),
+                istreambuf_iterator<char>());
+
+    if (options.threads != 1 && text.size() >= 2 * options.chunk_size) {
+        unique_ptr<IRProgram> ptr(new IRProgram);
+        if (ParseParallel(filename, text, options, ptr.get())) {
+            return ptr;
+        }
+    }
+
+    istringstream text_in(text);
+    LexerImpl lex(&text_in);
     Parser parse(filename, &lex, collector);
 
     unique_ptr<IRProgram> ptr(new IRProgram);
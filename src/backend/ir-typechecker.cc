@@ -24,6 +24,7 @@
 #include <string>
 #include <set>
 #include <functional>
+#include <algorithm>
 
 using namespace std;
 using namespace autopiper;
@@ -118,8 +119,23 @@ bool DerivePortWidth(IRPort* port, ErrorCollector* collector) {
 }
 
 bool DeriveStorageSize(IRStorage* storage, ErrorCollector* collector) {
-    // There must be at least one writer.
-    if (storage->writers.empty()) {
+    int index_width = -1, data_width = -1;
+
+    // There must be at least one writer, unless the storage is an initialized
+    // array (a ROM), whose size is then given by its first reader.
+    if (storage->writers.empty() && !storage->init.empty() &&
+        !storage->readers.empty() &&
+        storage->readers[0]->type == IRStmtArrayRead) {
+        index_width = storage->readers[0]->args[0]->width;
+        data_width = storage->readers[0]->width;
+        if (index_width >= 64 || data_width <= 0) {
+            collector->ReportError(storage->readers[0]->location,
+                    ErrorCollector::ERROR,
+                    strprintf("Invalid index or data width for ROM '%s'.",
+                              storage->name.c_str()));
+            return false;
+        }
+    } else if (storage->writers.empty()) {
         Location loc;
         if (storage->readers.size() > 0) {
             loc = storage->readers[0]->location;
@@ -132,7 +148,6 @@ bool DeriveStorageSize(IRStorage* storage, ErrorCollector* collector) {
     }
 
     // Determine width and elems by surveying writers.
-    int index_width = -1, data_width = -1;
     for (auto* writer : storage->writers) {
         int stmt_index_width = (writer->type == IRStmtRegWrite) ?
             0 :                     // single reg: always 1 elem (2^0 == 1)
@@ -449,6 +464,30 @@ bool CheckStmtWidth(IRStmt* stmt, ErrorCollector* collector) {
                         "killif statement must have one boolean argument.");
                 return false;
             }
+            break;
+        case IRStmtWait:
+            // One boolean arg; the result is the (boolean) hold signal.
+            if (stmt->args.size() != 1 || stmt->args[0]->width != 1) {
+                collector->ReportError(stmt->location, ErrorCollector::ERROR,
+                        "wait statement must have one boolean argument.");
+                return false;
+            }
+            if (!CheckExactWidth(stmt, 1, collector)) return false;
+            break;
+        case IRStmtInstance:
+            // At least one input, a result, and a non-negative latency.
+            if (stmt->args.empty()) {
+                collector->ReportError(stmt->location, ErrorCollector::ERROR,
+                        "instance statement must have at least one argument.");
+                return false;
+            }
+            if (!CheckMinWidth(stmt, 1, collector)) return false;
+            if (!stmt->has_constant || stmt->constant < 0) {
+                collector->ReportError(stmt->location, ErrorCollector::ERROR,
+                        "instance statement must have a non-negative latency.");
+                return false;
+            }
+            break;
         default:
             break;
     }
@@ -505,11 +544,16 @@ string JoinSet(I begin, I end, function<string(T)> f, const char* joiner) {
 // that each phi node has an in-edge from every BB that precedes it.
 // Also validates that every value use is dominated by its def.
 bool CheckPhis(IRProgram* program, ErrorCollector* collector) {
-    // Find all predecessors for each BB.
-    map<IRBB*, set<IRBB*>> preds;
+    // Find all predecessors for each BB, in program order so that
+    // diagnostics list them stably.
+    map<IRBB*, vector<IRBB*>> preds;
     for (auto& bb : program->bbs) {
         for (auto* succ : bb->Succs()) {
-            preds[succ].insert(bb.get());
+            auto& succ_preds = preds[succ];
+            if (find(succ_preds.begin(), succ_preds.end(), bb.get()) ==
+                succ_preds.end()) {
+                succ_preds.push_back(bb.get());
+            }
         }
     }
     // Compute the domtree.
@@ -533,8 +577,8 @@ bool CheckPhis(IRProgram* program, ErrorCollector* collector) {
                         "must have one bb, %value pair for every predecessor BB.",
                         stmt->valnum, stmt->args.size()));
                 string pred_str = JoinSet<IRBB*>(
-                        expected_inputs.begin(),
-                        expected_inputs.end(),
+                        preds[bb.get()].begin(),
+                        preds[bb.get()].end(),
                         [](IRBB* bb) { return bb->label; }, ", ");
                 collector->ReportError(
                     stmt->location,
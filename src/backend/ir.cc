@@ -105,6 +105,56 @@ string IRBB::ToString() const {
     return s;
 }
 
+const char* autopiper::IRStmtOpName(IRStmtOp op) {
+    switch (op) {
+        case IRStmtOpNone:
+            return "none";
+        case IRStmtOpConst:
+            return "const";
+        case IRStmtOpAdd:
+            return "add";
+        case IRStmtOpSub:
+            return "sub";
+        case IRStmtOpMul:
+            return "mul";
+        case IRStmtOpDiv:
+            return "div";
+        case IRStmtOpRem:
+            return "rem";
+        case IRStmtOpAnd:
+            return "and";
+        case IRStmtOpOr:
+            return "or";
+        case IRStmtOpXor:
+            return "xor";
+        case IRStmtOpNot:
+            return "not";
+        case IRStmtOpLsh:
+            return "lsh";
+        case IRStmtOpRsh:
+            return "rsh";
+        case IRStmtOpBitslice:
+            return "bsl";
+        case IRStmtOpConcat:
+            return "cat";
+        case IRStmtOpSelect:
+            return "sel";
+        case IRStmtOpCmpLT:
+            return "cmplt";
+        case IRStmtOpCmpLE:
+            return "cmple";
+        case IRStmtOpCmpEQ:
+            return "cmpeq";
+        case IRStmtOpCmpNE:
+            return "cmpne";
+        case IRStmtOpCmpGT:
+            return "cmpgt";
+        case IRStmtOpCmpGE:
+            return "cmpge";
+    }
+    return "";
+}
+
 string IRStmt::ToString() const {
     ostringstream os;
 
@@ -117,52 +167,7 @@ string IRStmt::ToString() const {
     os << " = ";
     switch (type) {
         case IRStmtExpr:
-            switch (op) {
-                case IRStmtOpNone:
-                    os << "none"; break;
-                case IRStmtOpConst:
-                    os << "const"; break;
-                case IRStmtOpAdd:
-                    os << "add"; break;
-                case IRStmtOpSub:
-                    os << "sub"; break;
-                case IRStmtOpMul:
-                    os << "mul"; break;
-                case IRStmtOpDiv:
-                    os << "div"; break;
-                case IRStmtOpRem:
-                    os << "rem"; break;
-                case IRStmtOpAnd:
-                    os << "and"; break;
-                case IRStmtOpOr:
-                    os << "or"; break;
-                case IRStmtOpXor:
-                    os << "xor"; break;
-                case IRStmtOpNot:
-                    os << "not"; break;
-                case IRStmtOpLsh:
-                    os << "lsh"; break;
-                case IRStmtOpRsh:
-                    os << "rsh"; break;
-                case IRStmtOpBitslice:
-                    os << "bsl"; break;
-                case IRStmtOpConcat:
-                    os << "cat"; break;
-                case IRStmtOpSelect:
-                    os << "sel"; break;
-                case IRStmtOpCmpLT:
-                    os << "cmplt"; break;
-                case IRStmtOpCmpLE:
-                    os << "cmple"; break;
-                case IRStmtOpCmpEQ:
-                    os << "cmpeq"; break;
-                case IRStmtOpCmpNE:
-                    os << "cmpne"; break;
-                case IRStmtOpCmpGT:
-                    os << "cmpgt"; break;
-                case IRStmtOpCmpGE:
-                    os << "cmpge"; break;
-            }
+            os << IRStmtOpName(op);
             break;
         case IRStmtPhi:
             os << "phi"; break;
@@ -200,6 +205,10 @@ string IRStmt::ToString() const {
             os << "done"; break;
         case IRStmtKillIf:
             os << "killif"; break;
+        case IRStmtWait:
+            os << "wait"; break;
+        case IRStmtInstance:
+            os << "instance"; break;
         case IRStmtBypassStart:
             os << "bypassstart"; break;
         case IRStmtBypassEnd:
@@ -238,27 +247,51 @@ string IRStmt::ToString() const {
         return os.str();
     }
 
-    if (port_name != "") {
-        first = false;
-        os << '"' << port_name << '"';
-    }
+    // Special-case 'instance' to put the latency before the variable-length
+    // argument list.
+    if (type == IRStmtInstance) {
+        os << '"' << port_name << "\", " << constant;
+        for (auto arg : arg_nums) {
+            os << ", %" << arg;
+        }
+    } else if (type == IRStmtArraySize) {
+        // The size is always printed, and a ROM's contents follow it, so
+        // that the statement parses back (see ParseArraySizeAttrs()).
+        os << '"' << port_name << "\", " << constant;
+        if (!array_init.empty()) {
+            os << " [init = ";
+            for (unsigned i = 0; i < array_init.size(); i++) {
+                if (i > 0) os << ", ";
+                os << array_init[i];
+            }
+            os << "]";
+        }
+        if (array_registered) {
+            os << " [registered]";
+        }
+    } else {
+        if (port_name != "") {
+            first = false;
+            os << '"' << port_name << '"';
+        }
 
-    for (auto arg : arg_nums) {
-        if (!first) os << ", ";
-        first = false;
-        os << '%' << arg;
-    }
+        for (auto arg : arg_nums) {
+            if (!first) os << ", ";
+            first = false;
+            os << '%' << arg;
+        }
 
-    for (auto t : target_names) {
-        if (!first) os << ", ";
-        first = false;
-        os << t;
-    }
+        for (auto t : target_names) {
+            if (!first) os << ", ";
+            first = false;
+            os << t;
+        }
 
-    if (has_constant) {
-        if (!first) os << ", ";
-        first = false;
-        os << constant;
+        if (has_constant) {
+            if (!first) os << ", ";
+            first = false;
+            os << constant;
+        }
     }
 
     if (valid_in) {
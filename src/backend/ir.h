@@ -41,6 +41,20 @@ struct PipeSys;
 struct Pipe;
 struct PipeStage;
 
+// Orders IRStmts by valnum rather than by address. Every container of IRStmt
+// pointers that is iterated to produce output or new IR should use this so
+// that results do not depend on where the allocator placed each stmt.
+struct IRStmtLess {
+    bool operator()(const IRStmt* a, const IRStmt* b) const;
+};
+
+template<>
+struct PredicateFactorLess<IRStmt*> {
+    bool operator()(const IRStmt* a, const IRStmt* b) const {
+        return IRStmtLess()(a, b);
+    }
+};
+
 struct IRProgram {
     IRProgram() {
         next_valnum = 1;
@@ -66,14 +80,37 @@ struct IRProgram {
     // that crosslinking of arg valnums and targets does not occur.
     bool crosslinked_args_bbs;
 
-    static std::unique_ptr<IRProgram> Parse(const std::string& filename,
-                                            std::istream* in,
-                                            ErrorCollector* collector);
+    // Controls the parallel parse of large inputs (see ir-parser.cc).
+    struct ParseOptions {
+        // Inputs of at least twice this many bytes are split into chunks of
+        // about this size, which are parsed in parallel.
+        size_t chunk_size;
+        // Number of parser threads; 0 uses the hardware concurrency, and 1
+        // always parses serially.
+        unsigned threads;
+
+        ParseOptions() : chunk_size(1 << 20), threads(0) {}
+    };
+
+    static std::unique_ptr<IRProgram> Parse(
+            const std::string& filename, std::istream* in,
+            ErrorCollector* collector,
+            const ParseOptions& options = ParseOptions());
 
     bool Crosslink(ErrorCollector* collector);
     bool Typecheck(ErrorCollector* collector);
     std::vector<std::unique_ptr<PipeSys>> Lower(ErrorCollector* collector);
 
+    // Lower() in two halves. LowerUntimed() extracts, if-converts and
+    // flattens the pipes; nothing it does depends on the program's timing
+    // model, so its result can be checkpointed (see checkpoint.h) and re-timed
+    // many times. LowerTimed() assigns stages with |timing_model| and runs the
+    // passes that depend on stage assignment.
+    std::vector<std::unique_ptr<PipeSys>> LowerUntimed(
+            ErrorCollector* collector);
+    bool LowerTimed(std::vector<std::unique_ptr<PipeSys>>* systems,
+                    ErrorCollector* collector);
+
     // top-level entry and any spawn points
     std::vector<const IRBB*> Roots() const;
 
@@ -167,6 +204,12 @@ enum IRStmtType {
     IRStmtDone,  // txn completes
 
     IRStmtKillIf,  // kill self if a condition (first arg) is met at any downstream point.
+    IRStmtWait,  // hold this stage and all upstream stages until a condition (first arg) is met. Value is the hold signal.
+
+    // Instance of a separately-compiled pipelined module (portname is the
+    // module name, constant is its latency in stages). Args feed the module's
+    // inputs; the value is its result, available |latency| stages later.
+    IRStmtInstance,
 
     // bypass-network operations:
     IRStmtBypassStart,  // start a bypass-providing region (first arg is index, portname is bypass network name)
@@ -218,15 +261,24 @@ enum IRStmtOp {
     IRStmtOpCmpGE,
 };
 
+// The op's name in textual IR (e.g., "add", "sel", "cmplt").
+const char* IRStmtOpName(IRStmtOp op);
+
 static const int kIRStmtWidthTxnID = -2;
 
 struct IRStmt {
     IRStmt() {
         valnum = -1;
         type = IRStmtNone;
+        op = IRStmtOpNone;
         bb = NULL;
         port = NULL;
+        storage = NULL;
+        bypass = NULL;
+        pipe = NULL;
+        stage = NULL;
         port_has_default = false;
+        array_registered = false;
         dom_killyounger = NULL;
         timevar = NULL;
         restart_arg = NULL;
@@ -262,6 +314,10 @@ struct IRStmt {
     std::string port_name;
     bignum port_default;
     bool port_has_default;
+    // IRStmtArraySize: initial contents, and whether reads are registered if
+    // the array is read-only (see IRStorage).
+    std::vector<bignum> array_init;
+    bool array_registered;
 
     // Filled in during lowering/timing:
     IRStmt* dom_killyounger;  // dominated by a killyounger?
@@ -288,6 +344,10 @@ struct IRStmt {
     Location location;
 };
 
+inline bool IRStmtLess::operator()(const IRStmt* a, const IRStmt* b) const {
+    return a->valnum < b->valnum;
+}
+
 // IRPort represents either a port or a chan.
 struct IRPort {
     enum Type {
@@ -326,6 +386,7 @@ struct IRStorage {
         data_width = 0;
         index_width = 0;
         elements = 0;
+        registered = false;
     }
 
     std::string name;
@@ -333,8 +394,20 @@ struct IRStorage {
     int index_width;
     int elements;
 
+    // Initial contents of an array, by index; later elements are zero.
+    std::vector<bignum> init;
+    // For a ROM: its reads take the index from a pipeline register, so that
+    // the lookup maps to a synchronous-read memory.
+    bool registered;
+
     std::vector<IRStmt*> writers;
     std::vector<IRStmt*> readers;
+
+    // An array that is initialized and never written is a ROM: it is
+    // emitted as a module of its own, with one read port per read.
+    bool IsRom() const {
+        return index_width > 0 && writers.empty() && !init.empty();
+    }
 };
 
 struct IRBypass {
@@ -375,6 +448,7 @@ inline bool IRHasSideEffects(IRStmtType type) {
     switch (type) {
         case IRStmtExpr:
         case IRStmtPhi:
+        case IRStmtInstance:  // the submodule is a pure function of its args
             return false;
         default:
             return true;
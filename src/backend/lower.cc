@@ -19,11 +19,13 @@
 #include "backend/compiler.h"
 #include "common/util.h"
 #include "backend/rpo.h"
+#include "backend/domtree.h"
 #include "backend/predicate.h"
 #include "backend/ir-build.h"
 #include "backend/pipe-timing.h"
 
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <vector>
 #include <queue>
@@ -135,6 +137,806 @@ bool CheckChanUses(IRProgram* program,
     return true;
 }
 
+// Helpers for loop-invariant hoisting.
+
+// Is |phi| a loop-header phi whose value is the same on every iteration, i.e.,
+// whose in-loop inputs are all the phi itself? If so, returns the value coming
+// in from |preheader|.
+IRStmt* InvariantHeaderPhiValue(const IRStmt* phi,
+                                const set<const IRBB*>& body,
+                                const IRBB* preheader) {
+    IRStmt* value = nullptr;
+    for (unsigned i = 0; i < phi->args.size(); i++) {
+        if (phi->targets[i] == preheader) {
+            value = phi->args[i];
+        } else if (!body.count(phi->targets[i]) || phi->args[i] != phi) {
+            return nullptr;
+        }
+    }
+    return value;
+}
+
+// Hoist loop-invariant pure computations out of each loop body into the loop
+// preheader. Every statement in a loop body is re-evaluated on each iteration,
+// and since a backedge and its target must land in the same stage (unless a
+// killyounger intervenes), loop-body logic directly limits how much work fits
+// into one iteration.
+//
+// A value crossing into a loop cannot simply be staged down the pipe: when the
+// backedge restarts the transaction, the stages before the loop header hold a
+// younger transaction. Loop-carried values must come around through header
+// phis, as the frontend does for all bindings live into the loop. So each
+// hoisted value that is still used past the preheader gets its own header phi
+// that carries it unchanged around the backedge(s).
+//
+// Only pure expressions with nonzero delay (and chains extending them) are
+// hoisted. As in CompressAddTrees(), delays for this decision always come from
+// the standard model: the result of this pass is checkpointed before timing
+// and may be re-timed under another model. Register and array reads are left
+// in place even when nothing in the loop writes them: other transactions in
+// the pipe may write the storage between iterations.
+bool HoistLoopInvariants(IRProgram* program,
+                         PipeSys* sys,
+                         Pipe* pipe,
+                         ErrorCollector* coll) {
+    StandardTimingModel standard;
+    const TimingModel* timing_model = &standard;
+
+    BBReversePostorder rpo;
+    rpo.Compute( { pipe->entry } );
+    BBDomTree domtree;
+    domtree.Compute( { pipe->entry } );
+
+    // Find natural loops: a backedge is an edge to a block that dominates its
+    // source. Collect latches per header, in RPO.
+    vector<const IRBB*> headers;
+    map<const IRBB*, vector<const IRBB*>> latches;
+    for (auto* bb : rpo.RPO()) {
+        for (auto* succ : bb->Succs()) {
+            if (domtree.Dom(succ, bb)) {
+                if (latches[succ].empty()) {
+                    headers.push_back(succ);
+                }
+                latches[succ].push_back(bb);
+            }
+        }
+    }
+
+    // Visit innermost loops first (their headers come later in RPO), so that
+    // values hoisted into an inner preheader may be hoisted again by an
+    // enclosing loop.
+    for (auto hi = headers.rbegin(); hi != headers.rend(); ++hi) {
+        IRBB* header = const_cast<IRBB*>(*hi);
+
+        // Loop body: all blocks that reach a latch without passing through
+        // the header.
+        set<const IRBB*> body;
+        body.insert(header);
+        vector<const IRBB*> worklist = latches[header];
+        while (!worklist.empty()) {
+            const IRBB* bb = worklist.back();
+            worklist.pop_back();
+            if (!body.insert(bb).second) continue;
+            for (auto* pred : rpo.Preds(bb)) {
+                worklist.push_back(pred);
+            }
+        }
+
+        // Require a unique preheader; it then dominates the loop.
+        IRBB* preheader = nullptr;
+        bool unique = true;
+        for (auto* pred : rpo.Preds(header)) {
+            if (body.count(pred)) continue;
+            if (preheader) unique = false;
+            preheader = const_cast<IRBB*>(pred);
+        }
+        if (!preheader || !unique || preheader->stmts.empty()) continue;
+        auto& pre_stmts = preheader->stmts;
+        IRStmt* pre_term = pre_stmts.back().get();
+        if (pre_term->type != IRStmtJmp && pre_term->type != IRStmtIf) continue;
+
+        // Find invariant statements in body order. |subst| maps loop values
+        // to the equivalent value available in the preheader: invariant
+        // header phis to their incoming value, and constants to preheader
+        // clones.
+        map<IRStmt*, IRStmt*> subst;
+        set<IRStmt*> hoisted;
+        vector<IRStmt*> hoist_order;
+        for (auto* bb : rpo.RPO()) {
+            if (!body.count(bb)) continue;
+            for (auto& stmt : const_cast<IRBB*>(bb)->stmts) {
+                if (stmt->type == IRStmtPhi && bb == header) {
+                    IRStmt* value =
+                        InvariantHeaderPhiValue(stmt.get(), body, preheader);
+                    if (value) subst[stmt.get()] = value;
+                    continue;
+                }
+                if (stmt->type != IRStmtExpr || stmt->timevar ||
+                    stmt->op == IRStmtOpConst) {
+                    continue;
+                }
+                // Invariant if every arg is defined before the loop, is an
+                // invariant phi or hoisted value, or is a constant (but not
+                // if every arg is a constant: such logic costs nothing to
+                // recompute, while carrying it would cost a register).
+                bool invariant = true, all_const = true;
+                bool extends_hoisted = false;
+                for (auto* arg : stmt->args) {
+                    if (arg->type == IRStmtExpr &&
+                        arg->op == IRStmtOpConst) {
+                        continue;
+                    }
+                    all_const = false;
+                    if (hoisted.count(arg)) {
+                        extends_hoisted = true;
+                    } else if (body.count(arg->bb) && !subst.count(arg)) {
+                        invariant = false;
+                        break;
+                    }
+                }
+                if (!invariant || all_const) continue;
+                // Only logic with delay is worth hoisting, unless it extends
+                // an already-hoisted chain (in which case it costs nothing
+                // extra to carry its result instead).
+                if (timing_model->Delay(stmt.get()) == 0 && !extends_hoisted) {
+                    continue;
+                }
+                hoisted.insert(stmt.get());
+                hoist_order.push_back(stmt.get());
+            }
+        }
+        if (hoist_order.empty()) continue;
+
+        // Move the invariant statements to the end of the preheader, just
+        // before its terminator, rewriting their args to preheader values.
+        vector<unique_ptr<IRStmt>> moved;
+        for (auto* stmt : hoist_order) {
+            for (unsigned i = 0; i < stmt->args.size(); i++) {
+                IRStmt* arg = stmt->args[i];
+                if (body.count(arg->bb) && !hoisted.count(arg) &&
+                    !subst.count(arg)) {
+                    // A constant in the loop body: clone it.
+                    IRStmt* clone = new IRStmt(*arg);
+                    clone->valnum = program->GetValnum();
+                    clone->bb = preheader;
+                    moved.emplace_back(clone);
+                    subst[arg] = clone;
+                }
+                if (subst.count(arg)) {
+                    stmt->args[i] = subst[arg];
+                    stmt->arg_nums[i] = stmt->args[i]->valnum;
+                }
+            }
+            auto& stmts = stmt->bb->stmts;
+            for (auto it = stmts.begin(); it != stmts.end(); ++it) {
+                if (it->get() == stmt) {
+                    moved.push_back(move(*it));
+                    stmts.erase(it);
+                    break;
+                }
+            }
+            stmt->bb = preheader;
+        }
+        unique_ptr<IRStmt> term = move(pre_stmts.back());
+        pre_stmts.pop_back();
+        for (auto& stmt : moved) {
+            pre_stmts.push_back(move(stmt));
+        }
+        pre_stmts.push_back(move(term));
+
+        // Carry each hoisted value that is used outside the preheader around
+        // the loop with a header phi, and redirect those uses to the phi.
+        map<IRStmt*, IRStmt*> carried;
+        for (auto* bb : pipe->bbs) {
+            if (bb == preheader) continue;
+            for (auto& stmt : bb->stmts) {
+                for (auto* arg : stmt->args) {
+                    if (hoisted.count(arg)) carried[arg] = nullptr;
+                }
+            }
+        }
+        for (auto* stmt : hoist_order) {
+            if (!carried.count(stmt)) continue;
+            IRStmt* phi = PrependOwnedToVector(header->stmts, new IRStmt());
+            phi->valnum = program->GetValnum();
+            phi->type = IRStmtPhi;
+            phi->width = stmt->width;
+            phi->bb = header;
+            phi->location = stmt->location;
+            for (auto* pred : rpo.Preds(header)) {
+                IRStmt* value = (pred == preheader) ? stmt : phi;
+                phi->args.push_back(value);
+                phi->arg_nums.push_back(value->valnum);
+                phi->targets.push_back(const_cast<IRBB*>(pred));
+                phi->target_names.push_back(pred->label);
+            }
+            carried[stmt] = phi;
+        }
+        for (auto* bb : pipe->bbs) {
+            if (bb == preheader) continue;
+            for (auto& stmt : bb->stmts) {
+                for (unsigned i = 0; i < stmt->args.size(); i++) {
+                    // (A carrying phi keeps its own preheader input.)
+                    auto it = carried.find(stmt->args[i]);
+                    if (it != carried.end() && it->second != stmt.get()) {
+                        stmt->args[i] = it->second;
+                        stmt->arg_nums[i] = it->second->valnum;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool IsAddSub(const IRStmt* stmt) {
+    return stmt->type == IRStmtExpr &&
+           (stmt->op == IRStmtOpAdd || stmt->op == IRStmtOpSub);
+}
+
+// New statements for the carry-save form of one add tree. They are only
+// numbered and inserted into the tree's BB if the result is faster than the
+// original tree.
+struct CarrySaveTree {
+    const TimingModel* model;
+    IRStmt* root;
+    // Arrival times (cumulative delay within the BB) of existing values, and
+    // of the new statements.
+    const map<const IRStmt*, int>* arrival;
+    map<const IRStmt*, int> new_arrival;
+    vector<unique_ptr<IRStmt>> stmts;
+
+    int Arrival(const IRStmt* stmt) const {
+        auto it = new_arrival.find(stmt);
+        if (it != new_arrival.end()) return it->second;
+        it = arrival->find(stmt);
+        return (it != arrival->end()) ? it->second : 0;
+    }
+
+    IRStmt* New(IRStmtOp op, const vector<IRStmt*>& args) {
+        IRStmt* stmt = new IRStmt();
+        stmts.emplace_back(stmt);
+        stmt->type = IRStmtExpr;
+        stmt->op = op;
+        stmt->width = root->width;
+        stmt->bb = root->bb;
+        stmt->location = root->location;
+        stmt->args = args;
+        int t = 0;
+        for (auto* arg : args) {
+            t = max(t, Arrival(arg));
+        }
+        new_arrival[stmt] = t + model->Delay(stmt);
+        return stmt;
+    }
+
+    IRStmt* Const(const bignum& value) {
+        IRStmt* stmt = New(IRStmtOpConst, {});
+        stmt->constant = value;
+        stmt->has_constant = true;
+        return stmt;
+    }
+};
+
+// Collect the addends of the add tree below |node|: each arg that is itself an
+// add or subtract used only by |node| is part of the tree (an |interior| node);
+// anything else is a leaf, negated if it is subtracted an odd number of times.
+// The walk keeps its own stack, as a long chain of adds is as deep as it is
+// long.
+void CollectAddends(IRStmt* root,
+                    const map<const IRStmt*, int>& uses,
+                    vector<pair<IRStmt*, bool>>* leaves,
+                    vector<IRStmt*>* interior) {
+    // (node, negated) pairs still to visit, with the next one on top.
+    vector<pair<IRStmt*, bool>> stack;
+    for (unsigned i = root->args.size(); i > 0; i--) {
+        stack.push_back(make_pair(root->args[i - 1],
+                                  root->op == IRStmtOpSub && i == 2));
+    }
+    while (!stack.empty()) {
+        IRStmt* node = stack.back().first;
+        bool negate = stack.back().second;
+        stack.pop_back();
+        if (IsAddSub(node) && node->bb == root->bb &&
+            node->width == root->width && !node->timevar &&
+            uses.at(node) == 1) {
+            interior->push_back(node);
+            for (unsigned i = node->args.size(); i > 0; i--) {
+                bool neg = negate != (node->op == IRStmtOpSub && i == 2);
+                stack.push_back(make_pair(node->args[i - 1], neg));
+            }
+        } else {
+            leaves->push_back(make_pair(node, negate));
+        }
+    }
+}
+
+// Rewrite multi-operand add/subtract trees (a + b - c + d ...) as carry-save
+// trees of 3:2 compressors with a single carry-propagate add at the root. The
+// frontend emits such expressions as chains of two-input adds, each paying a
+// full carry-propagate delay; a compressor level costs only a full adder's
+// delay regardless of width. (A 4:2 compressor is two 3:2 levels here.)
+//
+// Each compressor takes the three earliest-arriving operands, so late inputs
+// enter the tree as close to the root as possible. Subtracted operands are
+// inverted, with the +1 of each negation folded into a single constant
+// operand along with any constant addends. All arithmetic is modulo 2^width,
+// as the original adds were. Sums of products are not fused: a multiply is
+// an ordinary leaf, and its partial products are not merged into the tree.
+//
+// A tree is rewritten only if it is faster in carry-save form. Delays for
+// this decision always come from the standard model, whatever model the
+// program selects: the result of this pass is checkpointed before timing and
+// may be re-timed under another model (see LowerUntimed()).
+bool CompressAddTrees(IRProgram* program,
+                      PipeSys* sys,
+                      Pipe* pipe,
+                      ErrorCollector* coll) {
+    StandardTimingModel standard;
+    const TimingModel* timing_model = &standard;
+
+    // Count uses across the whole system: values may flow between its pipes'
+    // BBs through phis.
+    map<const IRStmt*, int> uses;
+    map<const IRStmt*, IRStmt*> user;
+    for (auto& p : sys->pipes) {
+        for (auto* bb : p->bbs) {
+            for (auto& stmt : bb->stmts) {
+                uses[stmt.get()];
+                for (auto* arg : stmt->args) {
+                    uses[arg]++;
+                    user[arg] = stmt.get();
+                }
+            }
+        }
+    }
+
+    for (auto* bb : pipe->bbs) {
+        map<const IRStmt*, int> arrival;
+        for (auto& stmt : bb->stmts) {
+            int t = 0;
+            for (auto* arg : stmt->args) {
+                if (arg->bb == bb) t = max(t, arrival[arg]);
+            }
+            arrival[stmt.get()] = t + timing_model->Delay(stmt.get());
+        }
+
+        // Find tree roots in BB order: adds and subtracts that are not part
+        // of a larger tree. A root may be a leaf of a later tree, which then
+        // sees its rewritten form.
+        vector<IRStmt*> roots;
+        for (auto& stmt : bb->stmts) {
+            IRStmt* s = stmt.get();
+            if (!IsAddSub(s) || s->width < 2) continue;
+            IRStmt* parent = (uses[s] == 1) ? user[s] : nullptr;
+            if (parent && IsAddSub(parent) && parent->bb == bb &&
+                parent->width == s->width && !s->timevar) {
+                continue;
+            }
+            roots.push_back(s);
+        }
+
+        // Compressors to insert just before each rewritten root, and the
+        // interior nodes of the original trees. The BB is rebuilt once, after
+        // all of its trees are rewritten.
+        map<const IRStmt*, vector<unique_ptr<IRStmt>>> inserted;
+        set<const IRStmt*> dropped;
+
+        for (auto* root : roots) {
+            vector<pair<IRStmt*, bool>> leaves;
+            vector<IRStmt*> interior;
+            CollectAddends(root, uses, &leaves, &interior);
+            if (leaves.size() < 3) continue;
+
+            CarrySaveTree tree;
+            tree.model = timing_model;
+            tree.root = root;
+            tree.arrival = &arrival;
+
+            bignum modulus = bignum(1) << root->width;
+            bignum constant = 0;
+            vector<IRStmt*> operands;
+            for (auto& leaf : leaves) {
+                IRStmt* value = leaf.first;
+                bool neg = leaf.second;
+                if (value->type == IRStmtExpr && value->op == IRStmtOpConst) {
+                    if (neg) {
+                        constant -= value->constant;
+                    } else {
+                        constant += value->constant;
+                    }
+                } else if (neg) {
+                    // -x == ~x + 1
+                    operands.push_back(tree.New(IRStmtOpNot, { value }));
+                    constant += 1;
+                } else {
+                    operands.push_back(value);
+                }
+            }
+            constant = ((constant % modulus) + modulus) % modulus;
+            if (constant != 0) {
+                operands.push_back(tree.Const(constant));
+            }
+            if (operands.size() < 3) continue;
+
+            // Operands not yet compressed, earliest arrival first. Ties go to
+            // the operand that was added first.
+            typedef pair<pair<int, unsigned>, IRStmt*> PendingOperand;
+            priority_queue<PendingOperand, vector<PendingOperand>,
+                           greater<PendingOperand>> pending;
+            unsigned added = 0;
+            auto add_operand = [&](IRStmt* stmt) {
+                pending.push(make_pair(make_pair(tree.Arrival(stmt), added++),
+                                       stmt));
+            };
+            for (auto* operand : operands) {
+                add_operand(operand);
+            }
+            auto take_operand = [&]() {
+                IRStmt* stmt = pending.top().second;
+                pending.pop();
+                return stmt;
+            };
+            while (pending.size() > 2) {
+                IRStmt* a = take_operand();
+                IRStmt* b = take_operand();
+                IRStmt* c = take_operand();
+                // sum = a ^ b ^ c; carry = majority(a, b, c) << 1
+                IRStmt* ab = tree.New(IRStmtOpXor, { a, b });
+                IRStmt* sum = tree.New(IRStmtOpXor, { ab, c });
+                IRStmt* majority =
+                    tree.New(IRStmtOpOr, {
+                        tree.New(IRStmtOpAnd, { a, b }),
+                        tree.New(IRStmtOpAnd, { c, ab }) });
+                IRStmt* carry =
+                    tree.New(IRStmtOpLsh, { majority, tree.Const(1) });
+                add_operand(sum);
+                add_operand(carry);
+                operands = { sum, carry };
+            }
+            IRStmt* final_add = tree.New(IRStmtOpAdd, operands);
+            if (tree.Arrival(final_add) >= arrival[root]) continue;
+
+            // The compressors go just before the root, which becomes the
+            // final add (keeping its valnum and uses); the interior nodes of
+            // the original tree are dropped.
+            auto& created = inserted[root];
+            for (auto& stmt : tree.stmts) {
+                if (stmt.get() == final_add) continue;
+                stmt->valnum = program->GetValnum();
+                for (auto* arg : stmt->args) {
+                    stmt->arg_nums.push_back(arg->valnum);
+                }
+                arrival[stmt.get()] = tree.Arrival(stmt.get());
+                created.push_back(move(stmt));
+            }
+            root->op = IRStmtOpAdd;
+            root->args = final_add->args;
+            root->arg_nums.clear();
+            for (auto* arg : root->args) {
+                root->arg_nums.push_back(arg->valnum);
+            }
+            arrival[root] = tree.Arrival(final_add);
+            dropped.insert(interior.begin(), interior.end());
+        }
+
+        if (inserted.empty()) continue;
+        vector<unique_ptr<IRStmt>> stmts;
+        for (auto& stmt : bb->stmts) {
+            if (dropped.count(stmt.get())) continue;
+            auto it = inserted.find(stmt.get());
+            if (it != inserted.end()) {
+                for (auto& created : it->second) {
+                    stmts.push_back(move(created));
+                }
+            }
+            stmts.push_back(move(stmt));
+        }
+        bb->stmts.swap(stmts);
+    }
+
+    return true;
+}
+
+// One write of an accumulator: |write| stores |read| + |addend| (or |read| -
+// |addend|), where |read| reads the same reg.
+struct AccumulatorWrite {
+    IRStmt* write;
+    IRStmt* read;
+    IRStmt* addend;
+    bool subtract;
+};
+
+// Returns true and fills in |acc| if |write| is a reg write of r + x, x + r or
+// r - x, for a read r of the reg it writes.
+bool MatchAccumulatorWrite(IRStmt* write, AccumulatorWrite* acc) {
+    IRStmt* value = write->args[0];
+    if (value->type != IRStmtExpr || value->args.size() != 2 ||
+        value->width != write->storage->data_width ||
+        (value->op != IRStmtOpAdd && value->op != IRStmtOpSub)) {
+        return false;
+    }
+    auto is_read = [write](const IRStmt* s) {
+        return s->type == IRStmtRegRead && s->storage == write->storage;
+    };
+    acc->write = write;
+    acc->subtract = (value->op == IRStmtOpSub);
+    if (is_read(value->args[0])) {
+        acc->read = value->args[0];
+        acc->addend = value->args[1];
+        return true;
+    }
+    if (!acc->subtract && is_read(value->args[1])) {
+        acc->read = value->args[1];
+        acc->addend = value->args[0];
+        return true;
+    }
+    return false;
+}
+
+// Keep accumulator regs in carry-save form. A reg updated as r = r + x (or
+// r - x) has a feedback loop through a carry-propagate add, from the reg's
+// read back to its write, that pipelining cannot break and whose delay grows
+// with the reg's width. Such a reg is instead held as two regs, its sum and
+// its carries, whose total is its value. An accumulating write then needs
+// only a 3:2 compressor (a full adder's delay at any width) to fold x into
+// the pair; the carries are added in only where the reg is read for other
+// uses, outside of the loop, where the add can be timed and pipelined like
+// any other.
+//
+// For a reg r with at least one accumulating write:
+//
+//   v = regread r           ==>  s = regread r; c = regread r_carry;
+//                                v = add s, c
+//   regwrite r, add v, x    ==>  x' = x (or ~x to subtract)
+//                                regwrite r, s ^ c ^ x'
+//                                regwrite r_carry,
+//                                  (majority(s, c, x') << 1) (| 1 to subtract)
+//   regwrite r, y           ==>  regwrite r, y; regwrite r_carry, 0
+//
+// Each read pair, and each write pair, is tied to one stage with a time
+// variable, so that the two halves always belong to the same cycle. Regs read
+// by a wait condition are left alone, as those reads are tied to the wait's
+// stage instead (see ConstrainWaits()), as are regs whose updated total is
+// also used directly.
+bool DeferAccumulatorCarries(IRProgram* program, ErrorCollector* coll) {
+    map<const IRStmt*, int> uses;
+    vector<IRStmt*> waits;
+    for (auto& bb : program->bbs) {
+        for (auto& stmt : bb->stmts) {
+            uses[stmt.get()];
+            for (auto* arg : stmt->args) {
+                uses[arg]++;
+            }
+            if (stmt->type == IRStmtWait) {
+                waits.push_back(stmt.get());
+            }
+        }
+    }
+
+    set<const IRStorage*> waited_on;
+    for (auto* wait : waits) {
+        set<IRStmt*> seen;
+        vector<IRStmt*> worklist = wait->args;
+        while (!worklist.empty()) {
+            IRStmt* s = worklist.back();
+            worklist.pop_back();
+            if (!seen.insert(s).second) continue;
+            if (s->type == IRStmtExpr) {
+                worklist.insert(worklist.end(), s->args.begin(), s->args.end());
+            } else if (s->type == IRStmtRegRead) {
+                waited_on.insert(s->storage);
+            }
+        }
+    }
+
+    auto insert = [](IRStmt* pos, IRStmt* stmt, bool after) {
+        auto& stmts = pos->bb->stmts;
+        for (auto it = stmts.begin(); it != stmts.end(); ++it) {
+            if (it->get() == pos) {
+                stmt->bb = pos->bb;
+                stmts.emplace(after ? it + 1 : it, stmt);
+                return;
+            }
+        }
+        assert(false);
+    };
+    auto erase = [](IRStmt* stmt) {
+        auto& stmts = stmt->bb->stmts;
+        for (auto it = stmts.begin(); it != stmts.end(); ++it) {
+            if (it->get() == stmt) {
+                stmts.erase(it);
+                return;
+            }
+        }
+    };
+    auto new_stmt = [program](IRStmtType type, IRStmtOp op, int width,
+                              const vector<IRStmt*>& args,
+                              const IRStmt* near) {
+        IRStmt* stmt = new IRStmt();
+        stmt->valnum = program->GetValnum();
+        stmt->type = type;
+        stmt->op = op;
+        stmt->width = width;
+        stmt->location = near->location;
+        stmt->args = args;
+        for (auto* arg : args) {
+            stmt->arg_nums.push_back(arg->valnum);
+        }
+        return stmt;
+    };
+    auto pin = [program](IRStmt* a, IRStmt* b, const char* what) {
+        if (!a->timevar) {
+            a->timevar = program->GetTimeVar();
+            a->timevar->name = strprintf("__accum_%s_timevar_%d", what,
+                                         a->valnum);
+            a->time_offset = 0;
+        }
+        b->timevar = a->timevar;
+        b->time_offset = a->time_offset;
+    };
+
+    // Storage is appended to below; visit only the regs that exist now.
+    size_t num_storage = program->storage.size();
+    for (size_t i = 0; i < num_storage; i++) {
+        IRStorage* reg = program->storage[i].get();
+        if (reg->index_width != 0 || reg->data_width < 2 ||
+            waited_on.count(reg)) {
+            continue;
+        }
+        bool plain = true;
+        for (auto* s : reg->readers) {
+            if (s->type != IRStmtRegRead) plain = false;
+        }
+        for (auto* s : reg->writers) {
+            if (s->type != IRStmtRegWrite) plain = false;
+        }
+        if (!plain) continue;
+        // If an updated total is used other than by its write, that use
+        // still needs the carry-propagate add, now after a second one that
+        // recombines the read: leave such regs alone.
+        map<IRStmt*, AccumulatorWrite> accs;
+        bool profitable = true;
+        for (auto* write : reg->writers) {
+            AccumulatorWrite acc;
+            if (MatchAccumulatorWrite(write, &acc)) {
+                accs[write] = acc;
+                if (uses[write->args[0]] != 1) profitable = false;
+            }
+        }
+        if (accs.empty() || !profitable) continue;
+
+        int width = reg->data_width;
+        string carry_name = reg->name + "_carry";
+        for (bool unique = false; !unique;) {
+            unique = true;
+            for (auto& s : program->storage) {
+                if (s->name == carry_name) {
+                    unique = false;
+                    carry_name += "_";
+                    break;
+                }
+            }
+        }
+        IRStorage* carry = new IRStorage();
+        program->storage.emplace_back(carry);
+        carry->name = carry_name;
+        carry->data_width = width;
+        carry->index_width = reg->index_width;
+        carry->elements = reg->elements;
+
+        // Split each read into a sum read and a carry read.
+        map<IRStmt*, pair<IRStmt*, IRStmt*>> halves;
+        vector<IRStmt*> readers;
+        for (auto* read : reg->readers) {
+            IRStmt* sum = new_stmt(IRStmtRegRead, IRStmtOpNone, width, {},
+                                   read);
+            sum->port_name = reg->name;
+            sum->storage = reg;
+            IRStmt* carries = new_stmt(IRStmtRegRead, IRStmtOpNone, width,
+                                       {}, read);
+            carries->port_name = carry->name;
+            carries->storage = carry;
+            insert(read, sum, false);
+            insert(read, carries, false);
+            if (read->timevar) {
+                pin(read, sum, "read");
+            }
+            pin(sum, carries, "read");
+            readers.push_back(sum);
+            carry->readers.push_back(carries);
+            halves[read] = make_pair(sum, carries);
+
+            read->type = IRStmtExpr;
+            read->op = IRStmtOpAdd;
+            read->port_name = "";
+            read->storage = nullptr;
+            read->args = { sum, carries };
+            read->arg_nums = { sum->valnum, carries->valnum };
+            uses[sum] = 1;
+            uses[carries] = 1;
+        }
+        reg->readers = readers;
+
+        for (auto* write : reg->writers) {
+            IRStmt* carry_value = nullptr;
+            auto it = accs.find(write);
+            if (it == accs.end()) {
+                carry_value = new_stmt(IRStmtExpr, IRStmtOpConst, width, {},
+                                       write);
+                carry_value->constant = 0;
+                carry_value->has_constant = true;
+                insert(write, carry_value, false);
+            } else {
+                const AccumulatorWrite& acc = it->second;
+                IRStmt* s = halves[acc.read].first;
+                IRStmt* c = halves[acc.read].second;
+                IRStmt* x = acc.addend;
+                vector<IRStmt*> created;
+                auto op = [&](IRStmtOp op, const vector<IRStmt*>& args) {
+                    created.push_back(new_stmt(IRStmtExpr, op, width, args,
+                                               write));
+                    return created.back();
+                };
+                auto constant = [&](int value) {
+                    IRStmt* k = op(IRStmtOpConst, {});
+                    k->constant = value;
+                    k->has_constant = true;
+                    return k;
+                };
+                if (acc.subtract) {
+                    // r - x == r + ~x + 1; the +1 is the carry-in, the free
+                    // lsb of the shifted carries.
+                    x = op(IRStmtOpNot, { x });
+                }
+                IRStmt* sc = op(IRStmtOpXor, { s, c });
+                IRStmt* sum = op(IRStmtOpXor, { sc, x });
+                IRStmt* majority =
+                    op(IRStmtOpOr, { op(IRStmtOpAnd, { s, c }),
+                                     op(IRStmtOpAnd, { x, sc }) });
+                carry_value = op(IRStmtOpLsh, { majority, constant(1) });
+                if (acc.subtract) {
+                    carry_value = op(IRStmtOpOr,
+                                     { carry_value, constant(1) });
+                }
+                for (auto* stmt : created) {
+                    insert(write, stmt, false);
+                }
+                uses[s]++;
+                uses[c]++;
+
+                IRStmt* old_value = write->args[0];
+                write->args[0] = sum;
+                write->arg_nums[0] = sum->valnum;
+                if (--uses[old_value] == 0) {
+                    for (auto* arg : old_value->args) {
+                        uses[arg]--;
+                    }
+                    erase(old_value);
+                }
+            }
+
+            IRStmt* carry_write = new_stmt(IRStmtRegWrite, IRStmtOpNone,
+                                           width, { carry_value }, write);
+            carry_write->port_name = carry->name;
+            carry_write->storage = carry;
+            insert(write, carry_write, true);
+            pin(write, carry_write, "write");
+            carry->writers.push_back(carry_write);
+        }
+
+        // Reads whose only use was an accumulating write are now dead.
+        for (auto& h : halves) {
+            if (uses[h.first] == 0) {
+                erase(h.first);
+            }
+        }
+    }
+
+    return true;
+}
+
 bool ComputeKillyoungerDom(IRProgram* program,
                            PipeSys* sys,
                            Pipe* pipe,
@@ -415,10 +1217,22 @@ IRStmt* BuildMuxTree(IRBBBuilder* builder,
 
     assert(stmt->args.size() > 0);
     
-    // Compute pairs of (predicate, value) MUX inputs.
+    // Compute pairs of (predicate, value) MUX inputs. Each input is selected
+    // by the predicate on its in-edge, not by its value's own valid: a value
+    // defined in a block that branches to the phi along several paths (e.g.
+    // a loop header that falls through to the footer or enters the body) is
+    // valid on all of them.
     vector<pair<Predicate<IRStmt*>, IRStmt*>> inputs;
     for (unsigned i = 0; i < stmt->args.size(); i++) {
         Predicate<IRStmt*> pred_val = stmt->args[i]->valid_out_pred;
+        if (i < stmt->targets.size() && stmt->targets[i]) {
+            const IRBB* in_bb = stmt->targets[i];
+            int which_succ = in_bb->WhichSucc(stmt->bb);
+            if (which_succ >= 0 &&
+                which_succ < static_cast<int>(in_bb->out_preds.size())) {
+                pred_val = in_bb->out_preds[which_succ];
+            }
+        }
         // Sometimes predicate joins are smart enough to figure out that a
         // certain BB is unreachable...
         if (pred_val.IsFalse()) continue;
@@ -440,22 +1254,25 @@ IRStmt* BuildMuxTree(IRBBBuilder* builder,
                 // at the same place, the one from a later pipestage must also
                 // be 'killyounger', which will qualify/gate out the earlier
                 // backedge predicate).
-                Predicate<IRStmt*> sel_pred;
+                unsigned sel;
                 if (inputs[i].first.IsBackedge())
-                    sel_pred = inputs[i].first;
+                    sel = i;
                 else if (inputs[i+1].first.IsBackedge())
-                    sel_pred = inputs[i+1].first;
+                    sel = i + 1;
                 else if (inputs[i].first.IsTrue())
-                    sel_pred = inputs[i+1].first;
+                    sel = i + 1;
                 else
-                    sel_pred = inputs[i].first;
+                    sel = i;
+                unsigned other = (sel == i) ? i + 1 : i;
                 Predicate<IRStmt*> joined_pred = inputs[i].first.OrWith(inputs[i+1].first); // predicate on output
-                IRStmt* sel_input = memo->GetPredStmt(builder, stmt->bb, sel_pred);
+                IRStmt* sel_input = memo->GetPredStmt(builder, stmt->bb,
+                                                      inputs[sel].first);
                 assert(sel_input != nullptr);
+                // The MUX passes the selected input when its predicate holds.
                 IRStmt* mux = builder->AddExpr(IRStmtOpSelect,
                                                { sel_input,
-                                                 inputs[i].second,
-                                                 inputs[i+1].second });
+                                                 inputs[sel].second,
+                                                 inputs[other].second });
                 next.push_back(make_pair(joined_pred, mux));
             }
         }
@@ -476,6 +1293,37 @@ IRStmt* FindReplacement(
     return FindReplacement(replacements, i->second);
 }
 
+// Rewrites the factors of |pred| using replaced IRStmts, so that predicates
+// kept on BBs and stmts do not refer to stmts that are about to be deleted.
+Predicate<IRStmt*> ReplacePredFactors(
+        map<const IRStmt*, IRStmt*>& replacements,
+        const Predicate<IRStmt*>& pred) {
+    Predicate<IRStmt*> result = Predicate<IRStmt*>::False();
+    for (auto& term : pred.Terms()) {
+        Predicate<IRStmt*> t = Predicate<IRStmt*>::True();
+        for (auto& factor : term.Factors()) {
+            t = t.AndWith(FindReplacement(replacements, factor.first),
+                          factor.second);
+        }
+        result = result.OrWith(t);
+    }
+    if (pred.IsBackedge()) result.SetBackedge();
+    return result;
+}
+
+// Qualify |pred| by a boolean condition. Constant conditions are folded so that
+// edges that are never taken (e.g., the exit test of the loop that wraps an
+// inlined function body) get a 'false' predicate rather than a live signal.
+static Predicate<IRStmt*> AndWithCondition(
+        const Predicate<IRStmt*>& pred, IRStmt* cond, bool polarity) {
+    if (cond->type == IRStmtExpr && cond->op == IRStmtOpConst &&
+        cond->has_constant) {
+        bool value = cond->constant != 0;
+        return (value == polarity) ? pred : Predicate<IRStmt*>::False();
+    }
+    return pred.AndWith(cond, polarity);
+}
+
 // Perform if-conversion on statements, and place them in the statement list.
 bool IfConvert(IRProgram* program,
                PipeSys* sys,
@@ -486,6 +1334,7 @@ bool IfConvert(IRProgram* program,
     // statement propagates its input valid to its output valid, except:
     // - If statements add a condition to each side of the branch.
     // - Kill statements set valid to false.
+    // - Wait statements add their condition.
     //
     // At merge points (joins), predicates are OR'd together.
     //
@@ -565,8 +1414,13 @@ bool IfConvert(IRProgram* program,
                 // pipe timing occurs, to create the "continuous monitoring"
                 // semantics. Here we just need to create a predicate that is
                 // gated by the inverse of its arg.
-                stmt->valid_out_pred =
-                    stmt->valid_in_pred.AndWith(stmt->args[0], false);
+                stmt->valid_out_pred = AndWithCondition(
+                    stmt->valid_in_pred, stmt->args[0], false);
+            } else if (stmt->type == IRStmtWait) {
+                // A wait lets the txn proceed only once its condition holds;
+                // until then, AssignHolds() holds it in place.
+                stmt->valid_out_pred = AndWithCondition(
+                    stmt->valid_in_pred, stmt->args[0], true);
             } else {
                 stmt->valid_out_pred = stmt->valid_in_pred;
             }
@@ -579,10 +1433,10 @@ bool IfConvert(IRProgram* program,
             if (succ->type == IRStmtJmp) {
                 bb->out_preds.push_back(succ->valid_out_pred);
             } else if (succ->type == IRStmtIf) {
-                bb->out_preds.push_back(
-                        succ->valid_out_pred.AndWith(succ->args[0], true));
-                bb->out_preds.push_back(
-                        succ->valid_out_pred.AndWith(succ->args[0], false));
+                bb->out_preds.push_back(AndWithCondition(
+                        succ->valid_out_pred, succ->args[0], true));
+                bb->out_preds.push_back(AndWithCondition(
+                        succ->valid_out_pred, succ->args[0], false));
             }
         }
     }
@@ -649,13 +1503,21 @@ bool IfConvert(IRProgram* program,
         }
         builder->PrependToBB();
     }
-    // Rewrite args using replaced IRStmts.
+    // Rewrite args and predicates using replaced IRStmts.
     for (auto& bb : pipe->bbs) {
+        bb->in_pred = ReplacePredFactors(replacements, bb->in_pred);
+        for (auto& out_pred : bb->out_preds) {
+            out_pred = ReplacePredFactors(replacements, out_pred);
+        }
         for (auto& stmt : bb->stmts) {
             for (unsigned i = 0; i < stmt->args.size(); i++) {
                 stmt->args[i] = FindReplacement(replacements, stmt->args[i]);
                 stmt->arg_nums[i] = stmt->args[i]->valnum;
             }
+            stmt->valid_in_pred =
+                ReplacePredFactors(replacements, stmt->valid_in_pred);
+            stmt->valid_out_pred =
+                ReplacePredFactors(replacements, stmt->valid_out_pred);
         }
     }
 
@@ -673,11 +1535,168 @@ bool IfConvert(IRProgram* program,
     return true;
 }
 
-// Produce a side-effect-dep graph from the CFG before we lose it: each
-// side-effecting op depends either on the previous side-effecting op in its
-// same BB, if it's not the first; or if it is the first, then on the last
-// side-effecting op in each in-edge. We do this with a simple forward pass in
-// reverse postorder.
+// Returns the port, storage element or bypass network that a side-effecting
+// op accesses, or nullptr if the op is a global barrier (kills, spawns, timing
+// barriers, backedges, ...) that must be ordered against all side effects.
+const void* SideEffectResource(const IRStmt* stmt) {
+    switch (stmt->type) {
+        case IRStmtPortRead:
+        case IRStmtPortWrite:
+        case IRStmtChanRead:
+        case IRStmtChanWrite:
+        case IRStmtPortExport:
+            return stmt->port;
+        case IRStmtRegRead:
+        case IRStmtRegWrite:
+        case IRStmtArrayRead:
+        case IRStmtArrayWrite:
+        case IRStmtArraySize:
+            return stmt->storage;
+        case IRStmtBypassStart:
+        case IRStmtBypassEnd:
+        case IRStmtBypassWrite:
+        case IRStmtBypassPresent:
+        case IRStmtBypassReady:
+        case IRStmtBypassRead:
+            return stmt->bypass;
+        default:
+            return nullptr;
+    }
+}
+
+// Does the op only observe its resource? Reads of the same resource need not
+// be ordered with respect to each other, only with respect to writes. All
+// bypass-network ops are treated as writes, i.e., kept in program order.
+bool SideEffectIsRead(const IRStmt* stmt) {
+    switch (stmt->type) {
+        case IRStmtPortRead:
+        case IRStmtChanRead:
+        case IRStmtPortExport:
+        case IRStmtRegRead:
+        case IRStmtArrayRead:
+        case IRStmtArraySize:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Bypass networks carry no link to the storage they shadow, but a register
+// file read and the bypass query that may override it rely on their relative
+// order. Pseudo-resource that keeps every bypass op in program order with
+// respect to every storage access (bypass ops act as its writes, storage
+// accesses as its reads, so storage accesses still reorder among themselves).
+const char kBypassStorageOrder = 0;
+
+const void* SideEffectOrderKey(const IRStmt* stmt) {
+    switch (stmt->type) {
+        case IRStmtRegRead:
+        case IRStmtRegWrite:
+        case IRStmtArrayRead:
+        case IRStmtArrayWrite:
+        case IRStmtArraySize:
+        case IRStmtBypassStart:
+        case IRStmtBypassEnd:
+        case IRStmtBypassWrite:
+        case IRStmtBypassPresent:
+        case IRStmtBypassReady:
+        case IRStmtBypassRead:
+            return &kBypassStorageOrder;
+        default:
+            return nullptr;
+    }
+}
+
+void AppendUnique(vector<IRStmt*>* dest, const vector<IRStmt*>& src) {
+    for (auto* stmt : src) {
+        if (find(dest->begin(), dest->end(), stmt) == dest->end()) {
+            dest->push_back(stmt);
+        }
+    }
+}
+
+// Side-effect ordering state at a point in the CFG. Each resource's accesses
+// are ordered among themselves; global barriers are ordered against
+// everything. Sets rather than single stmts because paths merge.
+struct SideEffectFrontier {
+    struct Resource {
+        vector<IRStmt*> last_writes;  // writes (or barriers) to order after
+        vector<IRStmt*> reads;        // reads since |last_writes|
+    };
+
+    vector<IRStmt*> barriers;       // last global barriers
+    vector<IRStmt*> since_barrier;  // all accesses since |barriers|
+    map<const void*, Resource> resources;  // resources touched since barrier
+
+    // Merge in the state at the end of a predecessor. A resource untouched on
+    // some path is ordered only by that path's barriers.
+    void Merge(const SideEffectFrontier& other) {
+        for (auto& p : resources) {
+            if (!other.resources.count(p.first)) {
+                AppendUnique(&p.second.last_writes, other.barriers);
+            }
+        }
+        for (auto& p : other.resources) {
+            auto it = resources.find(p.first);
+            if (it == resources.end()) {
+                Resource r;
+                r.last_writes = barriers;
+                it = resources.insert(make_pair(p.first, r)).first;
+            }
+            AppendUnique(&it->second.last_writes, p.second.last_writes);
+            AppendUnique(&it->second.reads, p.second.reads);
+        }
+        AppendUnique(&barriers, other.barriers);
+        AppendUnique(&since_barrier, other.since_barrier);
+    }
+
+    // Record |stmt| and set its pipedag deps.
+    void Add(IRStmt* stmt) {
+        const void* key = SideEffectResource(stmt);
+        if (!key) {
+            AppendUnique(&stmt->pipedag_deps, barriers);
+            AppendUnique(&stmt->pipedag_deps, since_barrier);
+            barriers = { stmt };
+            since_barrier.clear();
+            resources.clear();
+            return;
+        }
+        Access(stmt, key, SideEffectIsRead(stmt));
+        if (const void* order_key = SideEffectOrderKey(stmt)) {
+            Access(stmt, order_key, stmt->storage != nullptr);
+        }
+        since_barrier.push_back(stmt);
+    }
+
+  private:
+    void Access(IRStmt* stmt, const void* key, bool is_read) {
+        auto it = resources.find(key);
+        if (it == resources.end()) {
+            Resource r;
+            r.last_writes = barriers;
+            it = resources.insert(make_pair(key, r)).first;
+        }
+        Resource& r = it->second;
+        AppendUnique(&stmt->pipedag_deps, r.last_writes);
+        if (is_read) {
+            r.reads.push_back(stmt);
+        } else {
+            AppendUnique(&stmt->pipedag_deps, r.reads);
+            r.last_writes = { stmt };
+            r.reads.clear();
+        }
+    }
+};
+
+// Produce a side-effect-dep graph from the CFG before we lose it. Side effects
+// are ordered only where they may interfere: accesses to the same port, chan,
+// storage element or bypass network keep their program order (reads may
+// reorder among themselves), bypass ops keep their program order against all
+// storage accesses (see kBypassStorageOrder), and global barriers -- kills,
+// spawns, timing barriers and the like -- are ordered against all side effects
+// before and after them. Independent accesses are left unordered so that they
+// may share a stage. We do this with a simple forward pass in reverse
+// postorder.
 bool BuildPipeDAG(IRProgram* program,
                   PipeSys* sys,
                   Pipe* pipe,
@@ -685,13 +1704,8 @@ bool BuildPipeDAG(IRProgram* program,
     BBReversePostorder rpo;
     rpo.Compute( { pipe->entry } );
 
-    // Map per block of outgoing side-effect spine. This is set of last
-    // side-effecting ops that were seen on this block's postdom frontier,
-    // i.e., these are all barriers that must come before any side-effecting op
-    // in this BB. We keep a barrier set and not just a single pre-joined point
-    // because we avoid generating extra join barriers where unnecessary (BBs
-    // with no side-effects).
-    map<const IRBB*, vector<IRStmt*>> last_side_effect;
+    // Side-effect ordering state at the end of each block.
+    map<const IRBB*, SideEffectFrontier> side_effects;
     // Map of set of timing barriers that must come before any unconstrained
     // (side-effect-free) op after the given BB.
     map<const IRBB*, vector<IRStmt*>> last_timing_barriers;
@@ -700,13 +1714,11 @@ bool BuildPipeDAG(IRProgram* program,
     map<const IRBB*, vector<IRStmt*>> unconstrained_pure_ops;
 
     for (auto* bb : rpo.RPO()) {
-        vector<IRStmt*> pred_barriers;
+        SideEffectFrontier frontier;
         vector<IRStmt*> timing_barriers;
         vector<IRStmt*> pure_ops;
         for (auto* pred : rpo.Preds(bb)) {
-            pred_barriers.insert(pred_barriers.end(),
-                    last_side_effect[pred].begin(),
-                    last_side_effect[pred].end());
+            frontier.Merge(side_effects[pred]);
             timing_barriers.insert(timing_barriers.end(),
                     last_timing_barriers[pred].begin(),
                     last_timing_barriers[pred].end());
@@ -715,10 +1727,9 @@ bool BuildPipeDAG(IRProgram* program,
                     unconstrained_pure_ops[pred].end());
         }
 
-        IRStmt* last = nullptr;
         IRStmt* last_timing_barrier = nullptr;
         if (rpo.Preds(bb).empty() && pipe->spawn) {
-            last = pipe->spawn;
+            frontier.barriers.push_back(pipe->spawn);
         }
         for (auto& stmt : bb->stmts) {
             if (!IRHasSideEffects(stmt->type)) {
@@ -737,12 +1748,7 @@ bool BuildPipeDAG(IRProgram* program,
                 continue;
             }
             if (stmt->type == IRStmtIf || stmt->type == IRStmtJmp) continue;
-            if (!last) {
-                stmt->pipedag_deps = pred_barriers;
-            } else {
-                stmt->pipedag_deps.push_back(last);
-            }
-            last = stmt.get();
+            frontier.Add(stmt.get());
             if (stmt->type == IRStmtTimingBarrier) {
                 last_timing_barrier = stmt.get();
                 for (auto* op : pure_ops) {
@@ -752,11 +1758,7 @@ bool BuildPipeDAG(IRProgram* program,
             }
         }
 
-        if (last) {
-            last_side_effect[bb].push_back(last);
-        } else {
-            last_side_effect[bb] = pred_barriers;
-        }
+        side_effects[bb] = frontier;
         if (last_timing_barrier) {
             last_timing_barriers[bb].push_back(last_timing_barrier);
         } else {
@@ -807,6 +1809,76 @@ bool FlattenPipe(IRProgram* program,
     return true;
 }
 
+// Constrains the reads in each wait condition's backward slice to the wait's
+// own stage. While the stage holds, the condition must be re-evaluated every
+// cycle; a condition computed in an earlier stage would be latched with the
+// held transaction and could never change.
+bool ConstrainWaits(IRProgram* program,
+                    PipeSys* sys,
+                    Pipe* pipe,
+                    ErrorCollector* coll) {
+    for (auto* stmt : pipe->stmts) {
+        if (stmt->type != IRStmtWait) continue;
+        if (!stmt->timevar) {
+            stmt->timevar = program->GetTimeVar();
+            stmt->timevar->name = strprintf("__wait_timevar_%d",
+                                            stmt->valnum);
+            stmt->time_offset = 0;
+        }
+
+        // Walk back through pure ops to the reads that feed the condition.
+        // Reads already placed by the user's own timing are left alone;
+        // AssignHolds() rejects any that land in an earlier stage.
+        set<IRStmt*> seen;
+        vector<IRStmt*> worklist = stmt->args;
+        while (!worklist.empty()) {
+            IRStmt* s = worklist.back();
+            worklist.pop_back();
+            if (!seen.insert(s).second) continue;
+            if (s->type == IRStmtExpr) {
+                worklist.insert(worklist.end(), s->args.begin(), s->args.end());
+            } else if ((IRReadsPort(s->type) || IRReadsStorage(s->type) ||
+                        s->type == IRStmtBypassPresent ||
+                        s->type == IRStmtBypassReady ||
+                        s->type == IRStmtBypassRead) && !s->timevar) {
+                s->timevar = stmt->timevar;
+                s->time_offset = stmt->time_offset;
+            }
+        }
+    }
+    return true;
+}
+
+// Places each read of a registered ROM one stage after its index, so that
+// the index reaches the ROM through a pipeline register and the two together
+// form a synchronous-read memory. Reads placed by the user's own timing (or
+// by a wait) are left combinational, as are reads at a constant index.
+bool RegisterRomReads(IRProgram* program,
+                      PipeSys* sys,
+                      Pipe* pipe,
+                      ErrorCollector* coll) {
+    for (auto* stmt : pipe->stmts) {
+        if (stmt->type != IRStmtArrayRead || !stmt->storage->IsRom() ||
+            !stmt->storage->registered || stmt->timevar) {
+            continue;
+        }
+        IRStmt* index = stmt->args[0];
+        if (index->pipe != pipe ||
+            (index->type == IRStmtExpr && index->op == IRStmtOpConst)) {
+            continue;
+        }
+        if (!index->timevar) {
+            index->timevar = program->GetTimeVar();
+            index->timevar->name = strprintf("__rom_index_timevar_%d",
+                                             index->valnum);
+            index->time_offset = 0;
+        }
+        stmt->timevar = index->timevar;
+        stmt->time_offset = index->time_offset + 1;
+    }
+    return true;
+}
+
 // DFS usd to extract slice.
 void DoExtractSlice(IRStmt* stmt,
                     set<IRStmt*>* seen,
@@ -1022,9 +2094,10 @@ bool InsertKillIfKills(IRProgram* program,
 }
 
 // Creates a RestartValue / RestartValueSrc pair to port a signal across
-// stages.
+// stages, and records it on |consumer_stage| as a link of kind |kind|.
 IRStmt* CreateNonStagedLink(IRProgram* prog, PipeStage* src_stage,
-                            IRStmt* src_value, PipeStage* consumer_stage) {
+                            IRStmt* src_value, PipeStage* consumer_stage,
+                            PipeStage::LinkKind kind) {
     if (src_stage->stage == consumer_stage->stage) {
         return src_value;
     }
@@ -1054,6 +2127,7 @@ IRStmt* CreateNonStagedLink(IRProgram* prog, PipeStage* src_stage,
     restart_value_src->stage->stmts.push_back(restart_value_src.get());
     restart_value_src->stage->owned_stmts.push_back(move(restart_value_src));
 
+    consumer_stage->links.push_back(make_pair(kind, ret));
 
     return ret;
 }
@@ -1079,7 +2153,11 @@ bool ConvertSingleWrites(IRProgram* program,
         {}
     };
 
+    // Keyed by port/storage pointer for lookup; |written_order| keeps the
+    // objects in first-write (program) order for the passes below, which
+    // create new IR and so must not depend on pointer order.
     map<void*, WrittenObj> written_objs;
+    vector<void*> written_order;
 
     for (auto& pipe : sys->pipes) {
         for (auto* stmt : pipe->stmts) {
@@ -1157,6 +2235,7 @@ bool ConvertSingleWrites(IRProgram* program,
                     record.storage = storage;
                     record.stmts.push_back(stmt);
                     written_objs.insert(make_pair(written_obj, record));
+                    written_order.push_back(written_obj);
                 }
             }
         }
@@ -1176,7 +2255,8 @@ bool ConvertSingleWrites(IRProgram* program,
     // one killing write in the same stage that activates at the same time,
     // that's undefined behavior. TODO: maybe we should check that killyoungers
     // in the same stage after lowering don't have overlapping predicates.)
-    for (auto& p : written_objs) {
+    for (auto* obj : written_order) {
+        auto& p = *written_objs.find(obj);
         if (p.second.earliest_killstage != -1 &&
             p.second.stage != -1 &&
             p.second.earliest_killstage < p.second.stage) {
@@ -1193,7 +2273,8 @@ bool ConvertSingleWrites(IRProgram* program,
 
     // For each written object, ensure that we got all defs, i.e. that there are
     // none in other pipe systems (processes).
-    for (auto& p : written_objs) {
+    for (auto* obj : written_order) {
+        auto& p = *written_objs.find(obj);
         if (p.second.port) {
             for (auto* def : p.second.port->defs) {
                 if (def->pipe->sys != sys) {
@@ -1223,7 +2304,8 @@ bool ConvertSingleWrites(IRProgram* program,
     // For each written object, ensure that predicates do not overlap (this is
     // equivalent to saying that no write dominates another write, i.e., that
     // there is only one write per path).
-    for (auto& p : written_objs) {
+    for (auto* obj : written_order) {
+        auto& p = *written_objs.find(obj);
         for (auto* stmt : p.second.stmts) {
             for (auto* other : p.second.stmts) {
                 if (stmt == other) continue;
@@ -1246,7 +2328,8 @@ bool ConvertSingleWrites(IRProgram* program,
 
     // Now, for each written object with more than one writer, generate a
     // sequence of select operations and rewrite the source of the write.
-    for (auto& p : written_objs) {
+    for (auto* obj : written_order) {
+        auto& p = *written_objs.find(obj);
         if (p.second.stmts.size() < 2) continue;
         PipeStage* write_stage = p.second.write_stage;
         // Wire up the sels and valid-signal combining ORs.
@@ -1262,17 +2345,20 @@ bool ConvertSingleWrites(IRProgram* program,
 
             sel->args.push_back(CreateNonStagedLink(program,
                         p.second.stmts[i+1]->stage,
-                        p.second.stmts[i+1]->valid_in, sel->stage));
+                        p.second.stmts[i+1]->valid_in, sel->stage,
+                        PipeStage::LINK_WRITE));
             sel->arg_nums.push_back(sel->args.back()->valnum);
 
             sel->args.push_back(CreateNonStagedLink(program,
                         p.second.stmts[i+1]->stage,
-                        p.second.stmts[i+1]->args[0], sel->stage));
+                        p.second.stmts[i+1]->args[0], sel->stage,
+                        PipeStage::LINK_WRITE));
             sel->arg_nums.push_back(sel->args.back()->valnum);
             sel->args.push_back(last_sel ? last_sel :
                     CreateNonStagedLink(program,
                         p.second.stmts[i]->stage,
-                        p.second.stmts[i]->args[0], sel->stage));
+                        p.second.stmts[i]->args[0], sel->stage,
+                        PipeStage::LINK_WRITE));
             sel->arg_nums.push_back(sel->args.back()->valnum);
             sel->width = sel->args[1]->width;
             last_sel = sel.get();
@@ -1290,12 +2376,14 @@ bool ConvertSingleWrites(IRProgram* program,
             valid_or->args.push_back(last_or ? last_or :
                     CreateNonStagedLink(program,
                         p.second.stmts[i]->stage,
-                        p.second.stmts[i]->valid_in, valid_or->stage));
+                        p.second.stmts[i]->valid_in, valid_or->stage,
+                        PipeStage::LINK_WRITE));
             valid_or->arg_nums.push_back(valid_or->args.back()->valnum);
             valid_or->args.push_back(
                     CreateNonStagedLink(program,
                         p.second.stmts[i+1]->stage,
-                        p.second.stmts[i+1]->valid_in, valid_or->stage));
+                        p.second.stmts[i+1]->valid_in, valid_or->stage,
+                        PipeStage::LINK_WRITE));
             valid_or->arg_nums.push_back(valid_or->args.back()->valnum);
             valid_or->width = 1;
             last_or = valid_or.get();
@@ -1370,7 +2458,8 @@ bool AssignStalls(IRProgram* program,
                         later_backedge_valids.push_back(
                                 CreateNonStagedLink(
                                     program, later_stage,
-                                    stmt->valid_in, pipe->stages[i-1].get()));
+                                    stmt->valid_in, pipe->stages[i-1].get(),
+                                    PipeStage::LINK_STALL));
                     }
                 }
             }
@@ -1407,6 +2496,152 @@ bool AssignStalls(IRProgram* program,
     return true;
 }
 
+// Assigns 'hold' signals to pipestages: each stage holds if any 'wait' in a
+// later stage is holding its txn. Unlike stalls, the waits' hold values are
+// used in the same cycle, directly from the waiting stages, so that the
+// waiting txn and everything upstream of it simply stay put, with no restart
+// bubble. AssignKills() suppresses side effects in the held stages.
+//
+// In the waiting stage itself, storage writes are also gated by the hold, so
+// that they take effect exactly once, in the cycle in which the stage
+// releases. (Port writes stay asserted while waiting, as a handshake
+// would expect.)
+bool AssignHolds(IRProgram* program,
+                 PipeSys* sys,
+                 Pipe* pipe,
+                 ErrorCollector* coll) {
+    // A submodule instance keeps advancing while this pipe holds, so no
+    // stage it spans may be held: reject any wait at or after its input
+    // stage.
+    for (auto* stmt : pipe->stmts) {
+        if (stmt->type != IRStmtInstance || stmt->constant == 0) continue;
+        int input_stage = stmt->stage->stage - static_cast<int>(stmt->constant);
+        for (auto& other_pipe : sys->pipes) {
+            for (auto* other : other_pipe->stmts) {
+                if (other->type == IRStmtWait && !other->deleted &&
+                    other->stage->stage >= input_stage) {
+                    coll->ReportError(other->location, ErrorCollector::ERROR,
+                            strprintf("Wait statement %%%d would hold stages "
+                                      "spanned by pipelined instance %%%d of "
+                                      "'%s'.", other->valnum, stmt->valnum,
+                                      stmt->port_name.c_str()));
+                    return false;
+                }
+            }
+        }
+    }
+
+    // A wait re-evaluates its condition each cycle it holds, but a read in
+    // an earlier stage reaches it through a held pipereg and never changes,
+    // so the stage would never release. ConstrainWaits() places untimed
+    // reads with the wait; reads the user timed earlier are errors.
+    for (auto* stmt : pipe->stmts) {
+        if (stmt->type != IRStmtWait || stmt->deleted) continue;
+        set<IRStmt*> seen;
+        vector<IRStmt*> worklist = stmt->args;
+        while (!worklist.empty()) {
+            IRStmt* s = worklist.back();
+            worklist.pop_back();
+            if (!seen.insert(s).second) continue;
+            if (s->type == IRStmtExpr) {
+                worklist.insert(worklist.end(), s->args.begin(), s->args.end());
+            } else if ((IRReadsPort(s->type) || IRReadsStorage(s->type) ||
+                        s->type == IRStmtBypassPresent ||
+                        s->type == IRStmtBypassReady ||
+                        s->type == IRStmtBypassRead) &&
+                       s->stage->stage < stmt->stage->stage) {
+                coll->ReportError(stmt->location, ErrorCollector::ERROR,
+                        strprintf("Wait statement %%%d's condition reads "
+                                  "%%%d in stage %d, before the wait's stage "
+                                  "%d: the wait would never see it change. "
+                                  "Time the read in the wait's stage.",
+                                  stmt->valnum, s->valnum, s->stage->stage,
+                                  stmt->stage->stage));
+                return false;
+            }
+        }
+    }
+
+    for (unsigned i = 1; i < pipe->stages.size(); i++) {
+        auto* stage = pipe->stages[i].get();
+
+        // Collect waits in later stages in *all* pipes.
+        vector<IRStmt*> later_waits;
+        for (auto& other_pipe : sys->pipes) {
+            for (unsigned j = i + 1; j < other_pipe->stages.size(); j++) {
+                for (auto* stmt : other_pipe->stages[j]->stmts) {
+                    if (stmt->type == IRStmtWait) {
+                        later_waits.push_back(stmt);
+                    }
+                }
+            }
+        }
+        // Later stages can only see fewer waits.
+        if (later_waits.empty()) {
+            break;
+        }
+
+        unique_ptr<IRBB> holdgen_bb(new IRBB());
+        holdgen_bb->label = strprintf("__holdgen_stage_%d", i);
+        IRBBBuilder builder(program, holdgen_bb.get());
+        stage->hold = builder.BuildTree(IRStmtOpOr, later_waits);
+        builder.PrependToBB();
+        for (auto* wait : later_waits) {
+            stage->links.push_back(make_pair(PipeStage::LINK_HOLD, wait));
+        }
+
+        for (auto& stmt : holdgen_bb->stmts) {
+            stage->stmts.push_back(stmt.get());
+            stmt->stage = stage;
+            stmt->stage->pipe->stmts.push_back(stmt.get());
+            stmt->pipe = stmt->stage->pipe;
+        }
+        pipe->bbs.push_back(holdgen_bb.get());
+        program->bbs.push_back(move(holdgen_bb));
+    }
+
+    for (auto& stage : pipe->stages) {
+        vector<IRStmt*> waits;
+        vector<IRStmt*> commits;
+        for (auto* stmt : stage->stmts) {
+            if (stmt->deleted) continue;
+            if (stmt->type == IRStmtWait) {
+                waits.push_back(stmt);
+            } else if (IRWritesStorage(stmt->type) && stmt->valid_in) {
+                commits.push_back(stmt);
+            }
+        }
+        if (waits.empty() || commits.empty()) {
+            continue;
+        }
+
+        unique_ptr<IRBB> commit_bb(new IRBB());
+        commit_bb->label = strprintf("__wait_commit_stage_%d", stage->stage);
+        IRBBBuilder builder(program, commit_bb.get());
+        IRStmt* waiting = builder.BuildTree(IRStmtOpOr, waits);
+        IRStmt* not_waiting = builder.AddExpr(IRStmtOpNot, { waiting });
+        for (auto* stmt : commits) {
+            // valid_spine, so that AssignKills() still gates the valid_in.
+            IRStmt* gated = builder.AddExpr(IRStmtOpAnd,
+                                            { stmt->valid_in, not_waiting });
+            gated->valid_spine = true;
+            stmt->valid_in = gated;
+        }
+        builder.PrependToBB();
+
+        for (auto& stmt : commit_bb->stmts) {
+            stage->stmts.push_back(stmt.get());
+            stmt->stage = stage.get();
+            stmt->stage->pipe->stmts.push_back(stmt.get());
+            stmt->pipe = stmt->stage->pipe;
+        }
+        pipe->bbs.push_back(commit_bb.get());
+        program->bbs.push_back(move(commit_bb));
+    }
+
+    return true;
+}
+
 bool AssignKills(IRProgram* program,
                  PipeSys* sys,
                  Pipe* pipe,
@@ -1435,7 +2670,8 @@ bool AssignKills(IRProgram* program,
                 for (auto* stmt : later_stage->stmts) {
                     if (stmt->type == IRStmtKillYounger) {
                         kill_inputs.push_back(CreateNonStagedLink(program,
-                                    later_stage, stmt->valid_in, stage));
+                                    later_stage, stmt->valid_in, stage,
+                                    PipeStage::LINK_KILL));
                     }
                 }
             }
@@ -1452,6 +2688,7 @@ bool AssignKills(IRProgram* program,
             killgen_bb->label = strprintf("__killgen_stage_%d", i);
             IRBBBuilder builder(program, killgen_bb.get());
             kill_signal = builder.BuildTree(IRStmtOpOr, kill_inputs);
+            builder.ReplaceBB();
             
             // Find the prior stage in which to insert the OR-tree, and put it
             // there.
@@ -1459,27 +2696,43 @@ bool AssignKills(IRProgram* program,
             for (auto& stmt : killgen_bb->stmts) {
                 prior_stage->stmts.push_back(stmt.get());
                 stmt->stage = prior_stage;
+                stmt->pipe = pipe;
+                pipe->stmts.push_back(stmt.get());
             }
             pipe->bbs.push_back(killgen_bb.get());
             program->bbs.push_back(move(killgen_bb));
         }
 
+        stage->kill = kill_signal;
+
         // The kill signal for this stage is the OR of its killyounger-derived
-        // kill (above), any downstream kill_if clones, and its stall signal.
-        // The reason for the latter is that if the stage is stalled, its
-        // internal logic must be prevented from invoking its side-effects; in
-        // such a case, the stage's output latches will hold the prior output.
+        // kill (above), any downstream kill_if clones, and its stall and hold
+        // signals. The reason for the latter is that if the stage is stalled
+        // or held, its internal logic must be prevented from invoking its
+        // side-effects; in such a case, the stage's output latches will hold
+        // the prior output.
+        vector<IRStmt*> final_kill_inputs;
         if (stage->stall) {
-            // insert an OR, if necessary.
+            final_kill_inputs.push_back(stage->stall);
+        }
+        if (stage->hold) {
+            final_kill_inputs.push_back(stage->hold);
+        }
+        if (!final_kill_inputs.empty()) {
             if (kill_signal != nullptr) {
-                vector<IRStmt*> final_kill_inputs = { stage->stall, kill_signal };
+                final_kill_inputs.push_back(kill_signal);
+            }
+            // insert an OR, if necessary.
+            if (final_kill_inputs.size() > 1) {
                 unique_ptr<IRBB> kill_or_bb(new IRBB());
                 kill_or_bb->label = strprintf("__kill_or_stage_%d", i);
                 IRBBBuilder builder(program, kill_or_bb.get());
                 kill_signal = builder.BuildTree(IRStmtOpOr, final_kill_inputs);
+                builder.PrependToBB();
 
                 for (auto& stmt : kill_or_bb->stmts) {
                     stmt->stage = stage;
+                    stmt->pipe = stage->pipe;
                     stage->stmts.push_back(stmt.get());
                     stage->pipe->stmts.push_back(stmt.get());
                 }
@@ -1487,32 +2740,34 @@ bool AssignKills(IRProgram* program,
                 pipe->bbs.push_back(kill_or_bb.get());
                 program->bbs.push_back(move(kill_or_bb));
             } else {
-                kill_signal = stage->stall;
+                kill_signal = final_kill_inputs[0];
             }
         }
 
-        if (kill_signal != nullptr) {
-            // Now find the valid-cut across inputs to this stage: all valid_ins
-            // that come from prior stages. We will insert ANDs to gate each of
-            // these valids and a map of substitutions, then make a second pass to
-            // substitute all uses of the 'valid' signals when they are either
-            // valid_ins on any stmt, or when they are ordinary args on
-            // valid_spine stmts.
-            set<IRStmt*> valid_cut;
-            for (auto* stmt : stage->stmts) {
-                if (stmt->valid_in && stmt->valid_in->stage->stage < i) {
-                    valid_cut.insert(stmt->valid_in);
-                } else if (stmt->is_valid_start) {
-                    valid_cut.insert(stmt);
-                }
-                if (stmt->valid_spine) {
-                    for (auto* arg : stmt->args) {
-                        if (arg->stage->stage < i) {
-                            valid_cut.insert(arg);
-                        }
+        // Now find the valid-cut across inputs to this stage: all valid_ins
+        // that come from prior stages. If the stage has a kill signal, we will
+        // insert ANDs to gate each of these valids and a map of
+        // substitutions, then make a second pass to substitute all uses of
+        // the 'valid' signals when they are either valid_ins on any stmt, or
+        // when they are ordinary args on valid_spine stmts.
+        set<IRStmt*, IRStmtLess> valid_cut;
+        for (auto* stmt : stage->stmts) {
+            if (stmt->valid_in && stmt->valid_in->stage->stage < i) {
+                valid_cut.insert(stmt->valid_in);
+            } else if (stmt->is_valid_start) {
+                valid_cut.insert(stmt);
+            }
+            if (stmt->valid_spine) {
+                for (auto* arg : stmt->args) {
+                    if (arg->stage->stage < i) {
+                        valid_cut.insert(arg);
                     }
                 }
             }
+        }
+        stage->valids.assign(valid_cut.begin(), valid_cut.end());
+
+        if (kill_signal != nullptr) {
             // TODO: abstract out this "create a new BB" pattern.
             map<IRStmt*, IRStmt*> valid_replacements;
             unique_ptr<IRBB> valid_cut_gating_bb(new IRBB());
@@ -1647,15 +2902,18 @@ bool ConvertBypasses(IRProgram* program,
                     sel->stage = write1->stage;
 
                     sel->args.push_back(CreateNonStagedLink(program,
-                                write2->stage, write2->valid_in, sel->stage));
+                                write2->stage, write2->valid_in, sel->stage,
+                                PipeStage::LINK_BYPASS));
                     sel->arg_nums.push_back(sel->args.back()->valnum);
 
                     sel->args.push_back(CreateNonStagedLink(program,
-                                write2->stage, write2->args[0], sel->stage));
+                                write2->stage, write2->args[0], sel->stage,
+                                PipeStage::LINK_BYPASS));
                     sel->arg_nums.push_back(sel->args.back()->valnum);
                     sel->args.push_back(last_sel ? last_sel :
                             CreateNonStagedLink(program,
-                                write1->stage, write1->args[0], sel->stage));
+                                write1->stage, write1->args[0], sel->stage,
+                                PipeStage::LINK_BYPASS));
                     sel->arg_nums.push_back(sel->args.back()->valnum);
                     sel->width = sel->args[1]->width;
                     last_sel = sel.get();
@@ -1672,11 +2930,13 @@ bool ConvertBypasses(IRProgram* program,
                     valid_or->stage = write1->stage;
                     valid_or->args.push_back(last_or ? last_or :
                             CreateNonStagedLink(program,
-                                write1->stage, write1->valid_in, valid_or->stage));
+                                write1->stage, write1->valid_in, valid_or->stage,
+                                PipeStage::LINK_BYPASS));
                     valid_or->arg_nums.push_back(valid_or->args.back()->valnum);
                     valid_or->args.push_back(
                             CreateNonStagedLink(program,
-                                write2->stage, write2->valid_in, valid_or->stage));
+                                write2->stage, write2->valid_in, valid_or->stage,
+                                PipeStage::LINK_BYPASS));
                     valid_or->arg_nums.push_back(valid_or->args.back()->valnum);
                     valid_or->width = 1;
                     last_or = valid_or.get();
@@ -1704,9 +2964,283 @@ bool ConvertBypasses(IRProgram* program,
     return true;
 }
 
+// Ops cheap enough to recompute in a later stage rather than stage through
+// piperegs: constants and bit rearrangements are free or nearly so, and a
+// compare is narrow however wide its inputs are.
+bool IsRematerializable(const IRStmt* stmt) {
+    if (stmt->type != IRStmtExpr || stmt->deleted) {
+        return false;
+    }
+    switch (stmt->op) {
+        case IRStmtOpConst:
+        case IRStmtOpNot:
+        case IRStmtOpBitslice:
+        case IRStmtOpConcat:
+        case IRStmtOpCmpLT:
+        case IRStmtOpCmpLE:
+        case IRStmtOpCmpEQ:
+        case IRStmtOpCmpNE:
+        case IRStmtOpCmpGT:
+        case IRStmtOpCmpGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Longest combinational path through |stage|, counting only dataflow within
+// the stage (as QoRMetrics does).
+int StageDepth(const PipeStage* stage, const TimingModel* timing_model) {
+    map<const IRStmt*, int> depth;
+    function<int(const IRStmt*)> visit = [&](const IRStmt* stmt) -> int {
+        auto it = depth.find(stmt);
+        if (it != depth.end()) return it->second;
+        depth[stmt] = 0;  // cut any (invalid) cycle
+        int in = 0;
+        for (auto* arg : stmt->args) {
+            if (arg->stage == stmt->stage) in = max(in, visit(arg));
+        }
+        if (stmt->valid_in && stmt->valid_in->stage == stmt->stage) {
+            in = max(in, visit(stmt->valid_in));
+        }
+        return depth[stmt] = in + timing_model->Delay(stmt);
+    };
+    int ret = 0;
+    for (auto* stmt : stage->stmts) {
+        if (!stmt->deleted) ret = max(ret, visit(stmt));
+    }
+    return ret;
+}
+
+// Inserts |stmt| into |list| just before the first of |users| in it, so that
+// the list stays in dataflow order.
+void InsertBefore(vector<IRStmt*>* list, IRStmt* stmt,
+                  const set<IRStmt*>& users) {
+    auto it = list->begin();
+    while (it != list->end() && !users.count(*it)) ++it;
+    list->insert(it, stmt);
+}
+
+// Clone cheap pure values into the later stages that use them, where the
+// clone's inputs are already present, instead of carrying the value there
+// through piperegs. Codegen stages each value from its defining stage to its
+// latest use (see VerilogGenerator::GetSignalInStage()), so a clone in every
+// use stage past some point shortens the value's pipereg chain at no cost in
+// piperegs for its inputs. A clone is only placed in a stage if the stage's
+// logic depth stays within the timing model's budget.
+//
+// Values are visited consumers-first, so that a chain of cheap ops (e.g. a
+// compare of a bitslice) moves downstream as a whole. Uses that codegen
+// resolves outside the user's stage -- a chan's write value, read where the
+// chan is read; a bypass index, carried to each bypass write; valid signals;
+// instance inputs -- pin the value in place.
+bool RematerializeValues(IRProgram* program,
+                         PipeSys* sys,
+                         const TimingModel* timing_model,
+                         ErrorCollector* coll) {
+    // The latest stage each value must reach, as codegen will compute it,
+    // and the uses that a clone could take over.
+    map<const IRStmt*, int> need;
+    map<const IRStmt*, vector<pair<IRStmt*, int>>> uses;  // (user, arg index)
+    set<const IRStmt*> pinned;
+    auto use = [&need](const IRStmt* value, int stage) {
+        auto it = need.find(value);
+        if (it == need.end()) {
+            need[value] = max(stage, value->stage->stage);
+        } else if (stage > it->second) {
+            it->second = stage;
+        }
+    };
+    vector<IRStmt*> all;
+    for (auto& pipe : sys->pipes) {
+        for (auto* stmt : pipe->stmts) {
+            if (stmt->deleted || !stmt->stage) continue;
+            all.push_back(stmt);
+            use(stmt, stmt->stage->stage);
+            int stage = stmt->stage->stage;
+            bool movable_uses = stmt->type != IRStmtInstance &&
+                                stmt->type != IRStmtChanWrite &&
+                                stmt->type != IRStmtBypassStart;
+            for (unsigned i = 0; i < stmt->args.size(); i++) {
+                IRStmt* arg = stmt->args[i];
+                if (!arg->stage) continue;
+                if (stmt->type == IRStmtInstance) {
+                    use(arg, stage - static_cast<int>(stmt->constant));
+                } else {
+                    use(arg, stage);
+                }
+                if (movable_uses) {
+                    uses[arg].push_back(make_pair(stmt, i));
+                } else {
+                    pinned.insert(arg);
+                }
+            }
+            if (stmt->valid_in) {
+                use(stmt->valid_in, stage);
+                pinned.insert(stmt->valid_in);
+            }
+            if (stmt->type == IRStmtChanRead) {
+                for (auto* def : stmt->port->defs) {
+                    if (def->args.empty() || !def->args[0]->stage) continue;
+                    use(def->args[0], stage);
+                    pinned.insert(def->args[0]);
+                }
+            }
+            if (stmt->type == IRStmtBypassWrite) {
+                use(stmt->bypass->start->args[0], stage);
+                pinned.insert(stmt->bypass->start->args[0]);
+            }
+        }
+        for (auto& stage : pipe->stages) {
+            for (auto* s : { stage->stall, stage->hold }) {
+                if (s) pinned.insert(s);
+            }
+            for (auto* s : stage->kills) pinned.insert(s);
+            for (auto& link : stage->links) pinned.insert(link.second);
+        }
+    }
+
+    // Clones by original value and stage.
+    map<pair<const IRStmt*, const PipeStage*>, IRStmt*> clones;
+
+    // Can |value| be used in stage |k| without staging it further? It can if
+    // it is already carried there, or if it is cheap and its inputs can be.
+    function<bool(const IRStmt*, int)> available =
+        [&](const IRStmt* value, int k) -> bool {
+        if (!value->stage || value->stage->stage > k) return false;
+        if (need[value] >= k) return true;
+        if (!IsRematerializable(value) || pinned.count(value)) return false;
+        for (auto* arg : value->args) {
+            if (!available(arg, k)) return false;
+        }
+        return true;
+    };
+
+    // Returns |value| as available in |stage|, cloning it (and its inputs,
+    // as needed) just ahead of |users|. New clones are added to |created|.
+    function<IRStmt*(IRStmt*, PipeStage*, const set<IRStmt*>&,
+                     vector<IRStmt*>*)> materialize =
+        [&](IRStmt* value, PipeStage* stage, const set<IRStmt*>& users,
+            vector<IRStmt*>* created) -> IRStmt* {
+        if (need[value] >= stage->stage) return value;
+        // Share an existing clone if it already precedes these users.
+        auto it = clones.find(make_pair(value, stage));
+        if (it != clones.end()) {
+            auto& list = stage->pipe->stmts;
+            auto pos = find(list.begin(), list.end(), it->second);
+            auto first = find_if(list.begin(), list.end(),
+                                 [&users](IRStmt* s) {
+                                     return users.count(s) > 0;
+                                 });
+            if (pos < first) return it->second;
+        }
+        unique_ptr<IRStmt> owned(new IRStmt(*value));
+        IRStmt* clone = owned.get();
+        clone->valnum = program->GetValnum();
+        clone->pipe = stage->pipe;
+        clone->stage = stage;
+        // The clone carries no transaction state; its users are predicated.
+        clone->valid_in = nullptr;
+        clone->timevar = nullptr;
+        InsertBefore(&stage->pipe->stmts, clone, users);
+        InsertBefore(&stage->stmts, clone, users);
+        stage->owned_stmts.push_back(move(owned));
+        need[clone] = stage->stage;
+        clones[make_pair(value, stage)] = clone;
+        created->push_back(clone);
+        for (unsigned i = 0; i < clone->args.size(); i++) {
+            IRStmt* arg = materialize(clone->args[i], stage, { clone },
+                                      created);
+            clone->args[i] = arg;
+            clone->arg_nums[i] = arg->valnum;
+        }
+        return clone;
+    };
+
+    for (auto it = all.rbegin(); it != all.rend(); ++it) {
+        IRStmt* value = *it;
+        if (!IsRematerializable(value) || pinned.count(value)) continue;
+        int def_stage = value->stage->stage;
+        if (need[value] <= def_stage) continue;
+
+        // Later users in this pipe, by stage, latest first.
+        map<int, vector<pair<IRStmt*, int>>, greater<int>> by_stage;
+        int kept = def_stage;
+        for (auto& u : uses[value]) {
+            if (u.first->pipe == value->pipe &&
+                u.first->stage->stage > def_stage) {
+                by_stage[u.first->stage->stage].push_back(u);
+            } else {
+                kept = max(kept, u.first->stage->stage);
+            }
+        }
+
+        // Clone into each use stage from the last one back, as long as the
+        // inputs are at hand and the stage stays fast enough; the value need
+        // then only be staged as far as the earliest stage not reached.
+        for (auto& p : by_stage) {
+            int k = p.first;
+            if (k <= kept) break;
+            PipeStage* stage = p.second[0].first->stage;
+            bool ok = true;
+            for (auto* arg : value->args) {
+                if (!available(arg, k)) ok = false;
+            }
+            if (!ok) break;
+
+            set<IRStmt*> users;
+            for (auto& u : p.second) users.insert(u.first);
+            int old_depth = StageDepth(stage, timing_model);
+            vector<IRStmt*> created;
+            // Force a clone of |value| itself, which is not available here.
+            need[value] = def_stage;
+            IRStmt* clone = materialize(value, stage, users, &created);
+            for (auto& u : p.second) {
+                u.first->args[u.second] = clone;
+                u.first->arg_nums[u.second] = clone->valnum;
+            }
+            int limit = max(old_depth, timing_model->DelayPerStage());
+            if (StageDepth(stage, timing_model) > limit) {
+                // Too slow: undo and keep staging the value.
+                for (auto& u : p.second) {
+                    u.first->args[u.second] = value;
+                    u.first->arg_nums[u.second] = value->valnum;
+                }
+                for (auto* c : created) {
+                    c->deleted = true;
+                }
+                for (auto cit = clones.begin(); cit != clones.end();) {
+                    if (cit->second->deleted) {
+                        cit = clones.erase(cit);
+                    } else {
+                        ++cit;
+                    }
+                }
+                break;
+            }
+            for (auto* c : created) {
+                for (unsigned i = 0; i < c->args.size(); i++) {
+                    uses[c->args[i]].push_back(make_pair(c, i));
+                }
+            }
+        }
+
+        // Uses in stages that were not reached keep the value staged.
+        int remaining = kept;
+        for (auto& u : uses[value]) {
+            if (!u.first->deleted && u.first->args[u.second] == value) {
+                remaining = max(remaining, u.first->stage->stage);
+            }
+        }
+        need[value] = max(remaining, def_stage);
+    }
+
+    return true;
+}
+
 }  // anonymous namespace
 
-vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
+vector<unique_ptr<PipeSys>> IRProgram::LowerUntimed(ErrorCollector* coll) {
 
     // Extract pipelines from the spawn forest (set of spawn trees). Each BB is
     // extracted to at most one pipe, because each pipeline can only be spawned
@@ -1729,10 +3263,12 @@ vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
 
     // For each PipeSys, perform pipe conversion and predication.
 
-    unique_ptr<TimingModel> timing_model =
-        TimingModel::New(this->timing_model);
-
-    PipeTimer timer(timing_model.get());
+    // Hold accumulator regs as sum and carry pairs, so that their update
+    // loops have no carry-propagate add.
+    if (!DeferAccumulatorCarries(this, coll)) {
+        pipesystems.clear();
+        return pipesystems;
+    }
 
     for (auto& sys : pipesystems) {
         // Check that chans are only used within their own extracted pipes. This is
@@ -1741,6 +3277,12 @@ vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
         if (!CheckChanUses(this, sys.get(), coll)) goto err;
 
         for (auto& pipe : sys->pipes) {
+            // Hoist loop-invariant pure computations out of loop bodies, so
+            // that they are not re-evaluated on every iteration.
+            if (!HoistLoopInvariants(this, sys.get(), pipe.get(), coll)) goto err;
+            // Turn multi-operand add trees into carry-save trees with a single
+            // carry-propagate add.
+            if (!CompressAddTrees(this, sys.get(), pipe.get(), coll)) goto err;
             // Compute killyounger dominance over all points in the CFG. This is
             // used during backedge conversion to decide how to constrain stages.
             if (!ComputeKillyoungerDom(this, sys.get(), pipe.get(), coll)) goto err;
@@ -1755,23 +3297,53 @@ vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
             if (!BuildPipeDAG(this, sys.get(), pipe.get(), coll)) goto err;
             // Flatten the BBs into a list of statements.
             if (!FlattenPipe(this, sys.get(), pipe.get(), coll)) goto err;
+            // Keep each wait in the stage that computes its condition.
+            if (!ConstrainWaits(this, sys.get(), pipe.get(), coll)) goto err;
+            // Read registered ROMs through a pipeline register.
+            if (!RegisterRomReads(this, sys.get(), pipe.get(), coll)) goto err;
         }
 
+        continue;
+err:
+        had_error = true;
+        break;
+    }
+
+    if (had_error) {
+        pipesystems.clear();
+    }
+    return pipesystems;
+}
+
+bool IRProgram::LowerTimed(vector<unique_ptr<PipeSys>>* pipesystems,
+                           ErrorCollector* coll) {
+    string timing_model_error;
+    unique_ptr<TimingModel> timing_model =
+        TimingModel::New(this->timing_model, &timing_model_error);
+    if (!timing_model) {
+        coll->ReportError(Location(), ErrorCollector::ERROR,
+                          timing_model_error);
+        return false;
+    }
+
+    PipeTimer timer(timing_model.get());
+
+    for (auto& sys : *pipesystems) {
         // Once all pipes have been flattened to lists of statements with
         // partial-order DAGs, we can segment statements into pipe stages according
         // to a model of node delays.
-        if (!timer.TimePipe(sys.get(), coll)) goto err;
+        if (!timer.TimePipe(sys.get(), coll)) return false;
 
         // We clone 'kill_if' backward slices downstream to each stage.
-        if (!InsertKillIfKills(this, sys.get(), coll)) goto err;
+        if (!InsertKillIfKills(this, sys.get(), coll)) return false;
 
         // We check that ports, chans, and regs have all write-points in only
         // one stage. Then we convert the multiple writes to a single write
         // with a muxed input. (We check that valids do not overlap.)
-        if (!ConvertSingleWrites(this, sys.get(), coll)) goto err;
+        if (!ConvertSingleWrites(this, sys.get(), coll)) return false;
 
         // Check bypasses and convert writes to a single write per stage.
-        if (!ConvertBypasses(this, sys.get(), coll)) goto err;
+        if (!ConvertBypasses(this, sys.get(), coll)) return false;
 
         for (auto& pipe : sys->pipes) {
 
@@ -1780,7 +3352,12 @@ vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
 
             // We assign stall signals *after* pipelining because the
             // signals depend on the pipestage assignments.
-            if (!AssignStalls(this, sys.get(), pipe.get(), coll)) goto err;
+            if (!AssignStalls(this, sys.get(), pipe.get(), coll)) return false;
+
+            // Hold signals for 'wait' likewise depend on pipestage
+            // assignments. They must be in place before kills, which fold
+            // them in.
+            if (!AssignHolds(this, sys.get(), pipe.get(), coll)) return false;
 
             // Likewise, we assign kill signals *after* pipelining because their inputs
             // depend on the pipestage assignments. We shoehorn in ANDs on valids that
@@ -1790,17 +3367,22 @@ vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
             // for each killyounger, and then ensure that codegen uses the result of
             // RestartValue *directly*, with no staging aside from the latch between
             // RestartValueSrc and RestartValue.
-            if (!AssignKills(this, sys.get(), pipe.get(), coll)) goto err;
+            if (!AssignKills(this, sys.get(), pipe.get(), coll)) return false;
         }
 
-
-        continue;
-err:
-        had_error = true;
-        break;
+        // With all stage logic in place, recompute cheap values where they
+        // are used rather than carry them down the pipe.
+        if (!RematerializeValues(this, sys.get(), timing_model.get(), coll)) {
+            return false;
+        }
     }
 
-    if (had_error) {
+    return true;
+}
+
+vector<unique_ptr<PipeSys>> IRProgram::Lower(ErrorCollector* coll) {
+    vector<unique_ptr<PipeSys>> pipesystems = LowerUntimed(coll);
+    if (!pipesystems.empty() && !LowerTimed(&pipesystems, coll)) {
         pipesystems.clear();
     }
     return pipesystems;
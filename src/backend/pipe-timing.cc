@@ -20,6 +20,11 @@
 
 #include <vector>
 #include <map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
 
 using namespace autopiper;
 using namespace std;
@@ -62,6 +67,15 @@ int BarrelShifter(int input_width, int shiftamt_width) {
     return 2 * shiftamt_width;
 }
 
+// Whether |stmt|, a ROM read, was placed a stage after its index by
+// RegisterRomReads() (see lower.cc).
+bool IsRegisteredRomRead(const IRStmt* stmt) {
+    const IRStmt* index = stmt->args[0];
+    return stmt->storage->registered && stmt->timevar &&
+           stmt->timevar == index->timevar &&
+           stmt->time_offset == index->time_offset + 1;
+}
+
 }  // anonymous namespace
 
 int StandardTimingModel::Delay(const IRStmt* stmt) const {
@@ -125,6 +139,15 @@ int StandardTimingModel::Delay(const IRStmt* stmt) const {
                     return 0;
             }
             break;
+        case IRStmtArrayRead:
+            // A ROM lookup is a tree of 2-input MUXes, one level per index
+            // bit; a registered ROM's lookup happens at the clock edge, as
+            // for a reg read.
+            if (stmt->storage && stmt->storage->IsRom() &&
+                !IsRegisteredRomRead(stmt)) {
+                return 2 * stmt->storage->index_width;
+            }
+            return 0;
         default:
             // TODO: other primitives: array reads/writes, ...
             return 0;
@@ -132,7 +155,103 @@ int StandardTimingModel::Delay(const IRStmt* stmt) const {
 }
 
 int StandardTimingModel::DelayPerStage() const {
-    return kGatesPerStage;
+    return gates_per_stage_;
+}
+
+bool TableTimingModel::Load(const string& filename, string* error) {
+    ifstream in(filename);
+    if (!in) {
+        *error = strprintf("Cannot open timing table '%s'", filename.c_str());
+        return false;
+    }
+    string line;
+    int lineno = 0;
+    while (getline(in, line)) {
+        lineno++;
+        size_t comment = line.find('#');
+        if (comment != string::npos) {
+            line.resize(comment);
+        }
+        istringstream is(line);
+        string key;
+        if (!(is >> key)) {
+            continue;
+        }
+        string rest;
+        if (key == "delay_per_stage") {
+            if (!(is >> delay_per_stage_) || (is >> rest) ||
+                delay_per_stage_ <= 0) {
+                *error = strprintf("%s:%d: expected 'delay_per_stage <delay>' "
+                                   "with a positive delay",
+                                   filename.c_str(), lineno);
+                return false;
+            }
+            continue;
+        }
+        int width;
+        double delay;
+        if (!(is >> width >> delay) || (is >> rest) ||
+            width <= 0 || delay < 0) {
+            *error = strprintf("%s:%d: expected '<op> <width> <delay>'",
+                               filename.c_str(), lineno);
+            return false;
+        }
+        delays_[key][width] = delay;
+    }
+    if (delay_per_stage_ <= 0) {
+        *error = strprintf("%s: missing 'delay_per_stage'", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TableTimingModel::Lookup(const string& op, int width,
+                              double* delay) const {
+    auto it = delays_.find(op);
+    if (it == delays_.end()) {
+        return false;
+    }
+    const map<int, double>& points = it->second;
+    auto hi = points.lower_bound(width);
+    if (hi != points.end() && hi->first == width) {
+        *delay = hi->second;
+    } else if (hi == points.begin()) {
+        *delay = hi->second;
+    } else {
+        if (hi == points.end()) {
+            // Extrapolate from the two widest points (or hold the only one).
+            --hi;
+            if (hi == points.begin()) {
+                *delay = hi->second;
+                return true;
+            }
+        }
+        auto lo = hi;
+        --lo;
+        double t = double(width - lo->first) / double(hi->first - lo->first);
+        *delay = max(lo->second + t * (hi->second - lo->second), 0.0);
+    }
+    return true;
+}
+
+int TableTimingModel::Delay(const IRStmt* stmt) const {
+    int standard = fallback_.Delay(stmt);
+    if (standard == 0) {
+        // Wires, constants, constant shifts, and most non-expression stmts
+        // cost nothing in either model.
+        return standard;
+    }
+    int width = stmt->width;
+    for (auto* arg : stmt->args) {
+        width = max(width, arg->width);
+    }
+    double delay;
+    if (stmt->type != IRStmtExpr ||
+        !Lookup(IRStmtOpName(stmt->op), width, &delay)) {
+        return static_cast<int>(ceil(
+            double(standard) * kUnitsPerStage / fallback_.DelayPerStage()));
+    }
+    return static_cast<int>(ceil(delay * kUnitsPerStage / delay_per_stage_));
 }
 
 namespace {
@@ -187,6 +306,11 @@ bool PipeTimer::TimePipe(PipeSys* sys, ErrorCollector* coll) const {
             if (stmt->timevar) {
                 dag.AddVar(stmt, stmt->timevar, stmt->time_offset);
             }
+            // Instances of pipelined submodules span a fixed number of
+            // stages from their inputs to their result.
+            if (stmt->type == IRStmtInstance) {
+                dag.SetLatency(stmt, static_cast<int>(stmt->constant));
+            }
             // TODO: mark as 'lifted' any nodes that the user lifts.
         }
     }
@@ -230,12 +354,33 @@ bool PipeTimer::TimePipe(PipeSys* sys, ErrorCollector* coll) const {
     return true;
 }
 
-unique_ptr<TimingModel> TimingModel::New(string name) {
+unique_ptr<TimingModel> TimingModel::New(string name, string* error) {
+    static const string kStandardPrefix = "standard:";
+    static const string kTablePrefix = "table:";
     unique_ptr<TimingModel> ret;
+    string reason;
     if (name == "standard") {
         ret.reset(new StandardTimingModel());
+    } else if (name.compare(0, kStandardPrefix.size(), kStandardPrefix) == 0) {
+        int gates = atoi(name.c_str() + kStandardPrefix.size());
+        if (gates > 0) {
+            ret.reset(new StandardTimingModel(gates));
+        } else {
+            reason = strprintf("Invalid stage budget in timing model '%s'",
+                               name.c_str());
+        }
     } else if (name == "null") {
         ret.reset(new NullTimingModel());
+    } else if (name.compare(0, kTablePrefix.size(), kTablePrefix) == 0) {
+        unique_ptr<TableTimingModel> table(new TableTimingModel());
+        if (table->Load(name.substr(kTablePrefix.size()), &reason)) {
+            ret = move(table);
+        }
+    } else {
+        reason = strprintf("Unknown timing model '%s'", name.c_str());
+    }
+    if (!ret && error) {
+        *error = reason;
     }
     return ret;
 }
@@ -21,6 +21,7 @@
 #include "backend/pipe.h"
 
 #include <vector>
+#include <map>
 #include <memory>
 #include <string>
 
@@ -28,21 +29,67 @@ namespace autopiper {
 
 class TimingModel {
     public:
+        virtual ~TimingModel() {}
+
         virtual int Delay(const IRStmt* stmt) const = 0;
         virtual int DelayPerStage() const = 0;
 
-        static std::unique_ptr<TimingModel> New(std::string name);
+        // Returns the model named by a 'timing_model' pragma: "null",
+        // "standard" (or "standard:<gates>" for a budget other than 32 gate
+        // delays per stage), or "table:<file>" for a calibrated delay table.
+        // Returns null, with a reason in |error| if given, if the name is
+        // unknown or the table cannot be loaded.
+        static std::unique_ptr<TimingModel> New(std::string name,
+                                                std::string* error = nullptr);
 };
 
 class StandardTimingModel : public TimingModel {
     public:
-        StandardTimingModel() {}
+        static const int kDefaultGatesPerStage = 32;
+
+        explicit StandardTimingModel(int gates_per_stage = kDefaultGatesPerStage)
+            : gates_per_stage_(gates_per_stage) {}
 
         virtual int Delay(const IRStmt* stmt) const;
         virtual int DelayPerStage() const;
 
     private:
-        static const int kGatesPerStage = 32;  // TODO: parameterize this (knobs on cmdline)
+        int gates_per_stage_;
+};
+
+// Delays measured by synthesizing per-op, per-width microbenchmarks (see
+// tests/timing/calibrate.py). The table is plain text:
+//
+//   # comment
+//   delay_per_stage <delay>
+//   <op> <width> <delay>
+//   ...
+//
+// where <op> is an IR expression op name (add, mul, cmplt, ...), <width> is
+// the widest of the op's result and operands, and delays are in any unit
+// (gate levels, ps, ...) shared by all lines. Widths between measured points
+// are interpolated linearly and widths beyond the largest are extrapolated
+// from the last two points. Ops missing from the table fall back to the
+// standard model, scaled to the table's stage budget.
+class TableTimingModel : public TimingModel {
+    public:
+        TableTimingModel() : delay_per_stage_(0) {}
+
+        bool Load(const std::string& filename, std::string* error);
+
+        virtual int Delay(const IRStmt* stmt) const;
+        virtual int DelayPerStage() const { return kUnitsPerStage; }
+
+    private:
+        // Delays are returned in fixed fractions of a stage so that tables
+        // measured in fractional library units keep their resolution.
+        static const int kUnitsPerStage = 1000;
+
+        double delay_per_stage_;
+        std::map<std::string, std::map<int, double>> delays_;
+        StandardTimingModel fallback_;
+
+        bool Lookup(const std::string& op, int width, double* delay) const;
 };
 
 class NullTimingModel : public TimingModel {
@@ -42,6 +42,9 @@ string Pipe::ToString() const {
             if (stage->stall) {
                 os << "Stall = %" << stage->stall->valnum << endl;
             }
+            if (stage->hold) {
+                os << "Hold = %" << stage->hold->valnum << endl;
+            }
             os << "Kills = { ";
             for (auto* kill : stage->kills) {
                 os << "%" << kill->valnum << ", ";
@@ -61,7 +61,7 @@ struct Pipe {
 // other operations we care only about what's in a single pipe.)
 struct PipeStage {
     PipeStage()
-        : stage(0), stall(nullptr) {}
+        : stage(0), stall(nullptr), hold(nullptr), kill(nullptr) {}
 
     int stage;  // global stage number, starting from 0.
     std::vector<IRStmt*> stmts;
@@ -70,12 +70,42 @@ struct PipeStage {
     // downstream)
     IRStmt* stall;
 
+    // hold signal, if any: a 'wait' in a later stage is holding its
+    // transaction, so this stage's transaction is held in place too. Its side
+    // effects are suppressed and the latches after this stage keep their
+    // contents. Unlike 'stall', this is a same-cycle signal.
+    IRStmt* hold;
+
     // Kills that kill the whole stage, across the input valid-cut. This does
     // not include any killyoungers -- those are accounted for directly in
     // AssignKills() -- but can include inputs from other transforms, e.g.
     // kill_if condition clone insertion.
     std::vector<IRStmt*> kills;
 
+    // Set by AssignKills(): the valids entering this stage, before kill
+    // gating (a transaction is present if any is set), and the OR of the
+    // killyounger and 'kills' inputs above, if any (not including the stall
+    // and hold signals, which also gate the stage). Both are computed in an
+    // earlier stage, or at the stage's own valid start. Used to trace
+    // pipeline occupancy.
+    std::vector<IRStmt*> valids;
+    IRStmt* kill;
+
+    // Non-staged links into this stage (see CreateNonStagedLink()): each is a
+    // RestartValue that reads, one cycle later, a value computed in another
+    // (usually later) stage, tagged with the control path it implements. A
+    // hold link is instead the later wait itself, read in the same cycle
+    // (see AssignHolds()); it is the only value a stage may read from a later
+    // stage without a latch.
+    enum LinkKind {
+        LINK_STALL,   // later backedge valids, for this stage's stall
+        LINK_KILL,    // later killyounger valids, for this stage's kill
+        LINK_BYPASS,  // bypass writes merged into one stage
+        LINK_WRITE,   // storage writes merged into one stage
+        LINK_HOLD,    // later waits, for this stage's hold
+    };
+    std::vector<std::pair<LinkKind, IRStmt*>> links;
+
     // Extra statements added after lowering, owned directly by the stage.
     std::vector<std::unique_ptr<IRStmt>> owned_stmts;
 
@@ -22,6 +22,7 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <functional>
 
 namespace autopiper {
 
@@ -41,13 +42,23 @@ namespace autopiper {
 // S2. A1 & A2 | A1 = A1
 // S3. A1 & A1 = A1  (implicitly, by construction of the data structures)
 // S4. A1 | A1 = A1
+//
+// Factors are kept sorted by PredicateFactorLess<T>, which defaults to
+// std::less<T>. Types whose natural ordering is not stable from run to run
+// (e.g., pointers) should specialize it so that term order, and everything
+// generated by walking it, does not depend on allocation addresses.
+template<typename T>
+struct PredicateFactorLess : public std::less<T> {};
+
 template<typename T>
 class Predicate {
  public:
   // Represents an AND of positive and negative factors, e.g. A & ~B & C & ~D.
   struct Term {
    public:
-    const std::map<T, bool> Factors() const { return factors; }
+    typedef std::map<T, bool, PredicateFactorLess<T>> FactorMap;
+
+    const FactorMap Factors() const { return factors; }
 
     bool operator==(const Term& other) const {
         // N.B.: don't worry about |falsified| here -- will be removed during
@@ -55,14 +66,25 @@ class Predicate {
         return (factors == other.factors);
     }
     bool operator<(const Term& other) const {
-        return (factors < other.factors);
+        return std::lexicographical_compare(
+                factors.begin(), factors.end(),
+                other.factors.begin(), other.factors.end(),
+                FactorPairLess);
     }
 
    protected:
     friend class Predicate;
-    std::map<T, bool> factors;
+    FactorMap factors;
     bool falsified;  // If factors.empty(), is this term true or false?
 
+    static bool FactorPairLess(const std::pair<const T, bool>& a,
+                               const std::pair<const T, bool>& b) {
+        PredicateFactorLess<T> less;
+        if (less(a.first, b.first)) return true;
+        if (less(b.first, a.first)) return false;
+        return a.second < b.second;
+    }
+
     Term() : falsified(false) {}
 
     template<typename StringFunc>
@@ -127,10 +149,11 @@ class Predicate {
         auto i_other = other->factors.begin(), e_other = other->factors.end();
         std::vector<std::pair<T, bool>> this_factors, other_factors;
         while (i_this != e_this && i_other != e_other) {
-            if (i_this->first < i_other->first) {
+            PredicateFactorLess<T> less;
+            if (less(i_this->first, i_other->first)) {
                 this_factors.push_back(*i_this);
                 i_this++;
-            } else if (i_this->first > i_other->first) {
+            } else if (less(i_other->first, i_this->first)) {
                 other_factors.push_back(*i_other);
                 i_other++;
             } else {
@@ -190,6 +213,21 @@ class Predicate {
       return p;
   }
 
+  // Rebuilds a predicate from the factors of each of its terms, as returned by
+  // Terms() and Factors() on a predicate (which are already in canonical
+  // form, so no simplification is done). Used to restore serialized
+  // predicates.
+  static Predicate FromTerms(
+          const std::vector<std::vector<std::pair<T, bool>>>& factor_lists) {
+      Predicate p;
+      for (auto& factors : factor_lists) {
+          Term term;
+          term.factors.insert(factors.begin(), factors.end());
+          p.terms.push_back(term);
+      }
+      return p;
+  }
+
  protected:
   struct DefaultStringFunc {
       std::string operator()(T t) { return t->ToString(); }
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backend/qor.h"
+#include "common/json-writer.h"
+
+#include <map>
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+// Rough two-input-gate count for a statement's combinational logic.
+int EstimateGates(const IRStmt* stmt) {
+    if (stmt->type != IRStmtExpr) {
+        return 0;
+    }
+    int w = stmt->width;
+    switch (stmt->op) {
+        case IRStmtOpAdd:
+        case IRStmtOpSub:
+            // Ripple-carry full adder per bit.
+            return 5 * w;
+        case IRStmtOpMul:
+            // Array multiplier: an AND and a full adder per partial-product
+            // bit.
+            return 6 * w * w;
+        case IRStmtOpDiv:
+        case IRStmtOpRem:
+            // Restoring array divider: a subtractor and a mux per row.
+            return 8 * w * stmt->args[0]->width;
+        case IRStmtOpAnd:
+        case IRStmtOpOr:
+        case IRStmtOpNot:
+            return w;
+        case IRStmtOpXor:
+            return 2 * w;
+        case IRStmtOpLsh:
+        case IRStmtOpRsh:
+            if (stmt->args[1]->type == IRStmtExpr &&
+                stmt->args[1]->op == IRStmtOpConst) {
+                return 0;
+            }
+            // Barrel shifter: one 2-input mux (3 gates) per bit per level.
+            return 3 * w * stmt->args[1]->width;
+        case IRStmtOpSelect:
+            return 3 * w;
+        case IRStmtOpCmpLT:
+        case IRStmtOpCmpLE:
+        case IRStmtOpCmpGT:
+        case IRStmtOpCmpGE:
+            return 5 * stmt->args[0]->width;
+        case IRStmtOpCmpEQ:
+        case IRStmtOpCmpNE:
+            return 2 * stmt->args[0]->width;
+        default:
+            return 0;
+    }
+}
+
+bool IsKillSource(const IRStmt* stmt) {
+    return stmt->type == IRStmtKill || stmt->type == IRStmtKillIf ||
+           stmt->type == IRStmtKillYounger;
+}
+
+}  // anonymous namespace
+
+map<const IRStmt*, int> StageLogicDepth(const Pipe* pipe,
+                                        const TimingModel& model) {
+    // |stmts| is in dataflow order, so args are always seen first.
+    map<const IRStmt*, int> depth;
+    for (auto* stmt : pipe->stmts) {
+        if (stmt->deleted || !stmt->stage) {
+            continue;
+        }
+        int in = 0;
+        for (auto* arg : stmt->args) {
+            if (arg->stage == stmt->stage && depth[arg] > in) {
+                in = depth[arg];
+            }
+        }
+        if (stmt->valid_in && stmt->valid_in->stage == stmt->stage &&
+            depth[stmt->valid_in] > in) {
+            in = depth[stmt->valid_in];
+        }
+        depth[stmt] = in + model.Delay(stmt);
+    }
+    return depth;
+}
+
+void QoRMetrics::Compute(const vector<PipeSys*>& systems,
+                         const VerilogGenerator& gen) {
+    StandardTimingModel model;
+
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            pipes++;
+            QoRPipeMetrics pipe_metrics;
+            pipe_metrics.entry = pipe->entry ? pipe->entry->label : "";
+
+            map<const IRStmt*, int> depth = StageLogicDepth(pipe.get(), model);
+
+            for (auto& stage : pipe->stages) {
+                QoRStageMetrics m;
+                m.stage = stage->stage;
+                m.stall = stage->stall != nullptr || stage->hold != nullptr;
+                for (auto* stmt : stage->stmts) {
+                    if (stmt->deleted) {
+                        continue;
+                    }
+                    m.stmts++;
+                    m.gates += EstimateGates(stmt);
+                    if (depth[stmt] > m.logic_depth) {
+                        m.logic_depth = depth[stmt];
+                    }
+                    if (IsKillSource(stmt)) {
+                        m.kills++;
+                    }
+                }
+                stages++;
+                gates += m.gates;
+                kill_sources += m.kills;
+                if (m.stall) {
+                    stall_sources++;
+                }
+                if (m.logic_depth > max_logic_depth) {
+                    max_logic_depth = m.logic_depth;
+                }
+                pipe_metrics.stages.push_back(m);
+            }
+            if (pipe->stages.size() > max_stages) {
+                max_stages = pipe->stages.size();
+            }
+            pipe_detail.push_back(pipe_metrics);
+        }
+    }
+
+    for (auto& p : gen.StagedSignals()) {
+        int regs = p.second.second - p.second.first;
+        piperegs += regs;
+        pipereg_bits += regs * p.first->width;
+    }
+
+    if (!systems.empty()) {
+        for (auto& storage : systems[0]->program->storage) {
+            int elements = storage->elements > 0 ? storage->elements : 1;
+            storage_bits += storage->data_width * elements;
+        }
+    }
+}
+
+void QoRMetrics::WriteJSON(ostream* out) const {
+    JSONWriter w(out);
+    w.BeginObject();
+    w.KeyValue("pipes", pipes);
+    w.KeyValue("stages", stages);
+    w.KeyValue("max_stages", max_stages);
+    w.KeyValue("pipereg_bits", pipereg_bits);
+    w.KeyValue("piperegs", piperegs);
+    w.KeyValue("max_logic_depth", max_logic_depth);
+    w.KeyValue("stall_sources", stall_sources);
+    w.KeyValue("kill_sources", kill_sources);
+    w.KeyValue("gates", gates);
+    w.KeyValue("storage_bits", storage_bits);
+    w.Key("pipe_detail");
+    w.BeginArray();
+    for (auto& pipe : pipe_detail) {
+        w.BeginObject();
+        w.KeyValue("entry", pipe.entry);
+        w.Key("stages");
+        w.BeginArray();
+        for (auto& stage : pipe.stages) {
+            w.BeginObject();
+            w.KeyValue("stage", stage.stage);
+            w.KeyValue("stmts", stage.stmts);
+            w.KeyValue("logic_depth", stage.logic_depth);
+            w.KeyValue("gates", stage.gates);
+            w.KeyValue("stall", stage.stall);
+            w.KeyValue("kills", stage.kills);
+            w.EndObject();
+        }
+        w.EndArray();
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+}
+
+}  // namespace autopiper
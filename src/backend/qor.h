@@ -0,0 +1,87 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_QOR_H_
+#define _AUTOPIPER_QOR_H_
+
+#include "backend/ir.h"
+#include "backend/pipe.h"
+#include "backend/gen-verilog.h"
+#include "backend/pipe-timing.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// Quality-of-results metrics for a lowered and generated design. These are
+// gathered from the PipeSys after lowering and from the VerilogGenerator's
+// staging decisions, so they describe exactly what was emitted. Logic depth
+// and gate counts are estimates in units of simple two-input gates, using the
+// standard timing model regardless of the model the design was timed with.
+struct QoRStageMetrics {
+    QoRStageMetrics()
+        : stage(0), stmts(0), logic_depth(0), gates(0),
+          stall(false), kills(0) {}
+
+    int stage;
+    int stmts;
+    int logic_depth;
+    int gates;
+    bool stall;
+    int kills;
+};
+
+struct QoRPipeMetrics {
+    std::string entry;
+    std::vector<QoRStageMetrics> stages;
+};
+
+struct QoRMetrics {
+    QoRMetrics()
+        : pipes(0), stages(0), max_stages(0), pipereg_bits(0),
+          piperegs(0), max_logic_depth(0), stall_sources(0),
+          kill_sources(0), gates(0), storage_bits(0) {}
+
+    int pipes;
+    int stages;          // summed over all pipes
+    int max_stages;      // longest single pipe
+    int pipereg_bits;
+    int piperegs;        // pipereg instances
+    int max_logic_depth;
+    int stall_sources;   // stages with a stall or hold signal
+    int kill_sources;    // kill, killif and killyounger sources
+    int gates;           // combinational logic, excluding piperegs
+    int storage_bits;    // regs and arrays
+
+    std::vector<QoRPipeMetrics> pipe_detail;
+
+    void Compute(const std::vector<PipeSys*>& systems,
+                 const VerilogGenerator& gen);
+
+    void WriteJSON(std::ostream* out) const;
+};
+
+// Computes the longest same-stage combinational path, in |model|'s delay
+// units, ending at each placed statement of |pipe|.
+std::map<const IRStmt*, int> StageLogicDepth(const Pipe* pipe,
+                                             const TimingModel& model);
+
+}  // namespace autopiper
+
+#endif
@@ -53,14 +53,22 @@ class ReversePostorder {
   const std::vector<const T*> FindRoots(Iter begin, Iter end) const {
       SuccFunc sf;
       std::vector<const T*> all_nodes(begin, end);
-      // Begin with all nodes as candidate roots. Remove all successors.
-      std::set<const T*> roots(all_nodes.begin(), all_nodes.end());
+      // Any node that is some node's successor is not a root. The roots are
+      // returned in input order (not pointer order) so that the resulting RPO
+      // is stable from run to run.
+      std::set<const T*> succs;
       for (const auto* node : all_nodes) {
           for (const auto* succ : sf(node)) {
-              roots.erase(succ);
+              succs.insert(succ);
           }
       }
-      return std::vector<const T*>(roots.begin(), roots.end());
+      std::vector<const T*> roots;
+      for (const auto* node : all_nodes) {
+          if (!succs.count(node)) {
+              roots.push_back(node);
+          }
+      }
+      return roots;
   }
 
  private:
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backend/sdc.h"
+#include "backend/qor.h"
+#include "common/util.h"
+
+#include <ctype.h>
+#include <set>
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+// A pipe's entry label, made safe for use in an SDC object name.
+string GroupName(const string& label) {
+    string ret;
+    for (char c : label) {
+        ret += (isalnum(c) || c == '_') ? c : '_';
+    }
+    return ret;
+}
+
+const char* LinkKindName(PipeStage::LinkKind kind) {
+    switch (kind) {
+        case PipeStage::LINK_STALL:  return "stall";
+        case PipeStage::LINK_KILL:   return "kill";
+        case PipeStage::LINK_BYPASS: return "bypass";
+        case PipeStage::LINK_WRITE:  return "write_merge";
+        case PipeStage::LINK_HOLD:   return "hold";
+    }
+    return "";
+}
+
+// Whether |gen| staged |stmt|'s value into |stage|, i.e., emitted the pipereg
+// named by PipeRegName(stmt, stage).
+bool HasPipeReg(const VerilogGenerator& gen, const IRStmt* stmt, int stage) {
+    auto it = gen.StagedSignals().find(stmt);
+    return it != gen.StagedSignals().end() &&
+           it->second.first < stage && stage <= it->second.second;
+}
+
+string ObjectList(const vector<string>& names) {
+    string ret;
+    for (auto& name : names) {
+        if (!ret.empty()) ret += " ";
+        ret += name;
+    }
+    return "{" + ret + "}";
+}
+
+}  // anonymous namespace
+
+void SDCConstraints::Compute(const vector<PipeSys*>& systems,
+                             const VerilogGenerator& gen,
+                             const TimingModel& model) {
+    budget = model.DelayPerStage();
+    if (systems.empty()) {
+        return;
+    }
+
+    const IRProgram* program = systems[0]->program;
+    timing_model = program->timing_model;
+    inputs.push_back("reset");
+    for (auto& port : program->ports) {
+        if (!port->exported) continue;
+        if (port->defs.size() > 0) {
+            outputs.push_back(port->name);
+        } else {
+            inputs.push_back(port->name);
+        }
+    }
+    for (auto& s : program->storage) {
+        // A ROM holds no state: it is logic between piperegs.
+        if (s->IsRom()) continue;
+        storage.push_back(gen.StorageCellName(s.get()) + "*");
+    }
+
+    map<const Pipe*, SDCPipe*> pipe_sdc;
+    set<string> names;
+    int idx = 0;
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            SDCPipe p;
+            p.entry = pipe->entry ? pipe->entry->label : "";
+            p.name = GroupName(p.entry);
+            if (p.name.empty() || names.count(p.name)) {
+                p.name = strprintf("pipe%d", idx);
+            }
+            names.insert(p.name);
+            idx++;
+
+            map<const IRStmt*, int> depth = StageLogicDepth(pipe.get(), model);
+            for (auto& stage : pipe->stages) {
+                SDCStage s;
+                s.stage = stage->stage;
+                for (auto* stmt : stage->stmts) {
+                    if (!stmt->deleted && depth[stmt] > s.delay) {
+                        s.delay = depth[stmt];
+                    }
+                }
+                p.stages.push_back(s);
+            }
+            pipes.push_back(p);
+        }
+    }
+    idx = 0;
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            pipe_sdc[pipe.get()] = &pipes[idx++];
+        }
+    }
+
+    // A value staged over [first, last] is latched at each boundary in
+    // between by a pipereg that belongs to the stage before it. A held stage
+    // gates those piperegs' enables with its hold signal.
+    set<string> holds;
+    for (auto& p : gen.StagedSignals()) {
+        const IRStmt* stmt = p.first;
+        auto it = pipe_sdc.find(stmt->pipe);
+        if (it == pipe_sdc.end()) {
+            continue;
+        }
+        auto& stages = it->second->stages;
+        for (int i = p.second.first;
+             i < p.second.second && i < static_cast<int>(stages.size());
+             i++) {
+            string reg = gen.PipeRegName(stmt, i + 1);
+            stages[i].piperegs.push_back(reg);
+            if (stmt->pipe->stages[i]->hold) {
+                holds.insert(reg + "/enable");
+            }
+        }
+    }
+    hold_pins.assign(holds.begin(), holds.end());
+
+    // A non-staged link reads its source one cycle later, through the
+    // pipereg that stages the source value out of its own stage. (A hold
+    // link is read in the same cycle; its paths end at the hold pins above.)
+    map<PipeStage::LinkKind, set<string>> links;
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            for (auto& stage : pipe->stages) {
+                for (auto& link : stage->links) {
+                    if (link.first == PipeStage::LINK_HOLD) continue;
+                    const IRStmt* src = link.second->restart_arg;
+                    if (link.second->deleted ||
+                        !HasPipeReg(gen, src, src->stage->stage + 1)) {
+                        continue;
+                    }
+                    links[link.first].insert(
+                            gen.PipeRegName(src, src->stage->stage + 1));
+                }
+            }
+        }
+    }
+    for (auto& p : links) {
+        link_sources[p.first].assign(p.second.begin(), p.second.end());
+    }
+}
+
+void SDCConstraints::Write(ostream* out) const {
+    (*out) << "# Timing constraints for module '" << module_name
+           << "', generated by autopiper.\n"
+           << "#\n"
+           << "# Paths are grouped by the pipe stage whose logic they time, "
+           << "so that timing\n"
+           << "# reports map back to autopiper stages. Each stage is "
+           << "annotated with the\n"
+           << "# timing model's estimate of its longest path.\n"
+           << "#\n"
+           << "# Timing model: "
+           << (timing_model.empty() ? string("standard") : timing_model)
+           << ", budget " << budget << " per stage.\n\n";
+
+    (*out) << "create_clock -name clock -period " << clock_period
+           << " [get_ports clock]\n";
+    if (!inputs.empty()) {
+        (*out) << "set_input_delay 0 -clock clock [get_ports "
+               << ObjectList(inputs) << "]\n";
+    }
+    if (!outputs.empty()) {
+        (*out) << "set_output_delay 0 -clock clock [get_ports "
+               << ObjectList(outputs) << "]\n";
+    }
+
+    for (auto& pipe : pipes) {
+        (*out) << "\n# Pipe '" << pipe.entry << "'.\n";
+        for (auto& stage : pipe.stages) {
+            double estimate = budget > 0 ?
+                clock_period * stage.delay / budget : 0;
+            (*out) << "# " << pipe.name << " stage " << stage.stage
+                   << ": longest path " << stage.delay << " / " << budget
+                   << strprintf(" (about %.3g of %.3g ns)", estimate,
+                                clock_period)
+                   << (stage.delay > budget ? ", over budget" : "")
+                   << "\n";
+            if (!stage.piperegs.empty()) {
+                (*out) << "group_path -name " << pipe.name << "_s"
+                       << stage.stage << " -to [get_cells "
+                       << ObjectList(stage.piperegs) << "]\n";
+            }
+        }
+    }
+
+    if (!storage.empty()) {
+        (*out) << "\n# Registers and arrays are written on the falling clock "
+               << "edge, so paths from\n"
+               << "# stage logic into them have half a clock period.\n"
+               << "group_path -name storage -to [get_cells "
+               << ObjectList(storage) << "]\n";
+    }
+
+    if (!link_sources.empty()) {
+        (*out) << "\n# Non-staged links: stall, kill, bypass and merged-write "
+               << "signals are latched\n"
+               << "# in the stage that computes them and used by another "
+               << "stage in the next\n"
+               << "# cycle. They are single-cycle paths (not multicycle or "
+               << "false paths),\n"
+               << "# grouped by source so that they stand apart from the "
+               << "stage groups.\n";
+        for (auto& p : link_sources) {
+            (*out) << "group_path -name " << LinkKindName(p.first)
+                   << " -from [get_cells " << ObjectList(p.second) << "]\n";
+        }
+    }
+
+    if (!hold_pins.empty()) {
+        (*out) << "\n# Holds: a wait's condition gates the piperegs of every "
+               << "upstream stage in\n"
+               << "# the same cycle, so these paths cross stage boundaries "
+               << "combinationally.\n"
+               << "group_path -name hold -through [get_pins "
+               << ObjectList(hold_pins) << "]\n";
+    }
+}
+
+}  // namespace autopiper
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_SDC_H_
+#define _AUTOPIPER_SDC_H_
+
+#include "backend/ir.h"
+#include "backend/pipe.h"
+#include "backend/gen-verilog.h"
+#include "backend/pipe-timing.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// Timing constraints (SDC) for a generated module, aligned with its pipeline
+// stages. Register-to-register paths are grouped by the stage whose logic
+// they time, i.e., by the piperegs that latch that stage's results, so that
+// a timing report maps back to autopiper stages; the non-staged links behind
+// stalls, kills, bypasses and merged writes, and the same-cycle hold fan-in
+// from waits, get groups of their own. Each stage is annotated with the
+// timing model's estimate of its longest path against the stage budget.
+struct SDCStage {
+    SDCStage() : stage(0), delay(0) {}
+
+    int stage;
+    int delay;                          // longest path, in model units
+    std::vector<std::string> piperegs;  // latch this stage's results
+};
+
+struct SDCPipe {
+    std::string name;   // group-name prefix
+    std::string entry;
+    std::vector<SDCStage> stages;
+};
+
+struct SDCConstraints {
+    SDCConstraints() : clock_period(10.0), budget(0) {}
+
+    std::string module_name;
+    double clock_period;       // ns
+    std::string timing_model;  // as named by the 'timing_model' pragma
+    int budget;                // model delay units per stage
+
+    std::vector<std::string> inputs;   // excluding clock
+    std::vector<std::string> outputs;
+    std::vector<std::string> storage;  // register and array cell patterns
+    std::vector<SDCPipe> pipes;
+
+    // Source piperegs of the non-staged links of each kind, and the enable
+    // inputs of held piperegs.
+    std::map<PipeStage::LinkKind, std::vector<std::string>> link_sources;
+    std::vector<std::string> hold_pins;
+
+    void Compute(const std::vector<PipeSys*>& systems,
+                 const VerilogGenerator& gen,
+                 const TimingModel& model);
+
+    void Write(std::ostream* out) const;
+};
+
+}  // namespace autopiper
+
+#endif
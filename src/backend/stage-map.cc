@@ -0,0 +1,253 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backend/stage-map.h"
+#include "backend/qor.h"
+#include "common/json-writer.h"
+#include "common/util.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+// Count the signals that AssignStalls(), AssignHolds() and AssignKills() OR
+// together into stage |i|'s stall/hold and kill inputs.
+void CountFanin(const PipeSys* sys, const PipeStage* stage,
+                StageMapStage* m) {
+    int i = stage->stage;
+    if (i == 0) {
+        return;
+    }
+    for (auto& other_pipe : sys->pipes) {
+        for (unsigned j = i + 1; j < other_pipe->stages.size(); j++) {
+            for (auto* stmt : other_pipe->stages[j]->stmts) {
+                if (stmt->type == IRStmtBackedge &&
+                    stmt->restart_target->restart_cond->stage->stage > i) {
+                    m->stall_fanin++;
+                } else if (stmt->type == IRStmtWait) {
+                    m->stall_fanin++;
+                } else if (stmt->type == IRStmtKillYounger) {
+                    m->kill_fanin++;
+                }
+            }
+        }
+    }
+    m->kill_fanin += stage->kills.size();
+}
+
+bool WiderValue(const StageMapValue& a, const StageMapValue& b) {
+    if (a.stmt->width != b.stmt->width) {
+        return a.stmt->width > b.stmt->width;
+    }
+    return a.stmt->valnum < b.stmt->valnum;
+}
+
+string ValueLocation(const StageMapValue& v) {
+    if (v.stmt->location.line == 0) {
+        return "";
+    }
+    return v.stmt->location.ToString();
+}
+
+string HTMLEscape(const string& s) {
+    string ret;
+    for (char c : s) {
+        switch (c) {
+            case '<': ret += "&lt;"; break;
+            case '>': ret += "&gt;"; break;
+            case '&': ret += "&amp;"; break;
+            case '"': ret += "&quot;"; break;
+            default: ret += c;
+        }
+    }
+    return ret;
+}
+
+}  // anonymous namespace
+
+void StageMap::Compute(const vector<PipeSys*>& systems,
+                       const VerilogGenerator& gen,
+                       const TimingModel& model) {
+    budget = model.DelayPerStage();
+
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            StageMapPipe pipe_map;
+            pipe_map.entry = pipe->entry ? pipe->entry->label : "";
+
+            map<const IRStmt*, int> depth = StageLogicDepth(pipe.get(), model);
+            for (auto& stage : pipe->stages) {
+                StageMapStage m;
+                m.stage = stage->stage;
+                for (auto* stmt : stage->stmts) {
+                    if (stmt->deleted) {
+                        continue;
+                    }
+                    m.stmts++;
+                    m.delay_sum += model.Delay(stmt);
+                    if (depth[stmt] > m.delay) {
+                        m.delay = depth[stmt];
+                    }
+                }
+                CountFanin(sys, stage.get(), &m);
+                pipe_map.stages.push_back(m);
+            }
+            pipes.push_back(pipe_map);
+        }
+    }
+
+    // Index pipes only once |pipes| has stopped growing.
+    map<const Pipe*, StageMapPipe*> pipe_maps;
+    int idx = 0;
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            pipe_maps[pipe.get()] = &pipes[idx++];
+        }
+    }
+
+    // A value carried over stages [first, last] occupies a pipereg at each
+    // boundary in between, and is live in every stage of that range.
+    for (auto& p : gen.StagedSignals()) {
+        const IRStmt* stmt = p.first;
+        int first = p.second.first, last = p.second.second;
+        if (first == last || stmt->width <= 0) {
+            continue;
+        }
+        auto it = pipe_maps.find(stmt->pipe);
+        if (it == pipe_maps.end()) {
+            continue;
+        }
+        auto& stages = it->second->stages;
+        StageMapValue v;
+        v.stmt = stmt;
+        v.first_stage = first;
+        v.last_stage = last;
+        for (int i = first; i <= last && i < stages.size(); i++) {
+            if (i < last) {
+                stages[i].bits_out += stmt->width;
+            }
+            if (i > first) {
+                stages[i].bits_in += stmt->width;
+            }
+            stages[i].live.push_back(v);
+        }
+    }
+
+    for (auto& pipe_map : pipes) {
+        for (auto& m : pipe_map.stages) {
+            sort(m.live.begin(), m.live.end(), WiderValue);
+            if (m.live.size() > kMaxLiveValues) {
+                m.live.resize(kMaxLiveValues);
+            }
+        }
+    }
+}
+
+void StageMap::WriteJSON(ostream* out) const {
+    JSONWriter w(out);
+    w.BeginObject();
+    w.KeyValue("budget", budget);
+    w.Key("pipes");
+    w.BeginArray();
+    for (auto& pipe : pipes) {
+        w.BeginObject();
+        w.KeyValue("entry", pipe.entry);
+        w.Key("stages");
+        w.BeginArray();
+        for (auto& stage : pipe.stages) {
+            w.BeginObject();
+            w.KeyValue("stage", stage.stage);
+            w.KeyValue("stmts", stage.stmts);
+            w.KeyValue("delay", stage.delay);
+            w.KeyValue("delay_sum", stage.delay_sum);
+            w.KeyValue("bits_in", stage.bits_in);
+            w.KeyValue("bits_out", stage.bits_out);
+            w.KeyValue("stall_fanin", stage.stall_fanin);
+            w.KeyValue("kill_fanin", stage.kill_fanin);
+            w.Key("live");
+            w.BeginArray();
+            for (auto& v : stage.live) {
+                w.BeginObject();
+                w.KeyValue("value", strprintf("%%%d", v.stmt->valnum));
+                w.KeyValue("width", v.stmt->width);
+                w.KeyValue("first_stage", v.first_stage);
+                w.KeyValue("last_stage", v.last_stage);
+                w.KeyValue("location", ValueLocation(v));
+                w.EndObject();
+            }
+            w.EndArray();
+            w.EndObject();
+        }
+        w.EndArray();
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+}
+
+void StageMap::WriteHTML(ostream* out) const {
+    (*out) << "<!DOCTYPE html>\n"
+           << "<html>\n<head>\n<meta charset=\"utf-8\">\n"
+           << "<title>autopiper stage map</title>\n"
+           << "<style>\n"
+           << "body { font-family: sans-serif; }\n"
+           << "table { border-collapse: collapse; margin-bottom: 2em; }\n"
+           << "th, td { border: 1px solid #999; padding: 2px 8px; "
+           << "text-align: right; vertical-align: top; }\n"
+           << "td.live { text-align: left; font-family: monospace; }\n"
+           << "tr.over { background: #fcc; }\n"
+           << "</style>\n</head>\n<body>\n";
+    (*out) << "<p>Delay budget per stage: " << budget << "</p>\n";
+    for (auto& pipe : pipes) {
+        (*out) << "<h2>Pipe " << HTMLEscape(pipe.entry) << "</h2>\n"
+               << "<table>\n<tr><th>Stage</th><th>Stmts</th>"
+               << "<th>Delay</th><th>Delay sum</th>"
+               << "<th>Bits in</th><th>Bits out</th>"
+               << "<th>Stall fan-in</th><th>Kill fan-in</th>"
+               << "<th>Widest live values</th></tr>\n";
+        for (auto& stage : pipe.stages) {
+            (*out) << "<tr" << (stage.delay > budget ? " class=\"over\"" : "")
+                   << "><td>" << stage.stage
+                   << "</td><td>" << stage.stmts
+                   << "</td><td>" << stage.delay << " / " << budget
+                   << "</td><td>" << stage.delay_sum
+                   << "</td><td>" << stage.bits_in
+                   << "</td><td>" << stage.bits_out
+                   << "</td><td>" << stage.stall_fanin
+                   << "</td><td>" << stage.kill_fanin
+                   << "</td><td class=\"live\">";
+            for (auto& v : stage.live) {
+                (*out) << "%" << v.stmt->valnum << " [" << v.stmt->width
+                       << "] stages " << v.first_stage << "-" << v.last_stage;
+                string loc = ValueLocation(v);
+                if (!loc.empty()) {
+                    (*out) << " " << HTMLEscape(loc);
+                }
+                (*out) << "<br>";
+            }
+            (*out) << "</td></tr>\n";
+        }
+        (*out) << "</table>\n";
+    }
+    (*out) << "</body>\n</html>\n";
+}
+
+}  // namespace autopiper
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_STAGE_MAP_H_
+#define _AUTOPIPER_STAGE_MAP_H_
+
+#include "backend/ir.h"
+#include "backend/pipe.h"
+#include "backend/gen-verilog.h"
+#include "backend/pipe-timing.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// A per-pipe, per-stage map of where logic and state landed after lowering:
+// occupancy (statements and combinational delay against the stage budget),
+// register pressure (bits carried across each stage boundary, and the widest
+// values doing so), and stall/kill fan-in. Delays and the budget come from
+// the timing model the design was timed with, so that a stage's delay can be
+// read against the budget the pipe timer split it by.
+struct StageMapValue {
+    StageMapValue()
+        : stmt(nullptr), first_stage(0), last_stage(0) {}
+
+    const IRStmt* stmt;
+    int first_stage;  // stage in which the value is computed
+    int last_stage;   // last stage in which it is used
+};
+
+struct StageMapStage {
+    StageMapStage()
+        : stage(0), stmts(0), delay(0), delay_sum(0), bits_in(0),
+          bits_out(0), stall_fanin(0), kill_fanin(0) {}
+
+    int stage;
+    int stmts;
+    int delay;       // longest combinational path within the stage
+    int delay_sum;   // summed delay of all statements in the stage
+    int bits_in;     // pipereg bits entering from the previous stage
+    int bits_out;    // pipereg bits leaving for the next stage
+    int stall_fanin; // later backedges and waits that stall this stage
+    int kill_fanin;  // later killyoungers plus kill_if clones
+    std::vector<StageMapValue> live;  // widest staged values, widest first
+};
+
+struct StageMapPipe {
+    std::string entry;
+    std::vector<StageMapStage> stages;
+};
+
+struct StageMap {
+    StageMap() : budget(0) {}
+
+    // Number of values listed per stage in |live|.
+    static const int kMaxLiveValues = 5;
+
+    int budget;  // delay budget per stage, in model units
+    std::vector<StageMapPipe> pipes;
+
+    void Compute(const std::vector<PipeSys*>& systems,
+                 const VerilogGenerator& gen,
+                 const TimingModel& model);
+
+    void WriteJSON(std::ostream* out) const;
+    void WriteHTML(std::ostream* out) const;
+};
+
+}  // namespace autopiper
+
+#endif
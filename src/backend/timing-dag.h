@@ -53,6 +53,10 @@ class TimingDAG {
         // Note a node as 'lifted'. A lifted node cannot sink past its
         // earliest-possible time during the sink phase.
         inline void LiftNode(const T* node);
+        // Give a node a fixed latency in stages: its inputs are consumed
+        // |stages| stages before the stage in which its output appears (at the
+        // start of that stage).
+        inline void SetLatency(const T* node, int stages);
 
         // Solves the DAG. Requires ErrorReporter with the method:
         //   ReportError(const T* node, const U* var,
@@ -107,6 +111,7 @@ class TimingDAG {
                 : t(t_),
                   lifted(false),
                   delay(delay_),
+                  latency(0),
                   stage(kUnknown),
                   stage_offset(kUnknown),
                   anchored(false),
@@ -118,6 +123,7 @@ class TimingDAG {
             const T* t;
             bool lifted;
             int delay;
+            int latency;  // stages from inputs to output (0: combinational)
             int stage;
             int stage_offset;  // gate delays from start of stage
             bool anchored;  // anchored to this stage
@@ -218,6 +224,13 @@ void TimingDAG<T, U>::LiftNode(const T* node) {
     n->lifted = true;
 }
 
+template<typename T, typename U>
+void TimingDAG<T, U>::SetLatency(const T* node, int stages) {
+    assert(node_map_.find(node) != node_map_.end());
+    Node* n = node_map_[node];
+    n->latency = stages;
+}
+
 template<typename T, typename U>
 template<typename ErrorReporter>
 bool TimingDAG<T, U>::CheckForCycles(ErrorReporter* err) {
@@ -400,7 +413,14 @@ bool TimingDAG<T, U>::DoPhase(
                     // Forward direction: compute natural stage based on
                     // predecessors, and push node to higher stage if
                     // necessary.
-                    if (in_edge->from->stage != kUnknown) {
+                    if (in_edge->from->stage != kUnknown &&
+                        node->latency > 0) {
+                        // A fixed-latency node's output appears at the start
+                        // of the stage |latency| stages after its inputs.
+                        start_stage_from_this_input =
+                            in_edge->from->stage + node->latency;
+                        stage_offset_from_this_input = 0;
+                    } else if (in_edge->from->stage != kUnknown) {
                         // Compute timing offset in predecessor node's output from
                         // the beginning of its stage, in gate delays.
                         int start_delay = in_edge->from->stage_offset + in_edge->from->delay;
@@ -427,7 +447,15 @@ bool TimingDAG<T, U>::DoPhase(
                 } else {
                     // Reverse direction: compute natural stage based on
                     // successors, and push node to lower stage if necessary.
-                    if (in_edge->to->stage != kUnknown) {
+                    if (in_edge->to->stage != kUnknown &&
+                        in_edge->to->latency > 0) {
+                        // Feeding a fixed-latency node: be ready by the end
+                        // of the stage in which it consumes its inputs.
+                        start_stage_from_this_input =
+                            in_edge->to->stage - in_edge->to->latency;
+                        stage_offset_from_this_input =
+                            delay_per_stage - node->delay;
+                    } else if (in_edge->to->stage != kUnknown) {
                         int start_delay = in_edge->to->stage_offset - node->delay;
                         if (start_delay < 0) {
                             start_stage_from_this_input = in_edge->to->stage - 1;
@@ -551,7 +579,7 @@ void TimingDAG<T, U>::FindStageSets() {
 template<typename T, typename U>
 int TimingDAG<T, U>::GetStage(const T* t) const {
     assert(node_map_.find(t) != node_map_.end());
-    Node* n = node_map_[t];
+    Node* n = node_map_.at(t);
     return n->stage;
 }
 
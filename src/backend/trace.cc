@@ -0,0 +1,165 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backend/trace.h"
+#include "common/json-writer.h"
+#include "common/util.h"
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+
+const char* KindName(TraceSignal::Kind kind) {
+    switch (kind) {
+        case TraceSignal::VALID: return "valid";
+        case TraceSignal::STALL: return "stall";
+        case TraceSignal::HOLD:  return "hold";
+        case TraceSignal::KILL:  return "kill";
+        case TraceSignal::VALUE: return "value";
+    }
+    return "";
+}
+
+// Names of the trace buffer's module ports.
+const char* const kTracePorts[] = {
+    "trace_trigger", "trace_read_addr", "trace_read_data", "trace_done",
+};
+
+}  // anonymous namespace
+
+bool TraceBuffer::Compute(const vector<PipeSys*>& systems,
+                          int depth,
+                          const vector<string>& values,
+                          ErrorCollector* coll) {
+    if (depth < 2 || (depth & (depth - 1)) != 0) {
+        coll->ReportError(Location(), ErrorCollector::ERROR,
+                strprintf("Trace depth %d is not a power of two (at least "
+                          "2)", depth));
+        return false;
+    }
+    this->depth = depth;
+    addr_bits = 0;
+    while ((1 << addr_bits) < depth) addr_bits++;
+    post_trigger = depth / 2;
+
+    auto add = [this](TraceSignal s) {
+        s.bit = width;
+        width += s.width;
+        signals.push_back(s);
+    };
+
+    int idx = 0;
+    for (auto* sys : systems) {
+        for (auto& pipe : sys->pipes) {
+            TraceSignal s;
+            s.pipe = idx++;
+            s.entry = pipe->entry ? pipe->entry->label : "";
+            for (auto& stage : pipe->stages) {
+                s.stage = stage->stage;
+                // A stage with no valids has no logic of its own: its
+                // transactions are visible in the next stage that does.
+                if (stage->valids.empty()) continue;
+                s.kind = TraceSignal::VALID;
+                s.stmts.assign(stage->valids.begin(), stage->valids.end());
+                add(s);
+                const pair<TraceSignal::Kind, IRStmt*> bits[] = {
+                    { TraceSignal::STALL, stage->stall },
+                    { TraceSignal::HOLD, stage->hold },
+                    { TraceSignal::KILL, stage->kill },
+                };
+                for (auto& b : bits) {
+                    if (!b.second) continue;
+                    s.kind = b.first;
+                    s.stmts = { b.second };
+                    add(s);
+                }
+            }
+        }
+    }
+
+    if (systems.empty()) {
+        return true;
+    }
+    const IRProgram* program = systems[0]->program;
+    for (auto& port : program->ports) {
+        for (const char* name : kTracePorts) {
+            if (port->name == name) {
+                coll->ReportError(Location(), ErrorCollector::ERROR,
+                        strprintf("Port '%s' conflicts with the trace "
+                                  "buffer's port of the same name", name));
+                return false;
+            }
+        }
+    }
+    for (auto& name : values) {
+        const IRPort* port = nullptr;
+        for (auto& p : program->ports) {
+            if (p->name == name) {
+                port = p.get();
+                break;
+            }
+        }
+        if (!port) {
+            coll->ReportError(Location(), ErrorCollector::ERROR,
+                    strprintf("Unknown port '%s' to trace", name.c_str()));
+            return false;
+        }
+        if (port->type != IRPort::PORT || port->width <= 0) {
+            coll->ReportError(Location(), ErrorCollector::ERROR,
+                    strprintf("Cannot trace '%s'; only ports with a value "
+                              "can be traced", name.c_str()));
+            return false;
+        }
+        TraceSignal s;
+        s.kind = TraceSignal::VALUE;
+        s.port = port;
+        s.width = port->width;
+        add(s);
+    }
+    return true;
+}
+
+void TraceBuffer::WriteJSON(ostream* out, const string& module_name) const {
+    JSONWriter w(out);
+    w.BeginObject();
+    w.KeyValue("module", module_name);
+    w.KeyValue("depth", depth);
+    w.KeyValue("width", width);
+    // Entry index of the trigger sample in the read-out order.
+    w.KeyValue("trigger_index", depth - post_trigger);
+    w.Key("signals");
+    w.BeginArray();
+    for (auto& s : signals) {
+        w.BeginObject();
+        w.KeyValue("kind", KindName(s.kind));
+        if (s.kind == TraceSignal::VALUE) {
+            w.KeyValue("port", s.port->name);
+        } else {
+            w.KeyValue("pipe", s.pipe);
+            w.KeyValue("entry", s.entry);
+            w.KeyValue("stage", s.stage);
+        }
+        w.KeyValue("bit", s.bit);
+        w.KeyValue("width", s.width);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+}
+
+}  // namespace autopiper
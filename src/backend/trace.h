@@ -0,0 +1,84 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_TRACE_H_
+#define _AUTOPIPER_TRACE_H_
+
+#include "backend/ir.h"
+#include "backend/pipe.h"
+#include "common/parser-utils.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+
+// An on-chip trace buffer for bring-up under real traffic. Every cycle, the
+// generated module samples each pipe stage's control bits -- whether a
+// transaction is present (valid), and whether the stage is stalled, held or
+// killed -- together with the values of selected ports, into a circular
+// buffer of |depth| entries. Once the 'trace_trigger' input is seen, capture
+// continues for |post_trigger| more samples (counting the trigger's own) and
+// then stops, raising 'trace_done'; 'trace_read_data' then shows the entry
+// at 'trace_read_addr', counting from the oldest. The layout of a sample is
+// written as a JSON map so that a host tool can rebuild pipeline diagrams.
+struct TraceSignal {
+    enum Kind {
+        VALID,
+        STALL,
+        HOLD,
+        KILL,
+        VALUE,
+    };
+
+    TraceSignal()
+        : kind(VALID), pipe(0), stage(0), port(nullptr), bit(0), width(1) {}
+
+    Kind kind;
+    int pipe;                  // index over all pipes, in system order
+    std::string entry;         // the pipe's entry label
+    int stage;
+    const IRPort* port;        // VALUE: the traced port
+    std::vector<const IRStmt*> stmts;  // control bits: OR of these
+    int bit;                   // offset of the lsb in a sample
+    int width;
+};
+
+struct TraceBuffer {
+    TraceBuffer() : depth(0), addr_bits(0), post_trigger(0), width(0) {}
+
+    int depth;                 // entries; a power of two
+    int addr_bits;             // log2(depth)
+    int post_trigger;          // samples kept from the trigger on
+    int width;                 // bits per sample
+    std::vector<TraceSignal> signals;
+
+    // Lays out the control bits of every stage of |systems| and the ports
+    // named by |values|, in a buffer of |depth| entries. Returns false and
+    // reports an error if the depth or a port name is invalid.
+    bool Compute(const std::vector<PipeSys*>& systems,
+                 int depth,
+                 const std::vector<std::string>& values,
+                 ErrorCollector* coll);
+
+    // Writes the sample layout, for the module named |module_name|.
+    void WriteJSON(std::ostream* out, const std::string& module_name) const;
+};
+
+}  // namespace autopiper
+
+#endif
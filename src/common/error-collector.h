@@ -43,7 +43,7 @@ class CmdlineErrorCollector : public ErrorCollector {
                     (*output_) << "Info: ";
                     break;
             }
-            (*output_) << loc.filename << ":" << loc.line << ":" << loc.column << ": ";
+            (*output_) << loc.filename() << ":" << loc.line << ":" << loc.column << ": ";
             (*output_) << message << std::endl;
         }
 
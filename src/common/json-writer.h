@@ -0,0 +1,133 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_COMMON_JSON_WRITER_H_
+#define _AUTOPIPER_COMMON_JSON_WRITER_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace autopiper {
+
+// A minimal streaming JSON writer for machine-readable reports. Callers are
+// responsible for well-formedness (matched Begin/End calls, and a Key() before
+// each value inside an object); the writer only handles separators, quoting
+// and indentation.
+class JSONWriter {
+    public:
+        JSONWriter(std::ostream* out)
+            : out_(out), need_comma_(false), after_key_(false) {}
+
+        void BeginObject() { Open('{'); }
+        void EndObject() { Close('}'); }
+        void BeginArray() { Open('['); }
+        void EndArray() { Close(']'); }
+
+        void Key(const std::string& key) {
+            Separator();
+            WriteString(key);
+            (*out_) << ": ";
+            after_key_ = true;
+        }
+
+        void Value(const std::string& s) { Separator(); WriteString(s); }
+        void Value(const char* s) { Value(std::string(s)); }
+        void Value(int v) { Separator(); (*out_) << v; }
+        void Value(long long v) { Separator(); (*out_) << v; }
+        void Value(double v) { Separator(); (*out_) << v; }
+        void Value(bool v) { Separator(); (*out_) << (v ? "true" : "false"); }
+
+        template<typename T>
+        void KeyValue(const std::string& key, const T& value) {
+            Key(key);
+            Value(value);
+        }
+
+    private:
+        std::ostream* out_;
+        std::vector<char> stack_;
+        bool need_comma_;
+        bool after_key_;
+
+        void Newline() {
+            (*out_) << "\n";
+            for (unsigned i = 0; i < stack_.size(); i++) {
+                (*out_) << "  ";
+            }
+        }
+
+        // Emit whatever precedes a new value or key.
+        void Separator() {
+            if (after_key_) {
+                after_key_ = false;
+                need_comma_ = true;
+                return;
+            }
+            if (need_comma_) {
+                (*out_) << ",";
+            }
+            if (!stack_.empty()) {
+                Newline();
+            }
+            need_comma_ = true;
+        }
+
+        void Open(char c) {
+            Separator();
+            (*out_) << c;
+            stack_.push_back(c);
+            need_comma_ = false;
+        }
+
+        void Close(char c) {
+            stack_.pop_back();
+            if (need_comma_) {
+                Newline();
+            }
+            (*out_) << c;
+            need_comma_ = true;
+            if (stack_.empty()) {
+                (*out_) << "\n";
+            }
+        }
+
+        void WriteString(const std::string& s) {
+            (*out_) << '"';
+            for (char c : s) {
+                switch (c) {
+                    case '"': (*out_) << "\\\""; break;
+                    case '\\': (*out_) << "\\\\"; break;
+                    case '\n': (*out_) << "\\n"; break;
+                    case '\t': (*out_) << "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            char buf[8];
+                            snprintf(buf, sizeof(buf), "\\u%04x", c);
+                            (*out_) << buf;
+                        } else {
+                            (*out_) << c;
+                        }
+                }
+            }
+            (*out_) << '"';
+        }
+};
+
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_COMMON_JSON_WRITER_H_
@@ -23,21 +23,35 @@
 
 #include <boost/multiprecision/gmp.hpp>
 
+#include "common/source-map.h"
+
 namespace autopiper {
 
+// A source location, packed into eight bytes: the file is an interned
+// SourceMap ID, resolved to a name only when printed. Columns past 65535 are
+// recorded as 65535.
 struct Location {
-    std::string filename;
-    int line, column;
+    uint32_t line;
+    uint16_t column;
+    SourceMap::FileID file;
 
     Location() {
-        filename = "(none)";
         line = 0;
         column = 0;
+        file = SourceMap::kNoFile;
+    }
+
+    const std::string& filename() const { return SourceMap::Filename(file); }
+    void set_column(int col) {
+        column = col > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(col);
+    }
+    void set_filename(const std::string& name) {
+        file = SourceMap::Intern(name);
     }
 
     std::string ToString() const {
         std::ostringstream os;
-        os << filename << ":" << line << ":" << column;
+        os << filename() << ":" << line << ":" << column;
         return os.str();
     }
 };
@@ -58,9 +72,11 @@ class ErrorCollector {
 
 class PeekableStream {
     public:
-        PeekableStream(std::istream* in)
+        // |first_line| is the line number of the first character of |in|;
+        // it is other than 1 only when lexing a fragment of a larger file.
+        PeekableStream(std::istream* in, int first_line = 1)
             : in_(in), peek_char_(0), have_peek_(false), eof_(false),
-              line_(1), col_(0) {
+              line_(first_line), col_(0) {
             ReadNext();
         }
 
@@ -353,8 +369,8 @@ class Lexer {
 
 class LexerImpl : public Lexer {
     public:
-        LexerImpl(std::istream* in)
-            : stream_(in), have_peek_(false),
+        LexerImpl(std::istream* in, int first_line = 1)
+            : stream_(in, first_line), have_peek_(false),
               ignore_newline_(false) {
             ReadNext();
         }
@@ -685,20 +701,22 @@ class TokenPrinter {
 class ParserBase {
     protected:
         std::string filename_;
+        SourceMap::FileID file_;
         Lexer* lexer_;
         ErrorCollector* collector_;
         bool have_errors_;
 
         ParserBase(std::string filename, Lexer* lexer,
                    ErrorCollector* collector)
-            : filename_(filename), lexer_(lexer), collector_(collector)
+            : filename_(filename), file_(SourceMap::Intern(filename)),
+              lexer_(lexer), collector_(collector)
         {}
 
         Location CurLocation() const {
             Location loc;
-            loc.filename = filename_;
+            loc.file = file_;
             loc.line = CurToken().line;
-            loc.column = CurToken().col;
+            loc.set_column(CurToken().col);
             return loc;
         }
 
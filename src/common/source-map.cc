@@ -0,0 +1,69 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/source-map.h"
+
+using namespace std;
+
+namespace autopiper {
+
+namespace {
+const string kUnknownFileName = "(unknown file)";
+}  // anonymous namespace
+
+thread_local SourceMap* SourceMap::current_ = nullptr;
+
+SourceMap::SourceMap() {
+    names_.push_back("(none)");
+    ids_["(none)"] = kNoFile;
+    names_.push_back("(internal)");
+    ids_["(internal)"] = kInternal;
+}
+
+SourceMap* SourceMap::Current() {
+    if (current_) {
+        return current_;
+    }
+    static SourceMap process_map;
+    return &process_map;
+}
+
+SourceMap::FileID SourceMap::Intern(const string& filename) {
+    SourceMap* m = Current();
+    lock_guard<mutex> lock(m->mutex_);
+    auto it = m->ids_.find(filename);
+    if (it != m->ids_.end()) {
+        return it->second;
+    }
+    if (m->names_.size() >= kUnknownFile) {
+        return kUnknownFile;
+    }
+    FileID id = static_cast<FileID>(m->names_.size());
+    m->names_.push_back(filename);
+    m->ids_[filename] = id;
+    return id;
+}
+
+const string& SourceMap::Filename(FileID id) {
+    SourceMap* m = Current();
+    lock_guard<mutex> lock(m->mutex_);
+    if (id >= m->names_.size()) {
+        return kUnknownFileName;
+    }
+    return m->names_[id];
+}
+
+}  // namespace autopiper
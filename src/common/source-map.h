@@ -0,0 +1,98 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_COMMON_SOURCE_MAP_H_
+#define _AUTOPIPER_COMMON_SOURCE_MAP_H_
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace autopiper {
+
+// A SourceMap is a table of interned source filenames. A Location refers to
+// its file by a small integer ID rather than carrying the name itself, so that
+// the locations copied into every AST node and IR statement stay compact; the
+// name is looked up only when a location is printed.
+//
+// Names are interned into the current map of the calling thread: the one
+// installed by a SourceMapScope (see below), or else a process-wide map. A
+// compilation that installs its own map thus keeps the names it interns from
+// accumulating across compilations, but its Locations may be printed only
+// while that map is current.
+class SourceMap {
+    public:
+        typedef uint16_t FileID;
+
+        // ID of the placeholder file "(none)", used by default-constructed
+        // locations.
+        static const FileID kNoFile = 0;
+        // ID of the placeholder file "(internal)", for AST nodes the compiler
+        // synthesizes.
+        static const FileID kInternal = 1;
+        // ID of the placeholder file "(unknown file)", given to every name
+        // interned once all other IDs are taken.
+        static const FileID kUnknownFile = UINT16_MAX;
+
+        SourceMap();
+
+        // Return the ID for |filename| in the current map, assigning a new
+        // one if the name has not been seen before, or kUnknownFile if the
+        // map is full.
+        static FileID Intern(const std::string& filename);
+
+        // Return the filename for |id| in the current map. The reference
+        // remains valid for the life of that map.
+        static const std::string& Filename(FileID id);
+
+        // The map that Intern() and Filename() use on this thread.
+        static SourceMap* Current();
+
+    private:
+        friend class SourceMapScope;
+
+        SourceMap(const SourceMap&) = delete;
+        SourceMap& operator=(const SourceMap&) = delete;
+
+        std::mutex mutex_;
+        // deque rather than vector: growth must not move existing strings,
+        // since Filename() hands out references to them.
+        std::deque<std::string> names_;
+        std::map<std::string, FileID> ids_;
+
+        static thread_local SourceMap* current_;
+};
+
+// RAII helper: installs |map| as the current SourceMap for the lifetime of
+// the scope, restoring the previous one on exit. Threads started within the
+// scope must install |map| themselves.
+class SourceMapScope {
+    public:
+        explicit SourceMapScope(SourceMap* map)
+            : saved_(SourceMap::current_) {
+            SourceMap::current_ = map;
+        }
+        ~SourceMapScope() { SourceMap::current_ = saved_; }
+
+    private:
+        SourceMap* saved_;
+};
+
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_COMMON_SOURCE_MAP_H_
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frontend/ast-build.h"
+#include "common/util.h"
+
+using namespace std;
+
+namespace autopiper {
+namespace frontend {
+
+ASTRef<ASTIdent> Ident(const string& name, ASTIdent::Type type) {
+    ASTRef<ASTIdent> ret(new ASTIdent());
+    ret->name = name;
+    ret->type = type;
+    return ret;
+}
+
+ASTRef<ASTExpr> Var(const string& name) {
+    ASTRef<ASTExpr> ret(new ASTExpr());
+    ret->op = ASTExpr::VAR;
+    ret->ident = Ident(name, ASTIdent::VAR);
+    return ret;
+}
+
+ASTRef<ASTExpr> Const(int value) {
+    ASTRef<ASTExpr> ret(new ASTExpr(value));
+    ret->op = ASTExpr::CONST;
+    return ret;
+}
+
+ASTRef<ASTExpr> Op(ASTExpr::Op op, ASTRef<ASTExpr> a, ASTRef<ASTExpr> b) {
+    ASTRef<ASTExpr> ret(new ASTExpr());
+    ret->op = op;
+    ret->ops.push_back(move(a));
+    if (b) {
+        ret->ops.push_back(move(b));
+    }
+    return ret;
+}
+
+ASTRef<ASTExpr> Slice(ASTRef<ASTExpr> value, int hi, int lo) {
+    ASTRef<ASTExpr> ret = Op(ASTExpr::BITSLICE, move(value), Const(hi));
+    ret->ops.push_back(Const(lo));
+    return ret;
+}
+
+ASTRef<ASTExpr> RegRef(const string& reg) {
+    return Op(ASTExpr::REG_REF, Var(reg));
+}
+
+ASTRef<ASTExpr> ArrayRef(const string& array, ASTRef<ASTExpr> index) {
+    return Op(ASTExpr::ARRAY_REF, Var(array), move(index));
+}
+
+ASTRef<ASTType> Type(const string& name) {
+    ASTRef<ASTType> ret(new ASTType());
+    ret->ident = Ident(name, ASTIdent::TYPE);
+    return ret;
+}
+
+ASTRef<ASTType> IntType(int width) {
+    return Type(strprintf("int_%d", width));
+}
+
+ASTRef<ASTStmt> Let(const string& name, ASTRef<ASTType> type,
+                    ASTRef<ASTExpr> rhs) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->let.reset(new ASTStmtLet());
+    ret->let->lhs = Ident(name, ASTIdent::VAR);
+    ret->let->type = move(type);
+    ret->let->rhs = move(rhs);
+    return ret;
+}
+
+ASTRef<ASTStmt> Assign(ASTRef<ASTExpr> lhs, ASTRef<ASTExpr> rhs) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->assign.reset(new ASTStmtAssign());
+    ret->assign->lhs = move(lhs);
+    ret->assign->rhs = move(rhs);
+    return ret;
+}
+
+ASTRef<ASTStmt> Write(const string& port, ASTRef<ASTExpr> rhs) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->write.reset(new ASTStmtWrite());
+    ret->write->port = Var(port);
+    ret->write->rhs = move(rhs);
+    return ret;
+}
+
+ASTRef<ASTStmt> Block(ASTVector<ASTStmt> stmts) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->block.reset(new ASTStmtBlock());
+    ret->block->stmts = move(stmts);
+    return ret;
+}
+
+ASTRef<ASTStmt> BypassStart(const string& bypass, ASTRef<ASTExpr> index) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->bypassstart.reset(new ASTStmtBypassStart());
+    ret->bypassstart->bypass = Var(bypass);
+    ret->bypassstart->index = move(index);
+    return ret;
+}
+
+ASTRef<ASTStmt> BypassWrite(const string& bypass, ASTRef<ASTExpr> value) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->bypasswrite.reset(new ASTStmtBypassWrite());
+    ret->bypasswrite->bypass = Var(bypass);
+    ret->bypasswrite->value = move(value);
+    return ret;
+}
+
+ASTRef<ASTStmt> BypassEnd(const string& bypass) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->bypassend.reset(new ASTStmtBypassEnd());
+    ret->bypassend->bypass = Var(bypass);
+    return ret;
+}
+
+ASTRef<ASTStmt> If(ASTRef<ASTExpr> condition, ASTVector<ASTStmt> body,
+                   ASTVector<ASTStmt> else_body) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->if_.reset(new ASTStmtIf());
+    ret->if_->condition = move(condition);
+    ret->if_->if_body = Block(move(body));
+    if (!else_body.empty()) {
+        ret->if_->else_body = Block(move(else_body));
+    }
+    return ret;
+}
+
+ASTRef<ASTStmt> If(ASTRef<ASTExpr> condition, ASTRef<ASTStmt> body) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->if_.reset(new ASTStmtIf());
+    ret->if_->condition = move(condition);
+    if (!body->block) {
+        ASTVector<ASTStmt> stmts;
+        stmts.push_back(move(body));
+        body = Block(move(stmts));
+    }
+    ret->if_->if_body = move(body);
+    return ret;
+}
+
+void SetLoc(ASTExpr* node, const Location& loc) {
+    if (!node) {
+        return;
+    }
+    node->loc = loc;
+    for (auto& op : node->ops) {
+        SetLoc(op.get(), loc);
+    }
+    if (node->stmt) {
+        for (auto& stmt : node->stmt->stmts) {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+}
+
+void SetLoc(ASTStmt* node, const Location& loc) {
+    if (!node) {
+        return;
+    }
+    node->loc = loc;
+    if (node->block) {
+        for (auto& stmt : node->block->stmts) {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+    if (node->let) {
+        node->let->loc = loc;
+        SetLoc(node->let->rhs.get(), loc);
+    }
+    if (node->assign) {
+        node->assign->loc = loc;
+        SetLoc(node->assign->lhs.get(), loc);
+        SetLoc(node->assign->rhs.get(), loc);
+    }
+    if (node->if_) {
+        node->if_->loc = loc;
+        SetLoc(node->if_->condition.get(), loc);
+        SetLoc(node->if_->if_body.get(), loc);
+        SetLoc(node->if_->else_body.get(), loc);
+    }
+    if (node->write) {
+        node->write->loc = loc;
+        SetLoc(node->write->port.get(), loc);
+        SetLoc(node->write->rhs.get(), loc);
+    }
+    if (node->wait) {
+        node->wait->loc = loc;
+        SetLoc(node->wait->condition.get(), loc);
+    }
+    if (node->expr) {
+        node->expr->loc = loc;
+        SetLoc(node->expr->expr.get(), loc);
+    }
+    if (node->timing) {
+        node->timing->loc = loc;
+        SetLoc(node->timing->body.get(), loc);
+    }
+    if (node->stage) {
+        node->stage->loc = loc;
+    }
+    if (node->nested) {
+        node->nested->loc = loc;
+        for (auto& stmt : node->nested->body->stmts) {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+}
+
+}  // namespace frontend
+}  // namespace autopiper
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_FRONTEND_AST_BUILD_H_
+#define _AUTOPIPER_FRONTEND_AST_BUILD_H_
+
+#include "frontend/ast.h"
+
+#include <string>
+
+namespace autopiper {
+namespace frontend {
+
+// ----------------- AST construction helpers. ----------------------
+//
+// Shorthands for the desugaring passes (BundlePass, RobPass, CamPass) and
+// the instance-module entry builder, which build new code as AST. Names are
+// left unresolved: the pass must run before VarScopePass, or VarScopePass must
+// run again afterward.
+
+ASTRef<ASTIdent> Ident(const std::string& name, ASTIdent::Type type);
+
+// A use of variable |name|.
+ASTRef<ASTExpr> Var(const std::string& name);
+ASTRef<ASTExpr> Const(int value);
+// Unary or binary |op| on |a| and |b|.
+ASTRef<ASTExpr> Op(ASTExpr::Op op, ASTRef<ASTExpr> a,
+                   ASTRef<ASTExpr> b = astnull<ASTExpr>());
+// Bits [hi:lo] of |value|.
+ASTRef<ASTExpr> Slice(ASTRef<ASTExpr> value, int hi, int lo);
+ASTRef<ASTExpr> RegRef(const std::string& reg);
+ASTRef<ASTExpr> ArrayRef(const std::string& array, ASTRef<ASTExpr> index);
+
+ASTRef<ASTType> Type(const std::string& name);
+ASTRef<ASTType> IntType(int width);
+
+// 'let name : type = rhs;', or with the type inferred if |type| is null.
+ASTRef<ASTStmt> Let(const std::string& name, ASTRef<ASTType> type,
+                    ASTRef<ASTExpr> rhs);
+ASTRef<ASTStmt> Assign(ASTRef<ASTExpr> lhs, ASTRef<ASTExpr> rhs);
+ASTRef<ASTStmt> Write(const std::string& port, ASTRef<ASTExpr> rhs);
+ASTRef<ASTStmt> Block(ASTVector<ASTStmt> stmts);
+// 'bypassstart bypass, index;', 'bypasswrite bypass, value;' and
+// 'bypassend bypass;'.
+ASTRef<ASTStmt> BypassStart(const std::string& bypass, ASTRef<ASTExpr> index);
+ASTRef<ASTStmt> BypassWrite(const std::string& bypass, ASTRef<ASTExpr> value);
+ASTRef<ASTStmt> BypassEnd(const std::string& bypass);
+// 'if (condition) { body } else { else_body }'; the else is omitted if
+// |else_body| is empty.
+ASTRef<ASTStmt> If(ASTRef<ASTExpr> condition, ASTVector<ASTStmt> body,
+                   ASTVector<ASTStmt> else_body = ASTVector<ASTStmt>());
+// 'if (condition) body', where a |body| that is not a block becomes the only
+// statement of one.
+ASTRef<ASTStmt> If(ASTRef<ASTExpr> condition, ASTRef<ASTStmt> body);
+
+// Give |node| and every node below it the location |loc|, so that errors in
+// generated code point at the construct it came from. Either may be null.
+void SetLoc(ASTExpr* node, const Location& loc);
+void SetLoc(ASTStmt* node, const Location& loc);
+
+}  // namespace frontend
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_FRONTEND_AST_BUILD_H_
@@ -19,12 +19,84 @@
 
 #include <iostream>
 #include <string>
+#include <cstddef>
+#include <new>
 
 using namespace std;
 
 namespace autopiper {
 namespace frontend {
 
+// ----------------- Arena allocation. ----------------------
+
+thread_local ASTArena* ASTArena::current_ = nullptr;
+
+namespace {
+// Header preceding every ASTBase allocation. Aligned to the maximum
+// fundamental alignment so that the node that follows is suitably aligned.
+// |block| is the pointer that ::operator new returned for a heap-backed
+// node, so that delete hands exactly that pointer back to ::operator delete.
+struct alignas(std::max_align_t) AllocHeader {
+    ASTArena* arena;
+    void* block;
+};
+
+size_t RoundUp(size_t size) {
+    const size_t align = alignof(std::max_align_t);
+    return (size + align - 1) & ~(align - 1);
+}
+}  // anonymous namespace
+
+ASTArena::ASTArena() : cur_(nullptr), end_(nullptr) {}
+
+ASTArena::~ASTArena() {
+    for (auto* block : blocks_) {
+        delete[] block;
+    }
+}
+
+void* ASTArena::Allocate(size_t size) {
+    size = RoundUp(size);
+    if (size > static_cast<size_t>(end_ - cur_)) {
+        // Oversized requests get a dedicated block so that we don't waste
+        // the remainder of the current one.
+        if (size > kBlockSize / 4) {
+            char* block = new char[size];
+            blocks_.push_back(block);
+            return block;
+        }
+        cur_ = new char[kBlockSize];
+        end_ = cur_ + kBlockSize;
+        blocks_.push_back(cur_);
+    }
+    void* ret = cur_;
+    cur_ += size;
+    return ret;
+}
+
+void* ASTBase::operator new(size_t size) {
+    ASTArena* arena = ASTArena::Current();
+    size_t total = sizeof(AllocHeader) + size;
+    void* mem = arena ? arena->Allocate(total) : ::operator new(total);
+    AllocHeader* header = static_cast<AllocHeader*>(mem);
+    header->arena = arena;
+    header->block = mem;
+    return header + 1;
+}
+
+void ASTBase::operator delete(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    AllocHeader* header = static_cast<AllocHeader*>(ptr) - 1;
+    // Arena-backed nodes are freed when the arena is.
+    if (!header->arena) {
+        ::operator delete(header->block);
+    }
+}
+
+// ----------------- Printing. ----------------------
+
 static string Indent(int indent) {
     string ret;
     for (int i = 0; i < indent; i++) {
@@ -64,6 +136,12 @@ AST_PRINTER(ASTFunctionDef) {
     if (node->is_entry) {
         out << I(1) << "(entry)" << endl;
     }
+    if (node->bundle_width > 1) {
+        out << I(1) << "(bundle " << node->bundle_width << ")" << endl;
+    }
+    if (node->is_instance) {
+        out << I(1) << "(instance)" << endl;
+    }
 
     out << I(1) << "(return_type ";
     P(node->return_type.get(), 2);
@@ -121,6 +199,14 @@ AST_PRINTER(ASTType) {
     if (node->is_bypass) {
         out << " BYPASS";
     }
+    if (node->is_rob) {
+        out << " ROB";
+    }
+    if (node->is_cam) {
+        out << " CAM(key = ";
+        P(node->cam_key.get(), 0);
+        out << ")";
+    }
     out << ")";
 }
 
@@ -153,6 +239,7 @@ AST_PRINTER(ASTStmt) {
     T(kill);
     T(killyounger);
     T(killif);
+    T(wait);
     T(timing);
     T(stage);
     T(expr);
@@ -161,6 +248,9 @@ AST_PRINTER(ASTStmt) {
     T(bypassstart);
     T(bypassend);
     T(bypasswrite);
+    T(robdone);
+    T(caminsert);
+    T(caminvalidate);
 #undef T
     out << I(0) << ")" << endl;
 }
@@ -263,6 +353,11 @@ AST_PRINTER(ASTStmtWrite) {
 
 AST_PRINTER(ASTStmtSpawn) {
     out << I(0) << "(stmt-spawn " << node << endl;
+    if (node->rob) {
+        out << I(1) << "(rob " << endl;
+        P(node->rob.get(), 2);
+        out << I(1) << ")" << endl;
+    }
     P(node->body.get(), 1);
     out << I(0) << ")" << endl;
 }
@@ -287,6 +382,12 @@ AST_PRINTER(ASTStmtKillIf) {
     out << I(0) << ")" << endl;
 }
 
+AST_PRINTER(ASTStmtWait) {
+    out << I(0) << "(stmt-wait " << node << endl;
+    P(node->condition.get(), 1);
+    out << I(0) << ")" << endl;
+}
+
 AST_PRINTER(ASTStmtTiming) {
     out << I(0) << "(stmt-timing " << node << endl;
     P(node->body.get(), 1);
@@ -346,6 +447,42 @@ AST_PRINTER(ASTStmtBypassWrite) {
     out << I(0) << ")" << endl;
 }
 
+AST_PRINTER(ASTStmtRobDone) {
+    out << I(0) << "(stmt-robdone " << node << endl;
+    out << I(1) << "(rob ";
+    P(node->rob.get(), 1);
+    out << endl;
+    out << I(1) << "(value ";
+    P(node->value.get(), 1);
+    out << endl;
+    out << I(0) << ")" << endl;
+}
+
+AST_PRINTER(ASTStmtCamInsert) {
+    out << I(0) << "(stmt-caminsert " << node << endl;
+    out << I(1) << "(cam ";
+    P(node->cam.get(), 1);
+    out << endl;
+    out << I(1) << "(key ";
+    P(node->key.get(), 1);
+    out << endl;
+    out << I(1) << "(value ";
+    P(node->value.get(), 1);
+    out << endl;
+    out << I(0) << ")" << endl;
+}
+
+AST_PRINTER(ASTStmtCamInvalidate) {
+    out << I(0) << "(stmt-caminvalidate " << node << endl;
+    out << I(1) << "(cam ";
+    P(node->cam.get(), 1);
+    out << endl;
+    out << I(1) << "(key ";
+    P(node->key.get(), 1);
+    out << endl;
+    out << I(0) << ")" << endl;
+}
+
 
 AST_PRINTER(ASTExpr) {
     out << I(0) << "(expr " << node << " ";
@@ -389,6 +526,7 @@ AST_PRINTER(ASTExpr) {
         T(AGGLITERALFIELD);
 
         T(FUNCCALL);
+        T(INSTANCE);
 
         T(PORTREAD);
         T(PORTDEF);
@@ -397,6 +535,10 @@ AST_PRINTER(ASTExpr) {
         T(BYPASSPRESENT);
         T(BYPASSREADY);
         T(BYPASSREAD);
+        T(ROBDEF);
+        T(CAMDEF);
+        T(CAMHIT);
+        T(CAMREAD);
 
         T(STMTBLOCK);
 
@@ -426,6 +568,16 @@ AST_PRINTER(ASTExpr) {
         P(node->stmt.get(), 2);
         out << I(1) << ")" << endl;
     }
+    if (node->op == ASTExpr::ARRAY_INIT && node->array_registered) {
+        out << I(1) << "(registered)" << endl;
+    }
+    if (!node->array_init.empty()) {
+        out << I(1) << "(init";
+        for (auto& value : node->array_init) {
+            out << " " << value;
+        }
+        out << ")" << endl;
+    }
     if (node->cast_type) {
         out << I(1) << "(cast-type" << endl;
         P(node->cast_type.get(), 2);
@@ -483,6 +635,7 @@ AST_CLONE(AST) {
     SETUP(AST);
     VEC(functions);
     VEC(types);
+    VEC(pragmas);
     PRIM(gencounter);
     return ret;
 }
@@ -527,6 +680,9 @@ AST_CLONE(ASTType) {
     PRIM(is_array);
     PRIM(array_length);
     PRIM(is_bypass);
+    PRIM(is_rob);
+    PRIM(is_cam);
+    SUB(cam_key);
     return ret;
 }
 
@@ -545,6 +701,7 @@ AST_CLONE(ASTStmt) {
     SUB(kill);
     SUB(killyounger);
     SUB(killif);
+    SUB(wait);
     SUB(timing);
     SUB(stage);
     SUB(expr);
@@ -553,6 +710,9 @@ AST_CLONE(ASTStmt) {
     SUB(bypassstart);
     SUB(bypassend);
     SUB(bypasswrite);
+    SUB(robdone);
+    SUB(caminsert);
+    SUB(caminvalidate);
     return ret;
 }
 
@@ -616,6 +776,7 @@ AST_CLONE(ASTStmtWrite) {
 AST_CLONE(ASTStmtSpawn) {
     SETUP(ASTStmtSpawn);
     SUB(body);
+    SUB(rob);
     return ret;
 }
 
@@ -641,6 +802,12 @@ AST_CLONE(ASTStmtKillIf) {
     return ret;
 }
 
+AST_CLONE(ASTStmtWait) {
+    SETUP(ASTStmtWait);
+    SUB(condition);
+    return ret;
+}
+
 AST_CLONE(ASTStmtTiming) {
     SETUP(ASTStmtTiming);
     SUB(body);
@@ -691,6 +858,28 @@ AST_CLONE(ASTStmtBypassWrite) {
     return ret;
 }
 
+AST_CLONE(ASTStmtRobDone) {
+    SETUP(ASTStmtRobDone);
+    SUB(rob);
+    SUB(value);
+    return ret;
+}
+
+AST_CLONE(ASTStmtCamInsert) {
+    SETUP(ASTStmtCamInsert);
+    SUB(cam);
+    SUB(key);
+    SUB(value);
+    return ret;
+}
+
+AST_CLONE(ASTStmtCamInvalidate) {
+    SETUP(ASTStmtCamInvalidate);
+    SUB(cam);
+    SUB(key);
+    return ret;
+}
+
 AST_CLONE(ASTExpr) {
     SETUP(ASTExpr);
     PRIM(op);
@@ -702,6 +891,8 @@ AST_CLONE(ASTExpr) {
     PRIM(inferred_type);
     SUB(stmt);
     SUB(cast_type);
+    PRIM(array_init);
+    PRIM(array_registered);
     return ret;
 }
 
@@ -45,10 +45,64 @@ ASTRef<T> astnull() { return std::unique_ptr<T>(nullptr); }
 
 typedef Token::bignum ASTBignum;
 
+// An ASTArena is a bump-pointer allocator that backs all AST nodes created
+// while it is installed as the current arena (see ASTArenaScope below). Nodes
+// are still owned by ASTRef/ASTVector and their destructors still run, but
+// freeing one is a no-op: the memory is reclaimed all at once when the arena
+// itself is destroyed. The arena must therefore outlive every node allocated
+// from it -- the AST root owns the arena for exactly this reason.
+class ASTArena {
+    public:
+        ASTArena();
+        ~ASTArena();
+
+        void* Allocate(size_t size);
+
+        // The arena to which new AST nodes on this thread are allocated, or
+        // nullptr if they should come from the ordinary heap.
+        static ASTArena* Current() { return current_; }
+
+    private:
+        friend class ASTArenaScope;
+
+        ASTArena(const ASTArena&) = delete;
+        ASTArena& operator=(const ASTArena&) = delete;
+
+        static const size_t kBlockSize = 64 * 1024;
+
+        std::vector<char*> blocks_;
+        char* cur_;
+        char* end_;
+
+        static thread_local ASTArena* current_;
+};
+
+// RAII helper: installs |arena| as the current arena for the lifetime of the
+// scope, restoring the previous one on exit.
+class ASTArenaScope {
+    public:
+        explicit ASTArenaScope(ASTArena* arena)
+            : saved_(ASTArena::current_) {
+            ASTArena::current_ = arena;
+        }
+        ~ASTArenaScope() { ASTArena::current_ = saved_; }
+
+    private:
+        ASTArena* saved_;
+};
+
 struct ASTBase {
     autopiper::Location loc;
 
-    ASTBase() { loc.line = 0; loc.column = 0; loc.filename = "(internal)"; }
+    ASTBase() {
+        loc.file = SourceMap::kInternal;
+    }
+
+    // All AST node types allocate from the current ASTArena, if any, and
+    // otherwise from the heap. Each allocation carries a small header so that
+    // delete can tell the two apart.
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
 };
 
 struct AST;
@@ -73,6 +127,7 @@ struct ASTStmtReturn;
 struct ASTStmtKill;
 struct ASTStmtKillYounger;
 struct ASTStmtKillIf;
+struct ASTStmtWait;
 struct ASTStmtTiming;
 struct ASTStmtStage;
 struct ASTStmtExpr;
@@ -81,6 +136,9 @@ struct ASTStmtOnKillYounger;
 struct ASTStmtBypassStart;
 struct ASTStmtBypassEnd;
 struct ASTStmtBypassWrite;
+struct ASTStmtRobDone;
+struct ASTStmtCamInsert;
+struct ASTStmtCamInvalidate;
 
 struct ASTExpr;
 
@@ -89,6 +147,10 @@ struct ASTPragma;
 struct ASTTypeField;
 
 struct AST : public ASTBase {
+    // Backing store for the nodes of this AST. Declared first so that it is
+    // destroyed last, after all nodes it backs.
+    ASTArena arena;
+
     int gencounter;
     ASTVector<ASTFunctionDef> functions;
     ASTVector<ASTTypeDef> types;
@@ -110,8 +172,17 @@ struct ASTFunctionDef : public ASTBase {
     ASTVector<ASTParam> params;
     ASTRef<ASTStmtBlock> block;
     bool is_entry;
+    // Entry functions only: number of transaction slots carried by each
+    // pipeline transaction (see BundlePass). 1 is an ordinary scalar pipe.
+    int bundle_width;
+    // Compiled once into its own pipelined module, which call sites
+    // instantiate, rather than inlined. The latency (in stages) is filled in
+    // when the module is compiled.
+    bool is_instance;
+    int instance_latency;
 
-    ASTFunctionDef() : is_entry(false)  {}
+    ASTFunctionDef() : is_entry(false), bundle_width(1), is_instance(false),
+                       instance_latency(0)  {}
 };
 
 struct ASTParam : public ASTBase {
@@ -159,6 +230,10 @@ struct ASTType : public ASTBase {
     bool is_array;
     int array_length;
     bool is_bypass;
+    bool is_rob;
+    bool is_cam;
+    // 'cam K V': the key type K (the value type V is |ident|).
+    ASTRef<ASTType> cam_key;
 
     ASTTypeDef* def;
 
@@ -169,6 +244,8 @@ struct ASTType : public ASTBase {
           is_array(false),
           array_length(-1), 
           is_bypass(false),
+          is_rob(false),
+          is_cam(false),
           def(nullptr) {}
 };
 
@@ -186,6 +263,7 @@ struct ASTStmt : public ASTBase {
     ASTRef<ASTStmtKill> kill;
     ASTRef<ASTStmtKillYounger> killyounger;
     ASTRef<ASTStmtKillIf> killif;
+    ASTRef<ASTStmtWait> wait;
     ASTRef<ASTStmtTiming> timing;
     ASTRef<ASTStmtStage> stage;
     ASTRef<ASTStmtExpr> expr;
@@ -194,6 +272,9 @@ struct ASTStmt : public ASTBase {
     ASTRef<ASTStmtBypassStart> bypassstart;
     ASTRef<ASTStmtBypassEnd> bypassend;
     ASTRef<ASTStmtBypassWrite> bypasswrite;
+    ASTRef<ASTStmtRobDone> robdone;
+    ASTRef<ASTStmtCamInsert> caminsert;
+    ASTRef<ASTStmtCamInvalidate> caminvalidate;
 };
 
 struct ASTStmtExpr : public ASTBase {
@@ -210,6 +291,13 @@ struct ASTStmtLet : public ASTBase {
     ASTRef<ASTExpr> rhs;
 
     InferredType inferred_type;
+
+    // Order in which codegen first bound this let. Codegen keys its binding
+    // maps on this rather than on node addresses so that phi creation order
+    // (and so valnum assignment) is reproducible.
+    int binding_order;
+
+    ASTStmtLet() : binding_order(-1) {}
 };
 
 struct ASTStmtAssign : public ASTBase {
@@ -246,6 +334,9 @@ struct ASTStmtWrite : public ASTBase {
 
 struct ASTStmtSpawn : public ASTBase {
     ASTRef<ASTStmt> body;
+    // 'spawn (rob) { ... }': the reorder buffer in which the spawn allocates
+    // a slot for its child to complete (see RobPass). Optional.
+    ASTRef<ASTExpr> rob;
 };
 
 struct ASTStmtReturn : public ASTBase {
@@ -264,6 +355,10 @@ struct ASTStmtKillIf : public ASTBase {
     ASTRef<ASTExpr> condition;
 };
 
+struct ASTStmtWait : public ASTBase {
+    ASTRef<ASTExpr> condition;
+};
+
 struct ASTStmtTiming : public ASTBase {
     ASTRef<ASTStmt> body;
 };
@@ -294,6 +389,22 @@ struct ASTStmtBypassWrite: public ASTBase {
     ASTRef<ASTExpr> value;
 };
 
+struct ASTStmtRobDone: public ASTBase {
+    ASTRef<ASTExpr> rob;
+    ASTRef<ASTExpr> value;
+};
+
+struct ASTStmtCamInsert: public ASTBase {
+    ASTRef<ASTExpr> cam;
+    ASTRef<ASTExpr> key;
+    ASTRef<ASTExpr> value;
+};
+
+struct ASTStmtCamInvalidate: public ASTBase {
+    ASTRef<ASTExpr> cam;
+    ASTRef<ASTExpr> key;
+};
+
 struct ASTExpr : public ASTBase {
     enum Op {
         ADD,
@@ -334,6 +445,9 @@ struct ASTExpr : public ASTBase {
         REG_INIT,
 
         FUNCCALL,
+        // Call of an instance function: ident is the module name, constant is
+        // its latency, ops are the arguments and cast_type is the result type.
+        INSTANCE,
 
         PORTREAD,
         PORTDEF,
@@ -343,6 +457,16 @@ struct ASTExpr : public ASTBase {
         BYPASSREADY,
         BYPASSREAD,
 
+        // Reorder buffer: ident is the retirement port name, constant is the
+        // depth. Expanded away by RobPass.
+        ROBDEF,
+
+        // CAM: constant is the number of entries. Lookups take the CAM and a
+        // key. Expanded away by CamPass.
+        CAMDEF,
+        CAMHIT,
+        CAMREAD,
+
         STMTBLOCK,  // must end in an ASTStmtExpr
 
         CAST,
@@ -366,7 +490,15 @@ struct ASTExpr : public ASTBase {
 
     ASTRef<ASTType> cast_type;
 
-    ASTExpr() : op(CONST), has_constant(false), def(nullptr)  {}
+    // ARRAY_INIT: initial contents by index, from a constant list or a file
+    // (empty if uninitialized), and whether reads of a read-only array are
+    // registered.
+    std::vector<ASTBignum> array_init;
+    bool array_registered;
+
+    ASTExpr()
+        : op(CONST), has_constant(false), def(nullptr),
+          array_registered(false) {}
     ASTExpr(ASTBignum constant_)
         : ASTExpr()
     { constant = constant_; }
@@ -408,6 +540,7 @@ AST_METHODS(ASTStmtReturn);
 AST_METHODS(ASTStmtKill);
 AST_METHODS(ASTStmtKillYounger);
 AST_METHODS(ASTStmtKillIf);
+AST_METHODS(ASTStmtWait);
 AST_METHODS(ASTStmtTiming);
 AST_METHODS(ASTStmtStage);
 AST_METHODS(ASTStmtExpr);
@@ -416,6 +549,9 @@ AST_METHODS(ASTStmtOnKillYounger);
 AST_METHODS(ASTStmtBypassStart);
 AST_METHODS(ASTStmtBypassEnd);
 AST_METHODS(ASTStmtBypassWrite);
+AST_METHODS(ASTStmtRobDone);
+AST_METHODS(ASTStmtCamInsert);
+AST_METHODS(ASTStmtCamInvalidate);
 AST_METHODS(ASTExpr);
 AST_METHODS(ASTTypeField);
 AST_METHODS(ASTPragma);
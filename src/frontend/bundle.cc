@@ -0,0 +1,1015 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frontend/bundle.h"
+#include "frontend/ast-build.h"
+#include "common/util.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace autopiper {
+namespace frontend {
+
+BundlePass::BundlePass(autopiper::ErrorCollector* coll)
+    : ASTVisitorContext(coll), ast_(nullptr)
+{ }
+
+namespace {
+
+// ----------------- Bundle state. ----------------------
+
+// A port, chan, reg, array or bypass declared in the shared prologue.
+struct Entity {
+    enum Kind {
+        PORT,  // port or chan
+        REG,
+        ARRAY,
+        BYPASS,
+    };
+
+    Kind kind;
+    ASTStmtLet* let;
+
+    // Flattened indices of the first segment that refers to this entity and of
+    // the last one that writes it (regs and arrays), or -1.
+    int first_access;
+    int last_write;
+
+    // Regs the slots write: the shadow that holds the reg's value within the
+    // bundle, and a flag set once any slot writes it.
+    string shadow;
+    string dirty;
+
+    // Bypasses: the first segment that starts this bypass and the last one
+    // that writes it, or -1, and whether any slot queries or reads it.
+    int first_start;
+    int last_bypass_write;
+    bool queried;
+    bool read;
+
+    // Bypasses the slots use: one network per slot, and, if the slots read
+    // it, one per slot carrying the writing bundle's sequence number.
+    vector<string> lanes;
+    vector<string> seq_lanes;
+
+    // Bypasses the slots query: per slot, the state of its bypass scope that
+    // the younger slots of the bundle see.
+    struct Scope {
+        string open;
+        string index;
+        string ready;
+        string value;
+    };
+    vector<Scope> scopes;
+
+    Entity(Kind kind_, ASTStmtLet* let_)
+        : kind(kind_), let(let_), first_access(-1), last_write(-1),
+          first_start(-1), last_bypass_write(-1), queried(false),
+          read(false) {}
+};
+
+bool EntityKind(const ASTExpr* rhs, Entity::Kind* kind) {
+    if (!rhs) {
+        return false;
+    }
+    switch (rhs->op) {
+        case ASTExpr::PORTDEF:    *kind = Entity::PORT;   return true;
+        case ASTExpr::REG_INIT:   *kind = Entity::REG;    return true;
+        case ASTExpr::ARRAY_INIT: *kind = Entity::ARRAY;  return true;
+        case ASTExpr::BYPASSDEF:  *kind = Entity::BYPASS; return true;
+        default:                  return false;
+    }
+}
+
+struct Bundle {
+    AST* ast;
+    int width;
+
+    // In prologue order, so that everything generated from them is too.
+    vector<Entity> entities;
+    map<const ASTStmtLet*, int> entity_index;
+
+    // Array written by each array-write site in the slot body, as an index
+    // into |entities|, in program order.
+    vector<int> array_writes;
+
+    // Per array-write site and slot: the write's pending valid flag, index
+    // and value, committed to the array once all slots are done with it.
+    struct Site {
+        string valid;
+        string index;
+        string value;
+    };
+    vector<vector<Site>> sites;
+
+    // Does any slot kill? If so, each slot carries a flag that is cleared
+    // when it ends, and its remaining side effects are predicated on it.
+    bool has_kill;
+    vector<string> live;
+
+    // The bundle's sequence number, if any slot reads a bypass: it orders
+    // the bundles whose writes are visible on different networks.
+    string seq;
+
+    Bundle(AST* ast_, int width_)
+        : ast(ast_), width(width_), has_kill(false) {}
+
+    Entity* Find(const ASTStmtLet* let) {
+        auto it = entity_index.find(let);
+        return (it != entity_index.end()) ? &entities[it->second] : nullptr;
+    }
+
+    // Returns the entity that |expr| refers to, tracing through lets of plain
+    // variables (as codegen does), or nullptr.
+    Entity* Trace(const ASTExpr* expr) {
+        while (expr && expr->op == ASTExpr::VAR && expr->def) {
+            Entity* entity = Find(expr->def);
+            if (entity) {
+                return entity;
+            }
+            expr = expr->def->rhs.get();
+        }
+        return nullptr;
+    }
+};
+
+// A run of the slot body that is replicated as a unit: a top-level timing
+// block contributes one segment per stage, and the statements between timing
+// blocks form one segment each.
+struct Segment {
+    const ASTStmt* stage;  // 'stage' statement starting this segment, if any
+    vector<const ASTStmt*> stmts;
+
+    Segment() : stage(nullptr) {}
+};
+
+struct Item {
+    const ASTStmtTiming* timing;  // null for statements outside timing blocks
+    vector<Segment> segments;
+
+    Item() : timing(nullptr) {}
+};
+
+// Visit pass over the (single-slot) body: rejects what cannot be replicated
+// and records which segments use and write each shared entity.
+class SlotScanner : public ASTVisitorContext {
+    public:
+        SlotScanner(ErrorCollector* coll, Bundle* bundle)
+            : ASTVisitorContext(coll), bundle_(bundle), segment_(0) {}
+
+        void set_segment(int segment) { segment_ = segment; }
+
+        // Once all segments are scanned: a slot sees an older slot of its
+        // bundle only up to the same segment, so it could never see a write
+        // that the older slot makes in a later one. Reject queries that would
+        // wait on such a write.
+        bool CheckBypassQueries() {
+            for (auto& query : queries_) {
+                const Entity* entity =
+                    bundle_->Trace(query.first->ops[0].get());
+                if (entity->first_start != -1 &&
+                    entity->first_start <= query.second &&
+                    entity->last_bypass_write > query.second) {
+                    Error(query.first, "A bypass query in a bundled entry "
+                                       "must not come before a later stage's "
+                                       "'bypasswrite' to the same bypass.");
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    protected:
+        virtual Result VisitASTStmtPre(const ASTStmt* node) {
+            const char* what = nullptr;
+            if (node->killif) {
+                what = "killif";
+            } else if (node->spawn) {
+                what = "spawn";
+            } else if (node->nested) {
+                what = "func";
+            } else if (node->onkillyounger) {
+                what = "onkillyounger";
+            }
+            if (what) {
+                Error(node, strprintf(
+                            "'%s' is not supported in a bundled entry.", what));
+                return VISIT_END;
+            }
+            if (node->timing || node->stage) {
+                Error(node, "Timing blocks in a bundled entry must be at the "
+                            "top level of its body.");
+                return VISIT_END;
+            }
+            if (node->kill || node->killyounger) {
+                bundle_->has_kill = true;
+            }
+            if (node->bypassstart) {
+                Entity* entity =
+                    bundle_->Trace(node->bypassstart->bypass.get());
+                if (entity && entity->first_start == -1) {
+                    entity->first_start = segment_;
+                }
+            } else if (node->bypasswrite) {
+                Entity* entity =
+                    bundle_->Trace(node->bypasswrite->bypass.get());
+                if (entity) {
+                    entity->last_bypass_write = segment_;
+                }
+            }
+            return VISIT_CONTINUE;
+        }
+
+        virtual Result VisitASTStmtAssignPre(const ASTStmtAssign* node) {
+            const ASTExpr* lhs = node->lhs.get();
+            if (lhs->op != ASTExpr::REG_REF && lhs->op != ASTExpr::ARRAY_REF) {
+                return VISIT_CONTINUE;
+            }
+            Entity* entity = bundle_->Trace(lhs->ops[0].get());
+            if (entity && lhs->op == ASTExpr::REG_REF &&
+                entity->kind == Entity::REG) {
+                entity->last_write = segment_;
+            } else if (entity && lhs->op == ASTExpr::ARRAY_REF &&
+                       entity->kind == Entity::ARRAY) {
+                entity->last_write = segment_;
+                bundle_->array_writes.push_back(
+                        entity - &bundle_->entities[0]);
+            }
+            return VISIT_CONTINUE;
+        }
+
+        virtual Result VisitASTExprPre(const ASTExpr* node) {
+            switch (node->op) {
+                case ASTExpr::BYPASSPRESENT:
+                case ASTExpr::BYPASSREADY:
+                case ASTExpr::BYPASSREAD: {
+                    Entity* entity = bundle_->Trace(node->ops[0].get());
+                    if (entity) {
+                        entity->queried = true;
+                        if (node->op == ASTExpr::BYPASSREAD) {
+                            entity->read = true;
+                        }
+                        queries_.push_back(make_pair(node, segment_));
+                    }
+                    break;
+                }
+                case ASTExpr::PORTDEF:
+                case ASTExpr::REG_INIT:
+                case ASTExpr::ARRAY_INIT:
+                case ASTExpr::BYPASSDEF:
+                    Error(node, "Ports, chans, regs, arrays and bypasses of a "
+                                "bundled entry must be declared at the start "
+                                "of its body.");
+                    return VISIT_END;
+                case ASTExpr::VAR: {
+                    Entity* entity = bundle_->Trace(node);
+                    if (entity && entity->first_access == -1) {
+                        entity->first_access = segment_;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            return VISIT_CONTINUE;
+        }
+
+    private:
+        Bundle* bundle_;
+        int segment_;
+        // Bypass queries and the segments they are in.
+        vector<pair<const ASTExpr*, int>> queries_;
+};
+
+// Modify pass over one slot's clone of a segment: gives the slot's lets and
+// port lanes their per-slot names and routes shared-storage accesses, bypass
+// operations and side effects through the bundle's shadows, write sites,
+// bypass networks and scopes, and live flags. One instance per slot sees all of
+// that slot's segments in order.
+class SlotRewriter : public ASTVisitorContext {
+    public:
+        SlotRewriter(ErrorCollector* coll, Bundle* bundle, int slot)
+            : ASTVisitorContext(coll), bundle_(bundle), slot_(slot),
+              next_write_(0) {}
+
+    protected:
+        virtual Result ModifyASTStmtPre(ASTRef<ASTStmt>& node) {
+            if ((node->bypassstart || node->bypasswrite || node->bypassend) &&
+                !generated_.count(node.get())) {
+                RouteBypassStmt(node);
+                return VISIT_CONTINUE;
+            }
+            if (!node->assign) {
+                return VISIT_CONTINUE;
+            }
+            ASTExpr* lhs = node->assign->lhs.get();
+            if (lhs->op != ASTExpr::REG_REF && lhs->op != ASTExpr::ARRAY_REF) {
+                return VISIT_CONTINUE;
+            }
+            Entity* entity = bundle_->Trace(lhs->ops[0].get());
+            if (!entity) {
+                return VISIT_CONTINUE;
+            }
+
+            ASTVector<ASTStmt> stmts;
+            if (lhs->op == ASTExpr::REG_REF && entity->kind == Entity::REG) {
+                // reg r = value  ==>  shadow = value; dirty = 1;
+                stmts.push_back(Assign(Var(entity->shadow),
+                                       move(node->assign->rhs)));
+                stmts.push_back(Assign(Var(entity->dirty), Const(1)));
+            } else if (lhs->op == ASTExpr::ARRAY_REF &&
+                       entity->kind == Entity::ARRAY) {
+                // a[i] = value  ==>  valid = 1; index = i; value = value;
+                const Bundle::Site& site =
+                    bundle_->sites[next_write_++][slot_];
+                stmts.push_back(Assign(Var(site.valid), Const(1)));
+                stmts.push_back(Assign(Var(site.index), move(lhs->ops[1])));
+                stmts.push_back(Assign(Var(site.value),
+                                       move(node->assign->rhs)));
+            } else {
+                return VISIT_CONTINUE;
+            }
+            Location loc = node->loc;
+            node = Guard(Block(move(stmts)));
+            node->loc = loc;
+            return VISIT_CONTINUE;
+        }
+
+        virtual Result ModifyASTStmtPost(ASTRef<ASTStmt>& node) {
+            if (!bundle_->has_kill) {
+                return VISIT_CONTINUE;
+            }
+            const string& live = bundle_->live[slot_];
+            Location loc = node->loc;
+            if (node->write) {
+                node = Guard(move(node));
+            } else if (node->kill) {
+                // End this slot: it has no further side effects, and its
+                // bypass scopes close.
+                ASTVector<ASTStmt> stmts;
+                EndSlot(slot_, &stmts);
+                node = Block(move(stmts));
+            } else if (node->killyounger) {
+                // End the younger slots of this bundle as well as younger
+                // bundles.
+                ASTVector<ASTStmt> stmts;
+                stmts.push_back(move(node));
+                for (int slot = slot_ + 1; slot < bundle_->width; slot++) {
+                    EndSlot(slot, &stmts);
+                }
+                node = Guard(Block(move(stmts)));
+            } else if (node->wait) {
+                // An ended slot does not hold the bundle.
+                node->wait->condition =
+                    Op(ASTExpr::OR, Op(ASTExpr::NOT, Var(live)),
+                       move(node->wait->condition));
+            }
+            node->loc = loc;
+            return VISIT_CONTINUE;
+        }
+
+        virtual Result ModifyASTStmtLetPre(ASTRef<ASTStmtLet>& node) {
+            if (!generated_.count(node.get())) {
+                node->lhs->name = SlotName(node->lhs->name);
+            }
+            return VISIT_CONTINUE;
+        }
+
+        virtual Result ModifyASTExprPre(ASTRef<ASTExpr>& node) {
+            switch (node->op) {
+                case ASTExpr::VAR: {
+                    // VARs created by this pass have no def yet and already
+                    // carry their final names.
+                    if (!node->def) {
+                        break;
+                    }
+                    Entity* entity = bundle_->Find(node->def);
+                    if (!entity || entity->kind == Entity::PORT) {
+                        node->ident->name = SlotName(node->ident->name);
+                    }
+                    break;
+                }
+                case ASTExpr::REG_REF: {
+                    Entity* entity = bundle_->Trace(node->ops[0].get());
+                    if (entity && !entity->shadow.empty()) {
+                        Location loc = node->loc;
+                        node = Var(entity->shadow);
+                        node->loc = loc;
+                        return VISIT_TERMINAL;
+                    }
+                    break;
+                }
+                case ASTExpr::ARRAY_REF: {
+                    if (generated_.count(node.get())) {
+                        break;
+                    }
+                    Entity* entity = bundle_->Trace(node->ops[0].get());
+                    if (entity && entity->kind == Entity::ARRAY &&
+                        entity->last_write != -1) {
+                        ForwardArrayRead(entity, node);
+                    }
+                    break;
+                }
+                case ASTExpr::BYPASSPRESENT:
+                case ASTExpr::BYPASSREADY:
+                case ASTExpr::BYPASSREAD: {
+                    if (generated_.count(node.get())) {
+                        break;
+                    }
+                    Entity* entity = bundle_->Trace(node->ops[0].get());
+                    if (entity && !entity->lanes.empty()) {
+                        ForwardBypassQuery(entity, node);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            return VISIT_CONTINUE;
+        }
+
+    private:
+        string SlotName(const string& name) const {
+            return strprintf("%s_slot%d", name.c_str(), slot_);
+        }
+
+        // Predicate |stmt| on this slot still being live, if slots can end.
+        ASTRef<ASTStmt> Guard(ASTRef<ASTStmt> stmt) {
+            if (!bundle_->has_kill) {
+                return stmt;
+            }
+            Location loc = stmt->loc;
+            ASTRef<ASTStmt> guarded = If(Var(bundle_->live[slot_]),
+                                         move(stmt));
+            guarded->loc = loc;
+            return guarded;
+        }
+
+        // Clear |slot|'s live flag and close its bypass scopes.
+        void EndSlot(int slot, ASTVector<ASTStmt>* out) {
+            out->push_back(Assign(Var(bundle_->live[slot]), Const(0)));
+            for (auto& entity : bundle_->entities) {
+                if (!entity.scopes.empty()) {
+                    out->push_back(Assign(Var(entity.scopes[slot].open),
+                                          Const(0)));
+                }
+            }
+        }
+
+        // Returns |stmt|, marked as not to be rewritten again.
+        ASTRef<ASTStmt> Generated(ASTRef<ASTStmt> stmt) {
+            generated_.insert(stmt.get());
+            return stmt;
+        }
+        ASTRef<ASTExpr> Generated(ASTRef<ASTExpr> expr) {
+            generated_.insert(expr.get());
+            return expr;
+        }
+
+        // Move a bypass start, write or end onto this slot's network, and
+        // track it in the slot's scope if younger slots query the bypass:
+        //
+        // bypassstart b, i  ==>  index = i; open = 1; ready = 0;
+        //                        bypassstart lane, index;
+        //                        bypassstart seq_lane, index;
+        // bypasswrite b, v  ==>  value = v; ready = 1;
+        //                        bypasswrite lane, value;
+        //                        bypasswrite seq_lane, seq;
+        // bypassend b       ==>  open = 0; bypassend lane; bypassend seq_lane;
+        void RouteBypassStmt(ASTRef<ASTStmt>& node) {
+            const ASTExpr* bypass =
+                node->bypassstart ? node->bypassstart->bypass.get() :
+                node->bypasswrite ? node->bypasswrite->bypass.get() :
+                                    node->bypassend->bypass.get();
+            Entity* entity = bundle_->Trace(bypass);
+            if (!entity || entity->lanes.empty()) {
+                return;
+            }
+            const string& lane = entity->lanes[slot_];
+            const string* seq_lane = entity->seq_lanes.empty() ? nullptr :
+                                     &entity->seq_lanes[slot_];
+            const Entity::Scope* scope = entity->scopes.empty() ? nullptr :
+                                         &entity->scopes[slot_];
+
+            ASTVector<ASTStmt> stmts;
+            if (node->bypassstart) {
+                ASTRef<ASTExpr> index = move(node->bypassstart->index);
+                if (scope) {
+                    stmts.push_back(Assign(Var(scope->index), move(index)));
+                    stmts.push_back(Assign(Var(scope->open), Const(1)));
+                    stmts.push_back(Assign(Var(scope->ready), Const(0)));
+                    index = Var(scope->index);
+                }
+                stmts.push_back(Generated(BypassStart(lane, move(index))));
+                if (seq_lane) {
+                    stmts.push_back(Generated(
+                                BypassStart(*seq_lane, Var(scope->index))));
+                }
+            } else if (node->bypasswrite) {
+                ASTRef<ASTExpr> value = move(node->bypasswrite->value);
+                if (scope) {
+                    stmts.push_back(Assign(Var(scope->value), move(value)));
+                    stmts.push_back(Assign(Var(scope->ready), Const(1)));
+                    value = Var(scope->value);
+                }
+                stmts.push_back(Generated(BypassWrite(lane, move(value))));
+                if (seq_lane) {
+                    stmts.push_back(Generated(
+                                BypassWrite(*seq_lane, Var(bundle_->seq))));
+                }
+            } else {
+                if (scope) {
+                    stmts.push_back(Assign(Var(scope->open), Const(0)));
+                }
+                stmts.push_back(Generated(BypassEnd(lane)));
+                if (seq_lane) {
+                    stmts.push_back(Generated(BypassEnd(*seq_lane)));
+                }
+            }
+
+            Location loc = node->loc;
+            if (node->bypassend) {
+                node = Block(move(stmts));
+            } else {
+                node = Guard(Block(move(stmts)));
+            }
+            node->loc = loc;
+        }
+
+        // Replace the bypass query |node| with one over every slot's network
+        // and the scopes of the older slots of this bundle. A query is
+        // present or ready if it is on any of them. A read takes, in order of
+        // precedence, the youngest older slot's ready value, then the value
+        // from the youngest bundle whose write is ready on any network:
+        //
+        // expr {
+        //     let index = <index>;
+        //     let value = bypassread lane_0, index;
+        //     let found = bypassready lane_0, index;
+        //     let age = seq - bypassread seq_lane_0, index;
+        //     let age_1 = seq - bypassread seq_lane_1, index;
+        //     if ((bypassready lane_1, index) & (!found | age_1 <= age)) {
+        //         value = bypassread lane_1, index; age = age_1; found = 1;
+        //     }
+        //     ...  // for each further network
+        //     if (open_0 & ready_0 & index_0 == index) { value = value_0; }
+        //     ...  // for each older slot, in order
+        //     value;
+        // }
+        void ForwardBypassQuery(const Entity* entity, ASTRef<ASTExpr>& node) {
+            ASTExpr::Op op = node->op;
+            string index = ASTGenSym(bundle_->ast, "bundle_query_index")->name;
+            auto query = [&](ASTExpr::Op query_op, const string& lane) {
+                return Generated(Op(query_op, Var(lane), Var(index)));
+            };
+            auto in_scope = [&](int slot, bool ready) {
+                const Entity::Scope& scope = entity->scopes[slot];
+                ASTRef<ASTExpr> ret =
+                    Op(ASTExpr::AND, Var(scope.open),
+                       Op(ASTExpr::EQ, Var(scope.index), Var(index)));
+                if (ready) {
+                    ret = Op(ASTExpr::AND, Var(scope.ready), move(ret));
+                }
+                return ret;
+            };
+
+            ASTVector<ASTStmt> stmts;
+            auto let = [&](const string& name, ASTRef<ASTType> type,
+                           ASTRef<ASTExpr> rhs) {
+                stmts.push_back(Let(name, move(type), move(rhs)));
+                generated_.insert(stmts.back()->let.get());
+            };
+            let(index, nullptr, move(node->ops[1]));
+
+            ASTRef<ASTExpr> result;
+            if (op != ASTExpr::BYPASSREAD) {
+                for (auto& lane : entity->lanes) {
+                    ASTRef<ASTExpr> term = query(op, lane);
+                    result = result ? Op(ASTExpr::OR, move(result), move(term))
+                                    : move(term);
+                }
+                for (int slot = 0; slot < slot_; slot++) {
+                    result = Op(ASTExpr::OR, move(result),
+                                in_scope(slot, op == ASTExpr::BYPASSREADY));
+                }
+            } else {
+                AST* ast = bundle_->ast;
+                string value = ASTGenSym(ast, "bundle_query_value")->name;
+                string found = ASTGenSym(ast, "bundle_query_found")->name;
+                string age = ASTGenSym(ast, "bundle_query_age")->name;
+                let(value, nullptr,
+                    query(ASTExpr::BYPASSREAD, entity->lanes[0]));
+                let(found, Type("bool"),
+                    query(ASTExpr::BYPASSREADY, entity->lanes[0]));
+                let(age, nullptr,
+                    Op(ASTExpr::SUB, Var(bundle_->seq),
+                       query(ASTExpr::BYPASSREAD, entity->seq_lanes[0])));
+                for (unsigned lane = 1; lane < entity->lanes.size(); lane++) {
+                    string lane_age = ASTGenSym(ast, "bundle_query_age")->name;
+                    let(lane_age, nullptr,
+                        Op(ASTExpr::SUB, Var(bundle_->seq),
+                           query(ASTExpr::BYPASSREAD,
+                                 entity->seq_lanes[lane])));
+                    ASTVector<ASTStmt> take;
+                    take.push_back(Assign(Var(value),
+                                query(ASTExpr::BYPASSREAD,
+                                      entity->lanes[lane])));
+                    take.push_back(Assign(Var(age), Var(lane_age)));
+                    take.push_back(Assign(Var(found), Const(1)));
+                    stmts.push_back(If(
+                            Op(ASTExpr::AND,
+                               query(ASTExpr::BYPASSREADY, entity->lanes[lane]),
+                               Op(ASTExpr::OR, Op(ASTExpr::NOT, Var(found)),
+                                  Op(ASTExpr::LE, Var(lane_age), Var(age)))),
+                            move(take)));
+                }
+                for (int slot = 0; slot < slot_; slot++) {
+                    stmts.push_back(If(
+                            in_scope(slot, true),
+                            Assign(Var(value),
+                                   Var(entity->scopes[slot].value))));
+                }
+                result = Var(value);
+            }
+
+            ASTRef<ASTStmt> result_stmt(new ASTStmt());
+            result_stmt->expr.reset(new ASTStmtExpr());
+            result_stmt->expr->expr = move(result);
+            stmts.push_back(move(result_stmt));
+
+            Location loc = node->loc;
+            node.reset(new ASTExpr());
+            node->op = ASTExpr::STMTBLOCK;
+            node->loc = loc;
+            node->stmt.reset(new ASTStmtBlock());
+            node->stmt->stmts = move(stmts);
+        }
+
+        // Replace the array read |node| with
+        // expr {
+        //     let index = <index>;
+        //     let value = <array>[index];
+        //     if (site_valid && site_index == index) { value = site_value; }
+        //     ...  // for each write site of this and older slots, in order
+        //     value;
+        // }
+        void ForwardArrayRead(const Entity* entity, ASTRef<ASTExpr>& node) {
+            int array = entity - &bundle_->entities[0];
+            string index = ASTGenSym(bundle_->ast, "bundle_read_index")->name;
+            string value = ASTGenSym(bundle_->ast, "bundle_read_value")->name;
+
+            ASTRef<ASTStmtBlock> block(new ASTStmtBlock());
+            block->stmts.push_back(Let(index, nullptr, move(node->ops[1])));
+            generated_.insert(block->stmts.back()->let.get());
+
+            ASTRef<ASTExpr> read(new ASTExpr());
+            read->op = ASTExpr::ARRAY_REF;
+            read->loc = node->loc;
+            read->ops.push_back(Var(entity->let->lhs->name));
+            read->ops.push_back(Var(index));
+            generated_.insert(read.get());
+            block->stmts.push_back(Let(value, nullptr, move(read)));
+            generated_.insert(block->stmts.back()->let.get());
+
+            for (int slot = 0; slot <= slot_; slot++) {
+                for (unsigned w = 0; w < bundle_->array_writes.size(); w++) {
+                    if (bundle_->array_writes[w] != array) {
+                        continue;
+                    }
+                    const Bundle::Site& site = bundle_->sites[w][slot];
+                    block->stmts.push_back(If(
+                            Op(ASTExpr::AND, Var(site.valid),
+                               Op(ASTExpr::EQ, Var(site.index), Var(index))),
+                            Assign(Var(value), Var(site.value))));
+                }
+            }
+
+            ASTRef<ASTStmt> result(new ASTStmt());
+            result->expr.reset(new ASTStmtExpr());
+            result->expr->expr = Var(value);
+            block->stmts.push_back(move(result));
+
+            Location loc = node->loc;
+            node.reset(new ASTExpr());
+            node->op = ASTExpr::STMTBLOCK;
+            node->loc = loc;
+            node->stmt = move(block);
+        }
+
+        Bundle* bundle_;
+        int slot_;
+        int next_write_;
+        // Nodes created by ForwardArrayRead(), RouteBypassStmt() and
+        // ForwardBypassQuery(), which must not be rewritten.
+        set<const ASTBase*> generated_;
+};
+
+ASTRef<ASTExpr> StorageRef(const Entity* entity, ASTRef<ASTExpr> index) {
+    ASTRef<ASTExpr> ret(new ASTExpr());
+    ret->op = index ? ASTExpr::ARRAY_REF : ASTExpr::REG_REF;
+    ret->ops.push_back(Var(entity->let->lhs->name));
+    if (index) {
+        ret->ops.push_back(move(index));
+    }
+    return ret;
+}
+
+// Write back every pending write to array |entity|, in slot order. A write
+// is dropped if a younger one in the bundle hits the same index, so that each
+// index is written by at most one array write port per cycle.
+void CommitArrayWrites(const Bundle& bundle, const Entity* entity,
+                       ASTVector<ASTStmt>* out) {
+    int array = entity - &bundle.entities[0];
+    vector<const Bundle::Site*> order;
+    for (int slot = 0; slot < bundle.width; slot++) {
+        for (unsigned w = 0; w < bundle.array_writes.size(); w++) {
+            if (bundle.array_writes[w] == array) {
+                order.push_back(&bundle.sites[w][slot]);
+            }
+        }
+    }
+    for (unsigned i = 0; i < order.size(); i++) {
+        ASTRef<ASTExpr> condition = Var(order[i]->valid);
+        for (unsigned j = i + 1; j < order.size(); j++) {
+            condition = Op(ASTExpr::AND, move(condition),
+                           Op(ASTExpr::NOT,
+                              Op(ASTExpr::AND, Var(order[j]->valid),
+                                 Op(ASTExpr::EQ, Var(order[j]->index),
+                                    Var(order[i]->index)))));
+        }
+        out->push_back(If(move(condition),
+                          Assign(StorageRef(entity, Var(order[i]->index)),
+                                 Var(order[i]->value))));
+    }
+}
+
+// Width of the bundle sequence number that orders writes on a bypass's
+// per-slot networks. It only needs to tell apart the bundles in flight.
+const int kBundleSeqWidth = 16;
+
+bool ExpandBundle(AST* ast, ASTFunctionDef* func, ErrorCollector* coll) {
+    Bundle bundle(ast, func->bundle_width);
+
+    // The original body stays alive until expansion is done: the slot clones'
+    // defs still point into it.
+    ASTVector<ASTStmt> body;
+    body.swap(func->block->stmts);
+
+    // Shared prologue: the leading entity lets.
+    unsigned prologue_end = 0;
+    for (; prologue_end < body.size(); prologue_end++) {
+        ASTStmtLet* let = body[prologue_end]->let.get();
+        Entity::Kind kind;
+        if (!let || !EntityKind(let->rhs.get(), &kind)) {
+            break;
+        }
+        bundle.entity_index[let] = bundle.entities.size();
+        bundle.entities.push_back(Entity(kind, let));
+    }
+
+    // Split the slot body into segments.
+    vector<Item> items;
+    for (unsigned i = prologue_end; i < body.size(); i++) {
+        const ASTStmt* stmt = body[i].get();
+        if (stmt->timing) {
+            items.push_back(Item());
+            Item& item = items.back();
+            item.timing = stmt->timing.get();
+            item.segments.push_back(Segment());
+            const ASTStmt* timing_body = stmt->timing->body.get();
+            if (!timing_body->block) {
+                item.segments.back().stmts.push_back(timing_body);
+                continue;
+            }
+            for (auto& timed : timing_body->block->stmts) {
+                if (timed->stage) {
+                    item.segments.push_back(Segment());
+                    item.segments.back().stage = timed.get();
+                } else {
+                    item.segments.back().stmts.push_back(timed.get());
+                }
+            }
+        } else {
+            if (items.empty() || items.back().timing) {
+                items.push_back(Item());
+                items.back().segments.push_back(Segment());
+            }
+            items.back().segments.back().stmts.push_back(stmt);
+        }
+    }
+
+    ASTVisitor visitor;
+    SlotScanner scanner(coll, &bundle);
+    int segment_index = 0;
+    for (auto& item : items) {
+        for (auto& segment : item.segments) {
+            scanner.set_segment(segment_index++);
+            for (auto* stmt : segment.stmts) {
+                if (!visitor.VisitASTStmt(stmt, &scanner)) {
+                    return false;
+                }
+            }
+        }
+    }
+    if (!scanner.CheckBypassQueries()) {
+        return false;
+    }
+
+    // Shared declarations: the prologue, with a lane per slot for each port
+    // and bypass the slots use, then the shadows, write sites, live flags and
+    // bypass scopes.
+    ASTVector<ASTStmt> out;
+    ASTVector<ASTStmt> lanes_replaced;
+    bool has_read = false;
+    for (unsigned i = 0; i < prologue_end; i++) {
+        Entity* entity = bundle.Find(body[i]->let.get());
+        if ((entity->kind != Entity::PORT && entity->kind != Entity::BYPASS) ||
+            entity->first_access == -1) {
+            out.push_back(move(body[i]));
+            continue;
+        }
+        for (int slot = 0; slot < bundle.width; slot++) {
+            ASTRef<ASTStmt> lane = CloneAST(body[i].get());
+            lane->let->lhs->name = strprintf("%s_slot%d",
+                    lane->let->lhs->name.c_str(), slot);
+            ASTIdent* port_name = lane->let->rhs->ident.get();
+            if (port_name && !port_name->name.empty()) {
+                port_name->name = strprintf("%s_%d",
+                        port_name->name.c_str(), slot);
+            }
+            if (entity->kind == Entity::BYPASS) {
+                entity->lanes.push_back(lane->let->lhs->name);
+            }
+            out.push_back(move(lane));
+        }
+        if (entity->read) {
+            has_read = true;
+            for (int slot = 0; slot < bundle.width; slot++) {
+                entity->seq_lanes.push_back(
+                        ASTGenSym(ast, "bundle_seq_lane")->name);
+                ASTRef<ASTType> type = IntType(kBundleSeqWidth);
+                type->is_bypass = true;
+                ASTRef<ASTExpr> def(new ASTExpr());
+                def->op = ASTExpr::BYPASSDEF;
+                out.push_back(Let(entity->seq_lanes.back(), move(type),
+                                  move(def)));
+            }
+        }
+        lanes_replaced.push_back(move(body[i]));
+    }
+    string seq_reg;
+    if (has_read) {
+        seq_reg = ASTGenSym(ast, "bundle_seq_reg")->name;
+        bundle.seq = ASTGenSym(ast, "bundle_seq")->name;
+        ASTRef<ASTType> type = IntType(kBundleSeqWidth);
+        type->is_reg = true;
+        ASTRef<ASTExpr> init(new ASTExpr());
+        init->op = ASTExpr::REG_INIT;
+        out.push_back(Let(seq_reg, move(type), move(init)));
+    }
+    for (auto& entity : bundle.entities) {
+        if (entity.kind != Entity::REG || entity.last_write == -1) {
+            continue;
+        }
+        entity.shadow = ASTGenSym(ast, "bundle_shadow")->name;
+        entity.dirty = ASTGenSym(ast, "bundle_dirty")->name;
+        out.push_back(Let(entity.shadow, nullptr, Const(0)));
+        out.push_back(Let(entity.dirty, Type("bool"), Const(0)));
+    }
+    for (unsigned w = 0; w < bundle.array_writes.size(); w++) {
+        bundle.sites.push_back(vector<Bundle::Site>());
+        for (int slot = 0; slot < bundle.width; slot++) {
+            Bundle::Site site;
+            site.valid = ASTGenSym(ast, "bundle_write_valid")->name;
+            site.index = ASTGenSym(ast, "bundle_write_index")->name;
+            site.value = ASTGenSym(ast, "bundle_write_value")->name;
+            out.push_back(Let(site.valid, Type("bool"), Const(0)));
+            out.push_back(Let(site.index, nullptr, Const(0)));
+            out.push_back(Let(site.value, nullptr, Const(0)));
+            bundle.sites.back().push_back(site);
+        }
+    }
+    if (bundle.has_kill) {
+        for (int slot = 0; slot < bundle.width; slot++) {
+            bundle.live.push_back(ASTGenSym(ast, "bundle_live")->name);
+            out.push_back(Let(bundle.live.back(), Type("bool"), Const(1)));
+        }
+    }
+    for (auto& entity : bundle.entities) {
+        if (entity.lanes.empty() || !entity.queried) {
+            continue;
+        }
+        for (int slot = 0; slot < bundle.width; slot++) {
+            Entity::Scope scope;
+            scope.open = ASTGenSym(ast, "bundle_bypass_open")->name;
+            scope.index = ASTGenSym(ast, "bundle_bypass_index")->name;
+            scope.ready = ASTGenSym(ast, "bundle_bypass_ready")->name;
+            scope.value = ASTGenSym(ast, "bundle_bypass_value")->name;
+            out.push_back(Let(scope.open, Type("bool"), Const(0)));
+            out.push_back(Let(scope.index, nullptr, Const(0)));
+            out.push_back(Let(scope.ready, Type("bool"), Const(0)));
+            out.push_back(Let(scope.value, nullptr, Const(0)));
+            entity.scopes.push_back(scope);
+        }
+    }
+    if (has_read) {
+        // Number the bundles, so that reads can tell which of the writes
+        // visible on different networks is the youngest.
+        out.push_back(Let(bundle.seq, nullptr, RegRef(seq_reg)));
+        out.push_back(Assign(RegRef(seq_reg),
+                             Op(ASTExpr::ADD, Var(bundle.seq), Const(1))));
+    }
+
+    // Replicate each segment once per slot, bracketed by the shadow loads
+    // and storage write-backs that fall in it.
+    vector<unique_ptr<SlotRewriter>> rewriters;
+    for (int slot = 0; slot < bundle.width; slot++) {
+        rewriters.emplace_back(new SlotRewriter(coll, &bundle, slot));
+    }
+    segment_index = 0;
+    for (auto& item : items) {
+        ASTVector<ASTStmt>* target = &out;
+        if (item.timing) {
+            ASTRef<ASTStmt> timing(new ASTStmt());
+            timing->loc = item.timing->loc;
+            timing->timing.reset(new ASTStmtTiming());
+            timing->timing->loc = item.timing->loc;
+            timing->timing->body = Block(ASTVector<ASTStmt>());
+            target = &timing->timing->body->block->stmts;
+            out.push_back(move(timing));
+        }
+
+        for (auto& segment : item.segments) {
+            if (segment.stage) {
+                target->push_back(CloneAST(segment.stage));
+            }
+            for (auto& entity : bundle.entities) {
+                if (!entity.shadow.empty() &&
+                    entity.first_access == segment_index) {
+                    target->push_back(Assign(Var(entity.shadow),
+                                             StorageRef(&entity, nullptr)));
+                }
+            }
+            for (int slot = 0; slot < bundle.width; slot++) {
+                for (auto* stmt : segment.stmts) {
+                    ASTRef<ASTStmt> clone = CloneAST(stmt);
+                    if (!visitor.ModifyASTStmt(clone, rewriters[slot].get())) {
+                        return false;
+                    }
+                    target->push_back(move(clone));
+                }
+            }
+            for (auto& entity : bundle.entities) {
+                if (entity.last_write != segment_index) {
+                    continue;
+                }
+                if (entity.kind == Entity::REG) {
+                    target->push_back(If(
+                            Var(entity.dirty),
+                            Assign(StorageRef(&entity, nullptr),
+                                   Var(entity.shadow))));
+                } else if (entity.kind == Entity::ARRAY) {
+                    CommitArrayWrites(bundle, &entity, target);
+                }
+            }
+            segment_index++;
+        }
+    }
+
+    func->block->stmts.swap(out);
+    return true;
+}
+
+}  // anonymous namespace
+
+BundlePass::Result
+BundlePass::ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node) {
+    if (node->is_entry && node->bundle_width > 1) {
+        if (!ExpandBundle(ast_, node.get(), Errors())) {
+            return VISIT_END;
+        }
+    }
+    // Nothing else to rewrite inside function bodies.
+    return VISIT_TERMINAL;
+}
+
+}  // namesapce frontend
+}  // namespace autopiper
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_FRONTEND_BUNDLE_H_
+#define _AUTOPIPER_FRONTEND_BUNDLE_H_
+
+#include "frontend/ast.h"
+#include "frontend/visitor.h"
+
+namespace autopiper {
+namespace frontend {
+
+// Modify pass -- expand each bundled entry ('func entry(W) name() ...') so that
+// one invocation, i.e. one pipeline transaction, carries W transaction slots.
+// Must run after VarScopePass (it follows resolved let defs), and VarScopePass
+// must run again afterward to resolve the names it creates.
+//
+// The body's leading lets of ports, chans, regs, arrays and bypasses are
+// shared by all slots; the rest of the body is replicated once per slot, in
+// slot order, so that a younger slot sees everything an older slot did:
+//
+// - Each port or chan the slots use gets one lane per slot: port "p" becomes
+//   ports "p_0" .. "p_<W-1>".
+// - A reg the slots write is read into a shadow variable where it is first
+//   used; slots read and write the shadow, and the shadow is written back once,
+//   after the last slot's last write.
+// - An array the slots write is written once per write site and slot at the
+//   same point, youngest write winning on an index conflict. Until then, each
+//   slot's array reads are forwarded from older writes in the bundle.
+// - Each bypass the slots use gets one network per slot. A slot's queries see
+//   older bundles on all of them and, nearer than those, the scopes that the
+//   older slots of its bundle have started and written so far. A query must
+//   not precede, by stage, a 'bypasswrite' to the same bypass, which it could
+//   never see.
+// - 'kill' ends only its own slot. 'killyounger' ends the younger slots of its
+//   bundle and kills younger bundles as usual.
+//
+// Top-level timing blocks are merged rather than replicated: stage N of the
+// merged block holds stage N of every slot, so the bundle occupies the same
+// stages as one scalar transaction would.
+class BundlePass : public ASTVisitorContext {
+    public:
+        BundlePass(autopiper::ErrorCollector* coll);
+
+    protected:
+        virtual Result ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node);
+
+        // Grab a pointer to the AST so we can gensym new temps.
+        virtual Result ModifyASTPre(ASTRef<AST>& node) {
+            ast_ = node.get();
+            return VISIT_CONTINUE;
+        }
+
+    private:
+        AST* ast_;
+};
+
+}  // namesapce frontend
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_FRONTEND_BUNDLE_H_
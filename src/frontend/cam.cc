@@ -0,0 +1,609 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frontend/cam.h"
+#include "frontend/ast-build.h"
+#include "common/util.h"
+
+using namespace std;
+
+namespace autopiper {
+namespace frontend {
+
+static const int kMaxEntries = 64;
+
+// Names of the state that one CAM expands to.
+struct CamPass::Cam {
+    int entries;
+    const ASTStmtBlock* block;  // the declaring block
+
+    string valid;            // reg int_N: bit i set if entry i is valid
+    vector<string> key;      // reg K per entry
+    vector<string> data;     // reg V per entry
+    vector<string> younger;  // reg int_N per entry: entries younger than it
+
+    // Request ports, written by 'caminsert' and 'caminvalidate' and read by
+    // the updater process.
+    string ins_valid;
+    string ins_key;
+    string ins_data;
+    string inv_valid;
+    string inv_key;
+    bool inserted;
+    bool invalidated;
+
+    // Body of the updater process, filled in at the end of the declaring
+    // block, once it is known which requests are made.
+    ASTStmtBlock* updater;
+    Location loc;
+};
+
+CamPass::CamPass(autopiper::ErrorCollector* coll)
+    : ASTVisitorContext(coll), ast_(nullptr)
+{ }
+
+CamPass::~CamPass() { }
+
+namespace {
+
+// ----------------- AST construction helpers. ----------------------
+//
+// (The general ones are in ast-build.h.)
+
+ASTRef<ASTExpr> Bit(const string& name, int bit) {
+    return Slice(Var(name), bit, bit);
+}
+
+ASTRef<ASTExpr> PortRead(const string& port) {
+    return Op(ASTExpr::PORTREAD, Var(port));
+}
+
+ASTRef<ASTStmt> ExprStmt(ASTRef<ASTExpr> expr) {
+    ASTRef<ASTStmt> ret(new ASTStmt());
+    ret->expr.reset(new ASTStmtExpr());
+    ret->expr->expr = move(expr);
+    return ret;
+}
+
+}  // anonymous namespace
+
+CamPass::Cam* CamPass::Trace(const ASTExpr* expr) const {
+    while (expr && expr->op == ASTExpr::VAR && expr->def) {
+        auto it = cam_lets_.find(expr->def);
+        if (it != cam_lets_.end()) {
+            return it->second;
+        }
+        expr = expr->def->rhs.get();
+    }
+    return nullptr;
+}
+
+// let c : cam K V = cam N;
+//
+// ==>
+//
+// let valid : reg int_N = reg;
+// let key_i : reg K = reg;         // for each entry i
+// let data_i : reg V = reg;
+// let younger_i : reg int_N = reg;
+// let ins_valid : port bool = port default 0;
+// let ins_key : port K = port;
+// let ins_data : port V = port;
+// let inv_valid : port bool = port default 0;
+// let inv_key : port K = port;
+// func { ... }  // see BuildUpdater()
+bool CamPass::ExpandCam(ASTRef<ASTStmt>& stmt, const ASTStmtBlock* block,
+                        ASTVector<ASTStmt>* out) {
+    ASTStmtLet* let = stmt->let.get();
+    const ASTExpr* def = let->rhs.get();
+    if (!let->type || !let->type->is_cam) {
+        Error(let, "A CAM must be bound by a let of type 'cam K V'.");
+        return false;
+    }
+    if (!def->has_constant || def->constant < 2 ||
+        def->constant > kMaxEntries) {
+        Error(def, strprintf("CAM size must be between 2 and %d entries.",
+                             kMaxEntries));
+        return false;
+    }
+
+    unique_ptr<Cam> cam(new Cam());
+    cam->entries = static_cast<int>(def->constant);
+    cam->block = block;
+    cam->inserted = false;
+    cam->invalidated = false;
+    cam->loc = stmt->loc;
+    int N = cam->entries;
+    auto gensym = [this](const char* prefix) {
+        return ASTGenSym(ast_, prefix)->name;
+    };
+    cam->valid = gensym("cam_valid");
+    for (int i = 0; i < N; i++) {
+        cam->key.push_back(gensym("cam_key"));
+        cam->data.push_back(gensym("cam_data"));
+        cam->younger.push_back(gensym("cam_younger"));
+    }
+    cam->ins_valid = gensym("cam_ins_valid");
+    cam->ins_key = gensym("cam_ins_key");
+    cam->ins_data = gensym("cam_ins_data");
+    cam->inv_valid = gensym("cam_inv_valid");
+    cam->inv_key = gensym("cam_inv_key");
+
+    ASTVector<ASTStmt> stmts;
+    auto reg = [&](const string& name, ASTRef<ASTType> type) {
+        type->is_reg = true;
+        ASTRef<ASTExpr> init(new ASTExpr());
+        init->op = ASTExpr::REG_INIT;
+        stmts.push_back(Let(name, move(type), move(init)));
+    };
+    auto port = [&](const string& name, ASTRef<ASTType> type,
+                    bool has_default) {
+        type->is_port = true;
+        ASTRef<ASTExpr> portdef(new ASTExpr());
+        portdef->op = ASTExpr::PORTDEF;
+        portdef->ident = Ident("", ASTIdent::PORT);
+        if (has_default) {
+            portdef->constant = 0;
+            portdef->has_constant = true;
+        }
+        stmts.push_back(Let(name, move(type), move(portdef)));
+    };
+    ASTRef<ASTType> value_type = CloneAST(let->type.get());
+    value_type->is_cam = false;
+    value_type->cam_key.reset();
+    const ASTType* key_type = let->type->cam_key.get();
+
+    reg(cam->valid, IntType(N));
+    for (int i = 0; i < N; i++) {
+        reg(cam->key[i], CloneAST(key_type));
+        reg(cam->data[i], CloneAST(value_type.get()));
+        reg(cam->younger[i], IntType(N));
+    }
+    port(cam->ins_valid, Type("bool"), true);
+    port(cam->ins_key, CloneAST(key_type), false);
+    port(cam->ins_data, CloneAST(value_type.get()), false);
+    port(cam->inv_valid, Type("bool"), true);
+    port(cam->inv_key, CloneAST(key_type), false);
+
+    ASTRef<ASTStmt> nested(new ASTStmt());
+    nested->nested.reset(new ASTStmtNestedFunc());
+    nested->nested->body.reset(new ASTStmtBlock());
+    cam->updater = nested->nested->body.get();
+    stmts.push_back(move(nested));
+
+    for (auto& s : stmts) {
+        SetLoc(s.get(), stmt->loc);
+        out->push_back(move(s));
+    }
+    cam_lets_[let] = cam.get();
+    cams_.push_back(move(cam));
+    return true;
+}
+
+// The updater process, pinned to a single stage so that each cycle's
+// requests see the state the previous cycle's left:
+//
+// timing {
+//     stage 0;
+//     let v = reg valid;
+//     // If any 'caminvalidate': drop the matching entries.
+//     let ik = read inv_key;
+//     let iv = read inv_valid;
+//     let nv = v & ~{ iv & v[N-1] & (reg key_N-1 == ik), ...,
+//                     iv & v[0] & (reg key_0 == ik) };
+//     // If any 'caminsert': fill the lowest free entry, and make it the
+//     // youngest.
+//     let free = ~v;
+//     let pick = free & (~free + 1);
+//     if (read ins_valid) {
+//         let k = read ins_key;
+//         let d = read ins_data;
+//         if (pick[i]) {                       // for each entry i
+//             reg key_i = k;
+//             reg data_i = d;
+//             reg younger_i = 0;
+//         } else {
+//             reg younger_i = reg younger_i | pick;
+//         }
+//         nv = nv | pick;
+//     }
+//     reg valid = nv;
+// }
+void CamPass::BuildUpdater(const Cam* cam) {
+    int N = cam->entries;
+    auto gensym = [this](const char* prefix) {
+        return ASTGenSym(ast_, prefix)->name;
+    };
+    string v = gensym("cam_upd_valid");
+    string nv = gensym("cam_upd_next_valid");
+
+    ASTVector<ASTStmt> stmts;
+    ASTRef<ASTStmt> stage(new ASTStmt());
+    stage->stage.reset(new ASTStmtStage());
+    stage->stage->offset = 0;
+    stmts.push_back(move(stage));
+    stmts.push_back(Let(v, nullptr, RegRef(cam->valid)));
+
+    if (cam->invalidated) {
+        string ik = gensym("cam_upd_inv_key");
+        string iv = gensym("cam_upd_inv");
+        stmts.push_back(Let(ik, nullptr, PortRead(cam->inv_key)));
+        stmts.push_back(Let(iv, nullptr, PortRead(cam->inv_valid)));
+        ASTRef<ASTExpr> mask(new ASTExpr());
+        mask->op = ASTExpr::CONCAT;
+        for (int i = N - 1; i >= 0; i--) {
+            mask->ops.push_back(
+                    Op(ASTExpr::AND,
+                       Op(ASTExpr::AND, Var(iv), Bit(v, i)),
+                       Op(ASTExpr::EQ, RegRef(cam->key[i]), Var(ik))));
+        }
+        stmts.push_back(Let(nv, nullptr,
+                            Op(ASTExpr::AND, Var(v),
+                               Op(ASTExpr::NOT, move(mask)))));
+    } else {
+        stmts.push_back(Let(nv, nullptr, Var(v)));
+    }
+
+    if (cam->inserted) {
+        string free = gensym("cam_upd_free");
+        string pick = gensym("cam_upd_pick");
+        string k = gensym("cam_upd_ins_key");
+        string d = gensym("cam_upd_ins_data");
+        stmts.push_back(Let(free, nullptr, Op(ASTExpr::NOT, Var(v))));
+        stmts.push_back(Let(pick, nullptr,
+                            Op(ASTExpr::AND, Var(free),
+                               Op(ASTExpr::ADD,
+                                  Op(ASTExpr::NOT, Var(free)), Const(1)))));
+        ASTVector<ASTStmt> insert;
+        insert.push_back(Let(k, nullptr, PortRead(cam->ins_key)));
+        insert.push_back(Let(d, nullptr, PortRead(cam->ins_data)));
+        for (int i = 0; i < N; i++) {
+            ASTVector<ASTStmt> fill, age;
+            fill.push_back(Assign(RegRef(cam->key[i]), Var(k)));
+            fill.push_back(Assign(RegRef(cam->data[i]), Var(d)));
+            fill.push_back(Assign(RegRef(cam->younger[i]), Const(0)));
+            age.push_back(Assign(RegRef(cam->younger[i]),
+                                 Op(ASTExpr::OR, RegRef(cam->younger[i]),
+                                    Var(pick))));
+            insert.push_back(If(Bit(pick, i), move(fill), move(age)));
+        }
+        insert.push_back(Assign(Var(nv), Op(ASTExpr::OR, Var(nv), Var(pick))));
+        stmts.push_back(If(PortRead(cam->ins_valid), move(insert)));
+    }
+
+    stmts.push_back(Assign(RegRef(cam->valid), Var(nv)));
+
+    ASTRef<ASTStmt> timing(new ASTStmt());
+    timing->timing.reset(new ASTStmtTiming());
+    timing->timing->body = Block(move(stmts));
+    SetLoc(timing.get(), cam->loc);
+    cam->updater->stmts.push_back(move(timing));
+}
+
+// caminsert c, key, value;
+//
+// ==>
+//
+// {
+//     let k = key;
+//     let d = value;
+//     wait ((~reg valid) != 0);
+//     write ins_valid, 1;
+//     write ins_key, k;
+//     write ins_data, d;
+// }
+ASTRef<ASTStmt> CamPass::ExpandInsert(Cam* cam, ASTRef<ASTStmt> caminsert) {
+    cam->inserted = true;
+    string k = ASTGenSym(ast_, "cam_insert_key")->name;
+    string d = ASTGenSym(ast_, "cam_insert_data")->name;
+    Location loc = caminsert->loc;
+
+    ASTVector<ASTStmt> stmts;
+    stmts.push_back(Let(k, nullptr, move(caminsert->caminsert->key)));
+    stmts.push_back(Let(d, nullptr, move(caminsert->caminsert->value)));
+    ASTRef<ASTStmt> wait(new ASTStmt());
+    wait->wait.reset(new ASTStmtWait());
+    wait->wait->condition =
+        Op(ASTExpr::NE, Op(ASTExpr::NOT, RegRef(cam->valid)), Const(0));
+    stmts.push_back(move(wait));
+    stmts.push_back(Write(cam->ins_valid, Const(1)));
+    stmts.push_back(Write(cam->ins_key, Var(k)));
+    stmts.push_back(Write(cam->ins_data, Var(d)));
+
+    ASTRef<ASTStmt> ret = Block(move(stmts));
+    for (auto& stmt : ret->block->stmts) {
+        if (stmt->let) {
+            // Keep the key and value expressions' own locations.
+            stmt->loc = stmt->let->loc = loc;
+        } else {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+    ret->loc = loc;
+    return ret;
+}
+
+// caminvalidate c, key;
+//
+// ==>
+//
+// {
+//     let k = key;
+//     write inv_valid, 1;
+//     write inv_key, k;
+// }
+ASTRef<ASTStmt> CamPass::ExpandInvalidate(Cam* cam,
+                                          ASTRef<ASTStmt> caminvalidate) {
+    cam->invalidated = true;
+    string k = ASTGenSym(ast_, "cam_invalidate_key")->name;
+    Location loc = caminvalidate->loc;
+
+    ASTVector<ASTStmt> stmts;
+    stmts.push_back(Let(k, nullptr, move(caminvalidate->caminvalidate->key)));
+    stmts.push_back(Write(cam->inv_valid, Const(1)));
+    stmts.push_back(Write(cam->inv_key, Var(k)));
+
+    ASTRef<ASTStmt> ret = Block(move(stmts));
+    for (auto& stmt : ret->block->stmts) {
+        if (stmt->let) {
+            stmt->loc = stmt->let->loc = loc;
+        } else {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+    ret->loc = loc;
+    return ret;
+}
+
+// camhit c, key / camread c, key
+//
+// ==>
+//
+// expr {
+//     let k = key;
+//     let v = reg valid;
+//     let m_i = v[i] & (reg key_i == k);   // for each entry i
+//     let m = { m_N-1, ..., m_0 };
+//     m != 0;                               // camhit
+//
+//     // camread: the youngest match is the one with no younger match.
+//     let y_i = m_i & ((reg younger_i & m) == 0);
+//     // Then a balanced tree of two-way selects over (y_i, reg data_i):
+//     let any = l_any | r_any;
+//     let val = r_val;
+//     if (l_any) { val = l_val; }
+//     ...
+//     val;                                  // at the root
+// }
+ASTRef<ASTExpr> CamPass::ExpandLookup(const Cam* cam, ASTRef<ASTExpr> lookup) {
+    int N = cam->entries;
+    auto gensym = [this](const char* prefix) {
+        return ASTGenSym(ast_, prefix)->name;
+    };
+    string k = gensym("cam_lookup_key");
+    string v = gensym("cam_lookup_valid");
+    string m = gensym("cam_lookup_match");
+    Location loc = lookup->loc;
+
+    ASTVector<ASTStmt> stmts;
+    stmts.push_back(Let(k, nullptr, move(lookup->ops[1])));
+    stmts.push_back(Let(v, nullptr, RegRef(cam->valid)));
+    vector<string> match;
+    ASTRef<ASTExpr> all(new ASTExpr());
+    all->op = ASTExpr::CONCAT;
+    for (int i = 0; i < N; i++) {
+        match.push_back(gensym("cam_lookup_match"));
+        stmts.push_back(Let(match[i], nullptr,
+                            Op(ASTExpr::AND, Bit(v, i),
+                               Op(ASTExpr::EQ, RegRef(cam->key[i]),
+                                  Var(k)))));
+    }
+    for (int i = N - 1; i >= 0; i--) {
+        all->ops.push_back(Var(match[i]));
+    }
+    stmts.push_back(Let(m, nullptr, move(all)));
+
+    if (lookup->op == ASTExpr::CAMHIT) {
+        stmts.push_back(ExprStmt(Op(ASTExpr::NE, Var(m), Const(0))));
+    } else {
+        // (any, val) pairs at the current level of the select tree.
+        vector<pair<string, string>> level;
+        for (int i = 0; i < N; i++) {
+            string y = gensym("cam_lookup_youngest");
+            string d = gensym("cam_lookup_data");
+            stmts.push_back(Let(y, nullptr,
+                    Op(ASTExpr::AND, Var(match[i]),
+                       Op(ASTExpr::EQ,
+                          Op(ASTExpr::AND, RegRef(cam->younger[i]), Var(m)),
+                          Const(0)))));
+            stmts.push_back(Let(d, nullptr, RegRef(cam->data[i])));
+            level.push_back(make_pair(y, d));
+        }
+        while (level.size() > 1) {
+            vector<pair<string, string>> next;
+            for (size_t i = 0; i + 1 < level.size(); i += 2) {
+                const auto& l = level[i];
+                const auto& r = level[i + 1];
+                string any = gensym("cam_lookup_any");
+                string val = gensym("cam_lookup_value");
+                stmts.push_back(Let(any, nullptr,
+                                    Op(ASTExpr::OR, Var(l.first),
+                                       Var(r.first))));
+                stmts.push_back(Let(val, nullptr, Var(r.second)));
+                ASTVector<ASTStmt> take_left;
+                take_left.push_back(Assign(Var(val), Var(l.second)));
+                stmts.push_back(If(Var(l.first), move(take_left)));
+                next.push_back(make_pair(any, val));
+            }
+            if (level.size() % 2) {
+                next.push_back(level.back());
+            }
+            level.swap(next);
+        }
+        stmts.push_back(ExprStmt(Var(level[0].second)));
+    }
+
+    ASTRef<ASTExpr> ret(new ASTExpr());
+    ret->op = ASTExpr::STMTBLOCK;
+    ret->stmt.reset(new ASTStmtBlock());
+    ret->stmt->stmts = move(stmts);
+    for (auto& stmt : ret->stmt->stmts) {
+        if (stmt->let && stmt->let->lhs->name == k) {
+            // Keep the key expression's own locations.
+            stmt->loc = stmt->let->loc = loc;
+        } else {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+    ret->loc = loc;
+    return ret;
+}
+
+CamPass::Result
+CamPass::ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node) {
+    // Function bodies have been inlined into the entry points, the only ones
+    // that are compiled.
+    if (!node->is_entry) {
+        return VISIT_TERMINAL;
+    }
+    return VISIT_CONTINUE;
+}
+
+CamPass::Result
+CamPass::ModifyASTStmtBlockPre(ASTRef<ASTStmtBlock>& node) {
+    // Expand CAM lets in place, so that their state is in scope for the rest
+    // of the block, and drop their aliases.
+    bool has_cam = false;
+    for (auto& stmt : node->stmts) {
+        if (stmt->let && stmt->let->type && stmt->let->type->is_cam) {
+            has_cam = true;
+            break;
+        }
+        if (stmt->let && stmt->let->rhs &&
+            (stmt->let->rhs->op == ASTExpr::CAMDEF ||
+             Trace(stmt->let->rhs.get()))) {
+            has_cam = true;
+            break;
+        }
+    }
+    if (!has_cam) {
+        return VISIT_CONTINUE;
+    }
+
+    ASTVector<ASTStmt> stmts;
+    for (auto& stmt : node->stmts) {
+        ASTStmtLet* let = stmt->let.get();
+        if (!let || !let->rhs) {
+            stmts.push_back(move(stmt));
+            continue;
+        }
+        if (let->rhs->op == ASTExpr::CAMDEF) {
+            if (!ExpandCam(stmt, node.get(), &stmts)) {
+                return VISIT_END;
+            }
+            removed_.push_back(move(stmt));
+            continue;
+        }
+        Cam* cam = Trace(let->rhs.get());
+        if (cam) {
+            cam_lets_[let] = cam;
+            removed_.push_back(move(stmt));
+            continue;
+        }
+        if (let->type && let->type->is_cam) {
+            Error(let, "A let of type 'cam K V' must be bound to a CAM.");
+            return VISIT_END;
+        }
+        stmts.push_back(move(stmt));
+    }
+    node->stmts = move(stmts);
+    return VISIT_CONTINUE;
+}
+
+CamPass::Result
+CamPass::ModifyASTStmtBlockPost(ASTRef<ASTStmtBlock>& node) {
+    // All of a CAM's uses are in its declaring block, so its requests are
+    // now known.
+    for (auto& cam : cams_) {
+        if (cam->block != node.get()) {
+            continue;
+        }
+        if (!cam->inserted) {
+            Errors()->ReportError(cam->loc, ErrorCollector::ERROR,
+                    "CAM is never written by a 'caminsert'.");
+            return VISIT_END;
+        }
+        BuildUpdater(cam.get());
+    }
+    return VISIT_CONTINUE;
+}
+
+CamPass::Result
+CamPass::ModifyASTStmtPre(ASTRef<ASTStmt>& node) {
+    if (node->caminsert) {
+        Cam* cam = Trace(node->caminsert->cam.get());
+        if (!cam) {
+            Error(node->caminsert->cam.get(), "'caminsert' requires a CAM.");
+            return VISIT_END;
+        }
+        node = ExpandInsert(cam, move(node));
+        return VISIT_CONTINUE;
+    }
+
+    if (node->caminvalidate) {
+        Cam* cam = Trace(node->caminvalidate->cam.get());
+        if (!cam) {
+            Error(node->caminvalidate->cam.get(),
+                  "'caminvalidate' requires a CAM.");
+            return VISIT_END;
+        }
+        node = ExpandInvalidate(cam, move(node));
+        return VISIT_CONTINUE;
+    }
+
+    return VISIT_CONTINUE;
+}
+
+CamPass::Result
+CamPass::ModifyASTExprPre(ASTRef<ASTExpr>& node) {
+    if (node->op == ASTExpr::CAMDEF) {
+        Error(node.get(), "'cam' may only initialize a let of type "
+                          "'cam K V'.");
+        return VISIT_END;
+    }
+    if (node->op == ASTExpr::CAMHIT || node->op == ASTExpr::CAMREAD) {
+        const Cam* cam = Trace(node->ops[0].get());
+        if (!cam) {
+            Error(node->ops[0].get(), strprintf(
+                        "'%s' requires a CAM.",
+                        node->op == ASTExpr::CAMHIT ? "camhit" : "camread"));
+            return VISIT_END;
+        }
+        node = ExpandLookup(cam, move(node));
+        return VISIT_CONTINUE;
+    }
+    if (node->op == ASTExpr::VAR && Trace(node.get())) {
+        Error(node.get(), strprintf(
+                    "CAM '%s' may only be used by 'caminsert', "
+                    "'caminvalidate', 'camhit' and 'camread'.",
+                    node->ident->name.c_str()));
+        return VISIT_END;
+    }
+    return VISIT_CONTINUE;
+}
+
+}  // namesapce frontend
+}  // namespace autopiper
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_FRONTEND_CAM_H_
+#define _AUTOPIPER_FRONTEND_CAM_H_
+
+#include "frontend/ast.h"
+#include "frontend/visitor.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+namespace frontend {
+
+// Modify pass -- expand CAMs, associative stores that are searched by key
+// and answer with their youngest matching entry. Must run after
+// VarScopePass (it follows resolved let defs), and VarScopePass must run
+// again afterward to resolve the names it creates.
+//
+// let c : cam K V = cam N;   // N: entries, 2 to 64
+//
+// becomes N entries of key, value and age-matrix row regs, a valid-bit reg,
+// and a nested process that applies the cycle's insert and invalidate
+// requests to them.
+//
+// caminsert c, key, value;   // waits while the CAM is full
+// caminvalidate c, key;      // clears every entry matching key
+// camhit c, key              // bool: does any entry match?
+// camread c, key             // value of the youngest matching entry
+//
+// Inserts and invalidates take effect at the end of the cycle, so a lookup
+// in the same cycle sees the prior contents. At most one insert and one
+// invalidate may be requested per cycle (all 'caminsert's of a CAM must be
+// in one process and stage and mutually exclusive, as for a port's writes,
+// and likewise 'caminvalidate's); each lookup is its own read port. A
+// lookup compares the key with all entries in parallel and picks the
+// youngest match with a log-depth select tree, built of ordinary ops and so
+// timed and pipelined like the rest of its process.
+class CamPass : public ASTVisitorContext {
+    public:
+        CamPass(autopiper::ErrorCollector* coll);
+        ~CamPass();
+
+    protected:
+        virtual Result ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node);
+        virtual Result ModifyASTStmtBlockPre(ASTRef<ASTStmtBlock>& node);
+        virtual Result ModifyASTStmtBlockPost(ASTRef<ASTStmtBlock>& node);
+        virtual Result ModifyASTStmtPre(ASTRef<ASTStmt>& node);
+        virtual Result ModifyASTExprPre(ASTRef<ASTExpr>& node);
+
+        // Grab a pointer to the AST so we can gensym new temps.
+        virtual Result ModifyASTPre(ASTRef<AST>& node) {
+            ast_ = node.get();
+            return VISIT_CONTINUE;
+        }
+
+    private:
+        struct Cam;
+
+        // Returns the CAM that |expr| refers to, tracing through lets of
+        // plain variables, or nullptr.
+        Cam* Trace(const ASTExpr* expr) const;
+
+        bool ExpandCam(ASTRef<ASTStmt>& let, const ASTStmtBlock* block,
+                       ASTVector<ASTStmt>* out);
+        void BuildUpdater(const Cam* cam);
+        ASTRef<ASTStmt> ExpandInsert(Cam* cam, ASTRef<ASTStmt> caminsert);
+        ASTRef<ASTStmt> ExpandInvalidate(Cam* cam,
+                                         ASTRef<ASTStmt> caminvalidate);
+        ASTRef<ASTExpr> ExpandLookup(const Cam* cam, ASTRef<ASTExpr> lookup);
+
+        AST* ast_;
+
+        std::vector<std::unique_ptr<Cam>> cams_;
+        // CAM lets and their aliases.
+        std::map<const ASTStmtLet*, Cam*> cam_lets_;
+        // The lets above, removed from the AST but kept alive so that no
+        // other node takes their addresses.
+        ASTVector<ASTStmt> removed_;
+};
+
+}  // namesapce frontend
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_FRONTEND_CAM_H_
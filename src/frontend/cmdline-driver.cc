@@ -21,6 +21,8 @@
 #include "common/exception.h"
 #include "build-config.h"
 
+#include <stdlib.h>
+
 using namespace std;
 
 namespace autopiper {
@@ -39,6 +41,23 @@ static const char* kUsage =
     "                            but before lowering.\n"
     "        --print-lowered:    print the lowered pipeline form before backend codegen.\n"
     "        --ir-output <file>: print the IR to the given file (and continue to backend).\n"
+    "        --qor <file>:       write quality-of-results metrics (JSON) to the given file.\n"
+    "        --stage-map <file>: write per-stage occupancy and register pressure (JSON).\n"
+    "        --stage-map-html <file>: as --stage-map, but as an HTML table.\n"
+    "        --sdc <file>:       write timing constraints (SDC) grouped by\n"
+    "                            pipeline stage to the given file.\n"
+    "        --sdc-period <ns>:  clock period for --sdc (default 10).\n"
+    "        --trace <depth>:    add an on-chip trace buffer of <depth> entries\n"
+    "                            sampling every stage's valid, stall, hold and\n"
+    "                            kill bits.\n"
+    "        --trace-value <port>: also sample this port's value with --trace\n"
+    "                            (may be repeated).\n"
+    "        --trace-map <file>: write the --trace sample layout (JSON).\n"
+    "        --timing-model <name>: override the timing_model pragma (null,\n"
+    "                            standard, standard:<gates>, table:<file>).\n"
+    "        --checkpoint-out <file>: save the program as lowered up to pipe\n"
+    "                            timing, for re-timing with autopiper-backend\n"
+    "                            --checkpoint-in.\n"
     "        -h, --help:         print this help message.\n"
     "        -v, --version:      print version and license information.\n";
 
@@ -98,6 +117,36 @@ class FrontendFlags : public CmdlineParser {
             } else if (flag == "--ir-output") {
                 driver_->options_.ir_output = value;
                 return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--qor") {
+                driver_->options_.qor_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--stage-map") {
+                driver_->options_.stage_map_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--stage-map-html") {
+                driver_->options_.stage_map_html_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--sdc") {
+                driver_->options_.sdc_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--sdc-period") {
+                driver_->options_.sdc_clock_period = atof(value.c_str());
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace") {
+                driver_->options_.trace_depth = atoi(value.c_str());
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace-value") {
+                driver_->options_.trace_values.push_back(value);
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--trace-map") {
+                driver_->options_.trace_map_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--timing-model") {
+                driver_->options_.timing_model = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--checkpoint-out") {
+                driver_->options_.checkpoint_output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
             } else if (flag == "-o") {
                 driver_->options_.output = value;
                 return FLAG_CONSUMED_KEY_VALUE;
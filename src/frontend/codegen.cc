@@ -29,6 +29,7 @@ namespace frontend {
 CodeGenContext::CodeGenContext(AST* ast) {
     prog_.reset(new IRProgram());
     gensym_ = 1;
+    binding_order_ = 0;
     curbb_ = nullptr;
     ast_ = ast;
     prog_->crosslinked_args_bbs = true;
@@ -59,6 +60,9 @@ IRStmt* CodeGenContext::AddIRStmt(
         const ASTExpr* expr) {
     if (expr) {
         expr_to_ir_map_[expr] = stmt.get();
+        stmt->location = expr->loc;
+    } else if (!locs_.empty()) {
+        stmt->location = locs_.back();
     }
     if (stmt->valnum >= prog_->next_valnum) {
         prog_->next_valnum = stmt->valnum + 1;
@@ -102,7 +106,7 @@ CodeGenPass::ModifyASTFunctionDefPost(ASTRef<ASTFunctionDef>& node) {
 
 CodeGenPass::Result
 CodeGenPass::ModifyASTStmtLetPost(ASTRef<ASTStmtLet>& node) {
-    ctx_->Bindings().Set(node.get(), node->rhs.get());
+    ctx_->AddBinding(node.get(), node->rhs.get());
     return VISIT_CONTINUE;
 }
 
@@ -287,6 +291,19 @@ CodeGenPass::ModifyASTStmtKillIfPost(ASTRef<ASTStmtKillIf>& node) {
     return VISIT_CONTINUE;
 }
 
+CodeGenPass::Result
+CodeGenPass::ModifyASTStmtWaitPost(ASTRef<ASTStmtWait>& node) {
+    unique_ptr<IRStmt> stmt(new IRStmt());
+    stmt->valnum = ctx_->Valnum();
+    stmt->type = IRStmtWait;
+    stmt->width = 1;
+    IRStmt* cond = ctx_->GetIRStmt(node->condition.get());
+    stmt->args.push_back(cond);
+    stmt->arg_nums.push_back(cond->valnum);
+    ctx_->AddIRStmt(ctx_->CurBB(), move(stmt));
+    return VISIT_CONTINUE;
+}
+
 CodeGenPass::Result
 CodeGenPass::ModifyASTStmtTimingPre(ASTRef<ASTStmtTiming>& node) {
     unique_ptr<IRTimeVar> timevar(new IRTimeVar());
@@ -509,6 +526,29 @@ CodeGenPass::ModifyASTExprPost(ASTRef<ASTExpr>& node) {
                 array_def->type = IRStmtArraySize;
                 array_def->port_name = node->ident->name;
                 array_def->constant = node->inferred_type.array_size;
+
+                if (node->array_init.size() >
+                    static_cast<size_t>(node->inferred_type.array_size)) {
+                    Error(node.get(),
+                          strprintf("Array initializer has %d values for %d "
+                                    "elements.",
+                                    static_cast<int>(node->array_init.size()),
+                                    node->inferred_type.array_size));
+                    return VISIT_END;
+                }
+                ASTBignum limit = ASTBignum(1) << node->inferred_type.width;
+                for (auto& value : node->array_init) {
+                    if (value >= limit) {
+                        Error(node.get(),
+                              strprintf("Array initializer value %s does not "
+                                        "fit in %d bits.",
+                                        value.str().c_str(),
+                                        node->inferred_type.width));
+                        return VISIT_END;
+                    }
+                }
+                array_def->array_init = node->array_init;
+                array_def->array_registered = node->array_registered;
                 ctx_->AddIRStmt(ctx_->CurBB(), move(array_def));
                 break;
             }
@@ -596,6 +636,24 @@ CodeGenPass::ModifyASTExprPost(ASTRef<ASTExpr>& node) {
                 break;
             }
 
+            case ASTExpr::INSTANCE: {
+                unique_ptr<IRStmt> instance(new IRStmt());
+                instance->valnum = ctx_->Valnum();
+                instance->type = IRStmtInstance;
+                instance->width = node->inferred_type.width;
+                instance->port_name = node->ident->name;
+                instance->constant = node->constant;
+                instance->has_constant = true;
+                for (auto& op : node->ops) {
+                    IRStmt* arg = ctx_->GetIRStmt(op.get());
+                    instance->args.push_back(arg);
+                    instance->arg_nums.push_back(arg->valnum);
+                }
+
+                ctx_->AddIRStmt(ctx_->CurBB(), move(instance), node.get());
+                break;
+            }
+
             case ASTExpr::STMTBLOCK: {
                 // the block will have already been codegen'd during visit,
                 // since we're in a post-hook, so we merely have to find the
@@ -815,7 +873,7 @@ CodeGenPass::ModifyASTStmtIfPre(ASTRef<ASTStmtIf>& node) {
     ctx_->AddIRStmt(else_end, move(else_end_jmp));
 
     auto phi_map = ctx_->Bindings().JoinOverlays(
-            vector<map<ASTStmtLet*, const ASTExpr*>> {
+            vector<SubBindingMap> {
                 if_bindings, else_bindings });
 
     for (auto& p : phi_map) {
@@ -903,6 +961,17 @@ CodeGenPass::ModifyASTStmtIfPre(ASTRef<ASTStmtIf>& node) {
 // convenient structure is used to inline functions by desugaring 'return' to a
 // break out of a loop body.
 
+// Records the in-edge from |bb| to a loop's header or footer. A block ends in
+// one jump, so it contributes one edge: if |bb| already has one, the first
+// set of bindings stands.
+static void AddLoopEdge(SubBindingEdges* edges, IRBB* bb,
+                        const SubBindingMap& bindings) {
+    for (auto& p : *edges) {
+        if (p.first == bb) return;
+    }
+    edges->push_back(make_pair(bb, bindings));
+}
+
 bool CodeGenPass::AddWhileLoopPhiNodeInputs(
         const ASTBase* node,
         CodeGenContext* ctx,
@@ -910,9 +979,9 @@ bool CodeGenPass::AddWhileLoopPhiNodeInputs(
         // exist and we're adding to their input sets (e.g. for header), or
         // |binding_phi_bb| to be non-null, in which case we're creating new
         // phis (e.g. for footer).
-        map<ASTStmtLet*, IRStmt*>* binding_phis,
+        map<ASTStmtLet*, IRStmt*, ASTStmtLetLess>* binding_phis,
         IRBB* binding_phi_bb,
-        map<IRBB*, SubBindingMap>& in_edges) {
+        SubBindingEdges& in_edges) {
     vector<IRBB*> in_bbs;
     vector<SubBindingMap> in_maps;
     for (auto& p : in_edges) {
@@ -920,7 +989,7 @@ bool CodeGenPass::AddWhileLoopPhiNodeInputs(
         in_maps.push_back(p.second);
     }
 
-    map<ASTStmtLet*, vector<const ASTExpr*>> join =
+    map<ASTStmtLet*, vector<const ASTExpr*>, ASTStmtLetLess> join =
         ctx->Bindings().JoinOverlays(in_maps);
 
     for (auto& p : join) {
@@ -1004,8 +1073,8 @@ CodeGenPass::ModifyASTStmtWhilePre(ASTRef<ASTStmtWhile>& node) {
     //
     // We'll add inputs to the phis later, after codegen'ing the body, when we
     // know about all 'continue' edges up to the restart point.
-    set<ASTStmtLet*> bindings = ctx_->Bindings().Keys();
-    map<ASTStmtLet*, IRStmt*> binding_phis;
+    set<ASTStmtLet*, ASTStmtLetLess> bindings = ctx_->Bindings().Keys();
+    map<ASTStmtLet*, IRStmt*, ASTStmtLetLess> binding_phis;
     for (auto& let : bindings) {
         if (!ctx_->Bindings().Has(let)) {
             continue;
@@ -1064,9 +1133,8 @@ CodeGenPass::ModifyASTStmtWhilePre(ASTRef<ASTStmtWhile>& node) {
 
     // Add the implicit 'break' edge from the header to the footer due to the
     // exit condition.
-    frame->break_edges.insert(make_pair(
-                frame->header,
-                ctx_->Bindings().Overlay(frame->overlay_depth)));
+    AddLoopEdge(&frame->break_edges, frame->header,
+                ctx_->Bindings().Overlay(frame->overlay_depth));
 
     // Generate loop body starting at the body BB.
     ctx_->SetCurBB(body_bb);
@@ -1089,9 +1157,8 @@ CodeGenPass::ModifyASTStmtWhilePre(ASTRef<ASTStmtWhile>& node) {
 
     // Add the implicit 'continue' edge with bindings so that the phis will be
     // updated.
-    frame->continue_edges.insert(make_pair(
-                body_end_bb,
-                ctx_->Bindings().Overlay(frame->overlay_depth)));
+    AddLoopEdge(&frame->continue_edges, body_end_bb,
+                ctx_->Bindings().Overlay(frame->overlay_depth));
 
     // Restore the binding stack to its earlier level.
     ctx_->Bindings().PopTo(frame->overlay_depth);
@@ -1149,7 +1216,7 @@ CodeGenPass::LoopFrame* CodeGenPass::FindLoopFrame(
 }
 
 void CodeGenPass::HandleBreakContinue(LoopFrame* frame,
-        map<IRBB*, SubBindingMap>& edge_map, IRBB* target) {
+        SubBindingEdges& edge_map, IRBB* target) {
     // Capture the bindings up to this point.
     SubBindingMap bindings = ctx_->Bindings().Overlay(frame->overlay_depth);
     // Create a new binding scope for all bindings created after this 'break'.
@@ -1158,7 +1225,7 @@ void CodeGenPass::HandleBreakContinue(LoopFrame* frame,
     // Add the break/continue edge to the frame so that when the loop is
     // closed, this set of bindings is added to the header's or footer's (for
     // continue or break, respectively) phi nodes.
-    edge_map.insert(make_pair(ctx_->CurBB(), bindings));
+    AddLoopEdge(&edge_map, ctx_->CurBB(), bindings);
 
     // Generate the jump to the loop's header (continue) or footer (break)
     // block.
@@ -1242,7 +1309,21 @@ CodeGenPass::ModifyASTStmtSpawnPre(ASTRef<ASTStmtSpawn>& node) {
 CodeGenPass::Result
 CodeGenPass::ModifyASTPragmaPost(ASTRef<ASTPragma>& node) {
     if (node->key == "timing_model") {
-        ctx_->ir()->timing_model = node->value;
+        static const string kTablePrefix = "table:";
+        string model = node->value;
+        // A relative delay-table path is relative to the source file that
+        // names it, not to the compiler's working directory.
+        if (model.compare(0, kTablePrefix.size(), kTablePrefix) == 0 &&
+            model.size() > kTablePrefix.size() &&
+            model[kTablePrefix.size()] != '/') {
+            const string& source = node->loc.filename();
+            size_t slash = source.rfind('/');
+            if (slash != string::npos) {
+                model = kTablePrefix + source.substr(0, slash + 1) +
+                        model.substr(kTablePrefix.size());
+            }
+        }
+        ctx_->ir()->timing_model = model;
     }
     return VISIT_CONTINUE;
 }
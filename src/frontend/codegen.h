@@ -34,7 +34,7 @@ namespace frontend {
 // let-value slots (where scopes correspond to control-flow paths) and
 // primitive generator functions (where overrides can occur due to higher-level
 // structures).
-template<typename K, typename V>
+template<typename K, typename V, typename Less = std::less<K>>
 class CodeGenScope {
     public:
         CodeGenScope() {
@@ -80,8 +80,8 @@ class CodeGenScope {
             }
         }
 
-        std::map<K, V> Overlay(int from_level) const {
-            std::map<K, V> ret;
+        std::map<K, V, Less> Overlay(int from_level) const {
+            std::map<K, V, Less> ret;
             for (int i = from_level; i < scopes_.size(); i++) {
                 for (auto& p : scopes_[i].bindings) {
                     ret[p.first] = p.second;
@@ -90,8 +90,8 @@ class CodeGenScope {
             return ret;
         }
 
-        std::set<K> Keys() const {
-            std::set<K> ret;
+        std::set<K, Less> Keys() const {
+            std::set<K, Less> ret;
             for (auto& scope : scopes_) {
                 for (auto& p : scope.bindings) {
                     ret.insert(p.first);
@@ -111,11 +111,11 @@ class CodeGenScope {
         //
         // This function is useful, for example, in generating phi-nodes to
         // join together multiple variable definitions at control flow joins.
-        std::map<K, std::vector<V>> JoinOverlays(
-                const std::vector<std::map<K, V>>& inner_scopes) {
+        std::map<K, std::vector<V>, Less> JoinOverlays(
+                const std::vector<std::map<K, V, Less>>& inner_scopes) {
             // Take the union of all variables overwritten in inner scopes also
             // present in the base scope.
-            std::set<K> vars;
+            std::set<K, Less> vars;
             for (auto& s : inner_scopes) {
                 for (auto& p : s) {
                     auto k = p.first;
@@ -127,7 +127,7 @@ class CodeGenScope {
 
             // For each variable, find the binding it takes on for each path
             // (each joining scope).
-            std::map<K, std::vector<V>> ret;
+            std::map<K, std::vector<V>, Less> ret;
             for (auto& k : vars) {
                 auto& v = ret[k];
                 for (auto& s : inner_scopes) {
@@ -145,13 +145,21 @@ class CodeGenScope {
 
     private:
         struct Scope {
-            std::map<K, V> bindings;
+            std::map<K, V, Less> bindings;
         };
         std::vector<Scope> scopes_;
 };
 
 class CodeGenLoopHandler;
 
+struct ASTStmtLetLess {
+    bool operator()(const ASTStmtLet* a, const ASTStmtLet* b) const {
+        return a->binding_order < b->binding_order;
+    }
+};
+typedef CodeGenScope<ASTStmtLet*, const ASTExpr*, ASTStmtLetLess>
+    BindingScope;
+
 class CodeGenContext {
     public:
         CodeGenContext(AST* ast);
@@ -177,9 +185,15 @@ class CodeGenContext {
         // *is* the binding and there is no assignment, only creation of a new
         // binding with another let. This isn't a Real Functional Language.
         // Sorry.)
-        CodeGenScope<ASTStmtLet*, const ASTExpr*>& Bindings() {
+        BindingScope& Bindings() {
             return bindings_;
         }
+        // Assign the binding order of a newly-bound let; see
+        // ASTStmtLet::binding_order.
+        void AddBinding(ASTStmtLet* let, const ASTExpr* expr) {
+            let->binding_order = binding_order_++;
+            bindings_.Set(let, expr);
+        }
 
         // The expr -> IRStmt mapping. Each IRStmt is one value (in the SSA
         // sense).
@@ -199,17 +213,29 @@ class CodeGenContext {
             expr_to_ir_map_[expr] = const_cast<IRStmt*>(stmt);
         }
 
+        // Source location of the innermost statement being generated. New
+        // IRStmts take their expr's location if they compute one, or this
+        // location otherwise, so that backend diagnostics and reports can
+        // point back into the source.
+        void PushLocation(const Location& loc) { locs_.push_back(loc); }
+        void PopLocation() { locs_.pop_back(); }
+
     private:
         std::unique_ptr<IRProgram> prog_;
         int gensym_;
         IRBB* curbb_;
         std::map<const ASTExpr*, IRStmt*> expr_to_ir_map_;
         AST* ast_;
+        std::vector<Location> locs_;
 
-        CodeGenScope<ASTStmtLet*, const ASTExpr*> bindings_;
+        BindingScope bindings_;
+        int binding_order_;
 };
 
-typedef std::map<ASTStmtLet*, const ASTExpr*> SubBindingMap;
+typedef std::map<ASTStmtLet*, const ASTExpr*, ASTStmtLetLess> SubBindingMap;
+// Loop in-edges are kept in the order they are created (program order) so
+// that phi argument order does not depend on BB addresses.
+typedef std::vector<std::pair<IRBB*, SubBindingMap>> SubBindingEdges;
 
 // A CodeGenPass traverses some subtree (or possibly the whole tree) of the
 // AST, emitting code to a given CodeGenContext.
@@ -242,6 +268,16 @@ class CodeGenPass : public ASTVisitorContext {
         // post-hook on function: end with a 'kill'.
         virtual Result ModifyASTFunctionDefPost(ASTRef<ASTFunctionDef>& node);
 
+        // track the source location of the statement being generated.
+        virtual Result ModifyASTStmtPre(ASTRef<ASTStmt>& node) {
+            ctx_->PushLocation(node->loc);
+            return VISIT_CONTINUE;
+        }
+        virtual Result ModifyASTStmtPost(ASTRef<ASTStmt>& node) {
+            ctx_->PopLocation();
+            return VISIT_CONTINUE;
+        }
+
         // straight-line-code statement codegen hooks. We do codegen after
         // sub-stmts because exprs in the stmt must be gen'd first.
         virtual Result ModifyASTStmtLetPost(ASTRef<ASTStmtLet>& node);
@@ -254,6 +290,7 @@ class CodeGenPass : public ASTVisitorContext {
         virtual Result ModifyASTStmtKillYoungerPost(
                 ASTRef<ASTStmtKillYounger>& node);
         virtual Result ModifyASTStmtKillIfPost(ASTRef<ASTStmtKillIf>& node);
+        virtual Result ModifyASTStmtWaitPost(ASTRef<ASTStmtWait>& node);
         virtual Result ModifyASTStmtTimingPre(ASTRef<ASTStmtTiming>& node);
         virtual Result ModifyASTStmtTimingPost(ASTRef<ASTStmtTiming>& node);
         virtual Result ModifyASTStmtStagePost(ASTRef<ASTStmtStage>& node);
@@ -304,8 +341,8 @@ class CodeGenPass : public ASTVisitorContext {
         struct LoopFrame {
             ASTStmtWhile* while_block;
             int overlay_depth;
-            std::map<IRBB*, SubBindingMap> break_edges;
-            std::map<IRBB*, SubBindingMap> continue_edges;
+            SubBindingEdges break_edges;
+            SubBindingEdges continue_edges;
             IRBB* header;
             IRBB* footer;
             // BB that jumps to (falls into) header. Used for phi generation.
@@ -315,11 +352,11 @@ class CodeGenPass : public ASTVisitorContext {
         LoopFrame* FindLoopFrame(const ASTBase* node, const ASTIdent* label);
         bool AddWhileLoopPhiNodeInputs(
                 const ASTBase* node, CodeGenContext* ctx,
-                std::map<ASTStmtLet*, IRStmt*>* binding_phis,
+                std::map<ASTStmtLet*, IRStmt*, ASTStmtLetLess>* binding_phis,
                 IRBB* binding_phi_bb,
-                std::map<IRBB*, SubBindingMap>& in_edges);
+                SubBindingEdges& in_edges);
         void HandleBreakContinue(LoopFrame* frame,
-                std::map<IRBB*, SubBindingMap>& edge_map,
+                SubBindingEdges& edge_map,
                 IRBB* target);
 
         // We store most of the codegen-visitor-walk state in a `FunctionCtx`,
@@ -17,53 +17,33 @@
 #include "frontend/compiler.h"
 #include "frontend/macro.h"
 #include "frontend/parser.h"
+#include "frontend/ast-build.h"
 #include "frontend/func-inline.h"
 #include "frontend/var-scope.h"
+#include "frontend/bundle.h"
+#include "frontend/rob.h"
+#include "frontend/cam.h"
 #include "frontend/type-infer.h"
 #include "frontend/type-lower.h"
 #include "frontend/codegen.h"
 #include "backend/compiler.h"
+#include "common/util.h"
 
 #include <fstream>
+#include <iostream>
 #include <memory>
+#include <sstream>
 
 using namespace autopiper::frontend;
 using namespace autopiper;
 using namespace std;
 
-bool Compiler::CompileFile(const Options& options, ErrorCollector* collector) {
-    // Parse input.
-    ifstream in(options.filename);
-    if (!in.good()) {
-        Location loc;
-        loc.filename = options.filename;
-        loc.line = loc.column = 0;
-        collector->ReportError(loc, ErrorCollector::ERROR,
-                               string("Could not open file '") +
-                               options.filename +
-                               string("'"));
-        return false;
-    }
-
-    LexerImpl lexer(&in);
-    MacroExpander macro(&lexer, collector);
-    Parser parser(options.filename, &macro, collector);
-
-    if (options.expand_macros) {
-        TokenPrinter tokprinter(&cout);
-        return tokprinter.PrintFromLexer(&macro);
-    }
-
-    unique_ptr<AST> ast(new AST());
-    if (!parser.Parse(ast.get())) {
-        return false;
-    }
+namespace {
 
-    if (options.print_ast_orig) {
-        PrintAST(ast.get(), cout);
-    }
-
-    // AST desugaring/transforms.
+// Runs the AST desugaring/transform passes and codegen over |ast|.
+unique_ptr<IRProgram> GenerateIR(ASTRef<AST>& ast,
+                                 const Compiler::Options& options,
+                                 ErrorCollector* collector) {
 #define TRANSFORM(tform)                                                       \
     if (!ASTVisitor::Transform< tform >(ast, collector)) {                     \
         throw autopiper::Exception(                                            \
@@ -73,13 +53,23 @@ bool Compiler::CompileFile(const Options& options, ErrorCollector* collector) {
     TRANSFORM(FuncInlinePass);
     TRANSFORM(ArgLetPass);
     TRANSFORM(VarScopePass);
+    TRANSFORM(RobPass);
+    // Resolve the names RobPass introduced.
+    TRANSFORM(VarScopePass);
+    TRANSFORM(CamPass);
+    // Resolve the names CamPass introduced.
+    TRANSFORM(VarScopePass);
+    TRANSFORM(BundlePass);
+    // Resolve the names BundlePass introduced.
+    TRANSFORM(VarScopePass);
     TRANSFORM(TypeInferPass);
     TRANSFORM(TypeLowerPass);
 
 #undef TRANSFORM
 
+    ostream& print = options.print_stream ? *options.print_stream : cout;
     if (options.print_ast) {
-        PrintAST(ast.get(), cout);
+        PrintAST(ast.get(), print);
     }
 
     CodeGenContext codegen_ctx(ast.get());
@@ -94,9 +84,216 @@ bool Compiler::CompileFile(const Options& options, ErrorCollector* collector) {
     unique_ptr<IRProgram> ir = codegen_ctx.Release();
 
     if (options.print_ir) {
-        printf("IR:\n%s\n", ir->ToString().c_str());
+        print << "IR:" << endl << ir->ToString() << endl;
+    }
+
+    return ir;
+}
+
+// Builds the entry point of an instance function's own module, which reads
+// each argument from input port "argN" in a single stage, calls the function
+// and writes its value to output port "result":
+//
+// func entry <gensym>() : void {
+//     let instance_port_1 : port <param 0 type> = port "arg0";
+//     ...
+//     let instance_port_N : port <return type> = port "result";
+//     let instance_value_1 : <param 0 type> = 0;
+//     ...
+//     timing {
+//         stage 0;
+//         instance_value_1 = read instance_port_1;
+//         ...
+//     }
+//     write instance_port_N, f(instance_value_1, ...);
+// }
+ASTRef<ASTFunctionDef> BuildInstanceEntry(AST* ast,
+                                          const ASTFunctionDef* func) {
+    ASTRef<ASTFunctionDef> entry(new ASTFunctionDef());
+    entry->loc = func->loc;
+    entry->name = ASTGenSym(ast, "instance_entry");
+    entry->name->type = ASTIdent::FUNC;
+    entry->is_entry = true;
+    entry->return_type = Type("void");
+    entry->block.reset(new ASTStmtBlock());
+    ASTVector<ASTStmt>& stmts = entry->block->stmts;
+
+    auto define_port = [&](const string& port_name, const ASTType* type) {
+        string name = ASTGenSym(ast, "instance_port_")->name;
+        ASTRef<ASTExpr> portdef(new ASTExpr());
+        portdef->op = ASTExpr::PORTDEF;
+        portdef->ident = Ident(port_name, ASTIdent::PORT);
+        ASTRef<ASTType> port_type = CloneAST(type);
+        port_type->is_port = true;
+        stmts.push_back(Let(name, move(port_type), move(portdef)));
+        return name;
+    };
+
+    vector<string> ports;
+    for (unsigned i = 0; i < func->params.size(); i++) {
+        ports.push_back(define_port(strprintf("arg%d", i),
+                                    func->params[i]->type.get()));
+    }
+    string result_port = define_port("result", func->return_type.get());
+
+    vector<string> values;
+    for (auto& param : func->params) {
+        values.push_back(ASTGenSym(ast, "instance_value_")->name);
+        stmts.push_back(Let(values.back(), CloneAST(param->type.get()),
+                            Const(0)));
     }
 
+    ASTVector<ASTStmt> reads;
+    ASTRef<ASTStmt> stage(new ASTStmt());
+    stage->stage.reset(new ASTStmtStage());
+    stage->stage->offset = 0;
+    reads.push_back(move(stage));
+    for (unsigned i = 0; i < values.size(); i++) {
+        reads.push_back(Assign(Var(values[i]),
+                               Op(ASTExpr::PORTREAD, Var(ports[i]))));
+    }
+    ASTRef<ASTStmt> timing(new ASTStmt());
+    timing->timing.reset(new ASTStmtTiming());
+    timing->timing->body = Block(move(reads));
+    stmts.push_back(move(timing));
+
+    ASTRef<ASTExpr> call(new ASTExpr());
+    call->op = ASTExpr::FUNCCALL;
+    call->loc = func->loc;
+    call->ident = CloneAST(func->name.get());
+    for (auto& value : values) {
+        call->ops.push_back(Var(value));
+    }
+    stmts.push_back(Write(result_port, move(call)));
+
+    return entry;
+}
+
+// Compiles an instance function into its own Verilog module, named after the
+// function, and records the module's latency on the function definition.
+bool CompileInstanceFunction(const AST* ast,
+                             ASTFunctionDef* func,
+                             const Compiler::Options& options,
+                             ostream* out,
+                             ErrorCollector* collector) {
+    const string& name = func->name->name;
+    if (name == "main" || name == "pipereg") {
+        collector->ReportError(func->loc, ErrorCollector::ERROR,
+                strprintf("Instance function cannot be named '%s'.",
+                          name.c_str()));
+        return false;
+    }
+    if (func->params.empty() || func->return_type->ident->name == "void") {
+        collector->ReportError(func->loc, ErrorCollector::ERROR,
+                "Instance function must take at least one argument and "
+                "return a value.");
+        return false;
+    }
+    for (auto& param : func->params) {
+        const ASTType* type = param->type.get();
+        if (type->is_port || type->is_chan || type->is_reg ||
+            type->is_array || type->is_bypass || type->is_rob ||
+            type->is_cam) {
+            collector->ReportError(param->loc, ErrorCollector::ERROR,
+                    "Instance function arguments must be plain values.");
+            return false;
+        }
+    }
+
+    // The module's program is a copy of the whole AST (so that the function
+    // can call, and inline, any other function) with a new entry point. Its
+    // nodes are allocated in the enclosing AST's arena, which outlives it.
+    ASTRef<AST> sub_ast = CloneAST(ast);
+    // The new entry must be the module's only pipe, and every call inside
+    // the module, including any to an instance function, is inlined: clear
+    // the copied functions' entry and instance attributes. (CloneAST does
+    // not copy them today, but this must not depend on it.)
+    for (auto& sub_func : sub_ast->functions) {
+        sub_func->is_entry = false;
+        sub_func->bundle_width = 1;
+        sub_func->is_instance = false;
+        sub_func->instance_latency = 0;
+    }
+    sub_ast->functions.push_back(BuildInstanceEntry(sub_ast.get(), func));
+
+    Compiler::Options sub_options;
+    unique_ptr<IRProgram> ir = GenerateIR(sub_ast, sub_options, collector);
+
+    BackendCompiler backend;
+    BackendCompiler::Options backend_options;
+    backend_options.input_ir = ir.get();
+    backend_options.filename = "(ir)";
+    backend_options.output_stream = out;
+    backend_options.module_name = name;
+    backend_options.timing_model = options.timing_model;
+    backend_options.instance_module = true;
+    backend_options.instance_latency = &func->instance_latency;
+    if (!backend.CompileFile(backend_options, collector)) {
+        collector->ReportError(func->loc, ErrorCollector::ERROR,
+                strprintf("Could not compile instance function '%s' into a "
+                          "fixed-latency module.", name.c_str()));
+        return false;
+    }
+    return true;
+}
+
+}  // anonymous namespace
+
+bool Compiler::CompileFile(const Options& options, ErrorCollector* collector) {
+    // Parse input.
+    ifstream file;
+    istream* in = options.input_stream;
+    if (!in) {
+        file.open(options.filename);
+        in = &file;
+    }
+    if (!in->good()) {
+        Location loc;
+        loc.set_filename(options.filename);
+        loc.line = loc.column = 0;
+        collector->ReportError(loc, ErrorCollector::ERROR,
+                               string("Could not open file '") +
+                               options.filename +
+                               string("'"));
+        return false;
+    }
+
+    LexerImpl lexer(in);
+    MacroExpander macro(&lexer, collector);
+    Parser parser(options.filename, &macro, collector);
+
+    ostream& print = options.print_stream ? *options.print_stream : cout;
+    if (options.expand_macros) {
+        TokenPrinter tokprinter(&print);
+        return tokprinter.PrintFromLexer(&macro);
+    }
+
+    unique_ptr<AST> ast(new AST());
+    // All nodes created from here on -- by the parser, the transform passes,
+    // and codegen -- live in the AST's arena.
+    ASTArenaScope arena_scope(&ast->arena);
+    if (!parser.Parse(ast.get())) {
+        return false;
+    }
+
+    if (options.print_ast_orig) {
+        PrintAST(ast.get(), print);
+    }
+
+    // Compile each instance function into its own module first: call sites
+    // need the module's latency.
+    ostringstream instance_modules;
+    for (auto& func : ast->functions) {
+        if (!func->is_instance) continue;
+        if (!CompileInstanceFunction(ast.get(), func.get(), options,
+                                     &instance_modules, collector)) {
+            throw autopiper::Exception(
+                    "Compilation failed in instance function.");
+        }
+    }
+
+    unique_ptr<IRProgram> ir = GenerateIR(ast, options, collector);
+
     // TODO: print IR to IR output file if requested (ensure IR printer
     // produces parsable output).
 
@@ -105,8 +302,28 @@ bool Compiler::CompileFile(const Options& options, ErrorCollector* collector) {
     backend_options_.input_ir = ir.get();
     backend_options_.filename = "(ir)";
     backend_options_.output = options.output;
+    backend_options_.output_stream = options.output_stream;
+    backend_options_.print_stream = options.print_stream;
     backend_options_.print_ir = options.print_backend_ir;
     backend_options_.print_lowered = options.print_lowered;
+    backend_options_.qor_output = options.qor_output;
+    backend_options_.stage_map_output = options.stage_map_output;
+    backend_options_.stage_map_html_output = options.stage_map_html_output;
+    backend_options_.sdc_output = options.sdc_output;
+    backend_options_.sdc_clock_period = options.sdc_clock_period;
+    backend_options_.trace_depth = options.trace_depth;
+    backend_options_.trace_values = options.trace_values;
+    backend_options_.trace_map_output = options.trace_map_output;
+    backend_options_.timing_model = options.timing_model;
+    backend_options_.checkpoint_output = options.checkpoint_output;
+    backend_options_.qor_stream = options.qor_stream;
+    backend_options_.stage_map_stream = options.stage_map_stream;
+    backend_options_.stage_map_html_stream = options.stage_map_html_stream;
+    backend_options_.sdc_stream = options.sdc_stream;
+    backend_options_.trace_map_stream = options.trace_map_stream;
+    // The instance modules follow the top-level module (and the shared
+    // pipereg module) in the same output file.
+    backend_options_.extra_verilog = instance_modules.str();
     if (!backend_.CompileFile(backend_options_, collector)) {
         throw autopiper::Exception(
                 "Compilation failed in backend.");
@@ -19,7 +19,9 @@
 
 #include "common/error-collector.h"
 
+#include <iostream>
 #include <string>
+#include <vector>
 #include <boost/noncopyable.hpp>
 
 namespace autopiper {
@@ -50,14 +52,56 @@ class Compiler : public boost::noncopyable {
             // Print lowered form after lowering/pipelining.
             bool print_lowered;
 
-            // Autopiper input.
+            // Autopiper input: the named file, or |input_stream| if set (the
+            // name then appears only in diagnostics, and anchors paths the
+            // source refers to).
             std::string filename;
+            std::istream* input_stream;
 
             // IR output.
             std::string ir_output;
 
-            // Verilog output.
+            // Verilog output: the named file, or |output_stream| if set.
             std::string output;
+            std::ostream* output_stream;
+
+            // Where the print_* options print (stdout if unset).
+            std::ostream* print_stream;
+
+            // Quality-of-results metrics output (JSON), if any.
+            std::string qor_output;
+
+            // Stage occupancy / register-pressure map outputs (JSON, HTML),
+            // if any.
+            std::string stage_map_output;
+            std::string stage_map_html_output;
+
+            // If set, write timing constraints (SDC) for the top-level module
+            // to this file; see BackendCompiler::Options.
+            std::string sdc_output;
+            double sdc_clock_period;
+
+            // On-chip trace buffer for the top-level module, if
+            // |trace_depth| is nonzero; see BackendCompiler::Options.
+            int trace_depth;
+            std::vector<std::string> trace_values;
+            std::string trace_map_output;
+
+            // If set, overrides the 'timing_model' pragma.
+            std::string timing_model;
+
+            // If set, save the program as lowered up to pipe timing, so that
+            // `autopiper-backend --checkpoint-in` can re-time it without
+            // recompiling the source.
+            std::string checkpoint_output;
+
+            // Streams to write the reports above to instead of files; see
+            // BackendCompiler::Options.
+            std::ostream* qor_stream;
+            std::ostream* stage_map_stream;
+            std::ostream* stage_map_html_stream;
+            std::ostream* sdc_stream;
+            std::ostream* trace_map_stream;
 
             Options()
                 : expand_macros(false)
@@ -66,6 +110,16 @@ class Compiler : public boost::noncopyable {
                 , print_ir(false)
                 , print_backend_ir(false)
                 , print_lowered(false)
+                , input_stream(nullptr)
+                , output_stream(nullptr)
+                , print_stream(nullptr)
+                , sdc_clock_period(10.0)
+                , trace_depth(0)
+                , qor_stream(nullptr)
+                , stage_map_stream(nullptr)
+                , stage_map_html_stream(nullptr)
+                , sdc_stream(nullptr)
+                , trace_map_stream(nullptr)
             { }
         };
 
@@ -156,6 +156,49 @@ bool InlineFunctionBody(
 }
 }  // anonymous namespace
 
+FuncInlinePass::Result
+FuncInlinePass::InstantiateFunction(const ASTFunctionDef* func,
+                                    ASTRef<ASTExpr>& node) {
+    if (node->ops.size() != func->params.size()) {
+        Error(node.get(), "Function call arity mismatch");
+        return VISIT_END;
+    }
+
+    // Replace the call with an expression block that evaluates each argument
+    // into a temp of its parameter's type, exactly as inlining would, and
+    // then feeds the temps to the instance:
+    // {
+    //     let instance_arg_1 : <param type> = <arg>;
+    //     ...
+    //     instance(instance_arg_1, ...);
+    // }
+    ASTRef<ASTStmtBlock> block(new ASTStmtBlock());
+    ASTRef<ASTExpr> instance(new ASTExpr());
+    instance->op = ASTExpr::INSTANCE;
+    instance->loc = node->loc;
+    instance->ident = CloneAST(func->name.get());
+    instance->constant = func->instance_latency;
+    instance->has_constant = true;
+    instance->cast_type = CloneAST(func->return_type.get());
+    for (unsigned i = 0; i < node->ops.size(); i++) {
+        auto arg_ident_and_expr =
+            ASTDefineTemp(ast_, "instance_arg_",
+                          block.get(), move(node->ops[i]),
+                          CloneAST(func->params[i]->type.get()));
+        instance->ops.push_back(move(arg_ident_and_expr.second));
+    }
+
+    ASTRef<ASTStmt> instance_stmt(new ASTStmt());
+    instance_stmt->expr.reset(new ASTStmtExpr());
+    instance_stmt->expr->expr = move(instance);
+    block->stmts.push_back(move(instance_stmt));
+
+    node.reset(new ASTExpr());
+    node->op = ASTExpr::STMTBLOCK;
+    node->stmt = move(block);
+    return VISIT_CONTINUE;
+}
+
 FuncInlinePass::Result
 FuncInlinePass::ModifyASTExprPost(ASTRef<ASTExpr>& node) {
     if (node->op == ASTExpr::FUNCCALL) {
@@ -167,6 +210,10 @@ FuncInlinePass::ModifyASTExprPost(ASTRef<ASTExpr>& node) {
             return VISIT_END;
         }
 
+        if (func->is_instance) {
+            return InstantiateFunction(func, node);
+        }
+
         // Create a block that will become part of an expression block.
         ASTRef<ASTStmtBlock> block(new ASTStmtBlock());
         // Create a temporary for the return value.
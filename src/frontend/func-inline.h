@@ -37,6 +37,10 @@ namespace frontend {
 //   }
 // }
 // rewrite use of f(x) with $temp$
+//
+// Calls to 'instance' functions are not inlined; they become INSTANCE
+// expressions that codegen turns into instances of the function's separately
+// compiled module.
 class FuncInlinePass : public ASTVisitorContext {
     public:
         FuncInlinePass(autopiper::ErrorCollector* coll);
@@ -62,6 +66,10 @@ class FuncInlinePass : public ASTVisitorContext {
             return VISIT_CONTINUE;
         }
     private:
+        // Replace a call to an instance function with an INSTANCE expr.
+        Result InstantiateFunction(const ASTFunctionDef* func,
+                                   ASTRef<ASTExpr>& node);
+
         // map from function names to ASTFunctionDefs.
         std::map<const std::string, const ASTFunctionDef*> function_defs_;
 
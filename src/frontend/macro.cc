@@ -140,7 +140,7 @@ void MacroExpander::InputFill() {
         if (input_->Have()) {
             input_queue_.push_back(input_->Peek());
             input_loc_.line = input_queue_.back().line;
-            input_loc_.column = input_queue_.back().col;
+            input_loc_.set_column(input_queue_.back().col);
             input_->ReadNext();
         }
     }
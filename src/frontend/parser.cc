@@ -16,6 +16,10 @@
 
 #include "frontend/ast.h"
 #include "frontend/parser.h"
+#include "common/util.h"
+
+#include <fstream>
+#include <sstream>
 
 using namespace std;
 
@@ -31,9 +35,9 @@ namespace frontend {
 template<typename T>
 ASTRef<T> Parser::New() {
     ASTRef<T> t(new T());
-    t->loc.filename = filename_;
+    t->loc.file = file_;
     t->loc.line = CurToken().line;
-    t->loc.column = CurToken().col;
+    t->loc.set_column(CurToken().col);
     return t;
 }
 
@@ -116,6 +120,28 @@ bool Parser::ParseFuncDef(ASTFunctionDef* def) {
     if (CurToken().s == "entry") {
         def->is_entry = true;
         Consume();
+        if (TryExpect(Token::LPAREN)) {
+            // Bundle width: 'func entry(4) name() ...'.
+            Consume();
+            if (!Expect(Token::INT_LITERAL)) {
+                return false;
+            }
+            if (CurToken().int_literal < 1 || CurToken().int_literal > 64) {
+                Error("Bundle width must be between 1 and 64.");
+                return false;
+            }
+            def->bundle_width = static_cast<int>(CurToken().int_literal);
+            Consume();
+            if (!Consume(Token::RPAREN)) {
+                return false;
+            }
+        }
+        if (!Expect(Token::IDENT)) {
+            return false;
+        }
+    } else if (CurToken().s == "instance") {
+        def->is_instance = true;
+        Consume();
         if (!Expect(Token::IDENT)) {
             return false;
         }
@@ -287,6 +313,24 @@ bool Parser::ParseType(ASTType* ty) {
         if (!Expect(Token::IDENT)) {
             return false;
         }
+    } else if (CurToken().s == "rob") {
+        ty->is_rob = true;
+        Consume();
+        if (!Expect(Token::IDENT)) {
+            return false;
+        }
+    } else if (CurToken().s == "cam") {
+        ty->is_cam = true;
+        Consume();
+        ty->cam_key = New<ASTType>();
+        ty->cam_key->ident = New<ASTIdent>();
+        if (!ParseIdent(ty->cam_key->ident.get())) {
+            return false;
+        }
+        ty->cam_key->ident->type = ASTIdent::TYPE;
+        if (!Expect(Token::IDENT)) {
+            return false;
+        }
     }
     ty->ident = New<ASTIdent>();
     if (!ParseIdent(ty->ident.get())) {
@@ -332,6 +376,7 @@ bool Parser::ParseStmt(ASTStmt* st) {
     HANDLE_STMT_TYPE("kill", kill, Kill);
     HANDLE_STMT_TYPE("killyounger", killyounger, KillYounger);
     HANDLE_STMT_TYPE("killif", killif, KillIf);
+    HANDLE_STMT_TYPE("wait", wait, Wait);
     HANDLE_STMT_TYPE("timing", timing, Timing);
     HANDLE_STMT_TYPE("stage", stage, Stage);
     HANDLE_STMT_TYPE("spawn", spawn, Spawn);
@@ -341,6 +386,9 @@ bool Parser::ParseStmt(ASTStmt* st) {
     HANDLE_STMT_TYPE("bypassstart", bypassstart, BypassStart);
     HANDLE_STMT_TYPE("bypassend", bypassend, BypassEnd);
     HANDLE_STMT_TYPE("bypasswrite", bypasswrite, BypassWrite);
+    HANDLE_STMT_TYPE("robdone", robdone, RobDone);
+    HANDLE_STMT_TYPE("caminsert", caminsert, CamInsert);
+    HANDLE_STMT_TYPE("caminvalidate", caminvalidate, CamInvalidate);
 
 #undef HANDLE_STMT_TYPE
 
@@ -482,6 +530,16 @@ bool Parser::ParseStmtWrite(ASTStmtWrite* write) {
 }
 
 bool Parser::ParseStmtSpawn(ASTStmtSpawn* spawn) {
+    if (TryExpect(Token::LPAREN)) {
+        Consume();
+        spawn->rob = ParseExpr();
+        if (!spawn->rob) {
+            return false;
+        }
+        if (!Consume(Token::RPAREN)) {
+            return false;
+        }
+    }
     spawn->body = New<ASTStmt>();
     return ParseStmt(spawn->body.get());
 }
@@ -510,6 +568,14 @@ bool Parser::ParseStmtKillIf(ASTStmtKillIf* killif) {
     return Consume(Token::SEMICOLON);
 }
 
+bool Parser::ParseStmtWait(ASTStmtWait* wait) {
+    wait->condition = ParseExpr();
+    if (!wait->condition) {
+        return false;
+    }
+    return Consume(Token::SEMICOLON);
+}
+
 bool Parser::ParseStmtTiming(ASTStmtTiming* timing) {
     timing->body.reset(new ASTStmt());
     return ParseStmt(timing->body.get());
@@ -573,15 +639,67 @@ bool Parser::ParseStmtBypassWrite(ASTStmtBypassWrite* bypasswrite) {
     return Consume(Token::SEMICOLON);
 }
 
+bool Parser::ParseStmtRobDone(ASTStmtRobDone* robdone) {
+    robdone->rob = ParseExpr();
+    if (!robdone->rob) {
+        return false;
+    }
+    if (!Consume(Token::COMMA)) {
+        return false;
+    }
+    robdone->value = ParseExpr();
+    if (!robdone->value) {
+        return false;
+    }
+    return Consume(Token::SEMICOLON);
+}
+
+bool Parser::ParseStmtCamInsert(ASTStmtCamInsert* caminsert) {
+    caminsert->cam = ParseExpr();
+    if (!caminsert->cam) {
+        return false;
+    }
+    if (!Consume(Token::COMMA)) {
+        return false;
+    }
+    caminsert->key = ParseExpr();
+    if (!caminsert->key) {
+        return false;
+    }
+    if (!Consume(Token::COMMA)) {
+        return false;
+    }
+    caminsert->value = ParseExpr();
+    if (!caminsert->value) {
+        return false;
+    }
+    return Consume(Token::SEMICOLON);
+}
+
+bool Parser::ParseStmtCamInvalidate(ASTStmtCamInvalidate* caminvalidate) {
+    caminvalidate->cam = ParseExpr();
+    if (!caminvalidate->cam) {
+        return false;
+    }
+    if (!Consume(Token::COMMA)) {
+        return false;
+    }
+    caminvalidate->key = ParseExpr();
+    if (!caminvalidate->key) {
+        return false;
+    }
+    return Consume(Token::SEMICOLON);
+}
+
 ASTRef<ASTExpr> Parser::ParseExpr() {
     return ParseExprGroup1();
 }
 
 // Group 1: ternary op
 ASTRef<ASTExpr> Parser::ParseExprGroup1() {
-    auto expr = ParseExprGroup2();
+    auto expr = ParseExprBinops();
     if (TryConsume(Token::QUESTION)) {
-        auto op1 = ParseExprGroup2();
+        auto op1 = ParseExprBinops();
         if (!Consume(Token::COLON)) {
             return astnull<ASTExpr>();
         }
@@ -596,130 +714,104 @@ ASTRef<ASTExpr> Parser::ParseExprGroup1() {
     return expr;
 }
 
-// This is a little hacky. We're abstracting out the left-associative
-// recursive-descent logic, and we want to take a template argument for the
-// next-lower nonterminal (precedence group). We actually take a member
-// function pointer, but devirtualization *should* reduce this down to a direct
-// function call given sufficient optimization settings.
-template<
-    Parser::ExprGroupParser this_level,
-    Parser::ExprGroupParser next_level,
-    typename ...Args>
-ASTRef<ASTExpr> Parser::ParseLeftAssocBinops(Args&&... args) {
-  ASTRef<ASTExpr> ret = (this->*next_level)();
-  if (!ret) {
-      Error("Parse failed.");
-      return nullptr;
-  }
-  ASTRef<ASTExpr> op_node = New<ASTExpr>();
-  op_node->ops.push_back(move(ret));
-  if (ParseLeftAssocBinopsRHS<this_level, next_level>(
-      op_node.get(), args...)) {
-    return op_node;
-  } else {
-    ret = move(op_node->ops[0]);
-    return ret;
-  }
-}
-
-template<
-    Parser::ExprGroupParser this_level,
-    Parser::ExprGroupParser next_level,
-    typename ...Args>
-bool Parser::ParseLeftAssocBinopsRHS(ASTExpr* expr,
-                                     Token::Type op_token,
-                                     ASTExpr::Op op,
-                                     Args&&... args) {
-  if (TryExpect(op_token)) {
-    Consume();
-    auto rhs = (this->*this_level)();
-    if (!rhs) {
-      return false;
+// Binary operators, by precedence level (higher binds tighter). Levels
+// correspond to the old per-group recursive-descent functions:
+//
+//   1: logical bitwise or  (|)
+//   2: logical bitwise xor (^)
+//   3: logical bitwise and (&)
+//   4: equality operators (==, !=)
+//   5: comparison operators (<, <=, >, >=)
+//   6: bitshift operators (<<, >>)
+//   7: add/sub (+, -)
+//   8: mul/div/rem (*, /, %)
+//
+// All binary operators are left-associative.
+namespace {
+struct BinopInfo {
+    Token::Type token;
+    ASTExpr::Op op;
+    int prec;
+};
+
+const BinopInfo kBinops[] = {
+    { Token::PIPE,          ASTExpr::OR,  1 },
+    { Token::CARET,         ASTExpr::XOR, 2 },
+    { Token::AMPERSAND,     ASTExpr::AND, 3 },
+    { Token::DOUBLE_EQUAL,  ASTExpr::EQ,  4 },
+    { Token::NOT_EQUAL,     ASTExpr::NE,  4 },
+    { Token::LANGLE,        ASTExpr::LT,  5 },
+    { Token::RANGLE,        ASTExpr::GT,  5 },
+    { Token::LESS_EQUAL,    ASTExpr::LE,  5 },
+    { Token::GREATER_EQUAL, ASTExpr::GE,  5 },
+    { Token::LSH,           ASTExpr::LSH, 6 },
+    { Token::RSH,           ASTExpr::RSH, 6 },
+    { Token::PLUS,          ASTExpr::ADD, 7 },
+    { Token::DASH,          ASTExpr::SUB, 7 },
+    { Token::STAR,          ASTExpr::MUL, 8 },
+    { Token::SLASH,         ASTExpr::DIV, 8 },
+    { Token::PERCENT,       ASTExpr::REM, 8 },
+};
+
+const BinopInfo* FindBinop(Token::Type type) {
+    for (auto& info : kBinops) {
+        if (info.token == type) {
+            return &info;
+        }
     }
-    expr->op = op;
-    expr->ops.push_back(move(rhs));
-    return true;
-  }
-  return ParseLeftAssocBinopsRHS<this_level, next_level>(expr, args...);
-}
-
-template<
-    Parser::ExprGroupParser this_level,
-    Parser::ExprGroupParser next_level>
-bool Parser::ParseLeftAssocBinopsRHS(ASTExpr* expr) {
-  return false;
-}
-
-// Group 2: logical bitwise or
-ASTRef<ASTExpr> Parser::ParseExprGroup2() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup2,
-      &Parser::ParseExprGroup3>(
-            Token::PIPE, ASTExpr::OR);
-}
-
-// Group 3: logical bitwise xor
-ASTRef<ASTExpr> Parser::ParseExprGroup3() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup3,
-      &Parser::ParseExprGroup4>(
-            Token::CARET, ASTExpr::XOR);
-}
-
-// Group 4: logical bitwise and
-ASTRef<ASTExpr> Parser::ParseExprGroup4() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup4,
-      &Parser::ParseExprGroup5>(
-            Token::AMPERSAND, ASTExpr::AND);
-}
-
-// Group 5: equality operators
-ASTRef<ASTExpr> Parser::ParseExprGroup5() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup5,
-      &Parser::ParseExprGroup6>(
-            Token::DOUBLE_EQUAL, ASTExpr::EQ,
-            Token::NOT_EQUAL, ASTExpr::NE);
+    return nullptr;
 }
+}  // anonymous namespace
+
+// Binary operators: operator-precedence parse with an explicit stack, so that
+// parsing a long operator chain costs neither stack depth nor a descent
+// through every precedence level per operand. Each pending entry is an
+// operator node whose LHS is filled in and whose RHS is still being parsed.
+//
+// Only the parse is iterative. The tree is still as deep as the chain is long,
+// and the printers, CloneAST, the visitor passes and node destructors recurse
+// once per level, as does parsing a parenthesized subexpression.
+ASTRef<ASTExpr> Parser::ParseExprBinops() {
+    struct Pending {
+        int prec;
+        ASTRef<ASTExpr> node;
+    };
+    std::vector<Pending> pending;
+
+    ASTRef<ASTExpr> expr = ParseExprGroup10();
+    if (!expr) {
+        Error("Parse failed.");
+        return nullptr;
+    }
 
-// Group 6: comparison operators
-ASTRef<ASTExpr> Parser::ParseExprGroup6() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup6,
-      &Parser::ParseExprGroup7>(
-            Token::LANGLE, ASTExpr::LT,
-            Token::RANGLE, ASTExpr::GT,
-            Token::LESS_EQUAL, ASTExpr::LE,
-            Token::GREATER_EQUAL, ASTExpr::GE);
-}
+    while (const BinopInfo* info = FindBinop(CurToken().type)) {
+        // Reduce all pending operators that bind at least as tightly as this
+        // one (ties reduce first, giving left-associativity).
+        while (!pending.empty() && pending.back().prec >= info->prec) {
+            pending.back().node->ops.push_back(move(expr));
+            expr = move(pending.back().node);
+            pending.pop_back();
+        }
 
-// Group 7: bitshift operators
-ASTRef<ASTExpr> Parser::ParseExprGroup7() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup7,
-      &Parser::ParseExprGroup8>(
-            Token::LSH, ASTExpr::LSH,
-            Token::RSH, ASTExpr::RSH);
-}
+        ASTRef<ASTExpr> op_node = New<ASTExpr>();
+        op_node->op = info->op;
+        op_node->ops.push_back(move(expr));
+        pending.push_back({ info->prec, move(op_node) });
+        Consume();
 
-// Group 8: add/sub
-ASTRef<ASTExpr> Parser::ParseExprGroup8() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup8,
-      &Parser::ParseExprGroup9>(
-            Token::PLUS, ASTExpr::ADD,
-            Token::DASH, ASTExpr::SUB);
-}
+        expr = ParseExprGroup10();
+        if (!expr) {
+            Error("Parse failed.");
+            return nullptr;
+        }
+    }
 
-// Group 9: mul/div/rem
-ASTRef<ASTExpr> Parser::ParseExprGroup9() {
-  return ParseLeftAssocBinops<
-      &Parser::ParseExprGroup9,
-      &Parser::ParseExprGroup10>(
-            Token::STAR, ASTExpr::MUL,
-            Token::SLASH, ASTExpr::DIV,
-            Token::PERCENT, ASTExpr::REM);
+    while (!pending.empty()) {
+        pending.back().node->ops.push_back(move(expr));
+        expr = move(pending.back().node);
+        pending.pop_back();
+    }
+    return expr;
 }
 
 // Group 10: unary ops (~, unary +, unary -)
@@ -889,6 +981,34 @@ ASTRef<ASTExpr> Parser::ParseExprAtom() {
         if (ident == "array") {
             Consume();
             ret->op = ASTExpr::ARRAY_INIT;
+            if (TryExpect(Token::IDENT) && CurToken().s == "registered") {
+                ret->array_registered = true;
+                Consume();
+            }
+            if (TryExpect(Token::QUOTED_STRING)) {
+                if (!ParseArrayInitFile(CurToken().s, ret.get())) {
+                    return astnull<ASTExpr>();
+                }
+                Consume();
+            } else if (TryConsume(Token::LBRACE)) {
+                while (true) {
+                    if (TryExpect(Token::INT_LITERAL)) {
+                        ret->array_init.push_back(CurToken().int_literal);
+                    } else if (TryExpect(Token::IDENT) &&
+                               consts_.count(CurToken().s)) {
+                        ret->array_init.push_back(consts_[CurToken().s]);
+                    } else {
+                        Error("Expected an integer literal or constant in "
+                              "array initializer");
+                        return astnull<ASTExpr>();
+                    }
+                    Consume();
+                    if (!TryConsume(Token::COMMA)) break;
+                }
+                if (!Consume(Token::RBRACE)) {
+                    return astnull<ASTExpr>();
+                }
+            }
             return ret;
         }
 
@@ -916,6 +1036,61 @@ ASTRef<ASTExpr> Parser::ParseExprAtom() {
             return ret;
         }
 
+        if (ident == "rob") {
+            Consume();
+            ret->op = ASTExpr::ROBDEF;
+            if (!Expect(Token::QUOTED_STRING)) {
+                return astnull<ASTExpr>();
+            }
+            ret->ident = New<ASTIdent>();
+            ret->ident->name = CurToken().s;
+            ret->ident->type = ASTIdent::PORT;
+            Consume();
+            if (!Expect(Token::INT_LITERAL)) {
+                return astnull<ASTExpr>();
+            }
+            ret->constant = CurToken().int_literal;
+            ret->has_constant = true;
+            Consume();
+            return ret;
+        }
+
+        if (ident == "cam") {
+            Consume();
+            ret->op = ASTExpr::CAMDEF;
+            if (!Expect(Token::INT_LITERAL)) {
+                return astnull<ASTExpr>();
+            }
+            ret->constant = CurToken().int_literal;
+            ret->has_constant = true;
+            Consume();
+            return ret;
+        }
+
+        if (ident == "camhit" || ident == "camread") {
+            Consume();
+            ret->op = (ident == "camhit") ? ASTExpr::CAMHIT : ASTExpr::CAMREAD;
+            if (!Expect(Token::IDENT)) {
+                return astnull<ASTExpr>();
+            }
+            ASTRef<ASTExpr> var_ref(new ASTExpr());
+            var_ref->op = ASTExpr::VAR;
+            var_ref->ident.reset(new ASTIdent());
+            if (!ParseIdent(var_ref->ident.get())) {
+                return astnull<ASTExpr>();
+            }
+            ret->ops.push_back(move(var_ref));
+            if (!Consume(Token::COMMA)) {
+                return astnull<ASTExpr>();
+            }
+            ASTRef<ASTExpr> key = ParseExpr();
+            if (!key) {
+                return astnull<ASTExpr>();
+            }
+            ret->ops.push_back(move(key));
+            return ret;
+        }
+
         if (ident == "bypasspresent" || ident == "bypassready" ||
             ident == "bypassread") {
             Consume();
@@ -1065,5 +1240,52 @@ ASTRef<ASTExpr> Parser::ParseExprAtom() {
     return astnull<ASTExpr>();
 }
 
+// Reads an array's initial contents from |name|, relative to the source
+// file's directory: hex values separated by whitespace, with '//' comments
+// and '_' digit separators, as for Verilog's $readmemh (but without '@'
+// address directives).
+bool Parser::ParseArrayInitFile(const string& name, ASTExpr* array) {
+    string path = name;
+    size_t slash = filename_.rfind('/');
+    if (!name.empty() && name[0] != '/' && slash != string::npos) {
+        path = filename_.substr(0, slash + 1) + name;
+    }
+    ifstream in(path);
+    if (!in) {
+        Error(strprintf("Cannot open array initializer file '%s'",
+                        path.c_str()));
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        size_t comment = line.find("//");
+        if (comment != string::npos) {
+            line.resize(comment);
+        }
+        istringstream is(line);
+        string word;
+        while (is >> word) {
+            string digits;
+            for (char c : word) {
+                if (c != '_') digits += c;
+            }
+            if (digits.empty() ||
+                digits.find_first_not_of("0123456789abcdefABCDEF") !=
+                string::npos) {
+                Error(strprintf("'%s' in array initializer file '%s' is not "
+                                "a hex value", word.c_str(), path.c_str()));
+                return false;
+            }
+            array->array_init.push_back(ASTBignum("0x" + digits));
+        }
+    }
+    if (array->array_init.empty()) {
+        Error(strprintf("Array initializer file '%s' has no values",
+                        path.c_str()));
+        return false;
+    }
+    return true;
+}
+
 }  // namespace frontend
 }  // namespace autopiper
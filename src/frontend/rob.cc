@@ -0,0 +1,589 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frontend/rob.h"
+#include "frontend/ast-build.h"
+#include "common/util.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace autopiper {
+namespace frontend {
+
+// Slot tags are sequence numbers of this width; a child's tag is compared
+// with its slot's current tag modulo 2^kTagBits.
+static const int kTagBits = 16;
+static const int kMaxDepth = 1024;
+
+// Names of the state that one reorder buffer expands to.
+struct RobPass::Rob {
+    int depth;
+    int index_bits;  // log2(depth)
+
+    string head;   // reg int_<index_bits+1>: oldest allocated slot
+    string tail;   // reg int_<index_bits+1>: next slot to allocate
+    string seq;    // reg int_<kTagBits>: last tag handed out
+    string tag;    // array: tag of each slot's current allocation
+    string done;   // array: tag of each slot's last completion
+    string data;   // array: each slot's value
+    string passed; // per txn: has this txn passed an allocation point?
+    string next;   // per txn: tail to rewind to on a killyounger
+
+    // Statement nesting depth (stmt_depth_) of its defining block's
+    // statements.
+    int stmt_depth;
+};
+
+RobPass::RobPass(autopiper::ErrorCollector* coll)
+    : ASTVisitorContext(coll), ast_(nullptr), stmt_depth_(0)
+{ }
+
+RobPass::~RobPass() { }
+
+const RobPass::Rob* RobPass::Trace(const ASTExpr* expr) const {
+    while (expr && expr->op == ASTExpr::VAR && expr->def) {
+        auto it = rob_lets_.find(expr->def);
+        if (it != rob_lets_.end()) {
+            return it->second;
+        }
+        expr = expr->def->rhs.get();
+    }
+    return nullptr;
+}
+
+// let q : rob T = rob "name" N;
+//
+// ==>
+//
+// let head : reg int_<B+1> = reg;
+// let tail : reg int_<B+1> = reg;
+// let seq : reg int_16 = reg;
+// let tag : int_16[N] = array;
+// let done : int_16[N] = array;
+// let data : T[N] = array;
+// let out : port T = port "name";
+// let out_valid : port bool = port "name_valid" default 0;
+// let passed : bool = 0;
+// let next : int_<B+1> = 0;
+// func {
+//     let h = reg head;
+//     let idx = h[B-1:0];
+//     if ((h != reg tail) & (done[idx] == tag[idx])) {
+//         write out, data[idx];
+//         write out_valid, 1;
+//         reg head = h + 1;
+//     }
+// }
+bool RobPass::ExpandRob(ASTRef<ASTStmt>& stmt, ASTVector<ASTStmt>* out) {
+    ASTStmtLet* let = stmt->let.get();
+    const ASTExpr* def = let->rhs.get();
+    if (!let->type || !let->type->is_rob) {
+        Error(let, "A reorder buffer must be bound by a let of type 'rob T'.");
+        return false;
+    }
+    int depth = (def->has_constant && def->constant >= 2 &&
+                 def->constant <= kMaxDepth) ?
+        static_cast<int>(def->constant) : 0;
+    if (depth == 0 || (depth & (depth - 1)) != 0) {
+        Error(def, strprintf("Reorder buffer depth must be a power of two "
+                             "between 2 and %d.", kMaxDepth));
+        return false;
+    }
+
+    unique_ptr<Rob> rob(new Rob());
+    rob->depth = depth;
+    rob->index_bits = 0;
+    while ((1 << rob->index_bits) < rob->depth) {
+        rob->index_bits++;
+    }
+    rob->stmt_depth = stmt_depth_ + 1;
+    int B = rob->index_bits;
+    auto gensym = [this](const char* prefix) {
+        return ASTGenSym(ast_, prefix)->name;
+    };
+    rob->head = gensym("rob_head");
+    rob->tail = gensym("rob_tail");
+    rob->seq = gensym("rob_seq");
+    rob->tag = gensym("rob_tag");
+    rob->done = gensym("rob_done");
+    rob->data = gensym("rob_data");
+    rob->passed = gensym("rob_passed");
+    rob->next = gensym("rob_next");
+    string out_port = gensym("rob_out");
+    string valid_port = gensym("rob_out_valid");
+
+    ASTVector<ASTStmt> stmts;
+    auto reg = [&](const string& name, int width) {
+        ASTRef<ASTType> type = IntType(width);
+        type->is_reg = true;
+        ASTRef<ASTExpr> init(new ASTExpr());
+        init->op = ASTExpr::REG_INIT;
+        stmts.push_back(Let(name, move(type), move(init)));
+    };
+    auto array = [&](const string& name, ASTRef<ASTType> type) {
+        type->is_array = true;
+        type->array_length = rob->depth;
+        ASTRef<ASTExpr> init(new ASTExpr());
+        init->op = ASTExpr::ARRAY_INIT;
+        stmts.push_back(Let(name, move(type), move(init)));
+    };
+    auto port = [&](const string& name, ASTRef<ASTType> type,
+                    const string& port_name, bool has_default) {
+        type->is_port = true;
+        ASTRef<ASTExpr> portdef(new ASTExpr());
+        portdef->op = ASTExpr::PORTDEF;
+        portdef->ident = Ident(port_name, ASTIdent::PORT);
+        if (has_default) {
+            portdef->constant = 0;
+            portdef->has_constant = true;
+        }
+        stmts.push_back(Let(name, move(type), move(portdef)));
+    };
+    ASTRef<ASTType> value_type = CloneAST(let->type.get());
+    value_type->is_rob = false;
+
+    reg(rob->head, B + 1);
+    reg(rob->tail, B + 1);
+    reg(rob->seq, kTagBits);
+    array(rob->tag, IntType(kTagBits));
+    array(rob->done, IntType(kTagBits));
+    array(rob->data, CloneAST(value_type.get()));
+    port(out_port, CloneAST(value_type.get()), def->ident->name, false);
+    port(valid_port, Type("bool"), def->ident->name + "_valid", true);
+    stmts.push_back(Let(rob->passed, Type("bool"), Const(0)));
+    stmts.push_back(Let(rob->next, IntType(B + 1), Const(0)));
+
+    string h = gensym("rob_retire_handle");
+    string idx = gensym("rob_retire_index");
+    ASTVector<ASTStmt> retire;
+    retire.push_back(Write(out_port, ArrayRef(rob->data, Var(idx))));
+    retire.push_back(Write(valid_port, Const(1)));
+    retire.push_back(Assign(RegRef(rob->head),
+                            Op(ASTExpr::ADD, Var(h), Const(1))));
+    ASTRef<ASTStmt> nested(new ASTStmt());
+    nested->nested.reset(new ASTStmtNestedFunc());
+    nested->nested->body.reset(new ASTStmtBlock());
+    ASTVector<ASTStmt>& body = nested->nested->body->stmts;
+    body.push_back(Let(h, nullptr, RegRef(rob->head)));
+    body.push_back(Let(idx, nullptr, Slice(Var(h), B - 1, 0)));
+    body.push_back(If(
+            Op(ASTExpr::AND,
+               Op(ASTExpr::NE, Var(h), RegRef(rob->tail)),
+               Op(ASTExpr::EQ, ArrayRef(rob->done, Var(idx)),
+                  ArrayRef(rob->tag, Var(idx)))),
+            move(retire)));
+    stmts.push_back(move(nested));
+
+    for (auto& s : stmts) {
+        SetLoc(s.get(), stmt->loc);
+        out->push_back(move(s));
+    }
+    rob_lets_[let] = rob.get();
+    in_scope_.push_back(rob.get());
+    robs_.push_back(move(rob));
+    return true;
+}
+
+// spawn (q) body
+//
+// ==>
+//
+// {
+//     let chan : chan int_<16+B> = chan;
+//     let handle = expr {
+//         wait (reg tail - reg head != N);
+//         let t = reg tail;
+//         let s = reg seq + 1;
+//         tag[t[B-1:0]] = s;
+//         reg tail = t + 1;
+//         reg seq = s;
+//         passed = 1;
+//         next = t + 1;
+//         { s, t[B-1:0] };
+//     };
+//     write chan, handle;
+//     spawn {
+//         let h = read chan;
+//         body  // with 'robdone q, v' expanded using h
+//     }
+// }
+ASTRef<ASTStmt> RobPass::ExpandSpawn(const Rob* rob, ASTRef<ASTStmt> spawn) {
+    int B = rob->index_bits;
+    string chan = ASTGenSym(ast_, "rob_handle_chan")->name;
+    string handle = ASTGenSym(ast_, "rob_handle")->name;
+    string t = ASTGenSym(ast_, "rob_alloc_tail")->name;
+    string s = ASTGenSym(ast_, "rob_alloc_seq")->name;
+    string h = ASTGenSym(ast_, "rob_handle")->name;
+
+    ASTVector<ASTStmt> stmts;
+    ASTRef<ASTType> chan_type = IntType(kTagBits + B);
+    chan_type->is_chan = true;
+    ASTRef<ASTExpr> chandef(new ASTExpr());
+    chandef->op = ASTExpr::PORTDEF;
+    chandef->ident = Ident("", ASTIdent::PORT);
+    stmts.push_back(Let(chan, move(chan_type), move(chandef)));
+
+    ASTRef<ASTExpr> alloc(new ASTExpr());
+    alloc->op = ASTExpr::STMTBLOCK;
+    alloc->stmt.reset(new ASTStmtBlock());
+    ASTVector<ASTStmt>& a = alloc->stmt->stmts;
+    ASTRef<ASTStmt> wait(new ASTStmt());
+    wait->wait.reset(new ASTStmtWait());
+    wait->wait->condition =
+        Op(ASTExpr::NE,
+           Op(ASTExpr::SUB, RegRef(rob->tail), RegRef(rob->head)),
+           Const(rob->depth));
+    a.push_back(move(wait));
+    a.push_back(Let(t, nullptr, RegRef(rob->tail)));
+    a.push_back(Let(s, nullptr,
+                    Op(ASTExpr::ADD, RegRef(rob->seq), Const(1))));
+    a.push_back(Assign(ArrayRef(rob->tag, Slice(Var(t), B - 1, 0)), Var(s)));
+    a.push_back(Assign(RegRef(rob->tail), Op(ASTExpr::ADD, Var(t), Const(1))));
+    a.push_back(Assign(RegRef(rob->seq), Var(s)));
+    a.push_back(Assign(Var(rob->passed), Const(1)));
+    a.push_back(Assign(Var(rob->next), Op(ASTExpr::ADD, Var(t), Const(1))));
+    ASTRef<ASTStmt> result(new ASTStmt());
+    result->expr.reset(new ASTStmtExpr());
+    result->expr->expr =
+        Op(ASTExpr::CONCAT, Var(s), Slice(Var(t), B - 1, 0));
+    a.push_back(move(result));
+    stmts.push_back(Let(handle, nullptr, move(alloc)));
+    stmts.push_back(Write(chan, Var(handle)));
+
+    ASTRef<ASTExpr> read(new ASTExpr());
+    read->op = ASTExpr::PORTREAD;
+    read->ops.push_back(Var(chan));
+    stmts.push_back(Let(h, nullptr, move(read)));
+
+    Location loc = spawn->loc;
+    for (auto& stmt : stmts) {
+        SetLoc(stmt.get(), loc);
+    }
+    ASTVector<ASTStmt> body;
+    body.push_back(move(stmts.back()));
+    stmts.pop_back();
+    // The child's own statements keep their locations.
+    body.push_back(move(spawn->spawn->body));
+    ASTRef<ASTStmt> child(new ASTStmt());
+    child->loc = loc;
+    child->spawn.reset(new ASTStmtSpawn());
+    child->spawn->loc = loc;
+    child->spawn->body = Block(move(body));
+    child->spawn->body->loc = loc;
+    rob_spawns_[child.get()] = Frame { rob, h };
+    stmts.push_back(move(child));
+
+    ASTRef<ASTStmt> ret = Block(move(stmts));
+    ret->loc = loc;
+    return ret;
+}
+
+// robdone q, v
+//
+// ==>
+//
+// {
+//     let value = v;
+//     let idx = h[B-1:0];
+//     let tag = h[B+15:B];
+//     let d = tag[idx] - tag;
+//     // Skip the write if the slot has since been dropped and reallocated.
+//     if ((d == 0) | (d[15:15] == 1)) {
+//         data[idx] = value;
+//         done[idx] = tag;
+//     }
+// }
+ASTRef<ASTStmt> RobPass::ExpandRobDone(const Rob* rob, const string& handle,
+                                       ASTRef<ASTStmt> robdone) {
+    int B = rob->index_bits;
+    string value = ASTGenSym(ast_, "rob_done_value")->name;
+    string idx = ASTGenSym(ast_, "rob_done_index")->name;
+    string tag = ASTGenSym(ast_, "rob_done_tag")->name;
+    string d = ASTGenSym(ast_, "rob_done_age")->name;
+
+    ASTVector<ASTStmt> stmts;
+    stmts.push_back(Let(value, nullptr, move(robdone->robdone->value)));
+    stmts.push_back(Let(idx, nullptr, Slice(Var(handle), B - 1, 0)));
+    stmts.push_back(Let(tag, nullptr,
+                        Slice(Var(handle), B + kTagBits - 1, B)));
+    stmts.push_back(Let(d, nullptr,
+                        Op(ASTExpr::SUB, ArrayRef(rob->tag, Var(idx)),
+                           Var(tag))));
+    ASTVector<ASTStmt> fill;
+    fill.push_back(Assign(ArrayRef(rob->data, Var(idx)), Var(value)));
+    fill.push_back(Assign(ArrayRef(rob->done, Var(idx)), Var(tag)));
+    stmts.push_back(If(
+            Op(ASTExpr::OR,
+               Op(ASTExpr::EQ, Var(d), Const(0)),
+               Op(ASTExpr::EQ, Slice(Var(d), kTagBits - 1, kTagBits - 1),
+                  Const(1))),
+            move(fill)));
+
+    Location loc = robdone->loc;
+    ASTRef<ASTStmt> ret = Block(move(stmts));
+    for (auto& stmt : ret->block->stmts) {
+        if (stmt->let && stmt->let->lhs->name == value) {
+            // Keep the value expression's own locations.
+            stmt->loc = stmt->let->loc = loc;
+        } else {
+            SetLoc(stmt.get(), loc);
+        }
+    }
+    ret->loc = loc;
+    return ret;
+}
+
+// After each statement of the reorder buffer's defining block that contains
+// a 'spawn (q)', i.e. at the allocation point of every transaction whether or
+// not it took the path that allocates:
+//
+// if (!passed) {
+//     next = reg tail;
+//     passed = 1;
+// }
+//
+// The read of the tail follows the allocation's write, so it lands in the
+// allocation's stage and sees the tail just past the older transactions'
+// slots.
+ASTRef<ASTStmt> RobPass::RecordTail(const Rob* rob, const Location& loc) {
+    ASTVector<ASTStmt> record;
+    record.push_back(Assign(Var(rob->next), RegRef(rob->tail)));
+    record.push_back(Assign(Var(rob->passed), Const(1)));
+    ASTRef<ASTStmt> ret = If(Op(ASTExpr::NOT, Var(rob->passed)),
+                             move(record));
+    SetLoc(ret.get(), loc);
+    return ret;
+}
+
+// killyounger
+//
+// ==>
+//
+// {
+//     killyounger;
+//     // for each reorder buffer in scope:
+//     if (!passed) { next = reg tail; }
+//     reg tail = next;
+// }
+//
+// A transaction that has not yet passed the allocation point rewinds the tail
+// to its current value: its killing write lands in the allocation's stage, so
+// no younger transaction has allocated yet.
+ASTRef<ASTStmt> RobPass::ExpandKillYounger(ASTRef<ASTStmt> killyounger) {
+    Location loc = killyounger->loc;
+    generated_.insert(killyounger.get());
+    ASTVector<ASTStmt> stmts;
+    stmts.push_back(move(killyounger));
+    for (const Rob* rob : in_scope_) {
+        ASTVector<ASTStmt> record;
+        record.push_back(Assign(Var(rob->next), RegRef(rob->tail)));
+        stmts.push_back(If(Op(ASTExpr::NOT, Var(rob->passed)),
+                           move(record)));
+        SetLoc(stmts.back().get(), loc);
+        stmts.push_back(Assign(RegRef(rob->tail), Var(rob->next)));
+        SetLoc(stmts.back().get(), loc);
+    }
+    ASTRef<ASTStmt> ret = Block(move(stmts));
+    ret->loc = loc;
+    return ret;
+}
+
+RobPass::Result
+RobPass::ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node) {
+    // Function bodies have been inlined into the entry points, the only ones
+    // that are compiled.
+    if (!node->is_entry) {
+        return VISIT_TERMINAL;
+    }
+    in_scope_.clear();
+    scope_marks_.clear();
+    frames_.clear();
+    spawned_.clear();
+    record_after_.clear();
+    stmt_depth_ = 0;
+    return VISIT_CONTINUE;
+}
+
+RobPass::Result
+RobPass::ModifyASTStmtBlockPre(ASTRef<ASTStmtBlock>& node) {
+    scope_marks_.push_back(in_scope_.size());
+
+    // Expand reorder buffer lets in place, so that their state is in scope
+    // for the rest of the block, and drop their aliases.
+    bool has_rob = false;
+    for (auto& stmt : node->stmts) {
+        if (stmt->let && stmt->let->type && stmt->let->type->is_rob) {
+            has_rob = true;
+            break;
+        }
+        if (stmt->let && stmt->let->rhs &&
+            (stmt->let->rhs->op == ASTExpr::ROBDEF ||
+             Trace(stmt->let->rhs.get()))) {
+            has_rob = true;
+            break;
+        }
+    }
+    if (!has_rob) {
+        return VISIT_CONTINUE;
+    }
+
+    ASTVector<ASTStmt> stmts;
+    for (auto& stmt : node->stmts) {
+        ASTStmtLet* let = stmt->let.get();
+        if (!let || !let->rhs) {
+            stmts.push_back(move(stmt));
+            continue;
+        }
+        if (let->rhs->op == ASTExpr::ROBDEF) {
+            if (!ExpandRob(stmt, &stmts)) {
+                return VISIT_END;
+            }
+            removed_.push_back(move(stmt));
+            continue;
+        }
+        const Rob* rob = Trace(let->rhs.get());
+        if (rob) {
+            rob_lets_[let] = rob;
+            removed_.push_back(move(stmt));
+            continue;
+        }
+        if (let->type && let->type->is_rob) {
+            Error(let, "A let of type 'rob T' must be bound to a reorder "
+                       "buffer.");
+            return VISIT_END;
+        }
+        stmts.push_back(move(stmt));
+    }
+    node->stmts = move(stmts);
+    return VISIT_CONTINUE;
+}
+
+RobPass::Result
+RobPass::ModifyASTStmtBlockPost(ASTRef<ASTStmtBlock>& node) {
+    if (!record_after_.empty()) {
+        ASTVector<ASTStmt> stmts;
+        for (auto& stmt : node->stmts) {
+            auto it = record_after_.find(stmt.get());
+            Location loc = stmt->loc;
+            stmts.push_back(move(stmt));
+            if (it == record_after_.end()) {
+                continue;
+            }
+            for (const Rob* rob : it->second) {
+                stmts.push_back(RecordTail(rob, loc));
+            }
+            record_after_.erase(it);
+        }
+        node->stmts = move(stmts);
+    }
+    in_scope_.resize(scope_marks_.back());
+    scope_marks_.pop_back();
+    return VISIT_CONTINUE;
+}
+
+RobPass::Result
+RobPass::ModifyASTStmtPre(ASTRef<ASTStmt>& node) {
+    stmt_depth_++;
+    if (generated_.count(node.get())) {
+        return VISIT_CONTINUE;
+    }
+
+    if (node->spawn && node->spawn->rob) {
+        const Rob* rob = Trace(node->spawn->rob.get());
+        if (!rob) {
+            Error(node->spawn->rob.get(),
+                  "'spawn (q)' requires a reorder buffer.");
+            return VISIT_END;
+        }
+        if (frames_.empty() &&
+            find(spawned_.begin(), spawned_.end(), rob) == spawned_.end()) {
+            spawned_.push_back(rob);
+        }
+        node = ExpandSpawn(rob, move(node));
+        return VISIT_CONTINUE;
+    }
+
+    if (node->spawn || node->nested) {
+        // A child or nested process can't see its parent's slot handle.
+        auto it = rob_spawns_.find(node.get());
+        frames_.push_back(it != rob_spawns_.end() ? it->second :
+                          Frame { nullptr, "" });
+        return VISIT_CONTINUE;
+    }
+
+    if (node->robdone) {
+        const Rob* rob = Trace(node->robdone->rob.get());
+        if (!rob) {
+            Error(node->robdone->rob.get(),
+                  "'robdone' requires a reorder buffer.");
+            return VISIT_END;
+        }
+        if (frames_.empty() || frames_.back().rob != rob) {
+            Error(node.get(), "'robdone q' must be in the body of a "
+                              "'spawn (q)' (and not in a spawn or func "
+                              "nested within it).");
+            return VISIT_END;
+        }
+        node = ExpandRobDone(rob, frames_.back().handle, move(node));
+        return VISIT_CONTINUE;
+    }
+
+    if (node->killyounger && frames_.empty() && !in_scope_.empty()) {
+        node = ExpandKillYounger(move(node));
+        return VISIT_CONTINUE;
+    }
+
+    return VISIT_CONTINUE;
+}
+
+RobPass::Result
+RobPass::ModifyASTStmtPost(ASTRef<ASTStmt>& node) {
+    if ((node->spawn && !node->spawn->rob) || node->nested) {
+        frames_.pop_back();
+    }
+    // Record the tail after the outermost statement of a reorder buffer's
+    // defining block that spawned into it.
+    for (auto it = spawned_.begin(); it != spawned_.end(); ) {
+        if ((*it)->stmt_depth == stmt_depth_) {
+            record_after_[node.get()].push_back(*it);
+            it = spawned_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    stmt_depth_--;
+    return VISIT_CONTINUE;
+}
+
+RobPass::Result
+RobPass::ModifyASTExprPre(ASTRef<ASTExpr>& node) {
+    if (node->op == ASTExpr::ROBDEF) {
+        Error(node.get(), "'rob' may only initialize a let of type 'rob T'.");
+        return VISIT_END;
+    }
+    if (node->op == ASTExpr::VAR && Trace(node.get())) {
+        Error(node.get(), strprintf(
+                    "Reorder buffer '%s' may only be used by 'spawn (q)' and "
+                    "'robdone'.", node->ident->name.c_str()));
+        return VISIT_END;
+    }
+    return VISIT_CONTINUE;
+}
+
+}  // namesapce frontend
+}  // namespace autopiper
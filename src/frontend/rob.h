@@ -0,0 +1,124 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AUTOPIPER_FRONTEND_ROB_H_
+#define _AUTOPIPER_FRONTEND_ROB_H_
+
+#include "frontend/ast.h"
+#include "frontend/visitor.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace autopiper {
+namespace frontend {
+
+// Modify pass -- expand reorder buffers, which let spawned children of
+// different latencies complete out of order while their results retire in
+// the order their parents spawned them. Must run after VarScopePass (it
+// follows resolved let defs), and VarScopePass must run again afterward to
+// resolve the names it creates.
+//
+// let q : rob T = rob "name" N;   // N: depth, a power of two
+//
+// becomes a ring of N slots (head and tail regs, and per-slot tag, done-tag
+// and value arrays) plus a nested process that retires the slot at the head,
+// once its child is done, on port "name" (valid on port "name_valid").
+//
+// spawn (q) { ... robdone q, value; ... }
+//
+// allocates the slot at the tail in the parent, waiting while the buffer is
+// full, and hands the slot's handle (its sequence tag and index) to the child
+// over a chan; 'robdone' fills the slot. Every transaction records the tail
+// as it passes the allocation point: just past its own slot if it allocated
+// one, else the tail it found. A 'killyounger' rewinds the tail to that
+// position, dropping the younger transactions' slots; a late 'robdone' from
+// the child of a dropped slot is ignored, as its tag no longer matches.
+class RobPass : public ASTVisitorContext {
+    public:
+        RobPass(autopiper::ErrorCollector* coll);
+        ~RobPass();
+
+    protected:
+        virtual Result ModifyASTFunctionDefPre(ASTRef<ASTFunctionDef>& node);
+        virtual Result ModifyASTStmtBlockPre(ASTRef<ASTStmtBlock>& node);
+        virtual Result ModifyASTStmtBlockPost(ASTRef<ASTStmtBlock>& node);
+        virtual Result ModifyASTStmtPre(ASTRef<ASTStmt>& node);
+        virtual Result ModifyASTStmtPost(ASTRef<ASTStmt>& node);
+        virtual Result ModifyASTExprPre(ASTRef<ASTExpr>& node);
+
+        // Grab a pointer to the AST so we can gensym new temps.
+        virtual Result ModifyASTPre(ASTRef<AST>& node) {
+            ast_ = node.get();
+            return VISIT_CONTINUE;
+        }
+
+    private:
+        struct Rob;
+
+        // A spawned child (or nested process) being visited: the reorder
+        // buffer it fills and the variable holding its slot handle, or null
+        // for a plain spawn or nested func.
+        struct Frame {
+            const Rob* rob;
+            std::string handle;
+        };
+
+        // Returns the reorder buffer that |expr| refers to, tracing through
+        // lets of plain variables, or nullptr.
+        const Rob* Trace(const ASTExpr* expr) const;
+
+        bool ExpandRob(ASTRef<ASTStmt>& let, ASTVector<ASTStmt>* out);
+        ASTRef<ASTStmt> ExpandSpawn(const Rob* rob, ASTRef<ASTStmt> spawn);
+        ASTRef<ASTStmt> ExpandRobDone(const Rob* rob, const std::string& handle,
+                                      ASTRef<ASTStmt> robdone);
+        ASTRef<ASTStmt> RecordTail(const Rob* rob, const Location& loc);
+        ASTRef<ASTStmt> ExpandKillYounger(ASTRef<ASTStmt> killyounger);
+
+        AST* ast_;
+
+        std::vector<std::unique_ptr<Rob>> robs_;
+        // Rob lets and their aliases.
+        std::map<const ASTStmtLet*, const Rob*> rob_lets_;
+        // The lets above, removed from the AST but kept alive so that no
+        // other node takes their addresses.
+        ASTVector<ASTStmt> removed_;
+
+        // Robs in scope, and the number in scope at each open block.
+        std::vector<const Rob*> in_scope_;
+        std::vector<size_t> scope_marks_;
+
+        std::vector<Frame> frames_;
+        // Spawns generated for 'spawn (q)' and the frame each opens.
+        std::map<const ASTStmt*, Frame> rob_spawns_;
+        // Statements generated by this pass that must not be expanded again.
+        std::set<const ASTStmt*> generated_;
+
+        // Robs spawned into by the transaction since the last statement of
+        // their defining block, and the statements of those blocks after
+        // which to record the tail.
+        int stmt_depth_;
+        std::vector<const Rob*> spawned_;
+        std::map<const ASTStmt*, std::vector<const Rob*>> record_after_;
+};
+
+}  // namesapce frontend
+}  // namespace autopiper
+
+#endif  // _AUTOPIPER_FRONTEND_ROB_H_
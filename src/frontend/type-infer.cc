@@ -578,6 +578,17 @@ TypeInferPass::ModifyASTExprPost(ASTRef<ASTExpr>& node) {
             // Handled by AGGLITERAL above.
             break;
 
+        case ASTExpr::INSTANCE: {
+            // Arguments were already converted to the parameter types; the
+            // result has the function's return type.
+            for (auto* arg : arg_types) {
+                EnsureSimple(arg);
+            }
+            ConveyConstType(n, aggs_->ResolveType(node->cast_type.get()));
+            EnsureSimple(n);
+            break;
+        }
+
         case ASTExpr::CAST:
             if (!HandleCast(n, arg_types[0], node->cast_type.get())) {
                 return VISIT_END;
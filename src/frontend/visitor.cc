@@ -101,6 +101,7 @@ VISIT(ASTStmt, {
     T(kill, Kill)
     T(killyounger, KillYounger)
     T(killif, KillIf)
+    T(wait, Wait)
     T(timing, Timing)
     T(stage, Stage)
     T(expr, Expr)
@@ -109,6 +110,9 @@ VISIT(ASTStmt, {
     T(bypassstart, BypassStart)
     T(bypassend, BypassEnd)
     T(bypasswrite, BypassWrite)
+    T(robdone, RobDone)
+    T(caminsert, CamInsert)
+    T(caminvalidate, CamInvalidate)
 })
 
 #undef T
@@ -174,6 +178,9 @@ VISIT(ASTStmtWrite, {
 })
 
 VISIT(ASTStmtSpawn, {
+    if (node->rob) {
+        CHECK(VisitASTExpr(node->rob.get(), context));
+    }
     if (node->body) {
         CHECK(VisitASTStmt(node->body.get(), context));
     }
@@ -193,6 +200,12 @@ VISIT(ASTStmtKillIf, {
     }
 })
 
+VISIT(ASTStmtWait, {
+    if (node->condition) {
+        CHECK(VisitASTExpr(node->condition.get(), context));
+    }
+})
+
 VISIT(ASTStmtTiming, {
     if (node->body) {
         CHECK(VisitASTStmt(node->body.get(), context));
@@ -227,6 +240,22 @@ VISIT(ASTStmtBypassWrite, {
     CHECK(VisitASTExpr(node->value.get(), context));
 })
 
+VISIT(ASTStmtRobDone, {
+    CHECK(VisitASTExpr(node->rob.get(), context));
+    CHECK(VisitASTExpr(node->value.get(), context));
+})
+
+VISIT(ASTStmtCamInsert, {
+    CHECK(VisitASTExpr(node->cam.get(), context));
+    CHECK(VisitASTExpr(node->key.get(), context));
+    CHECK(VisitASTExpr(node->value.get(), context));
+})
+
+VISIT(ASTStmtCamInvalidate, {
+    CHECK(VisitASTExpr(node->cam.get(), context));
+    CHECK(VisitASTExpr(node->key.get(), context));
+})
+
 VISIT(ASTExpr, {
     for (auto& op : node->ops) {
         CHECK(VisitASTExpr(op.get(), context));
@@ -337,6 +366,7 @@ MODIFY(ASTStmt, {
     T(kill, Kill)
     T(killyounger, KillYounger)
     T(killif, KillIf)
+    T(wait, Wait)
     T(timing, Timing)
     T(stage, Stage)
     T(expr, Expr)
@@ -345,6 +375,9 @@ MODIFY(ASTStmt, {
     T(bypassstart, BypassStart)
     T(bypassend, BypassEnd)
     T(bypasswrite, BypassWrite)
+    T(robdone, RobDone)
+    T(caminsert, CamInsert)
+    T(caminvalidate, CamInvalidate)
 })
 
 #undef T
@@ -410,6 +443,9 @@ MODIFY(ASTStmtWrite, {
 })
 
 MODIFY(ASTStmtSpawn, {
+    if (node->rob) {
+        FIELD(node->rob, ASTExpr);
+    }
     if (node->body) {
         FIELD(node->body, ASTStmt);
     }
@@ -427,6 +463,10 @@ MODIFY(ASTStmtKillIf, {
     FIELD(node->condition, ASTExpr);
 })
 
+MODIFY(ASTStmtWait, {
+    FIELD(node->condition, ASTExpr);
+})
+
 MODIFY(ASTStmtTiming, {
     if (node->body) {
         FIELD(node->body, ASTStmt);
@@ -461,6 +501,22 @@ MODIFY(ASTStmtBypassWrite, {
     FIELD(node->value, ASTExpr);
 })
 
+MODIFY(ASTStmtRobDone, {
+    FIELD(node->rob, ASTExpr);
+    FIELD(node->value, ASTExpr);
+})
+
+MODIFY(ASTStmtCamInsert, {
+    FIELD(node->cam, ASTExpr);
+    FIELD(node->key, ASTExpr);
+    FIELD(node->value, ASTExpr);
+})
+
+MODIFY(ASTStmtCamInvalidate, {
+    FIELD(node->cam, ASTExpr);
+    FIELD(node->key, ASTExpr);
+})
+
 MODIFY(ASTExpr, {
     for (unsigned i = 0; i < node->ops.size(); i++) {
         FIELD(node->ops[i], ASTExpr);
@@ -70,6 +70,7 @@ class ASTVisitor {
         METHODS(ASTStmtKill)
         METHODS(ASTStmtKillYounger)
         METHODS(ASTStmtKillIf)
+        METHODS(ASTStmtWait)
         METHODS(ASTStmtTiming)
         METHODS(ASTStmtStage)
         METHODS(ASTStmtExpr)
@@ -78,6 +79,9 @@ class ASTVisitor {
         METHODS(ASTStmtBypassStart)
         METHODS(ASTStmtBypassEnd)
         METHODS(ASTStmtBypassWrite)
+        METHODS(ASTStmtRobDone)
+        METHODS(ASTStmtCamInsert)
+        METHODS(ASTStmtCamInvalidate)
         METHODS(ASTExpr)
         METHODS(ASTTypeField)
         METHODS(ASTPragma)
@@ -170,6 +174,7 @@ class ASTVisitorContext {
         METHODS(ASTStmtKill)
         METHODS(ASTStmtKillYounger)
         METHODS(ASTStmtKillIf)
+        METHODS(ASTStmtWait)
         METHODS(ASTStmtTiming)
         METHODS(ASTStmtStage)
         METHODS(ASTStmtExpr)
@@ -178,6 +183,9 @@ class ASTVisitorContext {
         METHODS(ASTStmtBypassStart)
         METHODS(ASTStmtBypassEnd)
         METHODS(ASTStmtBypassWrite)
+        METHODS(ASTStmtRobDone)
+        METHODS(ASTStmtCamInsert)
+        METHODS(ASTStmtCamInvalidate)
         METHODS(ASTExpr)
         METHODS(ASTTypeField)
         METHODS(ASTPragma)
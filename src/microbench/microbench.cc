@@ -0,0 +1,829 @@
+/*
+ * Copyright 2014 Google Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks for the compiler's core data structures: predicates, the
+// timing DAG solver, RPO and dominator trees over CFGs, codegen binding
+// scopes, the Verilog printer and the lexer. Each benchmark runs on synthetic
+// input built from a fixed seed, so that a given case does the same work on
+// every run and every host; besides its timing, each case reports a checksum
+// of its result, which changes only when the data structure's answer does.
+//
+// Results are written as JSON, with cases in a fixed order, for comparison
+// across commits by tests/microbench/microbench.py.
+
+#include "backend/ir.h"
+#include "backend/predicate.h"
+#include "backend/timing-dag.h"
+#include "backend/rpo.h"
+#include "backend/domtree.h"
+#include "backend/gen-printer.h"
+#include "frontend/codegen.h"
+#include "common/parser-utils.h"
+#include "common/parse-args.h"
+#include "common/json-writer.h"
+#include "common/exception.h"
+#include "common/util.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace autopiper {
+namespace microbench {
+
+namespace {
+
+// Fixed seed for all synthetic inputs. Only the generator's raw output is
+// used (never std::*_distribution, whose results are implementation-defined)
+// so that inputs are identical across standard libraries.
+const unsigned kSeed = 0x5eed;
+
+// FNV-1a, for checksums that are stable across hosts (unlike std::hash).
+class Digest {
+    public:
+        Digest() : h_(14695981039346656037ULL) {}
+
+        void Add(uint64_t v) {
+            for (int i = 0; i < 8; i++) {
+                h_ ^= (v >> (i * 8)) & 0xff;
+                h_ *= 1099511628211ULL;
+            }
+        }
+        void Add(const string& s) {
+            for (unsigned char c : s) {
+                h_ ^= c;
+                h_ *= 1099511628211ULL;
+            }
+            Add(s.size());
+        }
+
+        uint64_t value() const { return h_; }
+
+    private:
+        uint64_t h_;
+};
+
+class Benchmark {
+    public:
+        virtual ~Benchmark() {}
+
+        // Performs one timed iteration.
+        virtual void Run() = 0;
+        // Digests the result of the last iteration.
+        virtual uint64_t Checksum() const = 0;
+};
+
+struct Case {
+    string name;
+    vector<pair<string, int>> params;
+    // Builds the benchmark and its input; not timed.
+    function<unique_ptr<Benchmark>()> make;
+};
+
+// ---------------------------------------------------------------- Predicate
+
+typedef Predicate<IRStmt*> Pred;
+
+// Random predicates in DNF over a pool of factors: each has |terms| terms of
+// |factors| factors apiece (fewer after simplification), built with AndWith
+// and OrWith as the backend builds path predicates.
+class PredicateInput {
+    public:
+        PredicateInput(int count, int terms, int factors) {
+            mt19937 rng(kSeed);
+            int pool = factors * 2;
+            for (int i = 0; i < pool; i++) {
+                unique_ptr<IRStmt> stmt(new IRStmt());
+                stmt->valnum = i + 1;
+                stmts_.push_back(move(stmt));
+            }
+            for (int i = 0; i < count; i++) {
+                Pred p = Pred::False();
+                for (int t = 0; t < terms; t++) {
+                    Pred term = Pred::True();
+                    for (int f = 0; f < factors; f++) {
+                        term = term.AndWith(stmts_[rng() % pool].get(),
+                                            rng() & 1);
+                    }
+                    p = p.OrWith(term);
+                }
+                preds.push_back(p);
+                factor.push_back(stmts_[rng() % pool].get());
+                polarity.push_back(rng() & 1);
+            }
+        }
+
+        vector<Pred> preds;
+        // A random factor to AND with each predicate.
+        vector<IRStmt*> factor;
+        vector<bool> polarity;
+
+    private:
+        vector<unique_ptr<IRStmt>> stmts_;
+};
+
+class PredicateBenchmark : public Benchmark {
+    public:
+        enum Op { AND_FACTOR, AND_PRED, OR_PRED };
+
+        PredicateBenchmark(Op op, int terms, int factors)
+            : op_(op), in_(64, terms, factors) {}
+
+        virtual void Run() {
+            results_.clear();
+            int n = in_.preds.size();
+            for (int i = 0; i < n; i++) {
+                const Pred& p = in_.preds[i];
+                const Pred& q = in_.preds[(i + 1) % n];
+                switch (op_) {
+                    case AND_FACTOR:
+                        results_.push_back(
+                                p.AndWith(in_.factor[i], in_.polarity[i]));
+                        break;
+                    case AND_PRED:
+                        results_.push_back(p.AndWith(q));
+                        break;
+                    case OR_PRED:
+                        results_.push_back(p.OrWith(q));
+                        break;
+                }
+            }
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            for (auto& p : results_) {
+                d.Add(p.IsFalse() ? 0 : p.IsTrue() ? 1 : 2);
+                for (auto& term : p.Terms()) {
+                    d.Add(term.Factors().size());
+                    for (auto& f : term.Factors()) {
+                        d.Add(f.first->valnum * 2 + f.second);
+                    }
+                }
+            }
+            return d.value();
+        }
+
+    private:
+        Op op_;
+        PredicateInput in_;
+        vector<Pred> results_;
+};
+
+// ---------------------------------------------------------------- TimingDAG
+
+struct DAGNode { int id; };
+struct DAGVar { int id; };
+
+struct DAGErrorReporter {
+    void ReportError(const DAGNode* node, const DAGVar* var,
+                     const string& message) {
+        throw autopiper::Exception(
+                strprintf("Timing DAG benchmark input failed to solve: %s",
+                          message.c_str()));
+    }
+};
+
+// A layered DAG of |depth| levels of |width| nodes, with delays of 1 to 8
+// gates; each node has edges to |fanout| random nodes in the next two
+// levels, and some pairs of nodes in a level are tied to one stage by a var.
+// The solver consumes its DAG, so each iteration rebuilds it from the stored
+// edge list, and the time includes AddNode/AddEdge as well as Solve.
+class TimingDAGBenchmark : public Benchmark {
+    public:
+        TimingDAGBenchmark(int depth, int fanout)
+            : nodes_(depth * kWidth), vars_(depth), stages_(0) {
+            mt19937 rng(kSeed);
+            for (int i = 0; i < nodes_.size(); i++) {
+                nodes_[i].id = i;
+                delays_.push_back(1 + rng() % 8);
+            }
+            for (int l = 0; l + 1 < depth; l++) {
+                int span = (l + 2 < depth) ? 2 * kWidth : kWidth;
+                for (int i = 0; i < kWidth; i++) {
+                    for (int f = 0; f < fanout; f++) {
+                        edges_.push_back(make_pair(
+                                    l * kWidth + i,
+                                    (l + 1) * kWidth + rng() % span));
+                    }
+                }
+            }
+            for (int l = 0; l < depth; l++) {
+                vars_[l].id = l;
+                if (rng() % 4 != 0) continue;
+                int a = rng() % kWidth, b = rng() % kWidth;
+                if (a == b) continue;
+                var_nodes_.push_back(make_pair(l * kWidth + a, l));
+                var_nodes_.push_back(make_pair(l * kWidth + b, l));
+            }
+        }
+
+        virtual void Run() {
+            TimingDAG<DAGNode, DAGVar> dag;
+            for (int i = 0; i < nodes_.size(); i++) {
+                dag.AddNode(&nodes_[i], delays_[i]);
+            }
+            for (auto& e : edges_) {
+                dag.AddEdge(&nodes_[e.first], &nodes_[e.second]);
+            }
+            for (auto& v : var_nodes_) {
+                dag.AddVar(&nodes_[v.first], &vars_[v.second], 0);
+            }
+            DAGErrorReporter err;
+            dag.Solve(32, &err);
+            stages_ = dag.StageCount();
+            node_stages_.clear();
+            for (auto& node : nodes_) {
+                node_stages_.push_back(dag.GetStage(&node));
+            }
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            d.Add(stages_);
+            for (int s : node_stages_) d.Add(s);
+            return d.value();
+        }
+
+    private:
+        static const int kWidth = 8;
+
+        vector<DAGNode> nodes_;
+        vector<DAGVar> vars_;
+        vector<int> delays_;
+        vector<pair<int, int>> edges_;
+        vector<pair<int, int>> var_nodes_;  // (node, var)
+
+        int stages_;
+        vector<int> node_stages_;
+};
+
+// ------------------------------------------------------------ RPO/DomTree
+
+// A CFG of |blocks| IRBBs: each block branches to its successor in block
+// order and to one random block (a forward edge, a backedge or a self-loop);
+// the last block exits.
+class CFGInput {
+    public:
+        CFGInput(int blocks) {
+            mt19937 rng(kSeed);
+            for (int i = 0; i < blocks; i++) {
+                unique_ptr<IRBB> bb(new IRBB());
+                bb->label = strprintf("bb%d", i);
+                index[bb.get()] = i;
+                bbs.push_back(move(bb));
+            }
+            for (int i = 0; i + 1 < blocks; i++) {
+                unique_ptr<IRStmt> br(new IRStmt());
+                br->valnum = i + 1;
+                br->type = IRStmtIf;
+                br->bb = bbs[i].get();
+                br->targets.push_back(bbs[i + 1].get());
+                int other = rng() % blocks;
+                if (other != i + 1) {
+                    br->targets.push_back(bbs[other].get());
+                }
+                bbs[i]->stmts.push_back(move(br));
+            }
+            roots.push_back(bbs[0].get());
+        }
+
+        vector<unique_ptr<IRBB>> bbs;
+        vector<const IRBB*> roots;
+        map<const IRBB*, int> index;
+};
+
+class RPOBenchmark : public Benchmark {
+    public:
+        RPOBenchmark(int blocks) : in_(blocks) {}
+
+        virtual void Run() {
+            rpo_.reset(new BBReversePostorder());
+            rpo_->Compute(in_.roots);
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            for (auto* bb : rpo_->RPO()) {
+                d.Add(in_.index.at(bb));
+                d.Add(rpo_->Preds(bb).size());
+            }
+            return d.value();
+        }
+
+    private:
+        CFGInput in_;
+        unique_ptr<BBReversePostorder> rpo_;
+};
+
+class DomTreeBenchmark : public Benchmark {
+    public:
+        DomTreeBenchmark(int blocks) : in_(blocks) {}
+
+        virtual void Run() {
+            domtree_.reset(new BBDomTree());
+            domtree_->Compute(in_.roots);
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            for (auto& bb : in_.bbs) {
+                const IRBB* parent = domtree_->IDomParent(bb.get());
+                d.Add(parent ? in_.index.at(parent) : -1);
+            }
+            return d.value();
+        }
+
+    private:
+        CFGInput in_;
+        unique_ptr<BBDomTree> domtree_;
+};
+
+// Dom() queries on random block pairs of a computed tree. Each query walks
+// up from the child, so its cost grows with the tree's depth.
+class DomQueryBenchmark : public Benchmark {
+    public:
+        DomQueryBenchmark(int blocks) : in_(blocks) {
+            domtree_.Compute(in_.roots);
+            mt19937 rng(kSeed);
+            for (int i = 0; i < kQueries; i++) {
+                queries_.push_back(make_pair(in_.bbs[rng() % blocks].get(),
+                                             in_.bbs[rng() % blocks].get()));
+            }
+        }
+
+        virtual void Run() {
+            answers_.clear();
+            for (auto& q : queries_) {
+                answers_.push_back(domtree_.Dom(q.first, q.second));
+            }
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            for (bool a : answers_) d.Add(a);
+            return d.value();
+        }
+
+    private:
+        static const int kQueries = 1024;
+
+        CFGInput in_;
+        BBDomTree domtree_;
+        vector<pair<const IRBB*, const IRBB*>> queries_;
+        vector<bool> answers_;
+};
+
+// ------------------------------------------------------------ CodeGenScope
+
+// A BindingScope nested |depth| deep with |bindings| lets bound per level,
+// as codegen builds along a control-flow path, and random lookups of bound
+// lets (for operator[]) or of bound and unbound lets (for Has()).
+class ScopeBenchmark : public Benchmark {
+    public:
+        ScopeBenchmark(bool has, int depth, int bindings)
+            : has_(has), lets_(depth * bindings * 2),
+              exprs_(depth * bindings) {
+            mt19937 rng(kSeed);
+            for (int i = 0; i < lets_.size(); i++) {
+                lets_[i].binding_order = i;
+            }
+            for (int l = 0; l < depth; l++) {
+                if (l > 0) scope_.Push();
+                for (int i = 0; i < bindings; i++) {
+                    int k = l * bindings + i;
+                    // Rebind an outer let now and then, as a path overlay
+                    // would.
+                    if (l > 0 && i > 0 && rng() % 4 == 0) {
+                        k = rng() % (l * bindings);
+                    }
+                    scope_.Set(&lets_[k], &exprs_[l * bindings + i]);
+                }
+            }
+            for (int i = 0; i < kLookups; i++) {
+                if (has_) {
+                    keys_.push_back(&lets_[rng() % lets_.size()]);
+                } else {
+                    // Only the first binding of each level is certain to be
+                    // bound.
+                    keys_.push_back(&lets_[(rng() % depth) * bindings]);
+                }
+            }
+        }
+
+        virtual void Run() {
+            answers_.clear();
+            for (auto* k : keys_) {
+                if (has_) {
+                    answers_.push_back(scope_.Has(k) ? 1 : 0);
+                } else {
+                    answers_.push_back(scope_[k] - &exprs_[0]);
+                }
+            }
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            for (auto a : answers_) d.Add(a);
+            return d.value();
+        }
+
+    private:
+        static const int kLookups = 256;
+
+        bool has_;
+        vector<frontend::ASTStmtLet> lets_;
+        vector<frontend::ASTExpr> exprs_;
+        frontend::BindingScope scope_;
+        vector<frontend::ASTStmtLet*> keys_;
+        vector<long long> answers_;
+};
+
+// ------------------------------------------------------------------ Printer
+
+// |lines| Verilog-like lines, each formatted from one of a few templates
+// with $var$ substitutions, at varying indent, into a fresh stream.
+class PrinterBenchmark : public Benchmark {
+    public:
+        PrinterBenchmark(int lines) {
+            mt19937 rng(kSeed);
+            for (int i = 0; i < kVars; i++) {
+                vars_.push_back(make_pair(strprintf("v%d", i),
+                                          strprintf("signal_%u", (unsigned)rng())));
+            }
+            const char* const templates[] = {
+                "wire [$width$:0] $v0$;\n",
+                "assign $v1$ = $v2$ + $v3$;\n",
+                "always @(posedge clock) begin\n",
+                "if ($v4$ && !$v5$) $v6$ <= $v7$;\n",
+                "end\n",
+                "reg [$width$:0] $v8$; // $$ $v9$\n",
+            };
+            for (int i = 0; i < lines; i++) {
+                fmts_.push_back(templates[rng() % 6]);
+                indents_.push_back(rng() % 4);
+            }
+        }
+
+        virtual void Run() {
+            ostringstream os;
+            {
+                Printer p(&os);
+                PrinterScope scope(&p);
+                for (auto& v : vars_) {
+                    p.SetVar(v.first, v.second);
+                }
+                p.SetVar("width", "31");
+                for (int i = 0; i < fmts_.size(); i++) {
+                    for (int j = 0; j < indents_[i]; j++) p.Indent();
+                    p.Print(fmts_[i]);
+                    for (int j = 0; j < indents_[i]; j++) p.Outdent();
+                }
+            }
+            output_ = os.str();
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            d.Add(output_);
+            return d.value();
+        }
+
+    private:
+        static const int kVars = 10;
+
+        vector<pair<string, string>> vars_;
+        vector<string> fmts_;
+        vector<int> indents_;
+        string output_;
+};
+
+// -------------------------------------------------------------------- Lexer
+
+// A stream of |tokens| tokens resembling autopiper source: identifiers,
+// keywords, decimal and hex literals, quoted strings, single and compound
+// punctuation, and newlines; lexed in full by each iteration.
+class LexerBenchmark : public Benchmark {
+    public:
+        LexerBenchmark(int tokens) : count_(0) {
+            mt19937 rng(kSeed);
+            const char* const words[] = {
+                "let", "func", "entry", "if", "else", "while", "port",
+                "chan", "reg", "array", "bypass", "int32", "bool",
+            };
+            const char* const puncts[] = {
+                "(", ")", "[", "]", "{", "}", "<", ">", "=", "+", "-", "*",
+                "&", "|", "^", "~", "!", ",", ".", ":", ";", "==", "!=",
+                "<=", ">=", "<<", ">>",
+            };
+            ostringstream os;
+            for (int i = 0; i < tokens; i++) {
+                switch (rng() % 8) {
+                    case 0: os << words[rng() % 13]; break;
+                    case 1: case 2: os << "x" << rng() % 1000; break;
+                    case 3: os << rng() % 100000; break;
+                    case 4: os << strprintf("0x%x", (unsigned)rng()); break;
+                    case 5: os << "\"s" << rng() % 100 << "\""; break;
+                    default: os << puncts[rng() % 27]; break;
+                }
+                os << ((rng() % 10 == 0) ? '\n' : ' ');
+            }
+            text_ = os.str();
+        }
+
+        virtual void Run() {
+            istringstream is(text_);
+            LexerImpl lexer(&is);
+            Digest d;
+            count_ = 0;
+            while (lexer.Have()) {
+                const Token& t = lexer.Peek();
+                d.Add(t.type);
+                d.Add(t.s);
+                count_++;
+                lexer.ReadNext();
+            }
+            digest_ = d.value();
+        }
+
+        virtual uint64_t Checksum() const {
+            Digest d;
+            d.Add(count_);
+            d.Add(digest_);
+            return d.value();
+        }
+
+    private:
+        string text_;
+        int count_;
+        uint64_t digest_;
+};
+
+// -------------------------------------------------------------------- Cases
+
+vector<Case> AllCases() {
+    vector<Case> cases;
+    auto add = [&cases](const string& name,
+                        vector<pair<string, int>> params,
+                        function<Benchmark*()> make) {
+        Case c;
+        c.name = name;
+        c.params = params;
+        c.make = [make]() { return unique_ptr<Benchmark>(make()); };
+        cases.push_back(c);
+    };
+
+    const pair<const char*, PredicateBenchmark::Op> pred_ops[] = {
+        { "predicate.and_factor", PredicateBenchmark::AND_FACTOR },
+        { "predicate.and_pred", PredicateBenchmark::AND_PRED },
+        { "predicate.or_pred", PredicateBenchmark::OR_PRED },
+    };
+    for (auto& op : pred_ops) {
+        for (int factors : { 2, 4, 8, 16 }) {
+            auto o = op.second;
+            add(op.first, { { "terms", 4 }, { "factors", factors } },
+                [o, factors]() {
+                    return new PredicateBenchmark(o, 4, factors);
+                });
+        }
+    }
+    for (int depth : { 16, 64, 256 }) {
+        for (int fanout : { 1, 2, 4 }) {
+            add("timing_dag.solve", { { "depth", depth }, { "fanout", fanout } },
+                [depth, fanout]() {
+                    return new TimingDAGBenchmark(depth, fanout);
+                });
+        }
+    }
+    for (int blocks : { 64, 512, 4096 }) {
+        add("rpo.compute", { { "blocks", blocks } },
+            [blocks]() { return new RPOBenchmark(blocks); });
+    }
+    for (int blocks : { 64, 512, 4096 }) {
+        add("domtree.compute", { { "blocks", blocks } },
+            [blocks]() { return new DomTreeBenchmark(blocks); });
+    }
+    for (int blocks : { 64, 512, 4096 }) {
+        add("domtree.dom", { { "blocks", blocks } },
+            [blocks]() { return new DomQueryBenchmark(blocks); });
+    }
+    for (int depth : { 4, 16, 64 }) {
+        add("codegen_scope.lookup", { { "depth", depth }, { "bindings", 32 } },
+            [depth]() { return new ScopeBenchmark(false, depth, 32); });
+        add("codegen_scope.has", { { "depth", depth }, { "bindings", 32 } },
+            [depth]() { return new ScopeBenchmark(true, depth, 32); });
+    }
+    for (int lines : { 100, 10000 }) {
+        add("printer.print", { { "lines", lines } },
+            [lines]() { return new PrinterBenchmark(lines); });
+    }
+    for (int tokens : { 1000, 100000 }) {
+        add("lexer.tokens", { { "tokens", tokens } },
+            [tokens]() { return new LexerBenchmark(tokens); });
+    }
+    return cases;
+}
+
+string CaseID(const Case& c) {
+    string id = c.name;
+    for (auto& p : c.params) {
+        id += strprintf("/%s=%d", p.first.c_str(), p.second);
+    }
+    return id;
+}
+
+// ------------------------------------------------------------------- Driver
+
+struct Options {
+    Options() : reps(5), min_time_ms(20), list(false) {}
+
+    int reps;
+    int min_time_ms;
+    bool list;
+    string filter;
+    string output;
+};
+
+const char* kUsage =
+    "Usage: autopiper-microbench [flags]\n"
+    "    Flags:\n"
+    "        -o <filename>:   write results (JSON) here instead of stdout.\n"
+    "        --filter <str>:  run only cases whose ID contains <str>.\n"
+    "        --reps <n>:      timed repetitions per case (default 5).\n"
+    "        --min-time <ms>: minimum duration of one repetition; the\n"
+    "                         iteration count is doubled until it is met\n"
+    "                         (default 20).\n"
+    "        --list:          list case IDs and exit.\n"
+    "        -h, --help:      print this help message.\n";
+
+class MicrobenchFlags : public CmdlineParser {
+    public:
+        MicrobenchFlags(Options* options, int argc, const char* const* argv)
+            : CmdlineParser(argc, argv), options_(options)
+        { }
+
+    protected:
+        virtual FlagHandlerResult HandleFlag(
+                const string& flag, bool have_value, const string& value) {
+            if (flag == "-o") {
+                options_->output = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--filter") {
+                options_->filter = value;
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--reps") {
+                options_->reps = max(1, atoi(value.c_str()));
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--min-time") {
+                options_->min_time_ms = max(1, atoi(value.c_str()));
+                return FLAG_CONSUMED_KEY_VALUE;
+            } else if (flag == "--list") {
+                options_->list = true;
+                return FLAG_CONSUMED_KEY;
+            } else if (flag == "-h" || flag == "--help") {
+                cerr << kUsage;
+                throw autopiper::Exception("No benchmarks run.");
+            } else {
+                return FLAG_BAD;
+            }
+        }
+
+    private:
+        Options* options_;
+};
+
+struct Timing {
+    long long iterations;  // per repetition
+    double median_ns;      // per iteration
+    double min_ns;
+};
+
+double TimeIterations(Benchmark* b, long long iterations) {
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; i++) {
+        b->Run();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count();
+}
+
+Timing TimeCase(Benchmark* b, const Options& options) {
+    Timing t;
+    const double min_ns = options.min_time_ms * 1e6;
+    // One untimed warm-up iteration, then double the count until a
+    // repetition is long enough for the clock's resolution not to matter.
+    b->Run();
+    t.iterations = 1;
+    while (TimeIterations(b, t.iterations) < min_ns &&
+           t.iterations < (1LL << 40)) {
+        t.iterations *= 2;
+    }
+    vector<double> per_iter;
+    for (int r = 0; r < options.reps; r++) {
+        per_iter.push_back(TimeIterations(b, t.iterations) / t.iterations);
+    }
+    sort(per_iter.begin(), per_iter.end());
+    t.median_ns = per_iter[per_iter.size() / 2];
+    t.min_ns = per_iter[0];
+    return t;
+}
+
+int Main(int argc, const char* const* argv) {
+    Options options;
+    MicrobenchFlags flags(&options, argc, argv);
+    flags.Parse();
+
+    vector<Case> cases;
+    for (auto& c : AllCases()) {
+        if (CaseID(c).find(options.filter) != string::npos) {
+            cases.push_back(c);
+        }
+    }
+    if (options.list) {
+        for (auto& c : cases) {
+            cout << CaseID(c) << endl;
+        }
+        return 0;
+    }
+
+    unique_ptr<ofstream> file;
+    ostream* out = &cout;
+    if (!options.output.empty()) {
+        file.reset(new ofstream(options.output.c_str()));
+        if (!file->good()) {
+            throw autopiper::Exception(
+                    "Could not open output file: " + options.output);
+        }
+        out = file.get();
+    }
+
+    JSONWriter w(out);
+    w.BeginObject();
+    w.KeyValue("reps", options.reps);
+    w.KeyValue("min_time_ms", options.min_time_ms);
+    w.Key("cases");
+    w.BeginArray();
+    for (auto& c : cases) {
+        cerr << CaseID(c) << endl;
+        unique_ptr<Benchmark> b = c.make();
+        Timing t = TimeCase(b.get(), options);
+        w.BeginObject();
+        w.KeyValue("id", CaseID(c));
+        w.KeyValue("name", c.name);
+        w.Key("params");
+        w.BeginObject();
+        for (auto& p : c.params) {
+            w.KeyValue(p.first, p.second);
+        }
+        w.EndObject();
+        w.KeyValue("iterations", t.iterations);
+        w.KeyValue("median_ns", t.median_ns);
+        w.KeyValue("min_ns", t.min_ns);
+        w.KeyValue("checksum", strprintf("%016llx",
+                    (unsigned long long)b->Checksum()));
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+    (*out) << endl;
+    return 0;
+}
+
+}  // anonymous namespace
+
+}  // namespace microbench
+}  // namespace autopiper
+
+int main(int argc, const char* const* argv) {
+    try {
+        return autopiper::microbench::Main(argc - 1, argv + 1);
+    } catch (autopiper::Exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+
+# Library API check: compiles the test corpus in-process through
+# libautopiper's C interface, many compilations at once on a thread pool,
+# and requires each result to match what the `autopiper` command line gives
+# for the same input: the same Verilog, QoR and SDC output on success, and
+# the same diagnostics on failure. Each file is compiled several times, so
+# that concurrent compilations of the same and different sources overlap.
+# Finally, an erroneous source is compiled under more distinct filenames
+# than a single SourceMap can hold, and each diagnostic must still name its
+# own file: every compilation interns its names into a map of its own.
+#
+# Usage: api.py [--threads <n>] [autopiper binary] [libautopiper.so]
+
+import concurrent.futures
+import ctypes
+import glob
+import os.path
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+          sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))) +
+          sorted(glob.glob(os.path.join(TESTS, 'frontend', '*.ap'))))
+
+ROUNDS = 3
+
+# More names than the 16-bit file IDs of one SourceMap can tell apart.
+DISTINCT_FILENAMES = 70000
+BAD_SOURCE = b"func entry main() : void {\n    let x = ;\n}\n"
+
+class Library(object):
+    def __init__(self, path):
+        lib = ctypes.CDLL(path)
+        lib.autopiper_version.restype = ctypes.c_char_p
+        lib.autopiper_options_new.restype = ctypes.c_void_p
+        lib.autopiper_options_free.argtypes = [ctypes.c_void_p]
+        lib.autopiper_options_set.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+        lib.autopiper_compile.restype = ctypes.c_void_p
+        lib.autopiper_compile.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        lib.autopiper_result_free.argtypes = [ctypes.c_void_p]
+        lib.autopiper_result_ok.argtypes = [ctypes.c_void_p]
+        lib.autopiper_result_output.restype = ctypes.c_char_p
+        lib.autopiper_result_output.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p]
+        lib.autopiper_result_diagnostic_count.argtypes = [ctypes.c_void_p]
+        lib.autopiper_result_diagnostic.restype = ctypes.c_char_p
+        lib.autopiper_result_diagnostic.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        self.lib = lib
+
+    def options(self, settings):
+        opts = self.lib.autopiper_options_new()
+        for name, value in settings:
+            if self.lib.autopiper_options_set(
+                    opts, name.encode('utf-8'), value.encode('utf-8')) != 0:
+                raise ValueError("bad option %s=%s" % (name, value))
+        return opts
+
+    def compile(self, opts, source):
+        res = self.lib.autopiper_compile(opts, source, len(source))
+        try:
+            out = {'ok': bool(self.lib.autopiper_result_ok(res))}
+            for name in ('verilog', 'qor', 'sdc'):
+                out[name] = self.lib.autopiper_result_output(
+                        res, name.encode('utf-8')).decode('utf-8')
+            out['diagnostics'] = [
+                self.lib.autopiper_result_diagnostic(res, i).decode('utf-8')
+                for i in range(
+                    self.lib.autopiper_result_diagnostic_count(res))]
+            return out
+        finally:
+            self.lib.autopiper_result_free(res)
+
+def run_cli(autopiper_bin, filename, tmpdir):
+    base = os.path.join(tmpdir, os.path.basename(filename))
+    args = [autopiper_bin, '-o', base + '.v', '--qor', base + '.qor',
+            '--sdc', base + '.sdc', filename]
+    sub = subprocess.Popen(args, stdin=None,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    _, stderr = sub.communicate()
+    out = {'ok': sub.returncode == 0,
+           'diagnostics': stderr.decode('utf-8').splitlines()}
+    for name, ext in (('verilog', '.v'), ('qor', '.qor'), ('sdc', '.sdc')):
+        if out['ok']:
+            with open(base + ext) as f:
+                out[name] = f.read()
+    return out
+
+def compare(expected, actual):
+    if expected['ok'] != actual['ok']:
+        return ["ok %s, not %s" % (actual['ok'], expected['ok'])]
+    errors = []
+    if expected['ok']:
+        for name in ('verilog', 'qor', 'sdc'):
+            if expected[name] != actual[name]:
+                errors.append("%s differs" % name)
+    # The command line prints warnings and info on success as well.
+    if expected['diagnostics'] != actual['diagnostics']:
+        errors.append("diagnostics differ: %s vs. %s" %
+                      (actual['diagnostics'], expected['diagnostics']))
+    return errors
+
+def check_filenames(lib, threads):
+    def one(i):
+        name = 'input_%d.ap' % i
+        opts = lib.options([('filename', name)])
+        try:
+            actual = lib.compile(opts, BAD_SOURCE)
+        finally:
+            lib.lib.autopiper_options_free(opts)
+        prefix = 'Error: %s:2:' % name
+        if actual['ok'] or not actual['diagnostics'] or \
+                not actual['diagnostics'][0].startswith(prefix):
+            return "%s: diagnostics %s" % (name, actual['diagnostics'])
+        return None
+    with concurrent.futures.ThreadPoolExecutor(max_workers=threads) as pool:
+        for error in pool.map(one, range(DISTINCT_FILENAMES)):
+            if error is not None:
+                return error
+    return None
+
+def main(argv):
+    threads = 8
+    args = argv[1:]
+    if len(args) >= 2 and args[0] == '--threads':
+        threads = int(args[1])
+        args = args[2:]
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    lib_path = os.path.join(TESTS, '..', 'build', 'src', 'libautopiper.so')
+    if len(args) > 0:
+        autopiper_bin = args[0]
+    if len(args) > 1:
+        lib_path = args[1]
+
+    lib = Library(lib_path)
+    tmpdir = tempfile.mkdtemp()
+    expected = {}
+    for filename in CORPUS:
+        expected[filename] = run_cli(autopiper_bin, filename, tmpdir)
+    shutil.rmtree(tmpdir)
+
+    # One options object per file, shared by all of its compilations.
+    opts = {}
+    sources = {}
+    for filename in CORPUS:
+        opts[filename] = lib.options([('filename', filename), ('sdc', '1')])
+        with open(filename, 'rb') as f:
+            sources[filename] = f.read()
+
+    jobs = [f for _ in range(ROUNDS) for f in CORPUS]
+    ok = True
+    with concurrent.futures.ThreadPoolExecutor(max_workers=threads) as pool:
+        results = pool.map(lambda f: (f, lib.compile(opts[f], sources[f])),
+                           jobs)
+        failed = set()
+        for filename, actual in results:
+            errors = compare(expected[filename], actual)
+            if errors and filename not in failed:
+                failed.add(filename)
+                for error in errors:
+                    print("%-40s %s" %
+                          (os.path.relpath(filename, TESTS), error))
+                ok = False
+    for o in opts.values():
+        lib.lib.autopiper_options_free(o)
+
+    error = check_filenames(lib, threads)
+    if error is not None:
+        print("distinct filenames: %s" % error)
+        ok = False
+
+    if not ok:
+        print("Library API check FAILED.")
+        return 1
+    print("Library API check passed (%d files, %d compilations, "
+          "%d distinct filenames, %d threads)." %
+          (len(CORPUS), len(jobs), DISTINCT_FILENAMES, threads))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+
+# Lowering checkpoint round trip: compiles each file in the test corpus once
+# while saving a checkpoint (--checkpoint-out), then re-times the checkpoint
+# with autopiper-backend --checkpoint-in and requires the resulting Verilog to
+# be byte-identical to the direct compile. Each checkpoint is also re-timed
+# under other timing models and compared against a direct compile with each
+# model, so that a checkpoint is known to carry everything timing depends on
+# and nothing that depends on the model it was saved under.
+# (Instance submodules are compiled before the checkpoint is taken and keep
+# their original timing, so for sources with instance functions only the
+# default model is compared.)
+#
+# Usage: checkpoint.py [autopiper binary] [autopiper-backend binary]
+
+import glob
+import os.path
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+FRONTEND_CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+                   sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))))
+BACKEND_CORPUS = sorted(glob.glob(os.path.join(TESTS, 'backend', '*.ir')))
+
+# Re-timing models; '' keeps the one the source selects. 'null' and the delay
+# table give per-op delays that differ from the standard model's, not just a
+# different stage budget.
+TIMING_MODELS = ['', 'standard:16', 'standard:64', 'null',
+                 'table:' + os.path.join(TESTS, 'behavior',
+                                         'timing_table_test.tbl')]
+
+def run(args):
+    sub = subprocess.Popen(args, stdin=None,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    return (sub.returncode, stderr.decode('utf-8'))
+
+def read(filename):
+    if not os.path.exists(filename):
+        return None
+    with open(filename, 'rb') as f:
+        return f.read()
+
+def check_one(binary, backend_bin, filename, tmpdir):
+    ckpt = os.path.join(tmpdir, 'out.ckpt')
+    direct = os.path.join(tmpdir, 'direct.v')
+    retimed = os.path.join(tmpdir, 'retimed.v')
+    for f in (ckpt, direct, retimed):
+        if os.path.exists(f):
+            os.unlink(f)
+
+    ret, stderr = run([binary, '-o', direct, '--checkpoint-out', ckpt,
+                       filename])
+    if ret < 0:
+        return "crashed (signal %d):\n%s" % (-ret, stderr)
+    if ret != 0:
+        # Files that fail to compile are expected-failure tests; they must
+        # not leave a checkpoint behind that claims otherwise.
+        return None
+    if not os.path.exists(ckpt):
+        return "no checkpoint written"
+
+    with open(filename) as f:
+        has_instances = 'func instance' in f.read()
+
+    for model in TIMING_MODELS:
+        model_args = ['--timing-model', model] if model else []
+        if model:
+            # A tighter budget may reject ops that do not fit in one stage;
+            # the re-timed checkpoint must then fail the same way.
+            for f in (direct, retimed):
+                if os.path.exists(f):
+                    os.unlink(f)
+            direct_ret, stderr = run([binary, '-o', direct] + model_args +
+                                     [filename])
+        else:
+            direct_ret = 0
+        ret, stderr = run([backend_bin, '--checkpoint-in', ckpt,
+                           '-o', retimed] + model_args)
+        if (ret != 0) != (direct_ret != 0):
+            return "re-timing %s:\n%s" % (
+                    "failed" if ret != 0 else "succeeded but direct failed",
+                    stderr)
+        # Instance submodules are carried in the checkpoint as compiled, so
+        # under another model they keep their original latency while a
+        # direct compile re-times them too.
+        if model and has_instances:
+            continue
+        if ret == 0 and read(direct) != read(retimed):
+            return "re-timed Verilog differs%s" % (
+                    (" (" + model + ")") if model else "")
+    return None
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+    if len(argv) > 2:
+        backend_bin = argv[2]
+    else:
+        backend_bin = os.path.join(os.path.dirname(autopiper_bin),
+                                   'autopiper-backend')
+
+    jobs = ([(autopiper_bin, f) for f in FRONTEND_CORPUS] +
+            [(backend_bin, f) for f in BACKEND_CORPUS])
+
+    tmpdir = tempfile.mkdtemp()
+    ok = True
+    for binary, filename in jobs:
+        error = check_one(binary, backend_bin, filename, tmpdir)
+        if error is not None:
+            print("%-40s %s" % (os.path.relpath(filename, TESTS), error))
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Checkpoint round trip FAILED.")
+        return 1
+    print("Checkpoint round trip passed (%d files)." % len(jobs))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+
+# Output determinism check: compiles the test corpus several times under
+# different memory layouts and requires byte-identical results (Verilog,
+# diagnostics, and exit status) every time. Any ordering in the compiler that
+# is keyed on pointer values rather than valnums or other stable IDs shows up
+# here as a diff between layouts.
+#
+# Usage: determinism.py [--runs <n>] [autopiper binary] [autopiper-backend binary]
+#
+# Layouts are varied by running each compile with and without ASLR, with
+# glibc malloc tuned to hand out memory in a different order (no tcache or
+# fastbins; every allocation served by mmap, which places blocks top-down),
+# and, when one is installed, under an alternative allocator via LD_PRELOAD.
+# Each layout is run |runs| times (default 2) so that ASLR gets several seeds.
+
+import glob
+import os.path
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+FRONTEND_CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+                   sorted(glob.glob(os.path.join(TESTS, 'frontend', '*.ap'))) +
+                   sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))))
+BACKEND_CORPUS = sorted(glob.glob(os.path.join(TESTS, 'backend', '*.ir')))
+
+ALT_ALLOCATORS = [
+    '/usr/lib/x86_64-linux-gnu/libjemalloc.so.2',
+    '/usr/lib/x86_64-linux-gnu/libtcmalloc.so.4',
+    '/usr/lib/x86_64-linux-gnu/libmimalloc.so.2',
+    '/usr/lib/libjemalloc.so.2',
+    '/usr/lib/libtcmalloc.so.4',
+    '/usr/lib/libmimalloc.so',
+]
+
+def layouts():
+    ret = [('default', [], {})]
+    setarch = shutil.which('setarch')
+    if setarch is not None:
+        ret.append(('no-aslr', [setarch, platform.machine(), '-R'], {}))
+    ret.append(('no-tcache', [], {
+        'GLIBC_TUNABLES': 'glibc.malloc.tcache_count=0:glibc.malloc.mxfast=0',
+        'MALLOC_PERTURB_': '165',
+    }))
+    ret.append(('mmap-all', [], {
+        'GLIBC_TUNABLES': 'glibc.malloc.mmap_threshold=0',
+    }))
+    for lib in ALT_ALLOCATORS:
+        if os.path.exists(lib):
+            ret.append((os.path.basename(lib), [], {'LD_PRELOAD': lib}))
+    return ret
+
+def compile_one(binary, filename, prefix, extra_env, tmpdir):
+    verilog = os.path.join(tmpdir, 'out.v')
+    if os.path.exists(verilog):
+        os.unlink(verilog)
+    env = dict(os.environ)
+    env.update(extra_env)
+    sub = subprocess.Popen(prefix + [binary, '-o', verilog, filename],
+            stdin=None, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+            env=env)
+    stdout, stderr = sub.communicate()
+    output = b''
+    if os.path.exists(verilog):
+        with open(verilog, 'rb') as f:
+            output = f.read()
+    return (sub.returncode, stdout, stderr, output)
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    backend_bin = None
+    runs = 2
+
+    args = argv[1:]
+    bins = []
+    while args:
+        a = args.pop(0)
+        if a == '--runs':
+            runs = int(args.pop(0))
+        else:
+            bins.append(a)
+    if bins:
+        autopiper_bin = bins[0]
+    if len(bins) > 1:
+        backend_bin = bins[1]
+    else:
+        backend_bin = os.path.join(os.path.dirname(autopiper_bin),
+                                   'autopiper-backend')
+
+    jobs = [(autopiper_bin, f) for f in FRONTEND_CORPUS]
+    if os.path.exists(backend_bin):
+        jobs += [(backend_bin, f) for f in BACKEND_CORPUS]
+
+    tmpdir = tempfile.mkdtemp()
+    ok = True
+    all_layouts = layouts()
+    print("Layouts: %s" % ', '.join(name for name, _, _ in all_layouts))
+    for binary, filename in jobs:
+        name = os.path.relpath(filename, TESTS)
+        reference = None
+        for layout, prefix, env in all_layouts:
+            for i in range(runs):
+                result = compile_one(binary, filename, prefix, env, tmpdir)
+                if reference is None:
+                    reference = (layout, result)
+                    continue
+                if result != reference[1]:
+                    what = [k for k, a, b in zip(
+                                ['exit status', 'stdout', 'stderr', 'Verilog'],
+                                reference[1], result) if a != b]
+                    print("%-40s differs (%s) between '%s' and '%s' run %d" %
+                          (name, ', '.join(what), reference[0], layout, i))
+                    ok = False
+                    break
+            else:
+                continue
+            break
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Determinism check FAILED.")
+        return 1
+    print("Determinism check passed (%d files)." % len(jobs))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
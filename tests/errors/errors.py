@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+# Expected-error check: compiles each design in tests/errors (.ap sources with
+# autopiper, .ir with autopiper-backend), which the compiler must reject. Each
+# file names the message it must fail with in one or more '#error: <text>'
+# lines; every text must appear in the compiler's error output, and the
+# compiler must exit with an error rather than crash.
+#
+# Usage: errors.py [autopiper binary] [autopiper-backend binary]
+
+import glob
+import os.path
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+FRONTEND_CORPUS = sorted(glob.glob(os.path.join(HERE, '*.ap')))
+BACKEND_CORPUS = sorted(glob.glob(os.path.join(HERE, '*.ir')))
+
+def expected_errors(filename):
+    ret = []
+    with open(filename) as f:
+        for line in f:
+            if line.startswith('#error:'):
+                ret.append(line[len('#error:'):].strip())
+    return ret
+
+def check_one(binary, filename, tmpdir):
+    expected = expected_errors(filename)
+    if not expected:
+        return "no '#error:' line"
+    sub = subprocess.Popen([binary, '-o', os.path.join(tmpdir, 'out.v'),
+                            filename],
+                           stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    stderr = stderr.decode('utf-8')
+    if sub.returncode < 0:
+        return "crashed (signal %d):\n%s" % (-sub.returncode, stderr)
+    if sub.returncode == 0:
+        return "compiled, but should have failed"
+    for text in expected:
+        if text not in stderr:
+            return "missing error '%s'; got:\n%s" % (text, stderr)
+    return None
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+    if len(argv) > 2:
+        backend_bin = argv[2]
+    else:
+        backend_bin = os.path.join(os.path.dirname(autopiper_bin),
+                                   'autopiper-backend')
+
+    jobs = ([(autopiper_bin, f) for f in FRONTEND_CORPUS] +
+            [(backend_bin, f) for f in BACKEND_CORPUS])
+
+    tmpdir = tempfile.mkdtemp()
+    ok = True
+    for binary, filename in jobs:
+        error = check_one(binary, filename, tmpdir)
+        if error is not None:
+            print("%-40s %s" % (os.path.relpath(filename, TESTS), error))
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Expected-error check FAILED.")
+        return 1
+    print("Expected-error check passed (%d files)." % len(jobs))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Parallel IR parse check: generates a text IR program of a few hundred BBs,
+# with values and timevars used across BBs, and compiles it with the backend
+# parsing serially and parsing in parallel in many small chunks on several
+# threads. The --print-ir output must be the same. A copy with a syntax error
+# late in the program must be rejected by both with the same message at the
+# same location.
+#
+# Usage: irparse.py [autopiper-backend binary]
+
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+BBS = 300
+TIMEVARS = 5
+# Small enough to split the program into dozens of chunks.
+CHUNK_SIZE = 2048
+SERIAL = ['--parse-threads', '1']
+PARALLEL = ['--parse-threads', '4', '--parse-chunk-size', str(CHUNK_SIZE)]
+
+ERROR_BB = BBS - 20
+ERROR_LOCATION = re.compile(r':(\d+):(\d+)')
+
+# Returns the program's lines. BB i reads the running sum from BB i - 1, so
+# every chunk refers back to valnums defined in an earlier one; every few BBs
+# carry a timing barrier on a timevar shared with BBs in other chunks.
+def generate():
+    lines = ['# Generated by irparse.py.',
+             'entry bb0:',
+             '%1[32] = portread "x"',
+             '%2[32] = const 0',
+             '%3 = jmp bb1',
+             '']
+    prev_sum = 2
+    for i in range(1, BBS + 1):
+        base = 10 * i
+        lines.append('bb%d:' % i)
+        lines.append('%%%d[32] = const %d' % (base, i))
+        lines.append('%%%d[32] = add %%%d, %%1' % (base + 1, base))
+        lines.append('%%%d[32] = add %%%d, %%%d' % (base + 2, prev_sum,
+                                                    base + 1))
+        if i % 7 == 0:
+            lines.append('%%%d = timing_barrier @[t%d + 0]' %
+                         (base + 3, i % TIMEVARS))
+        if i < BBS:
+            lines.append('%%%d = jmp bb%d' % (base + 4, i + 1))
+        else:
+            lines.append('%%%d[32] = portwrite "y", %%%d' % (base + 4, base + 2))
+            lines.append('%%%d = done' % (base + 5))
+        lines.append('')
+        prev_sum = base + 2
+    return lines
+
+def compile_ir(backend_bin, tmpdir, lines, flags):
+    ir_file = os.path.join(tmpdir, 'in.ir')
+    with open(ir_file, 'w') as f:
+        f.write('\n'.join(lines))
+    sub = subprocess.Popen([backend_bin, '--print-ir'] + flags +
+                           ['-o', os.path.join(tmpdir, 'out.v'), ir_file],
+                           stdin=None, stdout=subprocess.PIPE,
+                           stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    return sub.returncode, stdout.decode('utf-8'), stderr.decode('utf-8')
+
+def main(argv):
+    backend_bin = os.path.join(TESTS, '..', 'build', 'src',
+                               'autopiper-backend')
+    if len(argv) > 1:
+        backend_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    ok = True
+
+    lines = generate()
+    serial = compile_ir(backend_bin, tmpdir, lines, SERIAL)
+    parallel = compile_ir(backend_bin, tmpdir, lines, PARALLEL)
+    if serial[0] != 0:
+        print("serial parse: compile failed (exit %d):\n%s" %
+              (serial[0], serial[2]))
+        ok = False
+    elif parallel != serial:
+        print("parallel parse: output differs from the serial parse")
+        ok = False
+
+    # Break a statement in a BB far enough in that its chunk is not the first.
+    error_line = lines.index('bb%d:' % ERROR_BB) + 2
+    lines[error_line] = lines[error_line].replace(', %1', ' %1')
+    serial = compile_ir(backend_bin, tmpdir, lines, SERIAL)
+    parallel = compile_ir(backend_bin, tmpdir, lines, PARALLEL)
+    shutil.rmtree(tmpdir)
+    if serial[0] == 0 or parallel[0] == 0:
+        print("syntax error at line %d: not rejected" % (error_line + 1))
+        ok = False
+    else:
+        m = ERROR_LOCATION.search(serial[2])
+        if not m or int(m.group(1)) != error_line + 1:
+            print("syntax error at line %d: serial parse reports:\n%s" %
+                  (error_line + 1, serial[2]))
+            ok = False
+        if parallel[2] != serial[2]:
+            print("syntax error at line %d: parallel parse reports:\n%s" %
+                  (error_line + 1, parallel[2]))
+            ok = False
+
+    if not ok:
+        print("Parallel IR parse check FAILED.")
+        return 1
+    print("Parallel IR parse check passed (%d BBs)." % BBS)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
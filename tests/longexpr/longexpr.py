@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+
+# Long expression check: compiles a design whose output is a single generated
+# chain of 20000 operands joined by binary operators of mixed precedence, and
+# requires the frontend IR (--print-ir) to compute the chain's value for a few
+# input values. The parser builds such chains without recursing per operand;
+# the rest of the compile must also get through the resulting deep tree.
+#
+# Usage: longexpr.py [autopiper binary]
+
+import os.path
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+OPERANDS = 20000
+# Operators and their weights: mostly adds and subtracts, so that the value
+# depends on every operand. (Any | in so long a chain sets every bit.)
+OPERATORS = [('+', 40), ('-', 40), ('^', 16), ('&', 4)]
+INPUTS = [(0, 0), (1, 2), (0xdeadbeef, 0x12345678), (0xffffffff, 7)]
+MASK = 0xffffffff
+
+IR_STMT = re.compile(r'^%(\d+)\[\d+\] = (\w+) ?(.*)$')
+IR_OPS = {
+    'add': lambda x, y: x + y,
+    'sub': lambda x, y: x - y,
+    'and': lambda x, y: x & y,
+    'xor': lambda x, y: x ^ y,
+}
+
+def generate():
+    rand = random.Random(1)
+    terms = [rand.choice(['a', 'b', str(rand.randrange(1, 1000))])
+             for i in range(OPERANDS)]
+    ops = rand.choices([op for op, weight in OPERATORS],
+                       [weight for op, weight in OPERATORS], k=OPERANDS - 1)
+    expr = terms[0]
+    for op, term in zip(ops, terms[1:]):
+        expr += ' %s %s' % (op, term)
+    source = ('func entry main() : void {\n'
+              '    let a_in : port int32 = port "a";\n'
+              '    let b_in : port int32 = port "b";\n'
+              '    let y_out : port int32 = port "y";\n'
+              '    let a = read a_in;\n'
+              '    let b = read b_in;\n'
+              '    write y_out, %s;\n'
+              '}\n') % expr
+    return source, terms, ops
+
+# Evaluates the chain: operators are split out loosest-binding first (^, then
+# &, then + and - together), and each run of + and - is applied left to right.
+def eval_chain(terms, ops, a, b):
+    def value(term):
+        if term in ('a', 'b'):
+            return {'a': a, 'b': b}[term]
+        return int(term)
+    def split(terms, ops, op):
+        groups = [([terms[0]], [])]
+        for o, term in zip(ops, terms[1:]):
+            if o == op:
+                groups.append(([term], []))
+            else:
+                groups[-1][0].append(term)
+                groups[-1][1].append(o)
+        return groups
+    def fold(terms, ops, levels):
+        if not levels:
+            result = value(terms[0])
+            for o, term in zip(ops, terms[1:]):
+                result = result + value(term) if o == '+' else \
+                         result - value(term)
+            return result & MASK
+        op, combine = levels[0]
+        result = None
+        for t, o in split(terms, ops, op):
+            v = fold(t, o, levels[1:])
+            result = v if result is None else combine(result, v)
+        return result
+    return fold(terms, ops, [('^', lambda x, y: x ^ y),
+                             ('&', lambda x, y: x & y)])
+
+# Evaluates the straight-line IR of main() and returns the value written to
+# port "y".
+def eval_ir(ir, a, b):
+    ports = {'a': a, 'b': b}
+    values = {}
+    for line in ir.splitlines():
+        m = IR_STMT.match(line)
+        if not m:
+            continue
+        valnum, op, args = int(m.group(1)), m.group(2), m.group(3)
+        if op == 'const':
+            values[valnum] = int(args)
+        elif op == 'portread':
+            values[valnum] = ports[args.strip('"')]
+        elif op in IR_OPS:
+            x, y = [values[int(arg.strip().lstrip('%'))]
+                    for arg in args.split(',')]
+            values[valnum] = IR_OPS[op](x, y) & MASK
+        elif op == 'portwrite':
+            port, value = args.split(',')
+            if port.strip('"') == 'y':
+                return values[int(value.strip().lstrip('%'))]
+    return None
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    source, terms, ops = generate()
+    source_file = os.path.join(tmpdir, 'longexpr.ap')
+    with open(source_file, 'w') as f:
+        f.write(source)
+    sub = subprocess.Popen([autopiper_bin, '--print-ir',
+                            '-o', os.path.join(tmpdir, 'out.v'), source_file],
+                           stdin=None, stdout=subprocess.PIPE,
+                           stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    shutil.rmtree(tmpdir)
+
+    ok = True
+    if sub.returncode != 0:
+        print("compile failed (exit %d):\n%s" %
+              (sub.returncode, stderr.decode('utf-8')))
+        ok = False
+    else:
+        ir = stdout.decode('utf-8')
+        for a, b in INPUTS:
+            expected = eval_chain(terms, ops, a, b)
+            got = eval_ir(ir, a, b)
+            if got != expected:
+                print("a = %d, b = %d: IR computes %s, expected %d" %
+                      (a, b, got, expected))
+                ok = False
+
+    if not ok:
+        print("Long expression check FAILED.")
+        return 1
+    print("Long expression check passed (%d operands)." % OPERANDS)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
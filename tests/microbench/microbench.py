@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+# Microbenchmark runner: runs autopiper-microbench, prints per-case timings,
+# and optionally writes the results (JSON) and compares them against a
+# previous run's results, e.g. from the parent commit on the same machine.
+#
+# Usage: microbench.py [-o <file>] [--baseline <file>] [--tolerance <frac>]
+#                      [--filter <str>] [--reps <n>] [--min-time <ms>]
+#                      [autopiper-microbench binary]
+#
+# A case regresses when its median time per iteration grows past the
+# baseline's by more than the tolerance (relative, as a fraction; 0.25 by
+# default). A checksum mismatch means that the data structure now computes a
+# different answer on the same input, and always fails; cases only in one of
+# the two runs are reported (unless filtered) but do not fail. Timings are
+# only comparable between runs on the same machine and build configuration.
+
+import json
+import os.path
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+def usage():
+    print("Usage: microbench.py [-o <file>] [--baseline <file>] "
+          "[--tolerance <frac>] [--filter <str>] [--reps <n>] "
+          "[--min-time <ms>] [autopiper-microbench binary]")
+    sys.exit(1)
+
+def fmt_ns(ns):
+    for unit, scale in (('s', 1e9), ('ms', 1e6), ('us', 1e3)):
+        if ns >= scale:
+            return "%.2f %s" % (ns / scale, unit)
+    return "%.0f ns" % ns
+
+def compare(results, baseline, tolerance, filtered):
+    ok = True
+    base = dict((c['id'], c) for c in baseline['cases'])
+    for c in results['cases']:
+        b = base.pop(c['id'], None)
+        if b is None:
+            print("%-50s new case" % c['id'])
+            continue
+        if c['checksum'] != b['checksum']:
+            print("%-50s CHECKSUM %s, was %s" %
+                  (c['id'], c['checksum'], b['checksum']))
+            ok = False
+        ratio = c['median_ns'] / b['median_ns'] if b['median_ns'] else 1.0
+        if ratio > 1.0 + tolerance:
+            print("%-50s REGRESSED %s -> %s (%.2fx)" %
+                  (c['id'], fmt_ns(b['median_ns']), fmt_ns(c['median_ns']),
+                   ratio))
+            ok = False
+        elif ratio < 1.0 - tolerance:
+            print("%-50s improved %s -> %s (%.2fx)" %
+                  (c['id'], fmt_ns(b['median_ns']), fmt_ns(c['median_ns']),
+                   ratio))
+    # With --filter, most baseline cases are expected to be missing.
+    for case_id in ([] if filtered else sorted(base)):
+        print("%-50s missing (in baseline only)" % case_id)
+    return ok
+
+def main(argv):
+    microbench_bin = os.path.join(HERE, '..', '..', 'build', 'src',
+                                  'autopiper-microbench')
+    output = None
+    baseline_file = None
+    tolerance = 0.25
+    bench_args = []
+    args = argv[1:]
+    while args:
+        arg = args.pop(0)
+        if arg in ('-o', '--baseline', '--tolerance', '--filter', '--reps',
+                   '--min-time'):
+            if not args:
+                usage()
+            value = args.pop(0)
+            if arg == '-o':
+                output = value
+            elif arg == '--baseline':
+                baseline_file = value
+            elif arg == '--tolerance':
+                tolerance = float(value)
+            else:
+                bench_args += [arg, value]
+        elif arg.startswith('-'):
+            usage()
+        else:
+            microbench_bin = arg
+
+    sub = subprocess.Popen([microbench_bin] + bench_args,
+            stdin=None, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    if sub.returncode != 0:
+        print("autopiper-microbench failed:\n%s" % stderr.decode('utf-8'))
+        return 1
+    results = json.loads(stdout.decode('utf-8'))
+
+    for c in results['cases']:
+        print("%-50s %12s  (min %s)" %
+              (c['id'], fmt_ns(c['median_ns']), fmt_ns(c['min_ns'])))
+    if output:
+        with open(output, 'w') as f:
+            f.write(stdout.decode('utf-8'))
+
+    if baseline_file:
+        with open(baseline_file) as f:
+            baseline = json.load(f)
+        if not compare(results, baseline, tolerance,
+                       '--filter' in bench_args):
+            print("Microbenchmarks REGRESSED against %s." % baseline_file)
+            return 1
+        print("Microbenchmarks match %s." % baseline_file)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
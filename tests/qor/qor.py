@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+
+# Quality-of-results benchmark: compiles the reference corpus (tests/behavior
+# plus the larger designs in this directory), gathers the metrics written by
+# `autopiper --qor`, optionally adds area/depth numbers from a local yosys run,
+# and compares everything against the checked-in baseline.
+#
+# Usage: qor.py [--update] [--yosys] [--baseline <file>] [autopiper binary]
+#
+# A metric regresses when it grows past its baseline value by more than the
+# tolerance given in the baseline file (relative, as a fraction). Improvements
+# beyond the tolerance are reported but do not fail; rerun with --update to
+# accept them (or to accept an intentional regression).
+
+import glob
+import json
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+CORPUS = (sorted(glob.glob(os.path.join(HERE, '..', 'behavior', '*.ap'))) +
+          sorted(glob.glob(os.path.join(HERE, '*.ap'))))
+
+# Top-level metrics compared against the baseline, in report order.
+METRICS = [
+    'pipes', 'stages', 'max_stages', 'pipereg_bits', 'piperegs',
+    'max_logic_depth', 'stall_sources', 'kill_sources', 'gates',
+    'storage_bits', 'yosys_cells', 'yosys_depth',
+]
+
+DEFAULT_TOLERANCES = {
+    'default': 0.0,
+    'pipereg_bits': 0.05,
+    'piperegs': 0.05,
+    'gates': 0.05,
+    'yosys_cells': 0.10,
+    'yosys_depth': 0.10,
+}
+
+def run(args):
+    sub = subprocess.Popen(args, stdin=None,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    return (stdout.decode('utf-8'), stderr.decode('utf-8'), sub.returncode)
+
+def design_name(filename):
+    return os.path.relpath(filename, os.path.join(HERE, '..'))
+
+def yosys_metrics(verilog):
+    script = ('read_verilog %s; synth -top main; '
+              'abc -g AND,NAND,OR,NOR,XOR,XNOR,MUX; stat; ltp -noff' % verilog)
+    stdout, stderr, ret = run(['yosys', '-q', '-p', script])
+    if ret != 0:
+        print("yosys failed on %s:\n%s" % (verilog, stderr))
+        return {}
+    metrics = {}
+    m = re.findall(r'Number of cells:\s+(\d+)', stdout)
+    if m:
+        metrics['yosys_cells'] = int(m[-1])
+    m = re.search(r'Longest topological path .*\(length=(\d+)\)', stdout)
+    if m:
+        metrics['yosys_depth'] = int(m.group(1))
+    return metrics
+
+def measure(autopiper_bin, filename, tmpdir, use_yosys):
+    base = os.path.join(tmpdir, os.path.basename(filename))
+    verilog = base + '.v'
+    qor_json = base + '.qor.json'
+    stdout, stderr, ret = run([autopiper_bin, '-o', verilog,
+                               '--qor', qor_json, filename])
+    if ret != 0:
+        print("Error compiling %s:\n%s" % (filename, stderr))
+        return None
+    with open(qor_json) as f:
+        report = json.load(f)
+    metrics = dict((k, report[k]) for k in METRICS if k in report)
+    if use_yosys:
+        metrics.update(yosys_metrics(verilog))
+    return metrics
+
+def compare(name, metrics, baseline, tolerances):
+    ok = True
+    base = baseline.get(name)
+    if base is None:
+        print("%-40s NEW (not in baseline)" % name)
+        return False
+    for k in METRICS:
+        if k not in metrics or k not in base:
+            continue
+        old, new = base[k], metrics[k]
+        tol = tolerances.get(k, tolerances.get('default', 0.0))
+        limit = old * (1.0 + tol)
+        if new > limit:
+            print("%-40s %-16s REGRESSED %d -> %d (tolerance %.0f%%)" %
+                  (name, k, old, new, tol * 100))
+            ok = False
+        elif new < old * (1.0 - tol):
+            print("%-40s %-16s improved  %d -> %d" % (name, k, old, new))
+    return ok
+
+def main(argv):
+    autopiper_bin = os.path.join(HERE, '..', '..', 'build', 'src', 'autopiper')
+    baseline_file = os.path.join(HERE, 'baseline.json')
+    update = False
+    use_yosys = False
+
+    args = argv[1:]
+    while args:
+        a = args.pop(0)
+        if a == '--update':
+            update = True
+        elif a == '--yosys':
+            use_yosys = True
+        elif a == '--baseline':
+            baseline_file = args.pop(0)
+        else:
+            autopiper_bin = a
+
+    if use_yosys and shutil.which('yosys') is None:
+        print("yosys not found on PATH; skipping synthesis metrics.")
+        use_yosys = False
+
+    baseline = {}
+    tolerances = dict(DEFAULT_TOLERANCES)
+    if os.path.exists(baseline_file):
+        with open(baseline_file) as f:
+            data = json.load(f)
+        baseline = data.get('designs', {})
+        tolerances.update(data.get('tolerances', {}))
+
+    tmpdir = tempfile.mkdtemp()
+    results = {}
+    ok = True
+    for filename in CORPUS:
+        name = design_name(filename)
+        metrics = measure(autopiper_bin, filename, tmpdir, use_yosys)
+        if metrics is None:
+            ok = False
+            continue
+        results[name] = metrics
+        if not update:
+            ok = compare(name, metrics, baseline, tolerances) and ok
+    shutil.rmtree(tmpdir)
+
+    # Summary table.
+    cols = [k for k in METRICS if any(k in m for m in results.values())]
+    print("%-40s %s" % ('design', ' '.join('%8s' % c[:8] for c in cols)))
+    for name in sorted(results):
+        m = results[name]
+        print("%-40s %s" % (name, ' '.join('%8s' % m.get(c, '-') for c in cols)))
+
+    if update:
+        # Keep synthesis numbers from the old baseline when not re-running
+        # yosys, so that an update without it does not drop them.
+        for name, m in results.items():
+            for k, v in baseline.get(name, {}).items():
+                if k.startswith('yosys_') and k not in m:
+                    m[k] = v
+        with open(baseline_file, 'w') as f:
+            json.dump({'tolerances': tolerances, 'designs': results}, f,
+                      indent=2, sort_keys=True)
+            f.write('\n')
+        print("Baseline written to %s." % baseline_file)
+        return 0
+
+    if not ok:
+        print("QoR check FAILED.")
+        return 1
+    print("QoR check passed.")
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+
+# SDC consistency check: compiles the test corpus with --sdc and requires
+# every object the constraints name -- ports, pipereg instances and their
+# enable pins, and storage cells -- to exist in the generated Verilog, and every
+# pipereg in the Verilog to belong to exactly one stage group.
+#
+# Usage: sdc.py [autopiper binary]
+
+import glob
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+          sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))))
+
+OBJECTS = re.compile(r'\[get_(ports|cells|pins) (?:\{([^}]*)\}|(\S+))\]')
+GROUP = re.compile(r'^group_path -name (\S+) -(to|from|through) ')
+
+def top_module(verilog):
+    # The top-level module comes first; instance submodules and the pipereg
+    # module follow it.
+    end = verilog.find('endmodule')
+    return verilog[:end] if end >= 0 else verilog
+
+def module_bodies(verilog):
+    return dict(re.findall(r'^module (\w+)\((.*?)^endmodule', verilog,
+                           re.M | re.S))
+
+def cells(body):
+    piperegs = set(re.findall(r'^\s*pipereg #\(\d+\) (\w+)\(', body, re.M))
+    storage = set(re.findall(r'^\s*reg \[[^\]]*\] ((?:reg|array)_\w+)',
+                             body, re.M))
+    return piperegs, storage
+
+def check(sdc, verilog):
+    top = top_module(verilog)
+    ports = set(re.findall(r'^\s*(?:input|output)(?: \[\d+:0\])? (\w+)',
+                           top, re.M))
+    piperegs, storage = cells(top)
+    # Systems emitted as shared modules are instances in the top module;
+    # their cells are named by hierarchical path.
+    bodies = module_bodies(verilog)
+    for module, inst in re.findall(r'^\s*(\w+) (\w+)\($', top, re.M):
+        if module not in bodies or not re.search(r'_shared\d+$', module):
+            continue
+        sub_piperegs, sub_storage = cells(bodies[module])
+        piperegs |= set(inst + '/' + name for name in sub_piperegs)
+        storage |= set(inst + '/' + name for name in sub_storage)
+
+    errors = []
+    grouped = {}
+    for line in sdc.splitlines():
+        if line.startswith('#'):
+            continue
+        group = GROUP.match(line)
+        for kind, names, name in OBJECTS.findall(line):
+            for obj in (names.split() if names else [name]):
+                if kind == 'ports':
+                    ok = obj in ports
+                elif kind == 'pins':
+                    inst, _, pin = obj.rpartition('/')
+                    ok = inst in piperegs and pin == 'enable'
+                elif obj.endswith('*'):
+                    ok = obj[:-1] in storage
+                else:
+                    ok = obj in piperegs
+                if not ok:
+                    errors.append("unknown %s '%s'" % (kind[:-1], obj))
+                if group and group.group(2) == 'to' and kind == 'cells' \
+                        and not obj.endswith('*'):
+                    grouped.setdefault(obj, []).append(group.group(1))
+    for reg in sorted(piperegs):
+        groups = grouped.get(reg, [])
+        if len(groups) != 1:
+            errors.append("pipereg '%s' in %d stage groups" %
+                          (reg, len(groups)))
+    return errors
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    verilog_file = os.path.join(tmpdir, 'out.v')
+    sdc_file = os.path.join(tmpdir, 'out.sdc')
+    ok = True
+    checked = 0
+    for filename in CORPUS:
+        sub = subprocess.Popen([autopiper_bin, '-o', verilog_file,
+                                '--sdc', sdc_file, filename],
+                stdin=None, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        stdout, stderr = sub.communicate()
+        if sub.returncode != 0:
+            print("Error compiling %s:\n%s" % (filename,
+                                               stderr.decode('utf-8')))
+            ok = False
+            continue
+        with open(verilog_file) as f:
+            verilog = f.read()
+        with open(sdc_file) as f:
+            sdc = f.read()
+        checked += 1
+        for error in check(sdc, verilog):
+            print("%-40s %s" % (os.path.relpath(filename, TESTS), error))
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("SDC check FAILED.")
+        return 1
+    print("SDC check passed (%d files)." % checked)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+
+# Stage map consistency check: compiles the test corpus with --stage-map,
+# --stage-map-html and --sdc, and requires the JSON map to agree with the HTML
+# map and, for its budget and per-stage delays, with the SDC annotations. Both
+# reports time stages with the design's own timing model, so a map built with
+# any other model disagrees with the SDC on the table-timed designs. Pipereg
+# bits leaving one stage must also be the bits entering the next.
+#
+# Usage: stagemap.py [autopiper binary]
+
+import glob
+import html
+import json
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+          sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))))
+
+SDC_BUDGET = re.compile(r'^# Timing model: .*, budget (\d+) per stage\.$')
+SDC_PIPE = re.compile(r"^# Pipe '(.*)'\.$")
+SDC_STAGE = re.compile(r'^# \S+ stage (\d+): longest path (\d+) / (\d+)')
+
+HTML_BUDGET = re.compile(r'<p>Delay budget per stage: (\d+)</p>')
+HTML_PIPE = re.compile(r'<h2>Pipe (.*)</h2>')
+HTML_ROW = re.compile(r'<tr(?: class="over")?><td>(.*?)</td></tr>')
+
+def parse_sdc(sdc):
+    budget = None
+    pipes = []
+    for line in sdc.splitlines():
+        m = SDC_BUDGET.match(line)
+        if m:
+            budget = int(m.group(1))
+        m = SDC_PIPE.match(line)
+        if m:
+            pipes.append((m.group(1), []))
+        m = SDC_STAGE.match(line)
+        if m and pipes:
+            pipes[-1][1].append((int(m.group(1)), int(m.group(2))))
+    return budget, pipes
+
+def parse_html(text):
+    m = HTML_BUDGET.search(text)
+    budget = int(m.group(1)) if m else None
+    pipes = []
+    for line in text.splitlines():
+        m = HTML_PIPE.match(line)
+        if m:
+            pipes.append((html.unescape(m.group(1)), []))
+            continue
+        m = HTML_ROW.match(line)
+        if m and pipes:
+            pipes[-1][1].append(m.group(1).split('</td><td'))
+    return budget, pipes
+
+def check(stage_map, map_html, sdc):
+    errors = []
+    budget = stage_map['budget']
+    pipes = stage_map['pipes']
+
+    sdc_budget, sdc_pipes = parse_sdc(sdc)
+    if sdc_budget != budget:
+        errors.append("budget %d, but SDC budget %s" % (budget, sdc_budget))
+    sdc_delays = [(entry, stages) for entry, stages in sdc_pipes]
+    map_delays = [(p['entry'], [(s['stage'], s['delay']) for s in p['stages']])
+                  for p in pipes]
+    if sdc_delays != map_delays:
+        errors.append("stage delays differ from SDC annotations")
+
+    html_budget, html_pipes = parse_html(map_html)
+    if html_budget != budget:
+        errors.append("HTML budget %s, JSON budget %d" % (html_budget, budget))
+    if [entry for entry, rows in html_pipes] != [p['entry'] for p in pipes]:
+        errors.append("HTML and JSON list different pipes")
+    for (entry, rows), pipe in zip(html_pipes, pipes):
+        stages = pipe['stages']
+        if len(rows) != len(stages):
+            errors.append("pipe '%s': %d HTML rows, %d stages" %
+                          (entry, len(rows), len(stages)))
+            continue
+        for row, s in zip(rows, stages):
+            cells = [re.sub(r'^[^>]*>', '', c) for c in row]
+            expect = [str(s['stage']), str(s['stmts']),
+                      '%d / %d' % (s['delay'], budget), str(s['delay_sum']),
+                      str(s['bits_in']), str(s['bits_out']),
+                      str(s['stall_fanin']), str(s['kill_fanin'])]
+            if cells[:len(expect)] != expect:
+                errors.append("pipe '%s' stage %d: HTML row differs" %
+                              (entry, s['stage']))
+
+    for pipe in pipes:
+        stages = pipe['stages']
+        for prev, s in zip(stages, stages[1:]):
+            if prev['bits_out'] != s['bits_in']:
+                errors.append("pipe '%s' stage %d: %d bits in, but %d bits "
+                              "out of stage %d" %
+                              (pipe['entry'], s['stage'], s['bits_in'],
+                               prev['bits_out'], prev['stage']))
+    return errors
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    verilog_file = os.path.join(tmpdir, 'out.v')
+    map_file = os.path.join(tmpdir, 'out.json')
+    html_file = os.path.join(tmpdir, 'out.html')
+    sdc_file = os.path.join(tmpdir, 'out.sdc')
+    ok = True
+    checked = 0
+    for filename in CORPUS:
+        sub = subprocess.Popen([autopiper_bin, '-o', verilog_file,
+                                '--stage-map', map_file,
+                                '--stage-map-html', html_file,
+                                '--sdc', sdc_file, filename],
+                cwd=os.path.dirname(filename),
+                stdin=None, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        stdout, stderr = sub.communicate()
+        if sub.returncode != 0:
+            print("Error compiling %s:\n%s" % (filename,
+                                               stderr.decode('utf-8')))
+            ok = False
+            continue
+        with open(map_file) as f:
+            stage_map = json.load(f)
+        with open(html_file) as f:
+            map_html = f.read()
+        with open(sdc_file) as f:
+            sdc = f.read()
+        checked += 1
+        for error in check(stage_map, map_html, sdc):
+            print("%-40s %s" % (os.path.relpath(filename, TESTS), error))
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Stage map check FAILED.")
+        return 1
+    print("Stage map check passed (%d files)." % checked)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
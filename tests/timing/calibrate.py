@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+
+# Timing-model calibration: measures the delay of each IR expression op at a
+# range of widths by synthesizing one microbenchmark per (op, width) with a
+# local yosys/abc flow, and writes a delay table for the table timing model
+# (select it with `pragma timing_model = "table:<file>";`).
+#
+# Usage: calibrate.py [options] [autopiper-backend binary]
+#
+#   -o <file>          output table (default: timing.tbl)
+#   --liberty <file>   map to this liberty library and measure delays with
+#                      abc's static timing (library time units); without it,
+#                      map to a generic gate library and count gate levels
+#   --period <delay>   stage budget, in the same units as the measured delays
+#                      (default: 32 gate levels, matching the standard model;
+#                      with --liberty, 32 times the delay of a 2-input AND)
+#   --widths <list>    comma-separated widths (default: 1,2,4,8,16,32,64)
+#   --max-div-width <n>  skip div/rem above this width (default: 32)
+#   --yosys <binary>   yosys to run (default: yosys on PATH)
+#
+# Each microbenchmark is a one-op IR program (ports in, op, port out) compiled
+# by autopiper-backend, so the measured logic is exactly what the compiler
+# emits for that op. The delay of a plain port-to-port wire is measured once
+# and subtracted from every result.
+
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+GENERIC_GATES = 'AND,NAND,OR,NOR,XOR,XNOR,MUX'
+
+def clog2(n):
+    ret = 0
+    while (1 << ret) < n:
+        ret += 1
+    return ret
+
+# For each op: a function from width to (operand widths, result width).
+# The table key is the widest of these, as TableTimingModel looks it up.
+def binary(w):
+    return ([w, w], w)
+def compare(w):
+    return ([w, w], 1)
+def mul(w):
+    return ([w, w], 2 * w)
+def div(w):
+    return ([2 * w, w], w)
+def shift(w):
+    return ([w, max(clog2(w), 1)], w)
+def select(w):
+    return ([1, w, w], w)
+def unary(w):
+    return ([w], w)
+
+OPS = [
+    ('add', binary), ('sub', binary), ('mul', mul),
+    ('div', div), ('rem', div),
+    ('and', binary), ('or', binary), ('xor', binary), ('not', unary),
+    ('lsh', shift), ('rsh', shift),
+    ('sel', select),
+    ('cmplt', compare), ('cmple', compare), ('cmpgt', compare),
+    ('cmpge', compare), ('cmpeq', compare), ('cmpne', compare),
+]
+
+def microbenchmark(op, arg_widths, result_width):
+    lines = ['entry main:']
+    valnum = 1
+    args = []
+    for i, w in enumerate(arg_widths):
+        lines.append('%%%d[%d] = portread "in%d"' % (valnum, w, i))
+        args.append(valnum)
+        valnum += 1
+    if op is None:
+        result = args[0]
+    else:
+        result = valnum
+        lines.append('%%%d[%d] = %s %s' % (
+            valnum, result_width, op, ', '.join('%%%d' % a for a in args)))
+        valnum += 1
+    lines.append('%%%d[%d] = portwrite "out", %%%d' %
+                 (valnum, result_width, result))
+    valnum += 1
+    for i, w in enumerate(arg_widths):
+        lines.append('%%%d[%d] = portexport "in%d"' % (valnum, w, i))
+        valnum += 1
+    lines.append('%%%d[%d] = portexport "out"' % (valnum, result_width))
+    valnum += 1
+    lines.append('%%%d = done' % valnum)
+    return '\n'.join(lines) + '\n'
+
+def run(args):
+    sub = subprocess.Popen(args, stdin=None,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = sub.communicate()
+    return (stdout.decode('utf-8'), stderr.decode('utf-8'), sub.returncode)
+
+def synth_delay(yosys, verilog, liberty):
+    if liberty is None:
+        script = ('read_verilog %s; synth -top main; abc -g %s; ltp -noff' %
+                  (verilog, GENERIC_GATES))
+        pattern = r'Longest topological path .*\(length=(\d+)\)'
+    else:
+        script = ('read_verilog %s; synth -top main; '
+                  'abc -liberty %s -script +strash;dch;map;topo;stime,-p' %
+                  (verilog, liberty))
+        pattern = r'Delay\s*=\s*([-\d.]+)'
+    stdout, stderr, ret = run([yosys, '-p', script])
+    if ret != 0:
+        raise RuntimeError("yosys failed on %s:\n%s" % (verilog, stderr))
+    m = re.findall(pattern, stdout)
+    if not m:
+        # A design reduced to wires has no path to report.
+        return 0.0
+    return float(m[-1])
+
+def measure(backend_bin, yosys, liberty, tmpdir, name, op, arg_widths,
+            result_width):
+    ir = os.path.join(tmpdir, name + '.ir')
+    verilog = os.path.join(tmpdir, name + '.v')
+    with open(ir, 'w') as f:
+        f.write(microbenchmark(op, arg_widths, result_width))
+    stdout, stderr, ret = run([backend_bin, '-o', verilog, ir])
+    if ret != 0:
+        raise RuntimeError("autopiper-backend failed on %s:\n%s" %
+                           (ir, stderr))
+    return synth_delay(yosys, verilog, liberty)
+
+def main(argv):
+    backend_bin = os.path.join(HERE, '..', '..', 'build', 'src',
+                               'autopiper-backend')
+    output = 'timing.tbl'
+    liberty = None
+    period = None
+    widths = [1, 2, 4, 8, 16, 32, 64]
+    max_div_width = 32
+    yosys = 'yosys'
+
+    args = argv[1:]
+    while args:
+        a = args.pop(0)
+        if a == '-o':
+            output = args.pop(0)
+        elif a == '--liberty':
+            liberty = args.pop(0)
+        elif a == '--period':
+            period = float(args.pop(0))
+        elif a == '--widths':
+            widths = [int(w) for w in args.pop(0).split(',')]
+        elif a == '--max-div-width':
+            max_div_width = int(args.pop(0))
+        elif a == '--yosys':
+            yosys = args.pop(0)
+        else:
+            backend_bin = a
+
+    if shutil.which(yosys) is None:
+        print("%s not found; cannot calibrate." % yosys)
+        return 1
+
+    tmpdir = tempfile.mkdtemp()
+    try:
+        wire = measure(backend_bin, yosys, liberty, tmpdir, 'wire', None, [1], 1)
+        if period is None:
+            unit = 1.0
+            if liberty is not None:
+                unit = measure(backend_bin, yosys, liberty, tmpdir, 'unit',
+                               'and', [1, 1], 1) - wire
+            period = 32 * unit
+
+        table = []
+        for op, shape in OPS:
+            for w in widths:
+                if op in ('div', 'rem') and w > max_div_width:
+                    continue
+                arg_widths, result_width = shape(w)
+                key = max(arg_widths + [result_width])
+                delay = measure(backend_bin, yosys, liberty, tmpdir,
+                                '%s_%d' % (op, w), op, arg_widths,
+                                result_width)
+                delay = max(delay - wire, 0.0)
+                table.append((op, key, delay))
+                print("%-8s %4d %10.3f" % (op, key, delay))
+    finally:
+        shutil.rmtree(tmpdir)
+
+    with open(output, 'w') as f:
+        f.write('# Written by tests/timing/calibrate.py (%s).\n' %
+                ('liberty ' + os.path.basename(liberty) if liberty
+                 else 'generic gates, delay in gate levels'))
+        f.write('delay_per_stage %g\n' % period)
+        for op, key, delay in table:
+            f.write('%s %d %g\n' % (op, key, delay))
+    print("Timing table written to %s." % output)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
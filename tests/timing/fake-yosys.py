@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+
+# Stands in for yosys when checking calibrate.py (see timing.py). Given
+# `-p <script>`, it prints the canned yosys log in reports/ for the script's
+# flow (liberty.log if it maps to a liberty library, generic.log otherwise),
+# with the delay that $CALIBRATE_FAKE_DELAYS (a JSON file mapping design names
+# to delays) gives for the design the script reads. A null delay stands for a
+# design reduced to wires: the log then reports no path at all.
+
+import json
+import os.path
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+def main(argv):
+    if len(argv) != 3 or argv[1] != '-p':
+        sys.stderr.write("usage: fake-yosys.py -p <script>\n")
+        return 1
+    script = argv[2]
+    m = re.match(r'read_verilog (\S+);', script)
+    if not m or not os.path.exists(m.group(1)):
+        sys.stderr.write("no Verilog input in script: %s\n" % script)
+        return 1
+    verilog = m.group(1)
+    with open(verilog) as f:
+        if 'module main(' not in f.read():
+            sys.stderr.write("%s: no module main\n" % verilog)
+            return 1
+
+    with open(os.environ['CALIBRATE_FAKE_DELAYS']) as f:
+        delays = json.load(f)
+    name = os.path.splitext(os.path.basename(verilog))[0]
+    if name not in delays:
+        sys.stderr.write("unexpected design %s\n" % name)
+        return 1
+    delay = delays[name]
+
+    liberty = 'abc -liberty' in script
+    with open(os.path.join(HERE, 'reports',
+                           'liberty.log' if liberty else 'generic.log')) as f:
+        log = f.read()
+    if delay is None:
+        log = re.sub(r'.*\{delay\}.*\n', '', log)
+    log = log.replace('{delay}', str(delay))
+    log = log.replace('{script}', script).replace('{verilog}', verilog)
+    sys.stdout.write(log)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+
+# Calibration tool check: runs calibrate.py with fake-yosys.py in place of
+# yosys, so that every microbenchmark is compiled by the real backend but
+# "synthesized" into a canned yosys log (reports/) carrying a known delay. The
+# delay table calibrate.py writes, in both the generic-gate and the liberty
+# flow, must hold exactly those delays less the wire delay, and the backend
+# must accept it as a table timing model.
+#
+# Usage: timing.py [autopiper-backend binary]
+
+import json
+import os.path
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+sys.path.insert(0, HERE)
+import calibrate
+
+FAKE_YOSYS = os.path.join(HERE, 'fake-yosys.py')
+WIDTHS = [4, 32]
+MAX_DIV_WIDTH = 16
+
+# The designs calibrate.py should synthesize, as (op, width) pairs.
+def designs():
+    return [(op, w) for op, shape in calibrate.OPS for w in WIDTHS
+            if not (op in ('div', 'rem') and w > MAX_DIV_WIDTH)]
+
+def table_key(op, w):
+    shape = dict(calibrate.OPS)[op]
+    arg_widths, result_width = shape(w)
+    return max(arg_widths + [result_width])
+
+# Returns (delays to report per design, expected delay_per_stage, expected
+# table rows) for one flow.
+def fake_delays(liberty):
+    delays = {}
+    rows = []
+    if liberty:
+        # Library time units; one op is faster than a wire and clamps to 0.
+        wire = 3.25
+        delays['wire'] = wire
+        delays['unit'] = 9.75
+        period = 32 * (9.75 - wire)
+        for i, (op, w) in enumerate(designs()):
+            delay = 2.0 if (op, w) == ('not', 4) else 10.5 + 7.25 * i + w
+            delays['%s_%d' % (op, w)] = delay
+            rows.append((op, table_key(op, w), max(delay - wire, 0.0)))
+    else:
+        # Gate levels; a wire has no path at all.
+        delays['wire'] = None
+        period = 32
+        for i, (op, w) in enumerate(designs()):
+            delay = 1 + i
+            delays['%s_%d' % (op, w)] = delay
+            rows.append((op, table_key(op, w), float(delay)))
+    return delays, period, rows
+
+def read_table(filename):
+    period = None
+    rows = []
+    with open(filename) as f:
+        lines = f.read().splitlines()
+    for line in lines[1:]:
+        fields = line.split()
+        if fields[0] == 'delay_per_stage':
+            period = float(fields[1])
+        else:
+            rows.append((fields[0], int(fields[1]), float(fields[2])))
+    return lines[0], period, rows
+
+def run(args, env=None):
+    sub = subprocess.Popen(args, stdin=None, stdout=subprocess.PIPE,
+                           stderr=subprocess.PIPE, env=env)
+    stdout, stderr = sub.communicate()
+    return sub.returncode, stdout.decode('utf-8') + stderr.decode('utf-8')
+
+def check(backend_bin, tmpdir, liberty):
+    errors = []
+    flow = 'liberty' if liberty else 'generic'
+    delays, period, rows = fake_delays(liberty)
+    delays_file = os.path.join(tmpdir, 'delays.json')
+    with open(delays_file, 'w') as f:
+        json.dump(delays, f)
+    table_file = os.path.join(tmpdir, flow + '.tbl')
+
+    env = dict(os.environ)
+    env['CALIBRATE_FAKE_DELAYS'] = delays_file
+    args = [sys.executable, os.path.join(HERE, 'calibrate.py'),
+            '-o', table_file, '--yosys', FAKE_YOSYS,
+            '--widths', ','.join(str(w) for w in WIDTHS),
+            '--max-div-width', str(MAX_DIV_WIDTH)]
+    if liberty:
+        args += ['--liberty', os.path.join(tmpdir, 'cells.lib')]
+    ret, output = run(args + [backend_bin], env)
+    if ret != 0:
+        return ["%s: calibrate.py failed (exit %d):\n%s" % (flow, ret, output)]
+
+    header, got_period, got_rows = read_table(table_file)
+    if not header.startswith('# Written by tests/timing/calibrate.py'):
+        errors.append("%s: unexpected header '%s'" % (flow, header))
+    if got_period is None or abs(got_period - period) > 1e-6:
+        errors.append("%s: delay_per_stage %s, expected %g" %
+                      (flow, got_period, period))
+    if [(op, key) for op, key, delay in got_rows] != \
+       [(op, key) for op, key, delay in rows]:
+        errors.append("%s: table rows differ:\n  got %s\n  expected %s" %
+                      (flow, [r[:2] for r in got_rows], [r[:2] for r in rows]))
+    else:
+        for (op, key, got), (_, _, expected) in zip(got_rows, rows):
+            if abs(got - expected) > 1e-6:
+                errors.append("%s: %s %d: delay %g, expected %g" %
+                              (flow, op, key, got, expected))
+
+    # The backend must load the table and time a design with it.
+    ir_file = os.path.join(tmpdir, 'add.ir')
+    with open(ir_file, 'w') as f:
+        f.write(calibrate.microbenchmark('add', [32, 32], 32))
+    ret, output = run([backend_bin, '--timing-model', 'table:' + table_file,
+                       '-o', os.path.join(tmpdir, 'add.v'), ir_file])
+    if ret != 0:
+        errors.append("%s: backend rejects the table:\n%s" % (flow, output))
+    return errors
+
+def main(argv):
+    backend_bin = os.path.join(TESTS, '..', 'build', 'src',
+                               'autopiper-backend')
+    if len(argv) > 1:
+        backend_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    ok = True
+    for liberty in (False, True):
+        for error in check(backend_bin, tmpdir, liberty):
+            print(error)
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Calibration check FAILED.")
+        return 1
+    print("Calibration check passed (%d designs per flow)." % len(designs()))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
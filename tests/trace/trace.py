@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+
+# Trace buffer consistency check: compiles the test corpus with --trace,
+# tracing every port the test declares, and requires the trace map to lay the
+# signals out contiguously, with one sample field per signal of the mapped
+# width, and the module's trace ports to match the map's depth and width.
+#
+# Usage: trace.py [autopiper binary]
+
+import glob
+import json
+import os.path
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TESTS = os.path.join(HERE, '..')
+
+CORPUS = (sorted(glob.glob(os.path.join(TESTS, 'behavior', '*.ap'))) +
+          sorted(glob.glob(os.path.join(TESTS, 'qor', '*.ap'))))
+
+DEPTH = 16
+
+def test_ports(filename):
+    ports = []
+    with open(filename) as f:
+        for line in f:
+            m = re.match(r'#test: port (\w+)', line)
+            if m:
+                ports.append(m.group(1))
+    return ports
+
+def check(trace_map, verilog, ports):
+    errors = []
+    if trace_map['depth'] != DEPTH:
+        errors.append("depth %d, not %d" % (trace_map['depth'], DEPTH))
+    bit = 0
+    values = []
+    for s in trace_map['signals']:
+        if s['bit'] != bit:
+            errors.append("%s signal at bit %d, not %d" %
+                          (s['kind'], s['bit'], bit))
+        bit = s['bit'] + s['width']
+        if s['kind'] == 'value':
+            values.append(s['port'])
+        elif s['width'] != 1:
+            errors.append("%s bit of width %d" % (s['kind'], s['width']))
+    if bit != trace_map['width']:
+        errors.append("signals cover %d bits of %d" %
+                      (bit, trace_map['width']))
+    if values != ports:
+        errors.append("traced values %s, not %s" % (values, ports))
+
+    width = re.search(r'output \[(\d+):0\] trace_read_data', verilog)
+    if not width or int(width.group(1)) + 1 != trace_map['width']:
+        errors.append("trace_read_data does not match the map's width")
+    addr = re.search(r'input \[(\d+):0\] trace_read_addr', verilog)
+    if not addr or 1 << (int(addr.group(1)) + 1) != DEPTH:
+        errors.append("trace_read_addr does not match the map's depth")
+    sample = re.search(r'assign trace_sample = \{([^}]*)\};', verilog)
+    if not sample:
+        errors.append("no trace sample")
+    else:
+        fields = [f.strip() for f in sample.group(1).split(',')]
+        if len(fields) != len(trace_map['signals']):
+            errors.append("%d sample fields for %d signals" %
+                          (len(fields), len(trace_map['signals'])))
+        # The first signal is the lsb, i.e., the last field.
+        for port, field in zip(reversed(values), fields):
+            if field != port:
+                errors.append("sample field '%s' for port '%s'" %
+                              (field, port))
+    return errors
+
+def main(argv):
+    autopiper_bin = os.path.join(TESTS, '..', 'build', 'src', 'autopiper')
+    if len(argv) > 1:
+        autopiper_bin = argv[1]
+
+    tmpdir = tempfile.mkdtemp()
+    verilog_file = os.path.join(tmpdir, 'out.v')
+    map_file = os.path.join(tmpdir, 'out.json')
+    ok = True
+    checked = 0
+    for filename in CORPUS:
+        ports = test_ports(filename)
+        args = [autopiper_bin, '-o', verilog_file, '--trace', str(DEPTH),
+                '--trace-map', map_file]
+        for port in ports:
+            args += ['--trace-value', port]
+        sub = subprocess.Popen(args + [filename],
+                stdin=None, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        stdout, stderr = sub.communicate()
+        if sub.returncode != 0:
+            print("Error compiling %s:\n%s" % (filename,
+                                               stderr.decode('utf-8')))
+            ok = False
+            continue
+        with open(verilog_file) as f:
+            verilog = f.read()
+        with open(map_file) as f:
+            trace_map = json.load(f)
+        checked += 1
+        for error in check(trace_map, verilog, ports):
+            print("%-40s %s" % (os.path.relpath(filename, TESTS), error))
+            ok = False
+    shutil.rmtree(tmpdir)
+
+    if not ok:
+        print("Trace check FAILED.")
+        return 1
+    print("Trace check passed (%d files)." % checked)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))